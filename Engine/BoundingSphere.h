@@ -0,0 +1,10 @@
+#pragma once
+#include "Vec3.h"
+
+// bounding sphere in model space
+// used by the pipeline for whole-mesh culling before vertex shading
+struct BoundingSphere
+{
+	Vec3 center = { 0.0f,0.0f,0.0f };
+	float radius = 0.0f;
+};
@@ -0,0 +1,279 @@
+#pragma once
+#include <vector>
+#include <memory>
+#include <functional>
+#include <mutex>
+#include <algorithm>
+#include <limits>
+#include <cstdint>
+#include <cstring>
+#include <cassert>
+#include "Mat.h"
+#include "Vec4.h"
+#include "BoundingSphere.h"
+#include "Pipeline.h"
+#include "LodChain.h"
+#include "EffectBinding.h"
+
+// deferred draws: instead of binding and drawing right away, scenes record draws into CommandLists
+// (one per thread, no locking while recording), submit them, and the buffer executes everything in
+// one pass sorted by layer, then pipeline, then material, then depth
+// the layer comes from the pipeline's blend mode: opaque pipelines draw first, front to back so
+// the ZBuffer rejects hidden pixels before they are shaded, then order independent ones, then
+// pipelines with BlendMode::Alpha, back to front across their materials
+class CommandBuffer
+{
+public:
+	// effect state shared by a set of draws through one pipeline (pixel shader colors, textures, ...)
+	template<class Effect>
+	struct Material
+	{
+		uint16_t id;
+	};
+	struct Stats
+	{
+		// draws executed by the last Execute
+		size_t draws = 0;
+		// camera binds, one each time the pipeline changed between sorted draws
+		size_t pipelineChanges = 0;
+		size_t materialChanges = 0;
+	};
+private:
+	struct Command
+	{
+		Mat4 world;
+		void* pMesh;
+		void (*draw)(void* pPipeline, void* pMesh);
+		const BoundingSphere& (*bounds)(void* pMesh);
+		uint16_t material;
+	};
+	// top byte of the sort key, translucent draws z test against every opaque one so they go after
+	// them whatever order their pipelines were added in
+	enum class Layer : uint8_t
+	{
+		Opaque,
+		OrderIndependent,
+		Alpha
+	};
+public:
+	// draws recorded on one thread, submitted to the buffer as a whole
+	class CommandList
+	{
+	public:
+		// mesh is anything Pipeline<Effect>::Draw takes, it and the material have to stay alive until Execute
+		template<class Effect, class Mesh>
+		void Draw(Material<Effect> material, Mesh& mesh, const Mat4& world)
+		{
+			commands.push_back({ world,&mesh,&DrawMesh<Effect, Mesh>,&MeshBounds<Mesh>,material.id });
+		}
+		size_t GetSize() const
+		{
+			return commands.size();
+		}
+		void Clear()
+		{
+			commands.clear();
+		}
+	private:
+		friend class CommandBuffer;
+		std::vector<Command> commands;
+	};
+public:
+	CommandBuffer() = default;
+	CommandBuffer(const CommandBuffer&) = delete;
+	CommandBuffer& operator=(const CommandBuffer&) = delete;
+	// pipelines of a layer execute in the order of their first material, materials of a pipeline in the
+	// order they were added; bind( Effect& ) runs on the effect before the first draw of the material
+	// register materials before recording, this is not thread safe
+	template<class Effect, typename F>
+	Material<Effect> AddMaterial(::Pipeline<Effect>& pipeline, F bind)
+	{
+		return { AddEntry(pipeline, [&pipeline, bind]() { bind(pipeline.effect); }) };
+	}
+	// material that binds nothing, for effects without per draw state
+	template<class Effect>
+	Material<Effect> AddMaterial(::Pipeline<Effect>& pipeline)
+	{
+		return { AddEntry(pipeline, std::function<void()>()) };
+	}
+	// thread safe, the list is left empty
+	void Submit(CommandList& list)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (commands.empty())
+		{
+			commands.swap(list.commands);
+		}
+		else
+		{
+			commands.insert(commands.end(), list.commands.begin(), list.commands.end());
+		}
+		list.commands.clear();
+	}
+	// sorts and draws everything submitted since the last Execute, on the calling thread
+	// the caller still brackets it with the pipelines' BeginFrame and resolves
+	void Execute(const Mat4& view, const Mat4& proj)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		keys.resize(commands.size());
+		for (size_t i = 0; i < commands.size(); i++)
+		{
+			const auto& c = commands[i];
+			const auto& m = materials[c.material];
+			const auto& bs = c.bounds(c.pMesh);
+			// view space depth of the bounding sphere center
+			const float z = std::max((Vec4(bs.center) * c.world * view).z, 0.0f);
+			uint32_t depth;
+			std::memcpy(&depth, &z, sizeof(depth));
+			// non negative floats order like their bits
+			const Layer layer = targets[m.target]->GetLayer();
+			const uint64_t key = layer == Layer::Alpha ?
+				uint64_t(~depth) << 16 | c.material :
+				uint64_t(c.material) << 32 | depth;
+			keys[i] = { uint64_t(layer) << 56 | uint64_t(m.target) << 48 | key,uint32_t(i) };
+		}
+		std::sort(keys.begin(), keys.end(), [](const SortKey& a, const SortKey& b) { return a.key < b.key; });
+
+		stats = {};
+		size_t target = std::numeric_limits<size_t>::max();
+		size_t material = std::numeric_limits<size_t>::max();
+		for (const auto& k : keys)
+		{
+			const auto& c = commands[k.index];
+			const auto& m = materials[c.material];
+			auto& t = *targets[m.target];
+			if (m.target != target)
+			{
+				t.BindCamera(view, proj);
+				target = m.target;
+				stats.pipelineChanges++;
+			}
+			if (c.material != material)
+			{
+				if (m.bind)
+				{
+					m.bind();
+				}
+				material = c.material;
+				stats.materialChanges++;
+			}
+			t.BindObject(c.world, view);
+			c.draw(t.GetPipeline(), c.pMesh);
+		}
+		stats.draws = keys.size();
+		commands.clear();
+	}
+	// drops everything submitted without drawing it
+	void Clear()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		commands.clear();
+	}
+	const Stats& GetStats() const
+	{
+		return stats;
+	}
+private:
+	template<class Effect>
+	uint16_t AddEntry(::Pipeline<Effect>& pipeline, std::function<void()> bind)
+	{
+		assert(materials.size() < size_t(std::numeric_limits<uint16_t>::max()));
+		size_t slot = 0;
+		while (slot < targets.size() && targets[slot]->GetPipeline() != &pipeline)
+		{
+			slot++;
+		}
+		if (slot == targets.size())
+		{
+			assert(targets.size() < 256);
+			targets.push_back(std::make_unique<PipelineTarget<Effect>>(pipeline));
+		}
+		MaterialEntry entry;
+		entry.target = uint8_t(slot);
+		entry.bind = std::move(bind);
+		materials.push_back(std::move(entry));
+		return uint16_t(materials.size() - 1);
+	}
+	class Target
+	{
+	public:
+		virtual ~Target() = default;
+		virtual void* GetPipeline() const = 0;
+		virtual Layer GetLayer() const = 0;
+		virtual void BindCamera(const Mat4& view, const Mat4& proj) = 0;
+		virtual void BindObject(const Mat4& world, const Mat4& view) = 0;
+	};
+	template<class Effect>
+	class PipelineTarget : public Target
+	{
+	public:
+		PipelineTarget(::Pipeline<Effect>& pipeline)
+			:
+			pPipeline(&pipeline)
+		{}
+		void* GetPipeline() const override
+		{
+			return pPipeline;
+		}
+		Layer GetLayer() const override
+		{
+			switch (pPipeline->GetBlendMode())
+			{
+			case ::Pipeline<Effect>::BlendMode::Alpha:
+				return Layer::Alpha;
+			case ::Pipeline<Effect>::BlendMode::OrderIndependent:
+				return Layer::OrderIndependent;
+			default:
+				return Layer::Opaque;
+			}
+		}
+		void BindCamera(const Mat4& view, const Mat4& proj) override
+		{
+			EffectBinding::BindCamera(pPipeline->effect.vs, view, proj);
+		}
+		void BindObject(const Mat4& world, const Mat4& view) override
+		{
+			EffectBinding::BindObject(pPipeline->effect.vs, world, view);
+		}
+	private:
+		::Pipeline<Effect>* pPipeline;
+	};
+	struct MaterialEntry
+	{
+		uint8_t target = 0;
+		std::function<void()> bind;
+	};
+	struct SortKey
+	{
+		uint64_t key;
+		uint32_t index;
+	};
+	template<class Effect, class Mesh>
+	static void DrawMesh(void* pPipeline, void* pMesh)
+	{
+		static_cast<::Pipeline<Effect>*>(pPipeline)->Draw(*static_cast<Mesh*>(pMesh));
+	}
+	// bounds are solved lazily by the meshes, so they are only asked for in Execute, never while recording
+	template<class Mesh>
+	static const BoundingSphere& MeshBounds(void* pMesh)
+	{
+		return GetBounds(*static_cast<Mesh*>(pMesh));
+	}
+	template<class Mesh>
+	static const BoundingSphere& GetBounds(Mesh& mesh)
+	{
+		return mesh.GetBoundingSphere();
+	}
+	template<class T>
+	static const BoundingSphere& GetBounds(LodChain<T>& lod)
+	{
+		return lod.levels.front().GetBoundingSphere();
+	}
+private:
+	std::vector<std::unique_ptr<Target>> targets;
+	std::vector<MaterialEntry> materials;
+	std::mutex mutex;
+	std::vector<Command> commands;
+	std::vector<SortKey> keys;
+	Stats stats;
+};
@@ -0,0 +1,225 @@
+#pragma once
+#include <vector>
+#include <algorithm>
+#include <limits>
+#include <cstdint>
+#include <cmath>
+#include <cassert>
+#include "Vec2.h"
+#include "Vec3.h"
+#include "BoundingSphere.h"
+#include "IndexedTriangleList.h"
+#include "VertexAttributes.h"
+
+// 16 or 32 bit indices, 2 or 4 bytes each instead of the 8 of size_t
+class IndexBuffer
+{
+public:
+	enum class Width
+	{
+		// 16 bit if every index fits, else 32 bit
+		Auto,
+		Bits16,
+		Bits32
+	};
+public:
+	IndexBuffer() = default;
+	IndexBuffer(const std::vector<size_t>& indices, size_t vertexCount, Width width = Width::Auto)
+	{
+		if (width == Width::Auto)
+		{
+			width = vertexCount <= size_t(std::numeric_limits<uint16_t>::max()) + 1 ? Width::Bits16 : Width::Bits32;
+		}
+		assert(width != Width::Bits16 || vertexCount <= size_t(std::numeric_limits<uint16_t>::max()) + 1);
+		assert(vertexCount <= size_t(std::numeric_limits<uint32_t>::max()) + 1);
+		wide = width == Width::Bits32;
+		if (wide)
+		{
+			indices32.assign(indices.begin(), indices.end());
+		}
+		else
+		{
+			indices16.resize(indices.size());
+			std::transform(indices.begin(), indices.end(), indices16.begin(), [](size_t i) { return uint16_t(i); });
+		}
+	}
+	bool IsWide() const
+	{
+		return wide;
+	}
+	const uint16_t* Data16() const
+	{
+		assert(!wide);
+		return indices16.data();
+	}
+	const uint32_t* Data32() const
+	{
+		assert(wide);
+		return indices32.data();
+	}
+	size_t GetCount() const
+	{
+		return wide ? indices32.size() : indices16.size();
+	}
+	size_t GetBytes() const
+	{
+		return wide ? indices32.size() * sizeof(uint32_t) : indices16.size() * sizeof(uint16_t);
+	}
+private:
+	bool wide = false;
+	std::vector<uint16_t> indices16;
+	std::vector<uint32_t> indices32;
+};
+
+// 14 byte vertex: position as 16 bit fractions of the mesh bounds, normal octahedral encoded in
+// 2 x 16 bits, texcoord as 16 bit fractions of the texcoord bounds
+struct QuantizedVertex
+{
+	uint16_t pos[3];
+	int16_t n[2];
+	uint16_t t[2];
+};
+
+// triangle list with compact indices and optionally quantized vertices, converted from an
+// IndexedTriangleList once it is final (after AdjustToTrueCenter, scaling etc.)
+// the pipeline dequantizes each vertex right before the vertex shader, so no float copy of the
+// mesh is ever built; positions are off by up to half a step of extent / 65535 per axis and
+// normals by a few hundredths of a degree
+// only vertices made of pos, n and t can be quantized, others (e.g. with a color) keep their floats
+template<class T>
+class CompactTriangleList
+{
+public:
+	// true if a quantized vertex holds everything in T
+	static constexpr bool CanQuantize = sizeof(T) == sizeof(Vec3) +
+		(VertexAttributes::HasNormal<T>() ? sizeof(Vec3) : 0u) +
+		(VertexAttributes::HasTexcoord<T>() ? sizeof(Vec2) : 0u);
+public:
+	CompactTriangleList(IndexedTriangleList<T>& src, bool quantize, IndexBuffer::Width width = IndexBuffer::Width::Auto)
+		:
+		indices(src.indices, src.vertices.size(), width),
+		bounds(src.vertices.empty() ? BoundingSphere() : src.GetBoundingSphere())
+	{
+		if (!quantize || !CanQuantize || src.vertices.empty())
+		{
+			vertices = src.vertices;
+			return;
+		}
+		Vec3 lo = src.vertices.front().pos;
+		Vec3 hi = lo;
+		Vec2 tlo = VertexAttributes::GetTexcoord(src.vertices.front());
+		Vec2 thi = tlo;
+		for (const auto& v : src.vertices)
+		{
+			lo = { std::min(lo.x,v.pos.x),std::min(lo.y,v.pos.y),std::min(lo.z,v.pos.z) };
+			hi = { std::max(hi.x,v.pos.x),std::max(hi.y,v.pos.y),std::max(hi.z,v.pos.z) };
+			const auto t = VertexAttributes::GetTexcoord(v);
+			tlo = { std::min(tlo.x,t.x),std::min(tlo.y,t.y) };
+			thi = { std::max(thi.x,t.x),std::max(thi.y,t.y) };
+		}
+		posOffset = lo;
+		posScale = (hi - lo) / 65535.0f;
+		texOffset = tlo;
+		texScale = (thi - tlo) / 65535.0f;
+
+		quantized.resize(src.vertices.size());
+		for (size_t i = 0; i < src.vertices.size(); i++)
+		{
+			const auto& v = src.vertices[i];
+			auto& q = quantized[i];
+			q.pos[0] = QuantizeUnorm(v.pos.x, lo.x, hi.x);
+			q.pos[1] = QuantizeUnorm(v.pos.y, lo.y, hi.y);
+			q.pos[2] = QuantizeUnorm(v.pos.z, lo.z, hi.z);
+			EncodeOctahedral(VertexAttributes::GetNormal(v), q.n);
+			const auto t = VertexAttributes::GetTexcoord(v);
+			q.t[0] = QuantizeUnorm(t.x, tlo.x, thi.x);
+			q.t[1] = QuantizeUnorm(t.y, tlo.y, thi.y);
+		}
+	}
+	bool IsQuantized() const
+	{
+		return !quantized.empty();
+	}
+	// full vertex from the quantized one, called by the pipeline's vertex stage
+	T Decode(const QuantizedVertex& q) const
+	{
+		T v;
+		v.pos = {
+			posOffset.x + float(q.pos[0]) * posScale.x,
+			posOffset.y + float(q.pos[1]) * posScale.y,
+			posOffset.z + float(q.pos[2]) * posScale.z
+		};
+		VertexAttributes::SetNormal(v, DecodeOctahedral(q.n));
+		VertexAttributes::SetTexcoord(v, Vec2{
+			texOffset.x + float(q.t[0]) * texScale.x,
+			texOffset.y + float(q.t[1]) * texScale.y
+			});
+		return v;
+	}
+	size_t GetVertexCount() const
+	{
+		return IsQuantized() ? quantized.size() : vertices.size();
+	}
+	size_t GetVertexBytes() const
+	{
+		return IsQuantized() ? quantized.size() * sizeof(QuantizedVertex) : vertices.size() * sizeof(T);
+	}
+	const BoundingSphere& GetBoundingSphere() const
+	{
+		return bounds;
+	}
+	static void EncodeOctahedral(const Vec3& n, int16_t out[2])
+	{
+		const float l1 = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+		if (l1 == 0.0f)
+		{
+			out[0] = out[1] = 0;
+			return;
+		}
+		float x = n.x / l1;
+		float y = n.y / l1;
+		// fold the lower hemisphere over the diagonals
+		if (n.z < 0.0f)
+		{
+			const float fx = (1.0f - std::abs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+			const float fy = (1.0f - std::abs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+			x = fx;
+			y = fy;
+		}
+		out[0] = int16_t(std::round(std::max(-1.0f, std::min(x, 1.0f)) * 32767.0f));
+		out[1] = int16_t(std::round(std::max(-1.0f, std::min(y, 1.0f)) * 32767.0f));
+	}
+	static Vec3 DecodeOctahedral(const int16_t in[2])
+	{
+		const float x = float(in[0]) / 32767.0f;
+		const float y = float(in[1]) / 32767.0f;
+		Vec3 n = { x,y,1.0f - std::abs(x) - std::abs(y) };
+		if (n.z < 0.0f)
+		{
+			n.x = (1.0f - std::abs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+			n.y = (1.0f - std::abs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+		}
+		const float len = n.Len();
+		return len > 0.0f ? n / len : n;
+	}
+private:
+	static uint16_t QuantizeUnorm(float v, float lo, float hi)
+	{
+		if (hi <= lo)
+		{
+			return 0;
+		}
+		return uint16_t(std::round((v - lo) / (hi - lo) * 65535.0f));
+	}
+public:
+	IndexBuffer indices;
+	// one of the two is filled
+	std::vector<T> vertices;
+	std::vector<QuantizedVertex> quantized;
+private:
+	BoundingSphere bounds;
+	Vec3 posOffset = { 0.0f,0.0f,0.0f };
+	Vec3 posScale = { 0.0f,0.0f,0.0f };
+	Vec2 texOffset = { 0.0f,0.0f };
+	Vec2 texScale = { 0.0f,0.0f };
+};
@@ -0,0 +1,310 @@
+#pragma once
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <cmath>
+#include <cassert>
+#include "Vec3.h"
+#include "Vec4.h"
+#include "Mat.h"
+#include "ZBuffer.h"
+#include "Frustum.h"
+#include "IndexedTriangleList.h"
+#include "LodChain.h"
+
+// depth only counterpart of Pipeline for shadow maps
+// only positions are transformed, triangles are clipped at the near plane and scan converted
+// straight into a ZBuffer: no geometry or pixel shader, no interpolated attributes, no render target
+// depth is z / w like Pipeline writes it but not interpolated the same way, so it can't feed
+// DepthPass::Equal; depth prepasses draw through Pipeline with DepthPass::DepthOnly
+class DepthPipeline
+{
+public:
+	enum class CullMode
+	{
+		// same faces as Pipeline draws
+		Back,
+		// only the back faces, shadow maps of closed meshes then don't self shadow their lit side
+		Front,
+		None
+	};
+	struct Stats
+	{
+		size_t draws = 0;
+		// meshes outside the frustum
+		size_t drawsCulled = 0;
+		size_t trianglesRasterized = 0;
+		size_t pixelsWritten = 0;
+	};
+public:
+	DepthPipeline(std::shared_ptr<ZBuffer> pTarget_in)
+		:
+		pTarget(std::move(pTarget_in))
+	{}
+	void SetTarget(std::shared_ptr<ZBuffer> pTarget_in)
+	{
+		pTarget = std::move(pTarget_in);
+	}
+	ZBuffer& GetTarget() const
+	{
+		return *pTarget;
+	}
+	void SetCullMode(CullMode mode)
+	{
+		cullMode = mode;
+	}
+	void BindWorldViewProj(const Mat4& worldViewProj_in)
+	{
+		worldViewProj = worldViewProj_in;
+	}
+	const Mat4& GetWorldViewProj() const
+	{
+		return worldViewProj;
+	}
+	// clears the target
+	void BeginFrame()
+	{
+		pTarget->Clear();
+		ResetStats();
+	}
+	void ResetStats()
+	{
+		stats = {};
+	}
+	template<class V>
+	void Draw(IndexedTriangleList<V>& triList)
+	{
+		Draw(triList, triList.GetBoundingSphere());
+	}
+	// bounds passed in when they were solved earlier, e.g. by another thread drawing the same mesh
+	template<class V>
+	void Draw(const IndexedTriangleList<V>& triList, const BoundingSphere& bounds)
+	{
+		// one depth per pixel, the rows are written directly
+		assert(pTarget->GetSampleCount() == 1);
+		stats.draws++;
+		const Frustum frustum(worldViewProj);
+		const auto result = frustum.Test(bounds);
+		if (result == Frustum::Result::Outside)
+		{
+			stats.drawsCulled++;
+			return;
+		}
+		clipVertices.resize(triList.vertices.size());
+		std::transform(triList.vertices.begin(), triList.vertices.end(), clipVertices.begin(),
+			[this](const V& v) { return Vec4(v.pos) * worldViewProj; });
+		const bool clip = result != Frustum::Result::Inside;
+		for (size_t i = 0, end = triList.indices.size() / 3; i < end; i++)
+		{
+			const auto& v0 = clipVertices[triList.indices[i * 3]];
+			const auto& v1 = clipVertices[triList.indices[i * 3 + 1]];
+			const auto& v2 = clipVertices[triList.indices[i * 3 + 2]];
+			// Pipeline::AssembleTriangles tests (v1 - v0) x (v2 - v0) * (v0 - eye) in clip space, with the
+			// eye at (0,0,0,1) * proj that is proj[2][2] * det( x y w ) for the perspective projections, so
+			// the same faces face away without knowing proj, also for triangles crossing the near plane
+			if (cullMode != CullMode::None)
+			{
+				const float facing =
+					v0.x * (v1.y * v2.w - v1.w * v2.y) -
+					v0.y * (v1.x * v2.w - v1.w * v2.x) +
+					v0.w * (v1.x * v2.y - v1.y * v2.x);
+				if (cullMode == CullMode::Back ? facing > 0.0f : facing <= 0.0f)
+				{
+					continue;
+				}
+			}
+			if (clip)
+			{
+				ClipTriangle(v0, v1, v2);
+			}
+			else
+			{
+				RasterizeTriangle(v0, v1, v2);
+			}
+		}
+	}
+	// shadows don't need the detail, but the coarser levels would shift the depths against
+	// what the main pass draws, so the full level is used
+	template<class V>
+	void Draw(LodChain<V>& lod)
+	{
+		Draw(lod.levels.front());
+	}
+	const Stats& GetStats() const
+	{
+		return stats;
+	}
+private:
+	void ClipTriangle(const Vec4& v0, const Vec4& v1, const Vec4& v2)
+	{
+		// outside one of the planes entirely
+		if ((v0.x > v0.w && v1.x > v1.w && v2.x > v2.w) ||
+			(v0.x < -v0.w && v1.x < -v1.w && v2.x < -v2.w) ||
+			(v0.y > v0.w && v1.y > v1.w && v2.y > v2.w) ||
+			(v0.y < -v0.w && v1.y < -v1.w && v2.y < -v2.w) ||
+			(v0.z > v0.w && v1.z > v1.w && v2.z > v2.w) ||
+			(v0.z < 0.0f && v1.z < 0.0f && v2.z < 0.0f))
+		{
+			return;
+		}
+		// polygon clipping against the near plane and a guard band around the sides: vertices close to
+		// the near plane project far off the target, and the edge functions lose their precision there
+		// the far plane is left to the depth test, the cleared target is infinity
+		constexpr float guard = 1.5f;
+		const auto distance = [guard](const Vec4& v, int plane)
+		{
+			switch (plane)
+			{
+			case 0: return v.z;
+			case 1: return guard * v.w - v.x;
+			case 2: return guard * v.w + v.x;
+			case 3: return guard * v.w - v.y;
+			default: return guard * v.w + v.y;
+			}
+		};
+		// every plane adds at most one vertex
+		Vec4 polygons[2][8] = { { v0,v1,v2 } };
+		size_t count = 3;
+		int cur = 0;
+		for (int plane = 0; plane < 5; plane++)
+		{
+			const Vec4* in = polygons[cur];
+			Vec4* out = polygons[cur ^ 1];
+			size_t outCount = 0;
+			bool clipped = false;
+			for (size_t i = 0; i < count; i++)
+			{
+				const Vec4& a = in[i];
+				const Vec4& b = in[(i + 1) % count];
+				const float da = distance(a, plane);
+				const float db = distance(b, plane);
+				if (da >= 0.0f)
+				{
+					out[outCount++] = a;
+				}
+				else
+				{
+					clipped = true;
+				}
+				if ((da >= 0.0f) != (db >= 0.0f))
+				{
+					out[outCount++] = a + (b - a) * (da / (da - db));
+				}
+			}
+			if (!clipped)
+			{
+				continue;
+			}
+			if (outCount < 3)
+			{
+				return;
+			}
+			count = outCount;
+			cur ^= 1;
+		}
+		// culling is done, so the winding of the fan doesn't matter
+		const Vec4* polygon = polygons[cur];
+		for (size_t i = 1; i + 1 < count; i++)
+		{
+			RasterizeTriangle(polygon[0], polygon[i], polygon[i + 1]);
+		}
+	}
+	// half space rasterization over the screen bounds of the triangle, depth from its plane equation
+	// pixel centers at +0.5 like Pipeline
+	void RasterizeTriangle(const Vec4& c0, const Vec4& c1, const Vec4& c2)
+	{
+		const float width = float(pTarget->GetWidth());
+		const float height = float(pTarget->GetHeight());
+		const auto toScreen = [width, height](const Vec4& c)
+		{
+			const float wInv = 1.0f / c.w;
+			return Vec3{ (c.x * wInv + 1.0f) * 0.5f * width,(1.0f - c.y * wInv) * 0.5f * height,c.z * wInv };
+		};
+		Vec3 p0 = toScreen(c0);
+		Vec3 p1 = toScreen(c1);
+		Vec3 p2 = toScreen(c2);
+		float area = (p1.x - p0.x) * (p2.y - p0.y) - (p2.x - p0.x) * (p1.y - p0.y);
+		if (area == 0.0f)
+		{
+			return;
+		}
+		// one winding for the edge functions, culling is already done
+		if (area < 0.0f)
+		{
+			std::swap(p1, p2);
+			area = -area;
+		}
+		const int xStart = std::max(int(std::ceil(std::min({ p0.x,p1.x,p2.x }) - 0.5f)), 0);
+		const int xEnd = std::min(int(std::ceil(std::max({ p0.x,p1.x,p2.x }) - 0.5f)), pTarget->GetWidth());
+		const int yStart = std::max(int(std::ceil(std::min({ p0.y,p1.y,p2.y }) - 0.5f)), 0);
+		const int yEnd = std::min(int(std::ceil(std::max({ p0.y,p1.y,p2.y }) - 0.5f)), pTarget->GetHeight());
+		if (xStart >= xEnd || yStart >= yEnd)
+		{
+			return;
+		}
+		stats.trianglesRasterized++;
+
+		struct Edge
+		{
+			float a, b, c;
+		};
+		const auto makeEdge = [](const Vec3& from, const Vec3& to)
+		{
+			return Edge{ from.y - to.y,to.x - from.x,from.x * to.y - from.y * to.x };
+		};
+		const Edge edges[3] = { makeEdge(p1, p2),makeEdge(p2, p0),makeEdge(p0, p1) };
+		// z = z0 * w0 + z1 * w1 + z2 * w2 with barycentric weights e_i / area
+		const float areaInv = 1.0f / area;
+		const float dzdx = (edges[0].a * p0.z + edges[1].a * p1.z + edges[2].a * p2.z) * areaInv;
+		const float dzdy = (edges[0].b * p0.z + edges[1].b * p1.z + edges[2].b * p2.z) * areaInv;
+		const float z00 = (edges[0].c * p0.z + edges[1].c * p1.z + edges[2].c * p2.z) * areaInv;
+
+		for (int y = yStart; y < yEnd; y++)
+		{
+			const float py = float(y) + 0.5f;
+			// pixel centers px with a * px + b * py + c >= 0 for every edge: each edge bounds the row's
+			// span from one side; pixels exactly on an edge shared by two triangles are written by both,
+			// which costs nothing when only depth is written
+			float spanStart = float(xStart);
+			float spanEnd = float(xEnd);
+			for (const auto& e : edges)
+			{
+				const float rest = e.b * py + e.c;
+				if (e.a > 0.0f)
+				{
+					spanStart = std::max(spanStart, std::ceil(-rest / e.a - 0.5f));
+				}
+				else if (e.a < 0.0f)
+				{
+					spanEnd = std::min(spanEnd, std::floor(-rest / e.a - 0.5f) + 1.0f);
+				}
+				else if (rest < 0.0f)
+				{
+					spanEnd = spanStart;
+				}
+			}
+			if (spanStart >= spanEnd)
+			{
+				continue;
+			}
+			const int x0 = int(spanStart);
+			const int x1 = int(spanEnd);
+			float* pDepth = &pTarget->At(x0, y);
+			float z = z00 + dzdx * (float(x0) + 0.5f) + dzdy * py;
+			for (int x = x0; x < x1; x++, pDepth++, z += dzdx)
+			{
+				if (z < *pDepth)
+				{
+					*pDepth = z;
+					stats.pixelsWritten++;
+				}
+			}
+		}
+	}
+private:
+	std::shared_ptr<ZBuffer> pTarget;
+	Mat4 worldViewProj = Mat4::Identity();
+	CullMode cullMode = CullMode::Back;
+	std::vector<Vec4> clipVertices;
+	Stats stats;
+};
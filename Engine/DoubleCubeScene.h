@@ -4,6 +4,7 @@
 #include "Mat.h"
 #include "Pipeline.h"
 #include "SolidEffect.h"
+#include "SceneGraph.h"
 
 // scene demonstrating gradient color blend cube
 class DoubleCubeScene : public Scene {
@@ -25,6 +26,10 @@ public:
 		{
 			itlist.vertices[i].color = colors[i / 4];
 		}
+		fixedCube = graph.AddNode(SceneGraph::NoParent, { { 0.0f,0.0f,2.0f } });
+		mobileCube = graph.AddNode(SceneGraph::NoParent, { { 0.0f,0.0f,offset_z } });
+		graph.Attach(fixedCube, pipeline, itlist);
+		graph.Attach(mobileCube, pipeline, itlist);
 	}
 	virtual void Update(Keyboard& kbd, Mouse& mouse, float dt) override
 	{
@@ -64,43 +69,22 @@ public:
 	virtual void Draw() override
 	{
 		pipeline.BeginFrame();
-		{
-			// fixed cube
-			// 
-			// generate rotation matrix 
-			const Mat3 rot =
-				Mat3::RotationX(theta_x) *
-				Mat3::RotationY(theta_y + 90.0f) *
-				Mat3::RotationZ(theta_z);
-			// translation
-			const Vec3 trans = { 0.0f,0.0f,2.0f };
-			// set pipeline transform
-			pipeline.effect.vs.BindRotation(rot);
-			pipeline.effect.vs.BindTranslation(trans);
-			// render triangles
-			pipeline.Draw(itlist);
-		}
-		{
-			// mobile cube
-			// 
-			// generate rotation matrix 
-			const Mat3 rot =
-				Mat3::RotationX(theta_x) *
-				Mat3::RotationY(theta_y) *
-				Mat3::RotationZ(theta_z);
-			// translation
-			const Vec3 trans = { 0.0f,0.0f,offset_z };
-			// set pipeline transform
-			pipeline.effect.vs.BindRotation(rot);
-			pipeline.effect.vs.BindTranslation(trans);
-			// render triangles
-			pipeline.Draw(itlist);
-		}
-		
+		// both cubes share the rotation, the fixed one is turned a further 90 about y (radians, as it always was)
+		const Vec3 rot = { theta_x,theta_y,theta_z };
+		graph.GetTransform(fixedCube).SetRotation(rot + Vec3{ 0.0f,90.0f,0.0f });
+		graph.GetTransform(mobileCube).SetRotation(rot);
+		graph.GetTransform(mobileCube).SetPosition({ 0.0f,0.0f,offset_z });
+		graph.Update();
+		graph.Draw(Mat4::Identity(), Mat4::ProjectionFOV(hfov, aspect_ratio, 0.5f, 7.0f));
 	}
 private:
 	IndexedTriangleList<Vertex> itlist;
 	Pipeline pipeline;
+	SceneGraph graph;
+	SceneGraph::NodeId fixedCube;
+	SceneGraph::NodeId mobileCube;
+	static constexpr float aspect_ratio = 1.77777778f;
+	static constexpr float hfov = 95.0f;
 	static constexpr float dTheta = PI;
 	float offset_z = 2.0f;
 	float theta_x = 0.0f;
@@ -0,0 +1,47 @@
+#pragma once
+#include "Mat.h"
+
+// camera and object transforms for effect vertex shaders, which take them in one of two ways:
+// world, view and projection separately (SpecularPhongPointEffect) or world view and projection
+// (SolidEffect); the older effects with a rotation and translation can't be drawn by Pipeline
+// (it needs their projection) and aren't supported
+// used by code that draws through pipelines of any effect (SceneGraph, CommandBuffer)
+namespace EffectBinding
+{
+	namespace detail
+	{
+		template<typename VS>
+		auto BindCamera(VS& vs, const Mat4& view, const Mat4& proj, int) -> decltype(vs.BindView(view), void())
+		{
+			vs.BindView(view);
+			vs.BindProjection(proj);
+		}
+		template<typename VS>
+		auto BindCamera(VS& vs, const Mat4&, const Mat4& proj, long) -> decltype(vs.BindProjection(proj), void())
+		{
+			vs.BindProjection(proj);
+		}
+		template<typename VS>
+		auto BindObject(VS& vs, const Mat4& world, const Mat4&, int) -> decltype(vs.BindWorld(world), void())
+		{
+			vs.BindWorld(world);
+		}
+		template<typename VS>
+		auto BindObject(VS& vs, const Mat4& world, const Mat4& view, long) -> decltype(vs.BindWorldView(world), void())
+		{
+			vs.BindWorldView(world.AffineMultiply(view));
+		}
+	}
+	// once per frame (or whenever the camera changes) for every pipeline
+	template<typename VS>
+	void BindCamera(VS& vs, const Mat4& view, const Mat4& proj)
+	{
+		detail::BindCamera(vs, view, proj, 0);
+	}
+	// per draw, after BindCamera with the same view
+	template<typename VS>
+	void BindObject(VS& vs, const Mat4& world, const Mat4& view)
+	{
+		detail::BindObject(vs, world, view, 0);
+	}
+}
@@ -0,0 +1,140 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include <limits>
+#include <cassert>
+#include "Colors.h"
+#include "RenderTarget.h"
+#include "ZBuffer.h"
+#include "PixelSpan.h"
+
+// order independent transparency: translucent pixels from any number of draws are
+// collected as per-pixel linked lists of fragments in one preallocated arena, then
+// sorted and blended back to front in a single Resolve pass after all draws
+// both limits are hard: fragments past the arena capacity are dropped, and only the
+// MaxLayers nearest fragments of a pixel are blended
+class FragmentBuffer
+{
+public:
+	static constexpr int MaxLayers = 16;
+	struct Stats
+	{
+		size_t fragments = 0;
+		// fragments lost because the arena was full
+		size_t overflowed = 0;
+		// fragments beyond MaxLayers in a pixel at resolve time
+		size_t dropped = 0;
+		// fragments hidden by opaque geometry drawn after them
+		size_t occluded = 0;
+		int maxLayers = 0;
+	};
+public:
+	// capacity is the total number of fragments per frame, a few times width * height is typical
+	FragmentBuffer(int width, int height, size_t capacity)
+		:
+		width(width),
+		height(height),
+		heads(size_t(width) * height, Empty),
+		nodes(capacity)
+	{}
+	void Clear()
+	{
+		std::fill(heads.begin(), heads.end(), Empty);
+		used = 0;
+		stats = {};
+	}
+	// color carries the fragment's alpha in its x channel
+	void Add(int x, int y, float depth, Color color)
+	{
+		assert(x >= 0 && x < width && y >= 0 && y < height);
+		if (used == nodes.size())
+		{
+			stats.overflowed++;
+			return;
+		}
+		auto& head = heads[size_t(y) * width + x];
+		nodes[used] = { color,depth,head };
+		head = uint32_t(used++);
+		stats.fragments++;
+	}
+	// blends every pixel's fragments over the target back to front
+	// fragments behind the final opaque depth are discarded, so opaque geometry may be drawn
+	// before or after the translucent draws
+	void Resolve(RenderTarget& target, const ZBuffer* pZb = nullptr)
+	{
+		assert(int(target.GetWidth()) == width && int(target.GetHeight()) == height);
+		Node layers[MaxLayers];
+		for (int y = 0; y < height; y++)
+		{
+			Color* pRow = target.GetRow(y);
+			for (int x = 0; x < width; x++)
+			{
+				uint32_t i = heads[size_t(y) * width + x];
+				if (i == Empty)
+				{
+					continue;
+				}
+				const float opaqueDepth = pZb ? pZb->At(x, y) : std::numeric_limits<float>::infinity();
+				int count = 0;
+				int total = 0;
+				for (; i != Empty; i = nodes[i].next)
+				{
+					const Node& n = nodes[i];
+					if (!(n.depth < opaqueDepth))
+					{
+						stats.occluded++;
+						continue;
+					}
+					total++;
+					// keep the MaxLayers nearest, sorted far to near by insertion
+					if (count == MaxLayers)
+					{
+						if (n.depth >= layers[0].depth)
+						{
+							continue;
+						}
+						std::copy(layers + 1, layers + count, layers);
+						count--;
+					}
+					int k = count++;
+					while (k > 0 && layers[k - 1].depth < n.depth)
+					{
+						layers[k] = layers[k - 1];
+						k--;
+					}
+					layers[k] = n;
+				}
+				stats.dropped += size_t(total - count);
+				stats.maxLayers = std::max(stats.maxLayers, total);
+				for (int l = 0; l < count; l++)
+				{
+					PixelSpan::Blend(pRow + x, layers[l].color, 1u);
+				}
+			}
+		}
+	}
+	const Stats& GetStats() const
+	{
+		return stats;
+	}
+	size_t GetCapacity() const
+	{
+		return nodes.size();
+	}
+private:
+	static constexpr uint32_t Empty = 0xFFFFFFFFu;
+	struct Node
+	{
+		Color color;
+		float depth;
+		uint32_t next;
+	};
+	int width;
+	int height;
+	// index of the most recently added fragment of each pixel
+	std::vector<uint32_t> heads;
+	std::vector<Node> nodes;
+	size_t used = 0;
+	Stats stats;
+};
@@ -0,0 +1,12 @@
+#pragma once
+#include "RenderTarget.h"
+
+// receives every finished frame on the thread that drew it (SharedFrameRing, FrameWriter)
+// Graphics hands its frames to the sink set with SetFrameSink, headless loops call Consume themselves
+class FrameSink
+{
+public:
+	virtual ~FrameSink() = default;
+	// frame is only valid during the call, sinks keep a copy
+	virtual void Consume( const RenderTarget& frame ) = 0;
+};
@@ -5,7 +5,10 @@ class FrameTimer
 {
 public:
 	FrameTimer();
+	// seconds since the last mark, restarts the timer
 	float Mark();
+	// seconds since the last mark, leaves the timer running
+	float Peek() const;
 private:
 	std::chrono::steady_clock::time_point last;
 };
\ No newline at end of file
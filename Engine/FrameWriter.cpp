@@ -0,0 +1,279 @@
+#include "FrameWriter.h"
+#include "ImageCodec.h"
+#include "FrameTimer.h"
+#include <stdexcept>
+#include <cstdio>
+#include <algorithm>
+
+FrameWriter::FrameWriter( const std::string& path,Format format,unsigned int width,unsigned int height,
+	unsigned int fps,unsigned int workerCount,size_t maxQueuedBytes )
+	:
+	path( path ),
+	format( format ),
+	width( width ),
+	height( height ),
+	fps( fps ),
+	frameBytes( size_t( width ) * height * sizeof( Color ) ),
+	maxQueuedBytes( maxQueuedBytes ),
+	// enough spares for one frame in flight per encoder plus the one being rendered
+	maxSpare( std::max( workerCount,1u ) + 1u )
+{
+	if( format == Format::Y4m )
+	{
+		stream.open( path,std::ios::binary | std::ios::trunc );
+		if( !stream )
+		{
+			throw std::runtime_error( "FrameWriter failed to open output  Path:" + path );
+		}
+		const std::string header = ImageCodec::GetY4mHeader( width,height,fps );
+		stream.write( header.data(),header.size() );
+	}
+	workerCount = std::max( workerCount,1u );
+	for( unsigned int i = 0; i < workerCount; i++ )
+	{
+		encoders.emplace_back( &FrameWriter::EncodeLoop,this );
+	}
+	writer = std::thread( &FrameWriter::WriteLoop,this );
+}
+
+FrameWriter::~FrameWriter()
+{
+	{
+		std::lock_guard<std::mutex> lock( mutex );
+		quitting = true;
+	}
+	cv.notify_all();
+	// encoders drain the pending queue and the writer drains the encoded frames before exiting
+	for( auto& t : encoders )
+	{
+		t.join();
+	}
+	writer.join();
+}
+
+Surface FrameWriter::AcquireSurface()
+{
+	{
+		std::lock_guard<std::mutex> lock( mutex );
+		if( !spare.empty() )
+		{
+			Surface s = std::move( spare.back() );
+			spare.pop_back();
+			return s;
+		}
+	}
+	return Surface( width,height );
+}
+
+void FrameWriter::Submit( Surface&& frame )
+{
+	RethrowError();
+	std::unique_lock<std::mutex> lock( mutex );
+	if( !HasRoom( frameBytes ) )
+	{
+		FrameTimer stallTimer;
+		cv.wait( lock,[this]() { return HasRoom( frameBytes ) || error; } );
+		stats.stalls++;
+		stats.stallTime += stallTimer.Mark();
+		if( error )
+		{
+			lock.unlock();
+			RethrowError();
+		}
+	}
+	Enqueue( std::move( frame ) );
+}
+
+bool FrameWriter::TrySubmit( Surface& frame )
+{
+	RethrowError();
+	std::unique_lock<std::mutex> lock( mutex );
+	if( !HasRoom( frameBytes ) )
+	{
+		stats.framesRefused++;
+		return false;
+	}
+	Enqueue( std::move( frame ) );
+	return true;
+}
+
+void FrameWriter::Consume( const RenderTarget& frame )
+{
+	if( frame.GetWidth() != width || frame.GetHeight() != height )
+	{
+		throw std::runtime_error( "FrameWriter got a frame of the wrong size  Path:" + path );
+	}
+	Surface s = AcquireSurface();
+	auto target = s.GetRenderTarget();
+	for( unsigned int y = 0u; y < height; y++ )
+	{
+		std::copy_n( frame.GetRow( y ),width,target.GetRow( y ) );
+	}
+	Submit( std::move( s ) );
+}
+
+void FrameWriter::Finish()
+{
+	{
+		std::unique_lock<std::mutex> lock( mutex );
+		cv.wait( lock,[this]() { return nextWrite == nextIndex || error; } );
+	}
+	RethrowError();
+	if( format == Format::Y4m )
+	{
+		stream.flush();
+	}
+}
+
+bool FrameWriter::IsBackedUp() const
+{
+	std::lock_guard<std::mutex> lock( mutex );
+	return !HasRoom( frameBytes );
+}
+
+FrameWriter::Stats FrameWriter::GetStats() const
+{
+	std::lock_guard<std::mutex> lock( mutex );
+	return stats;
+}
+
+// mutex must be held
+void FrameWriter::Enqueue( Surface&& frame )
+{
+	assert( frame.GetWidth() == width );
+	assert( frame.GetHeight() == height );
+	pending.push_back( { nextIndex++,std::move( frame ) } );
+	stats.framesSubmitted++;
+	stats.queuedBytes += frameBytes;
+	stats.peakQueuedBytes = std::max( stats.peakQueuedBytes,stats.queuedBytes );
+	cv.notify_all();
+}
+
+// mutex must be held
+bool FrameWriter::HasRoom( size_t bytes ) const
+{
+	// an empty queue always takes a frame so a tiny budget can't deadlock
+	return stats.queuedBytes == 0u || stats.queuedBytes + bytes <= maxQueuedBytes;
+}
+
+void FrameWriter::EncodeLoop()
+{
+	try
+	{
+		while( true )
+		{
+			std::unique_lock<std::mutex> lock( mutex );
+			cv.wait( lock,[this]() { return quitting || !pending.empty() || error; } );
+			if( pending.empty() || error )
+			{
+				return;
+			}
+			Job job = std::move( pending.front() );
+			pending.pop_front();
+			lock.unlock();
+
+			auto data = Encode( job.frame );
+
+			lock.lock();
+			stats.queuedBytes += data.size();
+			stats.queuedBytes -= frameBytes;
+			stats.peakQueuedBytes = std::max( stats.peakQueuedBytes,stats.queuedBytes );
+			encoded.emplace( job.index,std::move( data ) );
+			if( spare.size() < maxSpare )
+			{
+				spare.push_back( std::move( job.frame ) );
+			}
+			cv.notify_all();
+		}
+	}
+	catch( ... )
+	{
+		std::lock_guard<std::mutex> lock( mutex );
+		error = std::current_exception();
+		cv.notify_all();
+	}
+}
+
+void FrameWriter::WriteLoop()
+{
+	try
+	{
+		while( true )
+		{
+			std::unique_lock<std::mutex> lock( mutex );
+			cv.wait( lock,[this]()
+			{
+				return encoded.count( nextWrite ) != 0u || error || (quitting && nextWrite == nextIndex);
+			} );
+			if( encoded.count( nextWrite ) == 0u )
+			{
+				return;
+			}
+			// frame indices are handed out in order, so the next one to write is always the smallest
+			std::vector<unsigned char> data = std::move( encoded.begin()->second );
+			encoded.erase( encoded.begin() );
+			const uint64_t index = nextWrite;
+			lock.unlock();
+
+			if( format == Format::Y4m )
+			{
+				stream.write( reinterpret_cast<const char*>( data.data() ),data.size() );
+				if( !stream )
+				{
+					throw std::runtime_error( "FrameWriter failed writing output  Path:" + path );
+				}
+			}
+			else
+			{
+				char name[32];
+				std::snprintf( name,sizeof( name ),"_%06llu.%s",(unsigned long long)index,
+					format == Format::Png ? "png" : "qoi" );
+				std::ofstream file( path + name,std::ios::binary | std::ios::trunc );
+				file.write( reinterpret_cast<const char*>( data.data() ),data.size() );
+				if( !file )
+				{
+					throw std::runtime_error( "FrameWriter failed writing frame  Path:" + path + name );
+				}
+			}
+
+			lock.lock();
+			nextWrite++;
+			stats.framesWritten++;
+			stats.bytesWritten += data.size();
+			stats.queuedBytes -= data.size();
+			cv.notify_all();
+		}
+	}
+	catch( ... )
+	{
+		std::lock_guard<std::mutex> lock( mutex );
+		error = std::current_exception();
+		cv.notify_all();
+	}
+}
+
+std::vector<unsigned char> FrameWriter::Encode( const Surface& frame ) const
+{
+	switch( format )
+	{
+	case Format::Png:
+		return ImageCodec::EncodePng( frame );
+	case Format::Qoi:
+		return ImageCodec::EncodeQoi( frame );
+	default:
+		return ImageCodec::EncodeY4mFrame( frame );
+	}
+}
+
+void FrameWriter::RethrowError()
+{
+	std::exception_ptr e;
+	{
+		std::lock_guard<std::mutex> lock( mutex );
+		e = error;
+	}
+	if( e )
+	{
+		std::rethrow_exception( e );
+	}
+}
@@ -0,0 +1,100 @@
+#pragma once
+#include "Surface.h"
+#include "FrameSink.h"
+#include <vector>
+#include <deque>
+#include <map>
+#include <string>
+#include <fstream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <cstdint>
+
+// writes a sequence of rendered frames to disk without stalling the render loop
+// frames are encoded on worker threads and written in order by a single writer
+// thread; raw frames plus encoded data waiting for the disk are capped at
+// maxQueuedBytes, past that Submit blocks (or TrySubmit refuses) and the wait is
+// reported in the stats so you can tell when the disk can't keep up
+// as a FrameSink it captures the frames of Graphics (Graphics::SetFrameSink)
+class FrameWriter : public FrameSink
+{
+public:
+	enum class Format
+	{
+		Png,	// <path>_000000.png, <path>_000001.png, ...
+		Qoi,	// <path>_000000.qoi, ...
+		Y4m		// one raw yuv 4:2:0 stream at <path>
+	};
+	struct Stats
+	{
+		uint64_t framesSubmitted = 0u;
+		uint64_t framesWritten = 0u;
+		// TrySubmit calls turned away because the queue was full
+		uint64_t framesRefused = 0u;
+		// Submit calls that had to wait for room, and for how long in total
+		uint64_t stalls = 0u;
+		float stallTime = 0.0f;
+		uint64_t bytesWritten = 0u;
+		size_t queuedBytes = 0u;
+		size_t peakQueuedBytes = 0u;
+	};
+public:
+	FrameWriter( const std::string& path,Format format,unsigned int width,unsigned int height,
+		unsigned int fps = 60u,unsigned int workerCount = 2u,size_t maxQueuedBytes = size_t( 256u ) << 20u );
+	FrameWriter( const FrameWriter& ) = delete;
+	FrameWriter& operator=( const FrameWriter& ) = delete;
+	// waits for queued frames to be written, errors at that point are swallowed (call Finish to see them)
+	~FrameWriter() override;
+	// a surface of the output size to render the next frame into, recycled from written frames when possible
+	Surface AcquireSurface();
+	// queues a completed frame, blocks while the queue is over its memory budget
+	void Submit( Surface&& frame );
+	// queues a completed frame if there is room, otherwise leaves it alone and returns false
+	bool TrySubmit( Surface& frame );
+	// copies a frame of the output size drawn somewhere else into an acquired surface and submits it
+	void Consume( const RenderTarget& frame ) override;
+	// blocks until every queued frame is on disk
+	void Finish();
+	// true while Submit would have to wait
+	bool IsBackedUp() const;
+	Stats GetStats() const;
+private:
+	struct Job
+	{
+		uint64_t index;
+		Surface frame;
+	};
+	void Enqueue( Surface&& frame );
+	bool HasRoom( size_t bytes ) const;
+	void EncodeLoop();
+	void WriteLoop();
+	std::vector<unsigned char> Encode( const Surface& frame ) const;
+	void RethrowError();
+private:
+	std::string path;
+	Format format;
+	unsigned int width;
+	unsigned int height;
+	unsigned int fps;
+	size_t frameBytes;
+	size_t maxQueuedBytes;
+	size_t maxSpare;
+	std::ofstream stream;
+	// frames waiting for an encoder
+	std::deque<Job> pending;
+	// encoded frames waiting for their turn on disk, keyed by frame index
+	std::map<uint64_t,std::vector<unsigned char>> encoded;
+	// written frames kept around for AcquireSurface
+	std::vector<Surface> spare;
+	uint64_t nextIndex = 0u;
+	uint64_t nextWrite = 0u;
+	bool quitting = false;
+	Stats stats;
+	std::exception_ptr error;
+	mutable std::mutex mutex;
+	std::condition_variable cv;
+	std::vector<std::thread> encoders;
+	std::thread writer;
+};
@@ -0,0 +1,67 @@
+#pragma once
+#include "Vec4.h"
+#include "Mat.h"
+#include "BoundingSphere.h"
+
+// view frustum in object space extracted from a combined (world)viewproj matrix
+// planes are stored as (a,b,c,d) with the inside being a*x + b*y + c*z + d >= 0
+class Frustum
+{
+public:
+	enum class Result
+	{
+		Outside,
+		Intersect,
+		Inside
+	};
+public:
+	Frustum() = default;
+	// row vector convention (v * M) so clip coordinates are dot products with the columns
+	// clip volume is -w <= x,y <= w and 0 <= z <= w (same as ClipCullTriangle)
+	explicit Frustum(const Mat4& m)
+	{
+		const auto col = [&m](int i)
+		{
+			return Vec4{ m.elements[0][i],m.elements[1][i],m.elements[2][i],m.elements[3][i] };
+		};
+		const auto c0 = col(0);
+		const auto c1 = col(1);
+		const auto c2 = col(2);
+		const auto c3 = col(3);
+
+		planes[0] = c3 + c0; // left
+		planes[1] = c3 - c0; // right
+		planes[2] = c3 + c1; // bottom
+		planes[3] = c3 - c1; // top
+		planes[4] = c2;      // near
+		planes[5] = c3 - c2; // far
+
+		// normalize so plane distances are in object space units
+		for (auto& p : planes)
+		{
+			const float len = Vec3(p).Len();
+			p /= len;
+		}
+	}
+	// sphere vs frustum test
+	// Inside means every vertex of the sphere is guaranteed to be inside all planes
+	Result Test(const BoundingSphere& s) const
+	{
+		auto result = Result::Inside;
+		for (const auto& p : planes)
+		{
+			const float dist = Vec3(p) * s.center + p.w;
+			if (dist < -s.radius)
+			{
+				return Result::Outside;
+			}
+			if (dist < s.radius)
+			{
+				result = Result::Intersect;
+			}
+		}
+		return result;
+	}
+private:
+	Vec4 planes[6];
+};
@@ -29,6 +29,8 @@ namespace Gdiplus
 }
 #include <gdiplus.h>
 
+#pragma comment( lib,"gdiplus.lib" )
+
 ULONG_PTR GDIPlusManager::token = 0;
 int GDIPlusManager::refCount = 0;
 
@@ -89,6 +89,14 @@ void Game::UpdateModel()
 				CycleScenes();
 			}
 		}
+		else if (e.GetCode() == VK_F9 && e.IsPress())
+		{
+			ToggleFramePublishing();
+		}
+		else if (e.GetCode() == VK_F10 && e.IsPress())
+		{
+			ToggleFrameCapture();
+		}
 		else if (e.GetCode() == VK_ESCAPE && e.IsPress())
 		{
 			wnd.Kill();
@@ -124,3 +132,37 @@ void Game::ReverseCycleScenes()
 	}
 	
 }
+// publishes every frame to the shared memory ring "ChiliFrames" for other processes
+// (Tools/FrameConsumer reads it)
+void Game::ToggleFramePublishing()
+{
+	gfx.SetFrameSink(nullptr);
+	if (pFrameRing)
+	{
+		pFrameRing.reset();
+	}
+	else
+	{
+		pCapture.reset();
+		pFrameRing = std::make_unique<SharedFrameRing>(SharedFrameRing::Create("ChiliFrames", Graphics::ScreenWidth, Graphics::ScreenHeight));
+		gfx.SetFrameSink(pFrameRing.get());
+	}
+}
+// records every frame to capture_000000.qoi, capture_000001.qoi, ... in the working directory
+// the game waits when the disk falls behind, turning it off waits for the queued frames
+void Game::ToggleFrameCapture()
+{
+	gfx.SetFrameSink(nullptr);
+	if (pCapture)
+	{
+		// rethrows write errors the capture ran into
+		pCapture->Finish();
+		pCapture.reset();
+	}
+	else
+	{
+		pFrameRing.reset();
+		pCapture = std::make_unique<FrameWriter>("capture", FrameWriter::Format::Qoi, Graphics::ScreenWidth, Graphics::ScreenHeight);
+		gfx.SetFrameSink(pCapture.get());
+	}
+}
@@ -25,6 +25,8 @@
 #include <vector>
 #include "Scene.h"
 #include "FrameTimer.h"
+#include "SharedFrameRing.h"
+#include "FrameWriter.h"
 
 
 class Game
@@ -41,6 +43,8 @@ private:
 	/*  User Functions              */
 	void CycleScenes();
 	void ReverseCycleScenes();
+	void ToggleFramePublishing();
+	void ToggleFrameCapture();
 	/********************************/
 private:
 	MainWindow& wnd;
@@ -51,6 +55,10 @@ private:
 
 	std::vector<std::unique_ptr<Scene>> scenes;
 	std::vector<std::unique_ptr<Scene>>::iterator curScene;
+	// frames published to other processes (F9) or captured to disk (F10) while these exist,
+	// graphics feeds one sink, so turning one on turns the other off
+	std::unique_ptr<SharedFrameRing> pFrameRing;
+	std::unique_ptr<FrameWriter> pCapture;
 	
 	/********************************/
 };
\ No newline at end of file
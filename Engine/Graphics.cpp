@@ -40,8 +40,6 @@ namespace FramebufferShaders
 using Microsoft::WRL::ComPtr;
 
 Graphics::Graphics( HWNDKey& key )
-	:
-	sysBuffer( ScreenWidth,ScreenHeight )
 {
 	assert( key.hWnd != nullptr );
 
@@ -125,7 +123,7 @@ Graphics::Graphics( HWNDKey& key )
 
 
 	///////////////////////////////////////
-	// create texture for cpu render target
+	// create textures for cpu render targets
 	D3D11_TEXTURE2D_DESC sysTexDesc;
 	sysTexDesc.Width = Graphics::ScreenWidth;
 	sysTexDesc.Height = Graphics::ScreenHeight;
@@ -138,21 +136,27 @@ Graphics::Graphics( HWNDKey& key )
 	sysTexDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
 	sysTexDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
 	sysTexDesc.MiscFlags = 0;
-	// create the texture
-	if( FAILED( hr = pDevice->CreateTexture2D( &sysTexDesc,nullptr,&pSysBufferTexture ) ) )
-	{
-		throw CHILI_GFX_EXCEPTION( hr,L"Creating sysbuffer texture" );
-	}
 
 	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
 	srvDesc.Format = sysTexDesc.Format;
 	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
 	srvDesc.Texture2D.MipLevels = 1;
-	// create the resource view on the texture
-	if( FAILED( hr = pDevice->CreateShaderResourceView( pSysBufferTexture.Get(),
-		&srvDesc,&pSysBufferTextureView ) ) )
+
+	frames.resize( FrameBufferCount );
+	for( auto& f : frames )
 	{
-		throw CHILI_GFX_EXCEPTION( hr,L"Creating view on sysBuffer texture" );
+		// create the texture
+		if( FAILED( hr = pDevice->CreateTexture2D( &sysTexDesc,nullptr,&f.pTexture ) ) )
+		{
+			throw CHILI_GFX_EXCEPTION( hr,L"Creating sysbuffer texture" );
+		}
+		// create the resource view on the texture
+		if( FAILED( hr = pDevice->CreateShaderResourceView( f.pTexture.Get(),
+			&srvDesc,&f.pTextureView ) ) )
+		{
+			throw CHILI_GFX_EXCEPTION( hr,L"Creating view on sysBuffer texture" );
+		}
+		f.surfaceTarget = f.surface.GetRenderTarget();
 	}
 
 
@@ -238,29 +242,175 @@ Graphics::Graphics( HWNDKey& key )
 	{
 		throw CHILI_GFX_EXCEPTION( hr,L"Creating sampler state" );
 	}
+
+
+	//////////////////////////////////////////////////////
+	// map frame buffers and start the present thread
+	for( int i = 0; i < FrameBufferCount; i++ )
+	{
+		MapFrame( frames[i] );
+		freeBuffers.push_back( i );
+	}
+	presentThread = std::thread( &Graphics::PresentLoop,this );
 }
 
 Graphics::~Graphics()
 {
+	// stop the present thread before tearing down d3d
+	{
+		std::lock_guard<std::mutex> lock( bufferMutex );
+		quitting = true;
+	}
+	bufferCv.notify_all();
+	if( presentThread.joinable() ) presentThread.join();
+	for( auto& f : frames )
+	{
+		if( f.mapped ) pImmediateContext->Unmap( f.pTexture.Get(),0u );
+	}
 	// clear the state of the device context before destruction
 	if( pImmediateContext ) pImmediateContext->ClearState();
 }
 
 void Graphics::EndFrame()
+{
+	RethrowPresentError();
+	if( pSink )
+	{
+		pSink->Consume( *pTarget );
+	}
+	{
+		std::lock_guard<std::mutex> lock( bufferMutex );
+		presentQueue.push_back( curBuffer );
+	}
+	bufferCv.notify_all();
+	curBuffer = -1;
+	pTarget = nullptr;
+}
+
+void Graphics::BeginFrame()
+{
+	{
+		std::unique_lock<std::mutex> lock( bufferMutex );
+		bufferCv.wait( lock,[this]() { return !freeBuffers.empty() || presentError; } );
+		if( !presentError )
+		{
+			curBuffer = freeBuffers.front();
+			freeBuffers.pop_front();
+		}
+	}
+	RethrowPresentError();
+	auto& f = frames[curBuffer];
+	f.readback = readback || pSink;
+	pTarget = f.readback ? &f.surfaceTarget : &f.mappedTarget;
+	f.timer.Mark();
+	pTarget->Clear( Colors::Black );
+}
+
+void Graphics::SetTargetReadback( bool readback_in )
+{
+	readback = readback_in;
+	SelectTarget();
+}
+
+void Graphics::SetFrameSink( FrameSink* pSink_in )
+{
+	pSink = pSink_in;
+	SelectTarget();
+}
+
+void Graphics::SelectTarget()
+{
+	const bool useSurface = readback || pSink;
+	if( curBuffer >= 0 && frames[curBuffer].readback != useSurface )
+	{
+		auto& f = frames[curBuffer];
+		f.readback = useSurface;
+		pTarget = f.readback ? &f.surfaceTarget : &f.mappedTarget;
+		pTarget->Clear( Colors::Black );
+	}
+}
+
+void Graphics::RethrowPresentError()
+{
+	std::lock_guard<std::mutex> lock( bufferMutex );
+	if( presentError )
+	{
+		std::rethrow_exception( presentError );
+	}
+}
+
+void Graphics::PresentLoop()
+{
+	try
+	{
+		while( true )
+		{
+			int buffer;
+			{
+				std::unique_lock<std::mutex> lock( bufferMutex );
+				bufferCv.wait( lock,[this]() { return quitting || !presentQueue.empty(); } );
+				if( quitting )
+				{
+					return;
+				}
+				buffer = presentQueue.front();
+				presentQueue.pop_front();
+			}
+
+			FrameTimer presentTimer;
+			PresentFrame( frames[buffer] );
+			presentTime = presentTimer.Mark();
+			frameLatency = frames[buffer].timer.Peek();
+			// remap right away so the frame is ready to render into
+			MapFrame( frames[buffer] );
+
+			{
+				std::lock_guard<std::mutex> lock( bufferMutex );
+				freeBuffers.push_back( buffer );
+			}
+			bufferCv.notify_all();
+		}
+	}
+	catch( ... )
+	{
+		// hand the error over to the game thread, it gets rethrown there
+		{
+			std::lock_guard<std::mutex> lock( bufferMutex );
+			presentError = std::current_exception();
+		}
+		bufferCv.notify_all();
+	}
+}
+
+void Graphics::MapFrame( FrameBuffer& frame )
 {
 	HRESULT hr;
 
-	// lock and map the adapter memory for copying over the sysbuffer
-	if( FAILED( hr = pImmediateContext->Map( pSysBufferTexture.Get(),0u,
-		D3D11_MAP_WRITE_DISCARD,0u,&mappedSysBufferTexture ) ) )
+	// lock and map the adapter memory ahead of the frame
+	if( FAILED( hr = pImmediateContext->Map( frame.pTexture.Get(),0u,
+		D3D11_MAP_WRITE_DISCARD,0u,&frame.mappedTexture ) ) )
 	{
 		throw CHILI_GFX_EXCEPTION( hr,L"Mapping sysbuffer" );
 	}
-	// perform the copy line-by-line
-	sysBuffer.Present( mappedSysBufferTexture.RowPitch,
-		reinterpret_cast<BYTE*>(mappedSysBufferTexture.pData) );
+	frame.mappedTarget = RenderTarget( reinterpret_cast<Color*>(frame.mappedTexture.pData),
+		ScreenWidth,ScreenHeight,frame.mappedTexture.RowPitch );
+	frame.mapped = true;
+}
+
+void Graphics::PresentFrame( FrameBuffer& frame )
+{
+	HRESULT hr;
+
+	// opaque frames are already in the texture, readback ones are copied line-by-line,
+	// write only so write-combining works for it
+	if( frame.readback )
+	{
+		frame.surface.Present( frame.mappedTexture.RowPitch,
+			reinterpret_cast<BYTE*>(frame.mappedTexture.pData) );
+	}
 	// release the adapter memory
-	pImmediateContext->Unmap( pSysBufferTexture.Get(),0u );
+	pImmediateContext->Unmap( frame.pTexture.Get(),0u );
+	frame.mapped = false;
 
 	// render offscreen scene texture to back buffer
 	pImmediateContext->IASetInputLayout( pInputLayout.Get() );
@@ -270,7 +420,7 @@ void Graphics::EndFrame()
 	const UINT stride = sizeof( FSQVertex );
 	const UINT offset = 0u;
 	pImmediateContext->IASetVertexBuffers( 0u,1u,pVertexBuffer.GetAddressOf(),&stride,&offset );
-	pImmediateContext->PSSetShaderResources( 0u,1u,pSysBufferTextureView.GetAddressOf() );
+	pImmediateContext->PSSetShaderResources( 0u,1u,frame.pTextureView.GetAddressOf() );
 	pImmediateContext->PSSetSamplers( 0u,1u,pSamplerState.GetAddressOf() );
 	pImmediateContext->Draw( 6u,0u );
 
@@ -281,11 +431,6 @@ void Graphics::EndFrame()
 	}
 }
 
-void Graphics::BeginFrame()
-{
-	sysBuffer.Clear( Colors::Red );
-}
-
 
 //////////////////////////////////////////////////
 //           Graphics Exception
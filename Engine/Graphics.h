@@ -24,14 +24,24 @@
 #include "GDIPlusManager.h"
 #include "ChiliException.h"
 #include "Surface.h"
+#include "RenderTarget.h"
+#include "FrameSink.h"
 #include "Colors.h"
 #include "Vec2.h"
 #include "Vec3.h"
+#include "FrameTimer.h"
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <exception>
 
 
 #define CHILI_GFX_EXCEPTION( hr,note ) Graphics::Exception( hr,note,_CRT_WIDE(__FILE__),__LINE__ )
 
-class Graphics
+class Graphics : public RenderTargetSource
 {
 public:
 	class Exception : public ChiliException
@@ -52,11 +62,35 @@ private:
 		float x,y,z;		// position
 		float u,v;			// texcoords
 	};
+	// dynamic texture the game thread renders into while it is mapped; frames that read back their
+	// pixels (blending, the transparency resolve, the shading rate map) would be very slow on the
+	// write-combined texture memory, those render into a system memory surface that the present
+	// thread copies to the texture
+	struct FrameBuffer
+	{
+		FrameBuffer()
+			:
+			surface( ScreenWidth,ScreenHeight,Surface::GetPitch( ScreenWidth,Surface::RowAlignment ) )
+		{}
+		Microsoft::WRL::ComPtr<ID3D11Texture2D>				pTexture;
+		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>	pTextureView;
+		Surface												surface;
+		RenderTarget										surfaceTarget;
+		// view of the mapped texture memory, valid while mapped
+		RenderTarget										mappedTarget;
+		D3D11_MAPPED_SUBRESOURCE							mappedTexture;
+		bool												mapped = false;
+		// rendered into surface, set when the frame begins
+		bool												readback = false;
+		FrameTimer											timer;
+	};
 public:
 	Graphics( class HWNDKey& key );
 	Graphics( const Graphics& ) = delete;
 	Graphics& operator=( const Graphics& ) = delete;
+	// hands the finished frame to the present thread and returns without waiting for it
 	void EndFrame();
+	// waits for a free frame buffer (only blocks when the present thread falls behind)
 	void BeginFrame();
 	void DrawLine( const Vec2& p1,const Vec2& p2,Color c )
 	{
@@ -71,27 +105,78 @@ public:
 	}
 	void PutPixel( int x,int y,Color c )
 	{
-		sysBuffer.PutPixel( x,y,c );
+		pTarget->PutPixel( x,y,c );
+	}
+	// surface of the frame being rendered, only valid between BeginFrame and EndFrame
+	RenderTarget& GetRenderTarget() override
+	{
+		assert( pTarget != nullptr );
+		return *pTarget;
+	}
+	unsigned int GetTargetWidth() const override
+	{
+		return ScreenWidth;
+	}
+	unsigned int GetTargetHeight() const override
+	{
+		return ScreenHeight;
+	}
+	// frames that read back their own pixels (alpha or order independent blending, the shading
+	// rate map) go through system memory and a copy when presented, the others are drawn straight
+	// into the mapped texture; set it before drawing, switching mid frame starts over on a cleared target
+	void SetTargetReadback( bool readback_in );
+	// gets every finished frame in EndFrame, on the game thread (nullptr for none); it reads the
+	// frame back, so frames go through system memory while one is set
+	void SetFrameSink( FrameSink* pSink_in );
+	// seconds from BeginFrame of the last presented frame until its Present returned
+	float GetFrameLatency() const
+	{
+		return frameLatency;
+	}
+	// seconds the present thread spent presenting the last frame (and copying it, for readback frames)
+	float GetPresentTime() const
+	{
+		return presentTime;
 	}
 	~Graphics();
 private:
-	
+	void PresentLoop();
+	void PresentFrame( FrameBuffer& frame );
+	void MapFrame( FrameBuffer& frame );
+	void RethrowPresentError();
+	// moves the current frame between the mapped texture and the surface when that changed
+	void SelectTarget();
 private:
 	GDIPlusManager										gdipMan;
 	Microsoft::WRL::ComPtr<IDXGISwapChain>				pSwapChain;
 	Microsoft::WRL::ComPtr<ID3D11Device>				pDevice;
 	Microsoft::WRL::ComPtr<ID3D11DeviceContext>			pImmediateContext;
 	Microsoft::WRL::ComPtr<ID3D11RenderTargetView>		pRenderTargetView;
-	Microsoft::WRL::ComPtr<ID3D11Texture2D>				pSysBufferTexture;
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>	pSysBufferTextureView;
 	Microsoft::WRL::ComPtr<ID3D11PixelShader>			pPixelShader;
 	Microsoft::WRL::ComPtr<ID3D11VertexShader>			pVertexShader;
 	Microsoft::WRL::ComPtr<ID3D11Buffer>				pVertexBuffer;
 	Microsoft::WRL::ComPtr<ID3D11InputLayout>			pInputLayout;
 	Microsoft::WRL::ComPtr<ID3D11SamplerState>			pSamplerState;
-	D3D11_MAPPED_SUBRESOURCE							mappedSysBufferTexture;
-	Surface												sysBuffer;
+	// frames rendered on the game thread and presented on presentThread
+	// all d3d calls after construction happen on presentThread
+	// textures of free frames stay mapped, the game thread renders into them
+	std::vector<FrameBuffer>							frames;
+	RenderTarget*										pTarget = nullptr;
+	bool												readback = false;
+	FrameSink*											pSink = nullptr;
+	int													curBuffer = -1;
+	std::deque<int>										freeBuffers;
+	std::deque<int>										presentQueue;
+	std::mutex											bufferMutex;
+	std::condition_variable								bufferCv;
+	bool												quitting = false;
+	std::exception_ptr									presentError;
+	std::atomic<float>									frameLatency { 0.0f };
+	std::atomic<float>									presentTime { 0.0f };
+	std::thread											presentThread;
 public:
 	static constexpr unsigned int ScreenWidth = 1300u;
 	static constexpr unsigned int ScreenHeight = 731u;
+	// 2 lets frame N+1 render while N is presented, 3 also absorbs vsync hiccups
+	static constexpr int FrameBufferCount = 2;
 };
\ No newline at end of file
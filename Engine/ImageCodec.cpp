@@ -0,0 +1,1857 @@
+#include "ImageCodec.h"
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdlib>
+#include <cmath>
+#include <stdexcept>
+
+namespace
+{
+	// deflate length and distance code tables (rfc 1951 3.2.5)
+	const unsigned short lengthBase[29] = {
+		3,4,5,6,7,8,9,10,11,13,15,17,19,23,27,31,35,43,51,59,67,83,99,115,131,163,195,227,258 };
+	const unsigned char lengthExtra[29] = {
+		0,0,0,0,0,0,0,0,1,1,1,1,2,2,2,2,3,3,3,3,4,4,4,4,5,5,5,5,0 };
+	const unsigned short distBase[30] = {
+		1,2,3,4,5,7,9,13,17,25,33,49,65,97,129,193,257,385,513,769,
+		1025,1537,2049,3073,4097,6145,8193,12289,16385,24577 };
+	const unsigned char distExtra[30] = {
+		0,0,0,0,1,1,2,2,3,3,4,4,5,5,6,6,7,7,8,8,9,9,10,10,11,11,12,12,13,13 };
+
+	void PutU32BE( std::vector<unsigned char>& out,uint32_t v )
+	{
+		out.push_back( (unsigned char)(v >> 24) );
+		out.push_back( (unsigned char)(v >> 16) );
+		out.push_back( (unsigned char)(v >> 8) );
+		out.push_back( (unsigned char)v );
+	}
+
+	uint32_t Crc32( const unsigned char* p,size_t n,uint32_t crc = 0u )
+	{
+		static const auto table = []()
+		{
+			std::array<uint32_t,256> t;
+			for( uint32_t i = 0; i < 256; i++ )
+			{
+				uint32_t c = i;
+				for( int k = 0; k < 8; k++ )
+				{
+					c = (c & 1u) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+				}
+				t[i] = c;
+			}
+			return t;
+		}();
+		crc = ~crc;
+		for( size_t i = 0; i < n; i++ )
+		{
+			crc = table[(crc ^ p[i]) & 0xFFu] ^ (crc >> 8);
+		}
+		return ~crc;
+	}
+
+	uint32_t Adler32( const unsigned char* p,size_t n )
+	{
+		uint32_t a = 1u;
+		uint32_t b = 0u;
+		while( n > 0u )
+		{
+			// largest block that can't overflow before the modulo
+			const size_t block = std::min( n,size_t( 5552 ) );
+			for( size_t i = 0; i < block; i++ )
+			{
+				a += p[i];
+				b += a;
+			}
+			a %= 65521u;
+			b %= 65521u;
+			p += block;
+			n -= block;
+		}
+		return (b << 16) | a;
+	}
+
+	// lsb-first bit packer for deflate
+	class BitWriter
+	{
+	public:
+		BitWriter( std::vector<unsigned char>& out )
+			:
+			out( out )
+		{}
+		void Put( uint32_t bits,int count )
+		{
+			acc |= uint64_t( bits ) << fill;
+			fill += count;
+			while( fill >= 8 )
+			{
+				out.push_back( (unsigned char)acc );
+				acc >>= 8;
+				fill -= 8;
+			}
+		}
+		// huffman codes go out msb first
+		void PutCode( uint32_t code,int length )
+		{
+			uint32_t reversed = 0u;
+			for( int i = 0; i < length; i++ )
+			{
+				reversed = (reversed << 1) | ((code >> i) & 1u);
+			}
+			Put( reversed,length );
+		}
+		void Flush()
+		{
+			if( fill > 0 )
+			{
+				out.push_back( (unsigned char)acc );
+			}
+			acc = 0u;
+			fill = 0;
+		}
+	private:
+		std::vector<unsigned char>& out;
+		uint64_t acc = 0u;
+		int fill = 0;
+	};
+
+	void PutFixedLiteral( BitWriter& bw,unsigned int v )
+	{
+		if( v < 144u )
+		{
+			bw.PutCode( 0x30u + v,8 );
+		}
+		else if( v < 256u )
+		{
+			bw.PutCode( 0x190u + (v - 144u),9 );
+		}
+		else if( v < 280u )
+		{
+			bw.PutCode( v - 256u,7 );
+		}
+		else
+		{
+			bw.PutCode( 0xC0u + (v - 280u),8 );
+		}
+	}
+
+	void PutMatch( BitWriter& bw,unsigned int length,unsigned int distance )
+	{
+		int lc = 28;
+		while( lengthBase[lc] > length ) lc--;
+		PutFixedLiteral( bw,257u + lc );
+		bw.Put( length - lengthBase[lc],lengthExtra[lc] );
+
+		int dc = 29;
+		while( distBase[dc] > distance ) dc--;
+		bw.PutCode( dc,5 );
+		bw.Put( distance - distBase[dc],distExtra[dc] );
+	}
+
+	// zlib stream holding one fixed-huffman block, greedy lz77 with a single-probe hash table
+	void Deflate( const std::vector<unsigned char>& data,std::vector<unsigned char>& out )
+	{
+		constexpr size_t window = 32768u;
+		constexpr unsigned int minMatch = 3u;
+		constexpr unsigned int maxMatch = 258u;
+		constexpr int hashBits = 15;
+
+		out.push_back( 0x78u );
+		out.push_back( 0x01u );
+		BitWriter bw( out );
+		// bfinal, fixed huffman
+		bw.Put( 1u,1 );
+		bw.Put( 1u,2 );
+
+		std::vector<int64_t> head( size_t( 1 ) << hashBits,-int64_t( window ) - 1 );
+		const unsigned char* p = data.data();
+		const size_t n = data.size();
+		size_t i = 0u;
+		while( i < n )
+		{
+			unsigned int bestLength = 0u;
+			size_t bestDistance = 0u;
+			if( i + minMatch <= n )
+			{
+				const uint32_t key = (uint32_t( p[i] ) | uint32_t( p[i + 1] ) << 8 | uint32_t( p[i + 2] ) << 16) * 2654435761u;
+				const uint32_t h = key >> (32 - hashBits);
+				const int64_t candidate = head[h];
+				head[h] = int64_t( i );
+				if( candidate >= 0 && i - size_t( candidate ) <= window )
+				{
+					const size_t limit = std::min( size_t( maxMatch ),n - i );
+					size_t length = 0u;
+					while( length < limit && p[size_t( candidate ) + length] == p[i + length] )
+					{
+						length++;
+					}
+					if( length >= minMatch )
+					{
+						bestLength = (unsigned int)length;
+						bestDistance = i - size_t( candidate );
+					}
+				}
+			}
+			if( bestLength > 0u )
+			{
+				PutMatch( bw,bestLength,(unsigned int)bestDistance );
+				// keep the table warm inside long matches without hashing every byte
+				const size_t end = i + bestLength;
+				for( i += 1u; i < end && i + minMatch <= n; i += 4u )
+				{
+					const uint32_t key = (uint32_t( p[i] ) | uint32_t( p[i + 1] ) << 8 | uint32_t( p[i + 2] ) << 16) * 2654435761u;
+					head[key >> (32 - hashBits)] = int64_t( i );
+				}
+				i = end;
+			}
+			else
+			{
+				PutFixedLiteral( bw,p[i] );
+				i++;
+			}
+		}
+		PutFixedLiteral( bw,256u );
+		bw.Flush();
+		PutU32BE( out,Adler32( p,n ) );
+	}
+
+	void PutChunk( std::vector<unsigned char>& out,const char* type,const unsigned char* data,size_t size )
+	{
+		PutU32BE( out,uint32_t( size ) );
+		const size_t start = out.size();
+		out.insert( out.end(),type,type + 4 );
+		out.insert( out.end(),data,data + size );
+		PutU32BE( out,Crc32( &out[start],size + 4u ) );
+	}
+
+	unsigned char Paeth( int a,int b,int c )
+	{
+		const int p = a + b - c;
+		const int pa = std::abs( p - a );
+		const int pb = std::abs( p - b );
+		const int pc = std::abs( p - c );
+		if( pa <= pb && pa <= pc ) return (unsigned char)a;
+		if( pb <= pc ) return (unsigned char)b;
+		return (unsigned char)c;
+	}
+}
+
+std::vector<unsigned char> ImageCodec::EncodePng( const Surface& s )
+{
+	const unsigned int width = s.GetWidth();
+	const unsigned int height = s.GetHeight();
+	const size_t rowBytes = size_t( width ) * 3u;
+
+	// filtered scanlines, each row tries every filter and keeps the one with the
+	// smallest sum of absolute values (the usual libpng heuristic)
+	std::vector<unsigned char> filtered;
+	filtered.reserve( (rowBytes + 1u) * height );
+	std::vector<unsigned char> prev( rowBytes,0u );
+	std::vector<unsigned char> cur( rowBytes );
+	std::array<std::vector<unsigned char>,5> candidates;
+	for( auto& c : candidates )
+	{
+		c.resize( rowBytes );
+	}
+	for( unsigned int y = 0; y < height; y++ )
+	{
+		const Color* pRow = s.GetBufferPtrConst() + size_t( y ) * s.GetPitch();
+		for( unsigned int x = 0; x < width; x++ )
+		{
+			cur[x * 3u + 0u] = pRow[x].GetR();
+			cur[x * 3u + 1u] = pRow[x].GetG();
+			cur[x * 3u + 2u] = pRow[x].GetB();
+		}
+		size_t bestCost = SIZE_MAX;
+		int best = 0;
+		for( int f = 0; f < 5; f++ )
+		{
+			auto& c = candidates[f];
+			size_t cost = 0u;
+			for( size_t i = 0; i < rowBytes; i++ )
+			{
+				const int a = i >= 3u ? cur[i - 3u] : 0;
+				const int b = prev[i];
+				const int d = i >= 3u ? prev[i - 3u] : 0;
+				int v = cur[i];
+				switch( f )
+				{
+				case 1: v -= a; break;
+				case 2: v -= b; break;
+				case 3: v -= (a + b) / 2; break;
+				case 4: v -= Paeth( a,b,d ); break;
+				}
+				c[i] = (unsigned char)v;
+				cost += std::abs( int( (signed char)c[i] ) );
+			}
+			if( cost < bestCost )
+			{
+				bestCost = cost;
+				best = f;
+			}
+		}
+		filtered.push_back( (unsigned char)best );
+		filtered.insert( filtered.end(),candidates[best].begin(),candidates[best].end() );
+		std::swap( prev,cur );
+	}
+
+	std::vector<unsigned char> out;
+	static const unsigned char signature[8] = { 0x89,'P','N','G','\r','\n',0x1A,'\n' };
+	out.insert( out.end(),signature,signature + 8 );
+
+	std::vector<unsigned char> ihdr;
+	PutU32BE( ihdr,width );
+	PutU32BE( ihdr,height );
+	// 8 bit rgb, deflate, adaptive filtering, no interlace
+	const unsigned char rest[5] = { 8u,2u,0u,0u,0u };
+	ihdr.insert( ihdr.end(),rest,rest + 5 );
+	PutChunk( out,"IHDR",ihdr.data(),ihdr.size() );
+
+	std::vector<unsigned char> idat;
+	idat.reserve( filtered.size() / 2u );
+	Deflate( filtered,idat );
+	PutChunk( out,"IDAT",idat.data(),idat.size() );
+	PutChunk( out,"IEND",nullptr,0u );
+	return out;
+}
+
+std::vector<unsigned char> ImageCodec::EncodeQoi( const Surface& s )
+{
+	const unsigned int width = s.GetWidth();
+	const unsigned int height = s.GetHeight();
+
+	std::vector<unsigned char> out;
+	out.reserve( 14u + size_t( width ) * height + 8u );
+	out.insert( out.end(),{ 'q','o','i','f' } );
+	PutU32BE( out,width );
+	PutU32BE( out,height );
+	// 3 channels, srgb
+	out.push_back( 3u );
+	out.push_back( 0u );
+
+	struct Px
+	{
+		unsigned char r,g,b,a;
+	};
+	std::array<Px,64> index = {};
+	Px prev = { 0u,0u,0u,255u };
+	unsigned int run = 0u;
+	for( unsigned int y = 0; y < height; y++ )
+	{
+		const Color* pRow = s.GetBufferPtrConst() + size_t( y ) * s.GetPitch();
+		for( unsigned int x = 0; x < width; x++ )
+		{
+			const Px px = { pRow[x].GetR(),pRow[x].GetG(),pRow[x].GetB(),255u };
+			if( px.r == prev.r && px.g == prev.g && px.b == prev.b )
+			{
+				run++;
+				if( run == 62u )
+				{
+					out.push_back( (unsigned char)(0xC0u | (run - 1u)) );
+					run = 0u;
+				}
+				continue;
+			}
+			if( run > 0u )
+			{
+				out.push_back( (unsigned char)(0xC0u | (run - 1u)) );
+				run = 0u;
+			}
+			const unsigned int slot = (px.r * 3u + px.g * 5u + px.b * 7u + px.a * 11u) % 64u;
+			const Px& cached = index[slot];
+			if( cached.r == px.r && cached.g == px.g && cached.b == px.b && cached.a == px.a )
+			{
+				out.push_back( (unsigned char)slot );
+			}
+			else
+			{
+				index[slot] = px;
+				const int dr = (signed char)(px.r - prev.r);
+				const int dg = (signed char)(px.g - prev.g);
+				const int db = (signed char)(px.b - prev.b);
+				const int drg = dr - dg;
+				const int dbg = db - dg;
+				if( dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1 )
+				{
+					out.push_back( (unsigned char)(0x40u | ((dr + 2) << 4) | ((dg + 2) << 2) | (db + 2)) );
+				}
+				else if( dg >= -32 && dg <= 31 && drg >= -8 && drg <= 7 && dbg >= -8 && dbg <= 7 )
+				{
+					out.push_back( (unsigned char)(0x80u | (dg + 32)) );
+					out.push_back( (unsigned char)(((drg + 8) << 4) | (dbg + 8)) );
+				}
+				else
+				{
+					out.push_back( 0xFEu );
+					out.push_back( px.r );
+					out.push_back( px.g );
+					out.push_back( px.b );
+				}
+			}
+			prev = px;
+		}
+	}
+	if( run > 0u )
+	{
+		out.push_back( (unsigned char)(0xC0u | (run - 1u)) );
+	}
+	out.insert( out.end(),{ 0u,0u,0u,0u,0u,0u,0u,1u } );
+	return out;
+}
+
+std::string ImageCodec::GetY4mHeader( unsigned int width,unsigned int height,unsigned int fps )
+{
+	return "YUV4MPEG2 W" + std::to_string( width ) + " H" + std::to_string( height ) +
+		" F" + std::to_string( fps ) + ":1 Ip A1:1 C420jpeg\n";
+}
+
+std::vector<unsigned char> ImageCodec::EncodeY4mFrame( const Surface& s )
+{
+	const unsigned int width = s.GetWidth();
+	const unsigned int height = s.GetHeight();
+	const unsigned int cw = (width + 1u) / 2u;
+	const unsigned int ch = (height + 1u) / 2u;
+
+	static const char marker[] = "FRAME\n";
+	std::vector<unsigned char> out( 6u + size_t( width ) * height + size_t( cw ) * ch * 2u );
+	std::copy( marker,marker + 6,out.begin() );
+	unsigned char* pY = &out[6];
+	unsigned char* pU = pY + size_t( width ) * height;
+	unsigned char* pV = pU + size_t( cw ) * ch;
+
+	// bt.601 full range in 16.16 fixed point
+	for( unsigned int y = 0; y < height; y++ )
+	{
+		const Color* pRow = s.GetBufferPtrConst() + size_t( y ) * s.GetPitch();
+		unsigned char* pDst = pY + size_t( y ) * width;
+		for( unsigned int x = 0; x < width; x++ )
+		{
+			const int r = pRow[x].GetR();
+			const int g = pRow[x].GetG();
+			const int b = pRow[x].GetB();
+			pDst[x] = (unsigned char)((19595 * r + 38470 * g + 7471 * b + 32768) >> 16);
+		}
+	}
+	// chroma from the average of each 2x2 block (edge pixels repeat on odd sizes)
+	for( unsigned int cy = 0; cy < ch; cy++ )
+	{
+		const Color* pRow0 = s.GetBufferPtrConst() + size_t( cy * 2u ) * s.GetPitch();
+		const Color* pRow1 = s.GetBufferPtrConst() + size_t( std::min( cy * 2u + 1u,height - 1u ) ) * s.GetPitch();
+		for( unsigned int cx = 0; cx < cw; cx++ )
+		{
+			const unsigned int x0 = cx * 2u;
+			const unsigned int x1 = std::min( x0 + 1u,width - 1u );
+			const int r = pRow0[x0].GetR() + pRow0[x1].GetR() + pRow1[x0].GetR() + pRow1[x1].GetR();
+			const int g = pRow0[x0].GetG() + pRow0[x1].GetG() + pRow1[x0].GetG() + pRow1[x1].GetG();
+			const int b = pRow0[x0].GetB() + pRow0[x1].GetB() + pRow1[x0].GetB() + pRow1[x1].GetB();
+			// sums are 4x, so shift by 18 instead of 16
+			const int u = (-11059 * r - 21709 * g + 32768 * b + (128 << 18) + (1 << 17)) >> 18;
+			const int v = (32768 * r - 27439 * g - 5329 * b + (128 << 18) + (1 << 17)) >> 18;
+			pU[size_t( cy ) * cw + cx] = (unsigned char)std::min( std::max( u,0 ),255 );
+			pV[size_t( cy ) * cw + cx] = (unsigned char)std::min( std::max( v,0 ),255 );
+		}
+	}
+	return out;
+}
+
+namespace
+{
+	uint32_t GetU32BE( const unsigned char* p )
+	{
+		return uint32_t( p[0] ) << 24 | uint32_t( p[1] ) << 16 | uint32_t( p[2] ) << 8 | uint32_t( p[3] );
+	}
+
+	uint32_t GetU32LE( const unsigned char* p )
+	{
+		return uint32_t( p[3] ) << 24 | uint32_t( p[2] ) << 16 | uint32_t( p[1] ) << 8 | uint32_t( p[0] );
+	}
+
+	// decoders call this on header dimensions before sizing anything by them
+	void CheckDimensions( unsigned int width,unsigned int height )
+	{
+		if( width == 0u || height == 0u || width > 32768u || height > 32768u )
+		{
+			throw std::runtime_error( "Image has bad dimensions" );
+		}
+	}
+
+	Surface MakeSurface( unsigned int width,unsigned int height )
+	{
+		CheckDimensions( width,height );
+		return Surface( width,height,Surface::GetPitch( width,Surface::RowAlignment ) );
+	}
+
+	// zlib/deflate decoder (rfc 1950/1951)
+	class Inflater
+	{
+	public:
+		Inflater( const unsigned char* pData,size_t size )
+			:
+			p( pData ),
+			end( pData + size )
+		{}
+		void Inflate( std::vector<unsigned char>& out )
+		{
+			if( end - p < 2 || (p[0] & 0x0Fu) != 8u || ((p[0] << 8) | p[1]) % 31 != 0 || (p[1] & 0x20u) )
+			{
+				throw std::runtime_error( "Bad zlib header" );
+			}
+			p += 2;
+			bool final;
+			do
+			{
+				final = GetBits( 1 ) != 0u;
+				switch( GetBits( 2 ) )
+				{
+				case 0:
+					InflateStored( out );
+					break;
+				case 1:
+					BuildFixedTables();
+					InflateBlock( out );
+					break;
+				case 2:
+					ReadDynamicTables();
+					InflateBlock( out );
+					break;
+				default:
+					throw std::runtime_error( "Bad deflate block type" );
+				}
+			}
+			while( !final );
+		}
+	private:
+		static constexpr int FastBits = 9;
+		struct Huffman
+		{
+			// symbol | length << 9 for codes up to FastBits long, 0 for longer ones
+			uint16_t fast[1 << FastBits];
+			uint16_t count[16];
+			uint16_t symbols[288];
+			void Build( const unsigned char* lengths,int n )
+			{
+				std::fill( std::begin( count ),std::end( count ),uint16_t( 0 ) );
+				std::fill( std::begin( fast ),std::end( fast ),uint16_t( 0 ) );
+				for( int i = 0; i < n; i++ )
+				{
+					count[lengths[i]]++;
+				}
+				count[0] = 0u;
+				uint16_t offset[16];
+				uint16_t next[16];
+				offset[1] = 0u;
+				next[1] = 0u;
+				for( int len = 1; len < 15; len++ )
+				{
+					offset[len + 1] = offset[len] + count[len];
+					next[len + 1] = uint16_t( (next[len] + count[len]) << 1 );
+				}
+				for( int i = 0; i < n; i++ )
+				{
+					const int len = lengths[i];
+					if( len == 0 )
+					{
+						continue;
+					}
+					symbols[offset[len]++] = uint16_t( i );
+					const unsigned int code = next[len]++;
+					if( len <= FastBits )
+					{
+						// table is indexed by the next bits in stream order, i.e. the reversed code
+						unsigned int reversed = 0u;
+						for( int b = 0; b < len; b++ )
+						{
+							reversed |= ((code >> b) & 1u) << (len - 1 - b);
+						}
+						for( unsigned int j = reversed; j < (1u << FastBits); j += 1u << len )
+						{
+							fast[j] = uint16_t( i | (len << 9) );
+						}
+					}
+				}
+			}
+		};
+	private:
+		void Need( int n )
+		{
+			while( avail < n )
+			{
+				uint64_t byte = 0u;
+				if( p < end )
+				{
+					byte = *p++;
+				}
+				else if( ++pastEnd > 4 )
+				{
+					throw std::runtime_error( "Truncated deflate stream" );
+				}
+				bits |= byte << avail;
+				avail += 8;
+			}
+		}
+		uint32_t GetBits( int n )
+		{
+			Need( n );
+			const uint32_t v = uint32_t( bits & ((uint64_t( 1 ) << n) - 1u) );
+			bits >>= n;
+			avail -= n;
+			return v;
+		}
+		int Decode( const Huffman& h )
+		{
+			Need( 16 );
+			const unsigned int e = h.fast[bits & ((1u << FastBits) - 1u)];
+			if( e != 0u )
+			{
+				const int len = int( e >> 9 );
+				bits >>= len;
+				avail -= len;
+				return int( e & 511u );
+			}
+			// long code, walk the canonical code lengths one bit at a time
+			int code = 0;
+			int first = 0;
+			int index = 0;
+			for( int len = 1; len < 16; len++ )
+			{
+				code |= int( bits & 1u );
+				bits >>= 1;
+				avail--;
+				const int count = h.count[len];
+				if( code - first < count )
+				{
+					return h.symbols[index + code - first];
+				}
+				index += count;
+				first = (first + count) << 1;
+				code <<= 1;
+			}
+			throw std::runtime_error( "Bad huffman code in deflate stream" );
+		}
+		void InflateStored( std::vector<unsigned char>& out )
+		{
+			GetBits( avail & 7 );
+			const uint32_t len = GetBits( 16 );
+			const uint32_t nlen = GetBits( 16 );
+			if( (len ^ 0xFFFFu) != nlen )
+			{
+				throw std::runtime_error( "Bad stored block in deflate stream" );
+			}
+			uint32_t remaining = len;
+			// whatever is still in the bit buffer comes first
+			while( remaining > 0u && avail > 0 )
+			{
+				out.push_back( (unsigned char)GetBits( 8 ) );
+				remaining--;
+			}
+			if( size_t( end - p ) < remaining )
+			{
+				throw std::runtime_error( "Truncated deflate stream" );
+			}
+			out.insert( out.end(),p,p + remaining );
+			p += remaining;
+		}
+		void BuildFixedTables()
+		{
+			unsigned char lengths[288 + 30];
+			std::fill( lengths,lengths + 144,(unsigned char)8u );
+			std::fill( lengths + 144,lengths + 256,(unsigned char)9u );
+			std::fill( lengths + 256,lengths + 280,(unsigned char)7u );
+			std::fill( lengths + 280,lengths + 288,(unsigned char)8u );
+			std::fill( lengths + 288,lengths + 318,(unsigned char)5u );
+			literals.Build( lengths,288 );
+			distances.Build( lengths + 288,30 );
+		}
+		void ReadDynamicTables()
+		{
+			static const unsigned char order[19] = { 16,17,18,0,8,7,9,6,10,5,11,4,12,3,13,2,14,1,15 };
+			const int nLit = int( GetBits( 5 ) ) + 257;
+			const int nDist = int( GetBits( 5 ) ) + 1;
+			const int nCode = int( GetBits( 4 ) ) + 4;
+			unsigned char codeLengths[19] = {};
+			for( int i = 0; i < nCode; i++ )
+			{
+				codeLengths[order[i]] = (unsigned char)GetBits( 3 );
+			}
+			Huffman codeTable;
+			codeTable.Build( codeLengths,19 );
+
+			unsigned char lengths[288 + 32] = {};
+			int i = 0;
+			while( i < nLit + nDist )
+			{
+				const int sym = Decode( codeTable );
+				int repeat = 0;
+				unsigned char value = 0u;
+				if( sym < 16 )
+				{
+					lengths[i++] = (unsigned char)sym;
+					continue;
+				}
+				else if( sym == 16 )
+				{
+					if( i == 0 )
+					{
+						throw std::runtime_error( "Bad code lengths in deflate stream" );
+					}
+					value = lengths[i - 1];
+					repeat = 3 + int( GetBits( 2 ) );
+				}
+				else if( sym == 17 )
+				{
+					repeat = 3 + int( GetBits( 3 ) );
+				}
+				else
+				{
+					repeat = 11 + int( GetBits( 7 ) );
+				}
+				if( i + repeat > nLit + nDist )
+				{
+					throw std::runtime_error( "Bad code lengths in deflate stream" );
+				}
+				std::fill( lengths + i,lengths + i + repeat,value );
+				i += repeat;
+			}
+			literals.Build( lengths,nLit );
+			distances.Build( lengths + nLit,nDist );
+		}
+		void InflateBlock( std::vector<unsigned char>& out )
+		{
+			while( true )
+			{
+				int sym = Decode( literals );
+				if( sym < 256 )
+				{
+					out.push_back( (unsigned char)sym );
+					continue;
+				}
+				if( sym == 256 )
+				{
+					return;
+				}
+				sym -= 257;
+				if( sym >= 29 )
+				{
+					throw std::runtime_error( "Bad length code in deflate stream" );
+				}
+				const size_t length = lengthBase[sym] + GetBits( lengthExtra[sym] );
+				const int dsym = Decode( distances );
+				if( dsym >= 30 )
+				{
+					throw std::runtime_error( "Bad distance code in deflate stream" );
+				}
+				const size_t distance = distBase[dsym] + GetBits( distExtra[dsym] );
+				if( distance > out.size() )
+				{
+					throw std::runtime_error( "Bad distance in deflate stream" );
+				}
+				// byte at a time since the match may overlap what it is producing
+				size_t from = out.size() - distance;
+				for( size_t k = 0; k < length; k++ )
+				{
+					out.push_back( out[from + k] );
+				}
+			}
+		}
+	private:
+		const unsigned char* p;
+		const unsigned char* end;
+		uint64_t bits = 0u;
+		int avail = 0;
+		int pastEnd = 0;
+		Huffman literals;
+		Huffman distances;
+	};
+
+	Surface DecodePng( const unsigned char* pData,size_t size )
+	{
+		size_t pos = 8u;
+		unsigned int width = 0u;
+		unsigned int height = 0u;
+		int depth = 0;
+		int colorType = -1;
+		bool interlaced = false;
+		std::vector<unsigned char> idat;
+		unsigned char palette[256][4];
+		int paletteSize = 0;
+		bool hasKey = false;
+		unsigned int key[3] = {};
+		for( int i = 0; i < 256; i++ )
+		{
+			palette[i][0] = palette[i][1] = palette[i][2] = 0u;
+			palette[i][3] = 255u;
+		}
+		while( true )
+		{
+			if( size - pos < 12u )
+			{
+				throw std::runtime_error( "Truncated png" );
+			}
+			const uint32_t len = GetU32BE( pData + pos );
+			const unsigned char* type = pData + pos + 4u;
+			const unsigned char* chunk = pData + pos + 8u;
+			if( size - pos - 12u < len )
+			{
+				throw std::runtime_error( "Truncated png" );
+			}
+			if( std::equal( type,type + 4,"IHDR" ) )
+			{
+				if( len < 13u )
+				{
+					throw std::runtime_error( "Bad png header" );
+				}
+				width = GetU32BE( chunk );
+				height = GetU32BE( chunk + 4 );
+				depth = chunk[8];
+				colorType = chunk[9];
+				interlaced = chunk[12] != 0u;
+				const bool valid =
+					(colorType == 0 && (depth == 1 || depth == 2 || depth == 4 || depth == 8 || depth == 16)) ||
+					(colorType == 3 && (depth == 1 || depth == 2 || depth == 4 || depth == 8)) ||
+					((colorType == 2 || colorType == 4 || colorType == 6) && (depth == 8 || depth == 16));
+				if( !valid || chunk[10] != 0u || chunk[11] != 0u )
+				{
+					throw std::runtime_error( "Unsupported png format" );
+				}
+				CheckDimensions( width,height );
+			}
+			else if( std::equal( type,type + 4,"PLTE" ) )
+			{
+				paletteSize = int( std::min( len / 3u,256u ) );
+				for( int i = 0; i < paletteSize; i++ )
+				{
+					palette[i][0] = chunk[i * 3 + 0];
+					palette[i][1] = chunk[i * 3 + 1];
+					palette[i][2] = chunk[i * 3 + 2];
+				}
+			}
+			else if( std::equal( type,type + 4,"tRNS" ) )
+			{
+				if( colorType == 3 )
+				{
+					for( uint32_t i = 0; i < std::min( len,256u ); i++ )
+					{
+						palette[i][3] = chunk[i];
+					}
+				}
+				else if( colorType == 0 && len >= 2u )
+				{
+					hasKey = true;
+					key[0] = key[1] = key[2] = (chunk[0] << 8) | chunk[1];
+				}
+				else if( colorType == 2 && len >= 6u )
+				{
+					hasKey = true;
+					for( int c = 0; c < 3; c++ )
+					{
+						key[c] = (chunk[c * 2] << 8) | chunk[c * 2 + 1];
+					}
+				}
+			}
+			else if( std::equal( type,type + 4,"IDAT" ) )
+			{
+				idat.insert( idat.end(),chunk,chunk + len );
+			}
+			else if( std::equal( type,type + 4,"IEND" ) )
+			{
+				break;
+			}
+			pos += 12u + len;
+		}
+		if( colorType < 0 || idat.empty() )
+		{
+			throw std::runtime_error( "Png has no image data" );
+		}
+
+		const int channels = colorType == 2 ? 3 : colorType == 4 ? 2 : colorType == 6 ? 4 : 1;
+		const int bitsPerPixel = channels * depth;
+		// distance to the corresponding byte of the previous pixel for filtering
+		const size_t filterStride = std::max( bitsPerPixel / 8,1 );
+
+		struct Pass
+		{
+			unsigned int x0,y0,dx,dy;
+		};
+		static const Pass adam7[7] = {
+			{ 0,0,8,8 },{ 4,0,8,8 },{ 0,4,4,8 },{ 2,0,4,4 },{ 0,2,2,4 },{ 1,0,2,2 },{ 0,1,1,2 } };
+		static const Pass single = { 0,0,1,1 };
+		const Pass* passes = interlaced ? adam7 : &single;
+		const int passCount = interlaced ? 7 : 1;
+
+		size_t expected = 0u;
+		for( int i = 0; i < passCount; i++ )
+		{
+			const auto& pass = passes[i];
+			const size_t pw = (width - std::min( width,pass.x0 ) + pass.dx - 1u) / pass.dx;
+			const size_t ph = (height - std::min( height,pass.y0 ) + pass.dy - 1u) / pass.dy;
+			if( pw > 0u && ph > 0u )
+			{
+				expected += ph * ((pw * bitsPerPixel + 7u) / 8u + 1u);
+			}
+		}
+		std::vector<unsigned char> raw;
+		// deflate expands at most 1032:1, a header promising more than that is lying
+		raw.reserve( std::min( expected,idat.size() * 1032u ) );
+		Inflater( idat.data(),idat.size() ).Inflate( raw );
+		if( raw.size() < expected )
+		{
+			throw std::runtime_error( "Truncated png image data" );
+		}
+
+		Surface s = MakeSurface( width,height );
+		const int maxSample = (1 << depth) - 1;
+		unsigned char* pRaw = raw.data();
+		for( int i = 0; i < passCount; i++ )
+		{
+			const auto& pass = passes[i];
+			const unsigned int pw = (width - std::min( width,pass.x0 ) + pass.dx - 1u) / pass.dx;
+			const unsigned int ph = (height - std::min( height,pass.y0 ) + pass.dy - 1u) / pass.dy;
+			if( pw == 0u || ph == 0u )
+			{
+				continue;
+			}
+			const size_t rowBytes = (size_t( pw ) * bitsPerPixel + 7u) / 8u;
+			const unsigned char* pPrev = nullptr;
+			for( unsigned int y = 0; y < ph; y++ )
+			{
+				const unsigned char filter = pRaw[0];
+				unsigned char* row = pRaw + 1;
+				for( size_t k = 0; k < rowBytes; k++ )
+				{
+					const int a = k >= filterStride ? row[k - filterStride] : 0;
+					const int b = pPrev ? pPrev[k] : 0;
+					const int c = pPrev && k >= filterStride ? pPrev[k - filterStride] : 0;
+					switch( filter )
+					{
+					case 0: break;
+					case 1: row[k] = (unsigned char)(row[k] + a); break;
+					case 2: row[k] = (unsigned char)(row[k] + b); break;
+					case 3: row[k] = (unsigned char)(row[k] + (a + b) / 2); break;
+					case 4: row[k] = (unsigned char)(row[k] + Paeth( a,b,c )); break;
+					default: throw std::runtime_error( "Bad png filter type" );
+					}
+				}
+
+				Color* pDst = s.GetBufferPtr() + size_t( pass.y0 + y * pass.dy ) * s.GetPitch() + pass.x0;
+				const size_t dstStep = pass.dx;
+				if( depth == 8 && colorType == 6 )
+				{
+					for( unsigned int x = 0; x < pw; x++ )
+					{
+						const unsigned char* px = row + x * 4u;
+						pDst[x * dstStep] = Color( px[3],px[0],px[1],px[2] );
+					}
+				}
+				else if( depth == 8 && colorType == 2 && !hasKey )
+				{
+					for( unsigned int x = 0; x < pw; x++ )
+					{
+						const unsigned char* px = row + x * 3u;
+						pDst[x * dstStep] = Color( 255u,px[0],px[1],px[2] );
+					}
+				}
+				else
+				{
+					// generic path: fetch full precision samples, then reduce to 8 bits
+					auto sample = [row,depth]( size_t index ) -> unsigned int
+					{
+						if( depth == 8 )
+						{
+							return row[index];
+						}
+						if( depth == 16 )
+						{
+							return (row[index * 2u] << 8) | row[index * 2u + 1u];
+						}
+						const size_t bit = index * depth;
+						return (row[bit / 8u] >> (8u - depth - bit % 8u)) & ((1u << depth) - 1u);
+					};
+					auto to8 = [depth,maxSample]( unsigned int v ) -> unsigned char
+					{
+						return depth == 16 ? (unsigned char)(v >> 8) : depth == 8 ? (unsigned char)v : (unsigned char)(v * 255u / maxSample);
+					};
+					for( unsigned int x = 0; x < pw; x++ )
+					{
+						const size_t base = size_t( x ) * channels;
+						Color c;
+						switch( colorType )
+						{
+						case 0:
+						{
+							const unsigned int g = sample( base );
+							const unsigned char g8 = to8( g );
+							c = Color( (hasKey && g == key[0]) ? 0u : 255u,g8,g8,g8 );
+							break;
+						}
+						case 2:
+						{
+							const unsigned int r = sample( base );
+							const unsigned int g = sample( base + 1u );
+							const unsigned int b = sample( base + 2u );
+							const bool keyed = hasKey && r == key[0] && g == key[1] && b == key[2];
+							c = Color( keyed ? 0u : 255u,to8( r ),to8( g ),to8( b ) );
+							break;
+						}
+						case 3:
+						{
+							const auto& e = palette[sample( base )];
+							c = Color( e[3],e[0],e[1],e[2] );
+							break;
+						}
+						case 4:
+						{
+							const unsigned char g8 = to8( sample( base ) );
+							c = Color( to8( sample( base + 1u ) ),g8,g8,g8 );
+							break;
+						}
+						default:
+							c = Color( to8( sample( base + 3u ) ),to8( sample( base ) ),to8( sample( base + 1u ) ),to8( sample( base + 2u ) ) );
+							break;
+						}
+						pDst[x * dstStep] = c;
+					}
+				}
+				pPrev = row;
+				pRaw += rowBytes + 1u;
+			}
+		}
+		return s;
+	}
+
+	// baseline and progressive huffman jpeg, 1 or 3 components, any sampling factors
+	class JpegDecoder
+	{
+	public:
+		JpegDecoder( const unsigned char* pData,size_t size )
+			:
+			pData( pData ),
+			size( size )
+		{}
+		Surface Decode()
+		{
+			size_t pos = 2u;
+			bool done = false;
+			while( !done && pos + 1u < size )
+			{
+				if( pData[pos] != 0xFFu )
+				{
+					pos++;
+					continue;
+				}
+				const unsigned char marker = pData[pos + 1u];
+				pos += 2u;
+				// fill bytes, stuffed zeros and restart markers carry no segment
+				if( marker == 0xFFu )
+				{
+					pos--;
+					continue;
+				}
+				if( marker == 0x00u || marker == 0x01u || (marker >= 0xD0u && marker <= 0xD7u) )
+				{
+					continue;
+				}
+				if( marker == 0xD9u )
+				{
+					break;
+				}
+				if( pos + 2u > size )
+				{
+					break;
+				}
+				const size_t len = (pData[pos] << 8) | pData[pos + 1u];
+				if( len < 2u || pos + len > size )
+				{
+					throw std::runtime_error( "Truncated jpeg segment" );
+				}
+				const unsigned char* seg = pData + pos + 2u;
+				const size_t segLen = len - 2u;
+				switch( marker )
+				{
+				case 0xDBu:
+					ReadQuantTables( seg,segLen );
+					break;
+				case 0xC4u:
+					ReadHuffmanTables( seg,segLen );
+					break;
+				case 0xC0u:
+				case 0xC1u:
+				case 0xC2u:
+					ReadFrame( seg,segLen,marker == 0xC2u );
+					break;
+				case 0xDDu:
+					restartInterval = (seg[0] << 8) | seg[1];
+					break;
+				case 0xEEu:
+					// adobe transform flag 0 means the 3 channels are plain rgb
+					if( segLen >= 12u && std::equal( seg,seg + 5,"Adobe" ) )
+					{
+						adobeRgb = seg[11] == 0u;
+					}
+					break;
+				case 0xDAu:
+					pos = ReadScan( seg,segLen,pos + len );
+					continue;
+				default:
+					if( (marker >= 0xC3u && marker <= 0xCFu) )
+					{
+						throw std::runtime_error( "Unsupported jpeg coding (lossless or arithmetic)" );
+					}
+					break;
+				}
+				pos += len;
+			}
+			if( components.empty() )
+			{
+				throw std::runtime_error( "Jpeg has no frame" );
+			}
+			return Output();
+		}
+	private:
+		struct Huffman
+		{
+			// symbol | length << 8 for codes up to FastBits long
+			uint16_t fast[1 << 9];
+			unsigned char symbols[256];
+			// exclusive upper bound of left justified 16 bit codes of each length
+			int32_t maxCode[18];
+			int valOffset[17];
+			void Build( const unsigned char* counts,const unsigned char* syms,int total )
+			{
+				std::fill( std::begin( fast ),std::end( fast ),uint16_t( 0 ) );
+				std::copy( syms,syms + total,symbols );
+				int code = 0;
+				int k = 0;
+				for( int len = 1; len <= 16; len++ )
+				{
+					valOffset[len] = k - code;
+					for( int i = 0; i < counts[len - 1]; i++ )
+					{
+						if( len <= 9 )
+						{
+							const int shift = 9 - len;
+							for( int j = 0; j < (1 << shift); j++ )
+							{
+								fast[(code << shift) | j] = uint16_t( symbols[k] | (len << 8) );
+							}
+						}
+						code++;
+						k++;
+					}
+					maxCode[len] = code << (16 - len);
+					code <<= 1;
+				}
+				maxCode[17] = 0x7FFFFFFF;
+			}
+		};
+		struct Component
+		{
+			int id;
+			int h;
+			int v;
+			int tq;
+			int dcTable = 0;
+			int acTable = 0;
+			int blocksPerLine;
+			int blocksPerColumn;
+			int dcPred = 0;
+			std::vector<short> coeffs;
+			std::vector<unsigned char> pixels;
+		};
+	private:
+		void ReadQuantTables( const unsigned char* seg,size_t len )
+		{
+			size_t i = 0u;
+			while( i < len )
+			{
+				const int precision = seg[i] >> 4;
+				const int id = seg[i] & 3;
+				i++;
+				for( int k = 0; k < 64; k++ )
+				{
+					quant[id][zigzag[k]] = precision ? uint16_t( (seg[i + k * 2] << 8) | seg[i + k * 2 + 1] ) : seg[i + k];
+				}
+				i += precision ? 128u : 64u;
+			}
+		}
+		void ReadHuffmanTables( const unsigned char* seg,size_t len )
+		{
+			size_t i = 0u;
+			while( i + 17u <= len )
+			{
+				const int cls = seg[i] >> 4;
+				const int id = seg[i] & 3;
+				const unsigned char* counts = seg + i + 1u;
+				int total = 0;
+				for( int k = 0; k < 16; k++ )
+				{
+					total += counts[k];
+				}
+				if( cls > 1 || total > 256 || i + 17u + total > len )
+				{
+					throw std::runtime_error( "Bad jpeg huffman table" );
+				}
+				// more codes of a length than fit in it would overrun the lookup tables
+				int codes = 0;
+				for( int k = 0; k < 16; k++ )
+				{
+					codes = (codes << 1) + counts[k];
+					if( codes > (1 << (k + 1)) )
+					{
+						throw std::runtime_error( "Bad jpeg huffman table" );
+					}
+				}
+				// symbols are bit counts read with GetBits: dc difference sizes, ac run | size
+				for( int k = 0; k < total; k++ )
+				{
+					const int sym = seg[i + 17u + k];
+					if( cls == 0 ? sym > 16 : (sym & 15) > 11 )
+					{
+						throw std::runtime_error( "Bad jpeg huffman symbol" );
+					}
+				}
+				(cls == 0 ? dcTables : acTables)[id].Build( counts,seg + i + 17u,total );
+				i += 17u + total;
+			}
+		}
+		void ReadFrame( const unsigned char* seg,size_t len,bool isProgressive )
+		{
+			if( len < 6u || seg[0] != 8u )
+			{
+				throw std::runtime_error( "Unsupported jpeg precision" );
+			}
+			progressive = isProgressive;
+			height = (seg[1] << 8) | seg[2];
+			width = (seg[3] << 8) | seg[4];
+			const int count = seg[5];
+			if( (count != 1 && count != 3) || len < 6u + count * 3u )
+			{
+				throw std::runtime_error( "Unsupported jpeg component count" );
+			}
+			CheckDimensions( (unsigned int)width,(unsigned int)height );
+			components.resize( count );
+			for( int i = 0; i < count; i++ )
+			{
+				auto& c = components[i];
+				c.id = seg[6 + i * 3];
+				c.h = seg[7 + i * 3] >> 4;
+				c.v = seg[7 + i * 3] & 15;
+				c.tq = seg[8 + i * 3] & 3;
+				if( c.h < 1 || c.h > 4 || c.v < 1 || c.v > 4 )
+				{
+					throw std::runtime_error( "Bad jpeg sampling factors" );
+				}
+				hMax = std::max( hMax,c.h );
+				vMax = std::max( vMax,c.v );
+			}
+			mcusX = (width + 8 * hMax - 1) / (8 * hMax);
+			mcusY = (height + 8 * vMax - 1) / (8 * vMax);
+			for( auto& c : components )
+			{
+				c.blocksPerLine = mcusX * c.h;
+				c.blocksPerColumn = mcusY * c.v;
+				c.coeffs.assign( size_t( c.blocksPerLine ) * c.blocksPerColumn * 64u,short( 0 ) );
+			}
+		}
+		// returns the position right after the entropy coded data
+		size_t ReadScan( const unsigned char* seg,size_t len,size_t dataPos )
+		{
+			if( components.empty() )
+			{
+				throw std::runtime_error( "Jpeg scan before frame" );
+			}
+			const int count = seg[0];
+			if( count < 1 || count > int( components.size() ) || len < 4u + count * 2u )
+			{
+				throw std::runtime_error( "Bad jpeg scan header" );
+			}
+			std::vector<Component*> scan;
+			for( int i = 0; i < count; i++ )
+			{
+				const int id = seg[1 + i * 2];
+				auto it = std::find_if( components.begin(),components.end(),[id]( const Component& c ) { return c.id == id; } );
+				if( it == components.end() )
+				{
+					throw std::runtime_error( "Bad jpeg scan component" );
+				}
+				it->dcTable = seg[2 + i * 2] >> 4 & 3;
+				it->acTable = seg[2 + i * 2] & 3;
+				scan.push_back( &*it );
+			}
+			const unsigned char* params = seg + 1 + count * 2;
+			ss = params[0];
+			se = progressive ? params[1] : 63;
+			ah = params[2] >> 4;
+			al = params[2] & 15;
+			if( ss > se || se > 63 )
+			{
+				throw std::runtime_error( "Bad jpeg spectral selection" );
+			}
+
+			p = pData + dataPos;
+			ResetBits();
+			eobRun = 0;
+			for( auto& c : components )
+			{
+				c.dcPred = 0;
+			}
+			int unit = 0;
+			auto restart = [&]()
+			{
+				if( restartInterval != 0 && unit != 0 && unit % restartInterval == 0 )
+				{
+					// skip to and over the rst marker
+					while( p + 1 < pData + size && !(p[0] == 0xFFu && p[1] >= 0xD0u && p[1] <= 0xD7u) )
+					{
+						p++;
+					}
+					p = std::min( p + 2,pData + size );
+					ResetBits();
+					eobRun = 0;
+					for( auto& c : components )
+					{
+						c.dcPred = 0;
+					}
+				}
+				unit++;
+			};
+			if( count == 1 )
+			{
+				// non-interleaved scans cover only the blocks inside the component's image area
+				auto& c = *scan[0];
+				const int compWidth = (width * c.h + hMax - 1) / hMax;
+				const int compHeight = (height * c.v + vMax - 1) / vMax;
+				const int bw = (compWidth + 7) / 8;
+				const int bh = (compHeight + 7) / 8;
+				for( int by = 0; by < bh; by++ )
+				{
+					for( int bx = 0; bx < bw; bx++ )
+					{
+						restart();
+						DecodeBlock( c,&c.coeffs[(size_t( by ) * c.blocksPerLine + bx) * 64u] );
+					}
+				}
+			}
+			else
+			{
+				for( int my = 0; my < mcusY; my++ )
+				{
+					for( int mx = 0; mx < mcusX; mx++ )
+					{
+						restart();
+						for( auto pc : scan )
+						{
+							auto& c = *pc;
+							for( int v = 0; v < c.v; v++ )
+							{
+								for( int h = 0; h < c.h; h++ )
+								{
+									const size_t block = size_t( my * c.v + v ) * c.blocksPerLine + mx * c.h + h;
+									DecodeBlock( c,&c.coeffs[block * 64u] );
+								}
+							}
+						}
+					}
+				}
+			}
+			return size_t( p - pData );
+		}
+		void DecodeBlock( Component& c,short* blk )
+		{
+			if( ss == 0 )
+			{
+				if( ah == 0 )
+				{
+					const int t = DecodeHuffman( dcTables[c.dcTable] );
+					const int diff = t ? Extend( GetBits( t ),t ) : 0;
+					c.dcPred += diff;
+					blk[0] = short( c.dcPred * (1 << al) );
+				}
+				else if( GetBits( 1 ) )
+				{
+					blk[0] = short( blk[0] | (1 << al) );
+				}
+			}
+			if( se == 0 )
+			{
+				return;
+			}
+			const auto& ac = acTables[c.acTable];
+			int k = std::max( ss,1 );
+			if( ah == 0 )
+			{
+				if( eobRun > 0 )
+				{
+					eobRun--;
+					return;
+				}
+				while( k <= se )
+				{
+					const int rs = DecodeHuffman( ac );
+					const int r = rs >> 4;
+					const int s = rs & 15;
+					if( s == 0 )
+					{
+						if( r < 15 )
+						{
+							eobRun = (1 << r) - 1;
+							if( r )
+							{
+								eobRun += int( GetBits( r ) );
+							}
+							break;
+						}
+						k += 16;
+						continue;
+					}
+					k += r;
+					if( k > 63 )
+					{
+						throw std::runtime_error( "Bad jpeg ac coefficient" );
+					}
+					blk[zigzag[k]] = short( Extend( GetBits( s ),s ) * (1 << al) );
+					k++;
+				}
+				return;
+			}
+			// successive approximation refinement (libjpeg decode_mcu_AC_refine)
+			const int p1 = 1 << al;
+			const int m1 = -p1;
+			auto refine = [this,p1,m1]( short& coef )
+			{
+				if( GetBits( 1 ) && (coef & p1) == 0 )
+				{
+					coef = short( coef + (coef >= 0 ? p1 : m1) );
+				}
+			};
+			if( eobRun <= 0 )
+			{
+				for( ; k <= se; k++ )
+				{
+					const int rs = DecodeHuffman( ac );
+					int r = rs >> 4;
+					int s = rs & 15;
+					int value = 0;
+					if( s )
+					{
+						if( s != 1 )
+						{
+							throw std::runtime_error( "Bad jpeg refinement" );
+						}
+						value = GetBits( 1 ) ? p1 : m1;
+					}
+					else if( r != 15 )
+					{
+						eobRun = 1 << r;
+						if( r )
+						{
+							eobRun += int( GetBits( r ) );
+						}
+						break;
+					}
+					while( k <= se )
+					{
+						short& coef = blk[zigzag[k]];
+						if( coef != 0 )
+						{
+							refine( coef );
+						}
+						else if( --r < 0 )
+						{
+							break;
+						}
+						k++;
+					}
+					if( value && k <= 63 )
+					{
+						blk[zigzag[k]] = short( value );
+					}
+				}
+			}
+			if( eobRun > 0 )
+			{
+				for( ; k <= se; k++ )
+				{
+					short& coef = blk[zigzag[k]];
+					if( coef != 0 )
+					{
+						refine( coef );
+					}
+				}
+				eobRun--;
+			}
+		}
+		// entropy coded bits, msb first, with 0xFF00 unstuffing; zeros once a marker is reached
+		void ResetBits()
+		{
+			bits = 0u;
+			bitCount = 0;
+			hitMarker = false;
+		}
+		void FillBits()
+		{
+			const unsigned char* end = pData + size;
+			while( bitCount <= 24 )
+			{
+				uint32_t byte = 0u;
+				if( !hitMarker && p < end )
+				{
+					byte = *p;
+					if( byte == 0xFFu )
+					{
+						const unsigned char next = p + 1 < end ? p[1] : 0xD9u;
+						if( next == 0x00u )
+						{
+							p += 2;
+						}
+						else
+						{
+							hitMarker = true;
+							byte = 0u;
+						}
+					}
+					else
+					{
+						p++;
+					}
+				}
+				bits |= byte << (24 - bitCount);
+				bitCount += 8;
+			}
+		}
+		uint32_t GetBits( int n )
+		{
+			FillBits();
+			const uint32_t v = bits >> (32 - n);
+			bits <<= n;
+			bitCount -= n;
+			return v;
+		}
+		static int Extend( uint32_t v,int s )
+		{
+			return v < (1u << (s - 1)) ? int( v ) - (1 << s) + 1 : int( v );
+		}
+		int DecodeHuffman( const Huffman& h )
+		{
+			FillBits();
+			const unsigned int e = h.fast[bits >> (32 - 9)];
+			if( e != 0u )
+			{
+				const int len = int( e >> 8 );
+				bits <<= len;
+				bitCount -= len;
+				return int( e & 255u );
+			}
+			const int code = int( bits >> 16 );
+			for( int len = 10; len <= 16; len++ )
+			{
+				if( code < h.maxCode[len] )
+				{
+					const int index = (code >> (16 - len)) + h.valOffset[len];
+					bits <<= len;
+					bitCount -= len;
+					return h.symbols[index & 255];
+				}
+			}
+			throw std::runtime_error( "Bad jpeg huffman code" );
+		}
+		// dequantize and inverse dct every block of every component into its sample plane
+		void ReconstructComponent( Component& c )
+		{
+			static const auto table = []()
+			{
+				std::array<float,64> t;
+				for( int x = 0; x < 8; x++ )
+				{
+					for( int u = 0; u < 8; u++ )
+					{
+						const float cu = u == 0 ? 0.70710678f : 1.0f;
+						t[x * 8 + u] = 0.5f * cu * std::cos( (2.0f * x + 1.0f) * u * 3.14159265f / 16.0f );
+					}
+				}
+				return t;
+			}();
+			const int stride = c.blocksPerLine * 8;
+			c.pixels.resize( size_t( stride ) * c.blocksPerColumn * 8 );
+			const uint16_t* q = quant[c.tq];
+			for( int by = 0; by < c.blocksPerColumn; by++ )
+			{
+				for( int bx = 0; bx < c.blocksPerLine; bx++ )
+				{
+					const short* blk = &c.coeffs[(size_t( by ) * c.blocksPerLine + bx) * 64u];
+					float rows[64];
+					for( int v = 0; v < 8; v++ )
+					{
+						const short* in = blk + v * 8;
+						float* out = rows + v * 8;
+						bool zero = true;
+						for( int u = 1; u < 8; u++ )
+						{
+							zero = zero && in[u] == 0;
+						}
+						if( zero )
+						{
+							// only dc in this row, flat output
+							const float dc = in[0] * q[v * 8] * table[0];
+							std::fill( out,out + 8,dc );
+							continue;
+						}
+						for( int x = 0; x < 8; x++ )
+						{
+							float sum = 0.0f;
+							for( int u = 0; u < 8; u++ )
+							{
+								sum += in[u] * q[v * 8 + u] * table[x * 8 + u];
+							}
+							out[x] = sum;
+						}
+					}
+					unsigned char* pDst = &c.pixels[size_t( by * 8 ) * stride + bx * 8];
+					for( int y = 0; y < 8; y++ )
+					{
+						for( int x = 0; x < 8; x++ )
+						{
+							float sum = 128.5f;
+							for( int v = 0; v < 8; v++ )
+							{
+								sum += rows[v * 8 + x] * table[y * 8 + v];
+							}
+							pDst[y * stride + x] = (unsigned char)std::min( std::max( sum,0.0f ),255.0f );
+						}
+					}
+				}
+			}
+		}
+		Surface Output()
+		{
+			for( auto& c : components )
+			{
+				ReconstructComponent( c );
+			}
+			Surface s = MakeSurface( (unsigned int)width,(unsigned int)height );
+			// map each output column to the sample column of every component once
+			std::vector<int> columns( size_t( width ) * components.size() );
+			for( size_t i = 0; i < components.size(); i++ )
+			{
+				for( int x = 0; x < width; x++ )
+				{
+					columns[i * width + x] = x * components[i].h / hMax;
+				}
+			}
+			for( int y = 0; y < height; y++ )
+			{
+				Color* pDst = s.GetBufferPtr() + size_t( y ) * s.GetPitch();
+				if( components.size() == 1u )
+				{
+					const auto& c = components[0];
+					const unsigned char* pRow = &c.pixels[size_t( y * c.v / vMax ) * c.blocksPerLine * 8];
+					for( int x = 0; x < width; x++ )
+					{
+						const unsigned char g = pRow[columns[x]];
+						pDst[x] = Color( 255u,g,g,g );
+					}
+					continue;
+				}
+				const unsigned char* pRows[3];
+				for( int i = 0; i < 3; i++ )
+				{
+					const auto& c = components[i];
+					pRows[i] = &c.pixels[size_t( y * c.v / vMax ) * c.blocksPerLine * 8];
+				}
+				const int* pCol0 = &columns[0];
+				const int* pCol1 = &columns[width];
+				const int* pCol2 = &columns[size_t( width ) * 2u];
+				for( int x = 0; x < width; x++ )
+				{
+					const int c0 = pRows[0][pCol0[x]];
+					const int c1 = pRows[1][pCol1[x]];
+					const int c2 = pRows[2][pCol2[x]];
+					if( adobeRgb )
+					{
+						pDst[x] = Color( 255u,(unsigned char)c0,(unsigned char)c1,(unsigned char)c2 );
+						continue;
+					}
+					// jfif ycbcr to rgb in 16.16 fixed point
+					const int cb = c1 - 128;
+					const int cr = c2 - 128;
+					const int r = c0 + ((91881 * cr + 32768) >> 16);
+					const int g = c0 - ((22554 * cb + 46802 * cr - 32768) >> 16);
+					const int b = c0 + ((116130 * cb + 32768) >> 16);
+					pDst[x] = Color( 255u,
+						(unsigned char)std::min( std::max( r,0 ),255 ),
+						(unsigned char)std::min( std::max( g,0 ),255 ),
+						(unsigned char)std::min( std::max( b,0 ),255 ) );
+				}
+			}
+			return s;
+		}
+	private:
+		static const unsigned char zigzag[64];
+		const unsigned char* pData;
+		size_t size;
+		uint16_t quant[4][64] = {};
+		Huffman dcTables[4];
+		Huffman acTables[4];
+		std::vector<Component> components;
+		int width = 0;
+		int height = 0;
+		int hMax = 1;
+		int vMax = 1;
+		int mcusX = 0;
+		int mcusY = 0;
+		bool progressive = false;
+		bool adobeRgb = false;
+		int restartInterval = 0;
+		// current scan
+		int ss = 0;
+		int se = 63;
+		int ah = 0;
+		int al = 0;
+		int eobRun = 0;
+		const unsigned char* p = nullptr;
+		uint32_t bits = 0u;
+		int bitCount = 0;
+		bool hitMarker = false;
+	};
+
+	// zigzag scan position -> natural (row major) coefficient index
+	const unsigned char JpegDecoder::zigzag[64] = {
+		0,1,8,16,9,2,3,10,17,24,32,25,18,11,4,5,12,19,26,33,40,48,41,34,27,20,13,6,7,14,21,28,
+		35,42,49,56,57,50,43,36,29,22,15,23,30,37,44,51,58,59,52,45,38,31,39,46,53,60,61,54,47,55,62,63 };
+
+	Surface DecodeQoi( const unsigned char* pData,size_t size )
+	{
+		if( size < 22u )
+		{
+			throw std::runtime_error( "Truncated qoi" );
+		}
+		const unsigned int width = GetU32BE( pData + 4 );
+		const unsigned int height = GetU32BE( pData + 8 );
+		Surface s = MakeSurface( width,height );
+
+		struct Px
+		{
+			unsigned char r,g,b,a;
+		};
+		std::array<Px,64> index = {};
+		Px px = { 0u,0u,0u,255u };
+		const unsigned char* p = pData + 14;
+		// the 8 byte end marker is never part of a chunk
+		const unsigned char* end = pData + size - 8u;
+		unsigned int run = 0u;
+		for( unsigned int y = 0; y < height; y++ )
+		{
+			Color* pDst = s.GetBufferPtr() + size_t( y ) * s.GetPitch();
+			for( unsigned int x = 0; x < width; x++ )
+			{
+				if( run > 0u )
+				{
+					run--;
+				}
+				else if( p < end )
+				{
+					const unsigned char b = *p++;
+					if( b == 0xFEu && end - p >= 3 )
+					{
+						px.r = p[0];
+						px.g = p[1];
+						px.b = p[2];
+						p += 3;
+					}
+					else if( b == 0xFFu && end - p >= 4 )
+					{
+						px = { p[0],p[1],p[2],p[3] };
+						p += 4;
+					}
+					else if( (b >> 6) == 0u )
+					{
+						px = index[b];
+					}
+					else if( (b >> 6) == 1u )
+					{
+						px.r = (unsigned char)(px.r + ((b >> 4) & 3) - 2);
+						px.g = (unsigned char)(px.g + ((b >> 2) & 3) - 2);
+						px.b = (unsigned char)(px.b + (b & 3) - 2);
+					}
+					else if( (b >> 6) == 2u && p < end )
+					{
+						const int dg = (b & 63) - 32;
+						const unsigned char b2 = *p++;
+						px.r = (unsigned char)(px.r + dg - 8 + (b2 >> 4));
+						px.g = (unsigned char)(px.g + dg);
+						px.b = (unsigned char)(px.b + dg - 8 + (b2 & 15));
+					}
+					else
+					{
+						run = b & 63u;
+					}
+					index[(px.r * 3u + px.g * 5u + px.b * 7u + px.a * 11u) % 64u] = px;
+				}
+				pDst[x] = Color( px.a,px.r,px.g,px.b );
+			}
+		}
+		return s;
+	}
+
+	// uncompressed 24/32 bit bmp, the format Surface::Save writes
+	Surface DecodeBmp( const unsigned char* pData,size_t size )
+	{
+		if( size < 54u )
+		{
+			throw std::runtime_error( "Truncated bmp" );
+		}
+		const uint32_t dataOffset = GetU32LE( pData + 10 );
+		const int32_t w = int32_t( GetU32LE( pData + 18 ) );
+		const int32_t h = int32_t( GetU32LE( pData + 22 ) );
+		const int bpp = pData[28] | (pData[29] << 8);
+		const uint32_t compression = GetU32LE( pData + 30 );
+		// BI_RGB, or BI_BITFIELDS with the standard masks for 32 bit
+		if( (bpp != 24 && bpp != 32) || (compression != 0u && compression != 3u) || w <= 0 || h == 0 )
+		{
+			throw std::runtime_error( "Unsupported bmp format" );
+		}
+		const unsigned int width = (unsigned int)w;
+		const unsigned int height = (unsigned int)(h < 0 ? -h : h);
+		const size_t rowBytes = (size_t( width ) * bpp / 8u + 3u) & ~size_t( 3 );
+		if( dataOffset > size || size - dataOffset < rowBytes * height )
+		{
+			throw std::runtime_error( "Truncated bmp" );
+		}
+		Surface s = MakeSurface( width,height );
+		for( unsigned int y = 0; y < height; y++ )
+		{
+			// positive height means bottom-up rows
+			const unsigned int srcY = h > 0 ? height - 1u - y : y;
+			const unsigned char* pSrc = pData + dataOffset + rowBytes * srcY;
+			Color* pDst = s.GetBufferPtr() + size_t( y ) * s.GetPitch();
+			for( unsigned int x = 0; x < width; x++ )
+			{
+				const unsigned char* px = pSrc + x * (bpp / 8u);
+				pDst[x] = Color( bpp == 32 ? px[3] : 255u,px[2],px[1],px[0] );
+			}
+		}
+		return s;
+	}
+}
+
+Surface ImageCodec::Decode( const unsigned char* pData,size_t size )
+{
+	static const unsigned char pngSignature[8] = { 0x89,'P','N','G','\r','\n',0x1A,'\n' };
+	if( size >= 8u && std::equal( pngSignature,pngSignature + 8,pData ) )
+	{
+		return DecodePng( pData,size );
+	}
+	if( size >= 3u && pData[0] == 0xFFu && pData[1] == 0xD8u && pData[2] == 0xFFu )
+	{
+		return JpegDecoder( pData,size ).Decode();
+	}
+	if( size >= 4u && std::equal( pData,pData + 4,"qoif" ) )
+	{
+		return DecodeQoi( pData,size );
+	}
+	if( size >= 2u && pData[0] == 'B' && pData[1] == 'M' )
+	{
+		return DecodeBmp( pData,size );
+	}
+	throw std::runtime_error( "Unrecognized image format" );
+}
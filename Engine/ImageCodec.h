@@ -0,0 +1,25 @@
+#pragma once
+#include "Surface.h"
+#include <vector>
+#include <string>
+
+// standalone image codecs that don't go through gdi+, so they run on any thread and platform
+class ImageCodec
+{
+public:
+	// png (any bit depth/color type, interlaced or not), jpeg (baseline and progressive),
+	// qoi or uncompressed bmp, picked by signature; rows are padded to Surface::RowAlignment
+	// alpha (255 where the format has none) goes into the x channel like gdi+ did
+	// throws std::runtime_error for unsupported or broken data
+	static Surface Decode( const unsigned char* pData,size_t size );
+	// the encoders write the rgb channels only (the x channel of Color is not real alpha)
+	// png with a single fixed-huffman deflate block and per-row adaptive filtering
+	// fast rather than small, but still well below raw size for rendered frames
+	static std::vector<unsigned char> EncodePng( const Surface& s );
+	// qoi (https://qoiformat.org), much faster than png at a similar size
+	static std::vector<unsigned char> EncodeQoi( const Surface& s );
+	// yuv4mpeg2 stream header for frames of the given size, 4:2:0 full range (C420jpeg)
+	static std::string GetY4mHeader( unsigned int width,unsigned int height,unsigned int fps );
+	// one y4m frame (FRAME marker + planar yuv 4:2:0), append after the header
+	static std::vector<unsigned char> EncodeY4mFrame( const Surface& s );
+};
@@ -1,8 +1,11 @@
 #pragma once
 #include <vector>
 #include "Vec3.h"
-#include "tiny_obj_loader.h"
+#include "ObjParser.h"
+#include "VertexAttributes.h"
 #include "Miniball.h"
+#include "BoundingSphere.h"
+#include "Meshlet.h"
 #include <fstream>
 #include <sstream>
 
@@ -23,90 +26,84 @@ public:
 		assert(indices.size() % 3 == 0);
 		
 	}
+	// positions (and texcoords if T has a t member) from an obj file, all shapes merged
 	static IndexedTriangleList<T> Load(const std::string& filename)
 	{
-		IndexedTriangleList<T> tl;
+		ObjParser::Options options;
+		options.normals = false;
+		// texcoords split vertices at uv seams, only worth it if T keeps them
+		options.texcoords = VertexAttributes::HasTexcoord<T>();
+		// the list has nowhere to keep them
+		options.materials = false;
+		return FromObj(filename, ObjParser::Load(filename, options));
+	}
 
-		// check first line of file to see if CCW winding comment exists
-		bool isCCW = false;
+	// same as Load plus the vertex normals, vertices are split where a position has several normals
+	static IndexedTriangleList<T> LoadNormals(const std::string& filename)
+	{
+		ObjParser::Options options;
+		options.texcoords = VertexAttributes::HasTexcoord<T>();
+		options.materials = false;
+		auto mesh = ObjParser::Load(filename, options);
+		if (mesh.normals.empty())
 		{
-			std::ifstream file(filename);
-			std::string firstline;
-			std::getline(file, firstline);
-			std::transform(firstline.begin(), firstline.end(), firstline.begin(), std::tolower);
-			if (firstline.find("ccw") != std::string::npos)
-			{
-				isCCW = true;
-			}
+			throw std::runtime_error(("LoadNormals object file has no normals  File:" + filename).c_str());
 		}
+		return FromObj(filename, std::move(mesh));
+	}
 
-		// these will be filled by obj loading function
-		using namespace tinyobj;
-		attrib_t attrib;
-		std::vector<shape_t> shapes;
-		std::string err;
-
-		// load/parse the obj file
-		const bool ret = LoadObj(&attrib, &shapes, nullptr, &err, filename.c_str());
-
-		// check for errors
-		if (!err.empty() && err.substr(0, 4) != "WARN")
-		{
-			throw std::runtime_error(("LoadObj returned error:" + err + " File:" + filename).c_str());
-		}
-		if (!ret)
-		{
-			throw std::runtime_error(("LoadObj returned false  File:" + filename).c_str());
-		}
-		if (shapes.size() == 0u)
+	void AdjustToTrueCenter()
+	{
+		// solve the minimum bounding sphere
+		const auto bs = SolveBoundingSphere();
+		// adjust all vertices so that center of minimal sphere is at 0,0
+		for (auto& v : vertices)
 		{
-			throw std::runtime_error(("LoadObj object file had no shapes  File:" + filename).c_str());
+			v.pos -= bs.center;
 		}
-
-		// extract vertex data
-		tl.vertices.reserve(attrib.vertices.size() / 3u);
-		for (int i = 0; i < attrib.vertices.size(); i += 3)
+		bounds = { Vec3{ 0.0f,0.0f,0.0f },bs.radius };
+		boundsValid = true;
+	}
+	// minimal bounding sphere of the vertex positions
+	// solved once and cached, call InvalidateBounds after moving vertices
+	const BoundingSphere& GetBoundingSphere()
+	{
+		if (!boundsValid)
 		{
-			tl.vertices.emplace_back(Vec3{
-				attrib.vertices[i + 0],
-				attrib.vertices[i + 1],
-				attrib.vertices[i + 2]
-				});
+			bounds = SolveBoundingSphere();
+			boundsValid = true;
 		}
-
-		// extract index data
-		const auto& mesh = shapes[0].mesh;
-		tl.indices.reserve(mesh.indices.size());
-		for (size_t f = 0; f < mesh.num_face_vertices.size(); f++)
-		{
-			
-			if (mesh.num_face_vertices[f] != 3u)
-			{
-				std::stringstream ss;
-				ss << "LoadObj error face #" << f << " has "
-					<< mesh.num_face_vertices[f] << " vertices";
-				throw std::runtime_error(ss.str().c_str());
-			}
-			
-			for (size_t vn = 0; vn < 3u; vn++)
-			{
-				const auto idx = mesh.indices[f * 3u + vn];
-				tl.indices.push_back(size_t(idx.vertex_index));
-			}
-
-			// reverse winding if file marked as CCW
-			if (isCCW)
+		return bounds;
+	}
+	void InvalidateBounds()
+	{
+		boundsValid = false;
+	}
+	// partition into meshlets so the pipeline can cull whole clusters before vertex shading
+	// meshlet bounds are in model space, build after AdjustToTrueCenter
+	void BuildMeshlets(size_t maxVertices = Meshlets::DefaultMaxVertices, size_t maxTriangles = Meshlets::DefaultMaxTriangles)
+	{
+		meshlets = Meshlets::Build(vertices, indices, maxVertices, maxTriangles);
+	}
+	float GetRadius() const
+	{
+		return std::max_element(vertices.begin(), vertices.end(),
+			[](const T& v0, const T& v1)
 			{
-				std::swap(tl.indices.back(), *std::prev(tl.indices.end(), 2));
+				return v0.pos.LenSq() < v1.pos.LenSq();
 			}
-		}
-
-		return tl;
+		)->pos.Len();
 	}
-
-	static IndexedTriangleList<T> LoadNormals(const std::string& filename)
+	std::vector<T> vertices;
+	std::vector<size_t> indices;
+	Meshlets meshlets;
+private:
+	static IndexedTriangleList<T> FromObj(const std::string& filename, ObjParser::Mesh mesh)
 	{
-		IndexedTriangleList<T> tl;
+		if (mesh.indices.empty())
+		{
+			throw std::runtime_error(("LoadObj object file had no faces  File:" + filename).c_str());
+		}
 
 		// check first line of file to see if CCW winding comment exists
 		bool isCCW = false;
@@ -121,87 +118,33 @@ public:
 			}
 		}
 
-		// these will be filled by obj loading function
-		using namespace tinyobj;
-		attrib_t attrib;
-		std::vector<shape_t> shapes;
-		std::string err;
-
-		// load/parse the obj file
-		const bool ret = LoadObj(&attrib, &shapes, nullptr, &err, filename.c_str());
-
-		// check for errors
-		if (!err.empty() && err.substr(0, 4) != "WARN")
-		{
-			throw std::runtime_error(("LoadObj returned error:" + err + " File:" + filename).c_str());
-		}
-		if (!ret)
-		{
-			throw std::runtime_error(("LoadObj returned false  File:" + filename).c_str());
-		}
-		if (shapes.size() == 0u)
-		{
-			throw std::runtime_error(("LoadObj object file had no shapes  File:" + filename).c_str());
-		}
-
-		// extract vertex data
-		// attrib.vertices is a flat std::vector of floats corresponding
-		// to vertex positions, laid out as xyzxyzxyz... etc.
-		// first preallocate required space in OUR std::vector
-		tl.vertices.reserve(attrib.vertices.size() / 3u);
-		// iterate over individual vertices, construct Vec3s in OUR vector
-		for (int i = 0; i < attrib.vertices.size(); i += 3)
-		{
-			tl.vertices.emplace_back(Vec3{
-				attrib.vertices[i + 0],
-				attrib.vertices[i + 1],
-				attrib.vertices[i + 2]
-				});
-		}
-
-		// extract index data
-		// obj file can contain multiple meshes, we assume just 1
-		const auto& mesh = shapes[0].mesh;
-		// mesh contains a std::vector of num_face_vertices (uchar)
-		// and a flat std::vector of indices. If all faces are triangles
-		// then for any face f, the first index of that faces is [f * 3n]
-		tl.indices.reserve(mesh.indices.size());
-		for (size_t f = 0; f < mesh.num_face_vertices.size(); f++)
+		IndexedTriangleList<T> tl;
+		tl.vertices.resize(mesh.positions.size());
+		for (size_t i = 0; i < mesh.positions.size(); i++)
 		{
-			// make sure there are no non-triangle faces
-			if (mesh.num_face_vertices[f] != 3u)
+			tl.vertices[i].pos = mesh.positions[i];
+			if (!mesh.normals.empty())
 			{
-				std::stringstream ss;
-				ss << "LoadObj error face #" << f << " has "
-					<< mesh.num_face_vertices[f] << " vertices";
-				throw std::runtime_error(ss.str().c_str());
+				VertexAttributes::SetNormal(tl.vertices[i], mesh.normals[i]);
 			}
-
-			// load set of 3 indices for each face into OUR index std::vector
-			for (size_t vn = 0; vn < 3u; vn++)
+			if (!mesh.texcoords.empty())
 			{
-				const auto idx = mesh.indices[f * 3u + vn];
-				tl.indices.push_back(size_t(idx.vertex_index));
-				// write normals into the vertices
-				tl.vertices[(size_t)idx.vertex_index].n = Vec3{
-					attrib.normals[3 * idx.normal_index + 0],
-					attrib.normals[3 * idx.normal_index + 1],
-					attrib.normals[3 * idx.normal_index + 2]
-				};
+				VertexAttributes::SetTexcoord(tl.vertices[i], mesh.texcoords[i]);
 			}
-
-			// reverse winding if file marked as CCW
-			if (isCCW)
+		}
+		tl.indices.assign(mesh.indices.begin(), mesh.indices.end());
+		// reverse winding if file marked as CCW
+		if (isCCW)
+		{
+			for (size_t i = 0; i < tl.indices.size(); i += 3)
 			{
 				// swapping any two indices reverse the winding dir of triangle
-				std::swap(tl.indices.back(), *std::prev(tl.indices.end(), 2));
+				std::swap(tl.indices[i + 1], tl.indices[i + 2]);
 			}
 		}
-
 		return tl;
 	}
-
-	void AdjustToTrueCenter()
+	BoundingSphere SolveBoundingSphere() const
 	{
 		// used to enable miniball to access vertex pos info
 		struct VertexAccessor
@@ -214,26 +157,19 @@ public:
 			}
 		};
 
-		// solve the minimum bounding sphere
 		Miniball::Miniball<VertexAccessor> mb(3, vertices.cbegin(), vertices.cend());
 		// result is a pointer to float[3] (what a shitty fuckin interface)
 		const auto pc = mb.center();
 		const Vec3 center = { *pc,*std::next(pc),*std::next(pc,2) };
-		// adjust all vertices so that center of minimal sphere is at 0,0
-		for (auto& v : vertices)
+		// take radius from the farthest vertex so the sphere is conservative
+		float radiusSq = 0.0f;
+		for (const auto& v : vertices)
 		{
-			v.pos -= center;
+			radiusSq = std::max(radiusSq, (v.pos - center).LenSq());
 		}
+		return { center,std::sqrt(radiusSq) };
 	}
-	float GetRadius() const
-	{
-		return std::max_element(vertices.begin(), vertices.end(),
-			[](const T& v0, const T& v1)
-			{
-				return v0.pos.LenSq() < v1.pos.LenSq();
-			}
-		)->pos.Len();
-	}
-	std::vector<T> vertices;
-	std::vector<size_t> indices;
+private:
+	BoundingSphere bounds;
+	bool boundsValid = false;
 };
\ No newline at end of file
@@ -0,0 +1,185 @@
+#include "JobSystem.h"
+#include <utility>
+
+namespace
+{
+	// index of this thread's queue in the job system it works for
+	thread_local const JobSystem* pOwnerSystem = nullptr;
+	thread_local size_t ownerQueue = 0u;
+}
+
+JobSystem& JobSystem::Get()
+{
+	static JobSystem jobs( std::max( std::thread::hardware_concurrency(),1u ) - 1u );
+	return jobs;
+}
+
+JobSystem::JobSystem( unsigned int workerCount )
+{
+	for( unsigned int i = 0u; i <= workerCount; i++ )
+	{
+		queues.push_back( std::make_unique<Queue>() );
+	}
+	for( unsigned int i = 0u; i < workerCount; i++ )
+	{
+		workers.emplace_back( &JobSystem::WorkerLoop,this,size_t( i ) );
+	}
+}
+
+JobSystem::~JobSystem()
+{
+	while( RunOne( GetHomeQueue() ) )
+	{
+	}
+	{
+		std::lock_guard<std::mutex> lock( sleepMutex );
+		quitting = true;
+	}
+	cv.notify_all();
+	for( auto& t : workers )
+	{
+		t.join();
+	}
+}
+
+void JobSystem::Run( Group& group,Job job )
+{
+	const size_t home = GetHomeQueue();
+	group.pending.fetch_add( 1u,std::memory_order_relaxed );
+	{
+		auto& q = *queues[home];
+		std::lock_guard<std::mutex> lock( q.mutex );
+		q.entries.push_back( { std::move( job ),&group,home } );
+	}
+	queued.fetch_add( 1u );
+	// taking the lock orders the count before a worker's check for work, so no wakeup is lost
+	{
+		std::lock_guard<std::mutex> lock( sleepMutex );
+	}
+	cv.notify_one();
+}
+
+void JobSystem::Wait( Group& group )
+{
+	const auto error = Finish( group );
+	if( error )
+	{
+		std::rethrow_exception( error );
+	}
+}
+
+std::exception_ptr JobSystem::Finish( Group& group )
+{
+	const size_t home = GetHomeQueue();
+	while( group.pending.load( std::memory_order_acquire ) > 0u )
+	{
+		// the group's last jobs may be running elsewhere, help with anything queued meanwhile
+		if( !RunOne( home ) )
+		{
+			std::this_thread::yield();
+		}
+	}
+	std::lock_guard<std::mutex> lock( group.mutex );
+	return std::exchange( group.error,nullptr );
+}
+
+unsigned int JobSystem::GetWorkerCount() const
+{
+	return (unsigned int)workers.size();
+}
+
+unsigned int JobSystem::GetThreadCount() const
+{
+	return (unsigned int)workers.size() + 1u;
+}
+
+JobSystem::Stats JobSystem::GetStats() const
+{
+	Stats s;
+	s.jobsRun = jobsRun.load( std::memory_order_relaxed );
+	s.jobsStolen = jobsStolen.load( std::memory_order_relaxed );
+	return s;
+}
+
+bool JobSystem::IsWorkerThread() const
+{
+	return pOwnerSystem == this;
+}
+
+void JobSystem::WorkerLoop( size_t index )
+{
+	pOwnerSystem = this;
+	ownerQueue = index;
+	while( true )
+	{
+		if( RunOne( index ) )
+		{
+			continue;
+		}
+		std::unique_lock<std::mutex> lock( sleepMutex );
+		cv.wait( lock,[this]() { return quitting || queued.load() > 0u; } );
+		if( quitting && queued.load() == 0u )
+		{
+			return;
+		}
+	}
+}
+
+bool JobSystem::RunOne( size_t home )
+{
+	Entry entry;
+	bool found = false;
+	// newest own job first, it is the most likely to still be in cache
+	{
+		auto& q = *queues[home];
+		std::lock_guard<std::mutex> lock( q.mutex );
+		if( !q.entries.empty() )
+		{
+			entry = std::move( q.entries.back() );
+			q.entries.pop_back();
+			found = true;
+		}
+	}
+	// then the oldest job of another queue, starting with the next one so thieves spread out
+	for( size_t i = 1u; !found && i < queues.size(); i++ )
+	{
+		auto& q = *queues[(home + i) % queues.size()];
+		std::lock_guard<std::mutex> lock( q.mutex );
+		if( !q.entries.empty() )
+		{
+			entry = std::move( q.entries.front() );
+			q.entries.pop_front();
+			found = true;
+		}
+	}
+	if( !found )
+	{
+		return false;
+	}
+	queued.fetch_sub( 1u );
+	if( entry.owner != home )
+	{
+		jobsStolen.fetch_add( 1u,std::memory_order_relaxed );
+	}
+	try
+	{
+		entry.job();
+	}
+	catch( ... )
+	{
+		std::lock_guard<std::mutex> lock( entry.pGroup->mutex );
+		if( !entry.pGroup->error )
+		{
+			entry.pGroup->error = std::current_exception();
+		}
+	}
+	jobsRun.fetch_add( 1u,std::memory_order_relaxed );
+	// last access to the group, the waiter may destroy it right after
+	entry.pGroup->pending.fetch_sub( 1u,std::memory_order_release );
+	return true;
+}
+
+size_t JobSystem::GetHomeQueue() const
+{
+	return pOwnerSystem == this ? ownerQueue : queues.size() - 1u;
+}
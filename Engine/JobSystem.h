@@ -0,0 +1,123 @@
+#pragma once
+#include <vector>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <exception>
+#include <algorithm>
+#include <cstdint>
+
+// persistent worker threads with a job deque each, shared by the pipeline, scenes and loaders
+// a thread pushes and pops its own jobs at the back of its deque and steals from the front of
+// the others when it runs dry; threads waiting on a group run queued jobs instead of blocking
+class JobSystem
+{
+public:
+	typedef std::function<void()> Job;
+	// counts the jobs started through it so they can be waited on together
+	// the first exception thrown by one of its jobs is kept and rethrown by Wait
+	class Group
+	{
+	public:
+		Group() = default;
+		Group( const Group& ) = delete;
+		Group& operator=( const Group& ) = delete;
+	private:
+		friend class JobSystem;
+		std::atomic<size_t> pending = { 0u };
+		std::mutex mutex;
+		std::exception_ptr error;
+	};
+	struct Stats
+	{
+		uint64_t jobsRun = 0u;
+		// jobs run by another thread than the one that queued them
+		uint64_t jobsStolen = 0u;
+	};
+public:
+	// engine wide instance, one worker per hardware thread besides the calling thread
+	static JobSystem& Get();
+	// workerCount 0 runs every job on the threads that wait for them
+	explicit JobSystem( unsigned int workerCount );
+	JobSystem( const JobSystem& ) = delete;
+	JobSystem& operator=( const JobSystem& ) = delete;
+	// finishes the queued jobs, then joins the workers
+	~JobSystem();
+	void Run( Group& group,Job job );
+	// runs queued jobs on this thread until every job of the group is done
+	void Wait( Group& group );
+	// calls f( begin,end ) on consecutive ranges of at most grain items covering [0,count)
+	// and returns once all of them are done, the first range runs on the calling thread
+	template<typename F>
+	void ParallelFor( size_t count,size_t grain,F&& f )
+	{
+		grain = std::max( grain,size_t( 1u ) );
+		if( count <= grain || workers.empty() )
+		{
+			if( count > 0u )
+			{
+				f( size_t( 0u ),count );
+			}
+			return;
+		}
+		Group group;
+		for( size_t begin = grain; begin < count; begin += grain )
+		{
+			const size_t end = std::min( begin + grain,count );
+			Run( group,[&f,begin,end]() { f( begin,end ); } );
+		}
+		std::exception_ptr error;
+		try
+		{
+			f( size_t( 0u ),grain );
+		}
+		catch( ... )
+		{
+			error = std::current_exception();
+		}
+		// the jobs reference f, so they have to finish even if the first range threw
+		const auto jobError = Finish( group );
+		if( error || jobError )
+		{
+			std::rethrow_exception( error ? error : jobError );
+		}
+	}
+	// worker threads, not counting the threads that wait
+	unsigned int GetWorkerCount() const;
+	// threads that run jobs while one of them waits
+	unsigned int GetThreadCount() const;
+	// true when called from a job running on one of this system's workers
+	bool IsWorkerThread() const;
+	Stats GetStats() const;
+private:
+	struct Entry
+	{
+		Job job;
+		Group* pGroup;
+		size_t owner;
+	};
+	struct alignas( 64 ) Queue
+	{
+		std::mutex mutex;
+		std::deque<Entry> entries;
+	};
+	void WorkerLoop( size_t index );
+	// runs one job, from the thread's own queue if it has one, else stolen; false if there was none
+	bool RunOne( size_t home );
+	size_t GetHomeQueue() const;
+	std::exception_ptr Finish( Group& group );
+private:
+	// one per worker plus a shared one for every other thread, which is last
+	std::vector<std::unique_ptr<Queue>> queues;
+	std::vector<std::thread> workers;
+	std::atomic<size_t> queued = { 0u };
+	std::atomic<uint64_t> jobsRun = { 0u };
+	std::atomic<uint64_t> jobsStolen = { 0u };
+	std::mutex sleepMutex;
+	std::condition_variable cv;
+	bool quitting = false;
+};
@@ -0,0 +1,308 @@
+#pragma once
+#include <vector>
+#include <algorithm>
+#include <limits>
+#include <cstdint>
+#include <cmath>
+#include <cassert>
+#include "Vec3.h"
+#include "Vec4.h"
+#include "Mat.h"
+#include "ChiliMath.h"
+#include "ZBuffer.h"
+#include "JobSystem.h"
+
+// point light with a finite reach, its contribution is faded to zero at range
+struct PointLight
+{
+	Vec3 pos = { 0.0f,0.0f,0.0f };
+	Vec3 color = { 1.0f,1.0f,1.0f };
+	float range = 1.0f;
+	// 1 at the light, 0 from range on; smooth so the cut isn't visible
+	float GetFalloff(float distance) const
+	{
+		const float x = std::min(distance / range, 1.0f);
+		const float x2 = x * x;
+		return sq(1.0f - x2 * x2);
+	}
+};
+
+// tiled light culling: the screen is split into TileSize x TileSize tiles and every tile gets the list
+// of lights whose bounding sphere reaches into it, both on screen and in the tile's view space depth
+// range, so pixel shaders loop over the lights near them instead of all of them
+// depth ranges come from a ZBuffer holding the frame's opaque depth (a depth prepass, or last frame's
+// if the camera moves slowly); without one every tile spans the whole frustum
+class LightGrid
+{
+public:
+	static constexpr int TileSize = 16;
+	struct Stats
+	{
+		size_t lights = 0;
+		// lights in front of the camera that reach at least one tile
+		size_t lightsVisible = 0;
+		// tiles with geometry in the depth buffer (all of them without one)
+		size_t tilesUsed = 0;
+		// sum over tiles, divide by tilesUsed for the mean
+		size_t tileLightSum = 0;
+		size_t tileLightPeak = 0;
+	};
+	// indices into the view space lights of the tile
+	struct TileLights
+	{
+		const uint16_t* pBegin;
+		const uint16_t* pEnd;
+		const uint16_t* begin() const
+		{
+			return pBegin;
+		}
+		const uint16_t* end() const
+		{
+			return pEnd;
+		}
+	};
+public:
+	LightGrid(int width, int height)
+		:
+		width(width),
+		height(height),
+		tilesX((width + TileSize - 1) / TileSize),
+		tilesY((height + TileSize - 1) / TileSize),
+		tileMinZ(size_t(tilesX) * tilesY),
+		tileMaxZ(size_t(tilesX) * tilesY),
+		offsets(size_t(tilesX) * tilesY + 1)
+	{}
+	void SetJobSystem(JobSystem* pJobs_in)
+	{
+		pJobs = pJobs_in;
+	}
+	// lights in world space, view and proj as bound to the vertex shader (so pixel shader positions are
+	// in the same view space); pDepth, when given, is the depth of this frame's opaque surfaces
+	void Build(const std::vector<PointLight>& lights, const Mat4& view, const Mat4& proj, const ZBuffer* pDepth = nullptr)
+	{
+		assert(lights.size() <= size_t(std::numeric_limits<uint16_t>::max()) + 1);
+		assert(!pDepth || (pDepth->GetWidth() == width && pDepth->GetHeight() == height));
+		this->proj = proj;
+		// ndc depth d = A + B / z for view depth z (ProjectionFOV / Projection)
+		const float A = proj.elements[2][2];
+		const float B = proj.elements[3][2];
+		nearZ = -B / A;
+		farZ = B / (1.0f - A);
+		stats = {};
+		stats.lights = lights.size();
+
+		viewLights.resize(lights.size());
+		for (size_t i = 0; i < lights.size(); i++)
+		{
+			viewLights[i] = lights[i];
+			viewLights[i].pos = Vec3(Vec4(lights[i].pos) * view);
+		}
+		BuildTileDepths(pDepth, A, B);
+
+		// screen rect in tiles of every light, empty for lights that can't touch anything
+		lightRects.resize(lights.size());
+		for (size_t i = 0; i < lights.size(); i++)
+		{
+			lightRects[i] = GetTileRect(viewLights[i]);
+		}
+		// count, prefix sum, fill: tile lists end up back to back in light order
+		std::fill(offsets.begin(), offsets.end(), 0u);
+		const auto forEachTile = [this](size_t i, auto&& f)
+		{
+			const auto& l = viewLights[i];
+			const auto& r = lightRects[i];
+			for (int ty = r.y0; ty < r.y1; ty++)
+			{
+				for (int tx = r.x0; tx < r.x1; tx++)
+				{
+					const size_t tile = size_t(ty) * tilesX + tx;
+					if (l.pos.z - l.range <= tileMaxZ[tile] && l.pos.z + l.range >= tileMinZ[tile])
+					{
+						f(tile);
+					}
+				}
+			}
+		};
+		for (size_t i = 0; i < lights.size(); i++)
+		{
+			bool visible = false;
+			forEachTile(i, [this, &visible](size_t tile)
+			{
+				offsets[tile + 1]++;
+				visible = true;
+			});
+			stats.lightsVisible += visible ? 1 : 0;
+		}
+		for (size_t t = 0; t + 1 < offsets.size(); t++)
+		{
+			const size_t count = offsets[t + 1];
+			stats.tileLightSum += count;
+			stats.tileLightPeak = std::max(stats.tileLightPeak, count);
+			offsets[t + 1] += offsets[t];
+		}
+		indices.resize(offsets.back());
+		cursors.assign(offsets.begin(), offsets.end() - 1);
+		for (size_t i = 0; i < lights.size(); i++)
+		{
+			forEachTile(i, [this, i](size_t tile)
+			{
+				indices[cursors[tile]++] = uint16_t(i);
+			});
+		}
+	}
+	// lights of the tile a view space position (pixel shader input) projects into
+	TileLights GetTileLights(const Vec3& viewPos) const
+	{
+		const auto& m = proj.elements;
+		const float w = viewPos.x * m[0][3] + viewPos.y * m[1][3] + viewPos.z * m[2][3] + m[3][3];
+		const float x = viewPos.x * m[0][0] + viewPos.y * m[1][0] + viewPos.z * m[2][0] + m[3][0];
+		const float y = viewPos.x * m[0][1] + viewPos.y * m[1][1] + viewPos.z * m[2][1] + m[3][1];
+		const float sx = (x / w + 1.0f) * 0.5f * float(width);
+		const float sy = (1.0f - y / w) * 0.5f * float(height);
+		const int tx = std::min(std::max(int(sx) / TileSize, 0), tilesX - 1);
+		const int ty = std::min(std::max(int(sy) / TileSize, 0), tilesY - 1);
+		const size_t tile = size_t(ty) * tilesX + tx;
+		return { indices.data() + offsets[tile],indices.data() + offsets[tile + 1] };
+	}
+	// light as passed to Build, with its position in view space
+	const PointLight& GetViewLight(size_t i) const
+	{
+		return viewLights[i];
+	}
+	const Stats& GetStats() const
+	{
+		return stats;
+	}
+private:
+	// half open range of tiles
+	struct TileRect
+	{
+		int x0, y0, x1, y1;
+	};
+	// view space depth range of every tile, empty (min > max) for tiles without geometry
+	void BuildTileDepths(const ZBuffer* pDepth, float A, float B)
+	{
+		if (!pDepth)
+		{
+			std::fill(tileMinZ.begin(), tileMinZ.end(), nearZ);
+			std::fill(tileMaxZ.begin(), tileMaxZ.end(), farZ);
+			stats.tilesUsed = tileMinZ.size();
+			return;
+		}
+		const int samples = pDepth->GetSampleCount();
+		const auto reduce = [this, pDepth, samples, A, B](size_t begin, size_t end)
+		{
+			for (size_t ty = begin; ty < end; ty++)
+			{
+				for (int tx = 0; tx < tilesX; tx++)
+				{
+					float lo = std::numeric_limits<float>::infinity();
+					float hi = -std::numeric_limits<float>::infinity();
+					const int yEnd = std::min(int(ty + 1) * TileSize, height);
+					const int xEnd = std::min((tx + 1) * TileSize, width);
+					for (int y = int(ty) * TileSize; y < yEnd; y++)
+					{
+						// every sample of the row's pixels, they are stored together
+						const float* pRow = &pDepth->At(tx * TileSize, y);
+						for (int k = 0, n = (xEnd - tx * TileSize) * samples; k < n; k++)
+						{
+							const float z = pRow[k];
+							// cleared pixels are infinity, nothing there to light
+							if (z != std::numeric_limits<float>::infinity())
+							{
+								lo = std::min(lo, z);
+								hi = std::max(hi, z);
+							}
+						}
+					}
+					const size_t tile = ty * tilesX + tx;
+					if (lo > hi)
+					{
+						tileMinZ[tile] = std::numeric_limits<float>::infinity();
+						tileMaxZ[tile] = -std::numeric_limits<float>::infinity();
+					}
+					else
+					{
+						tileMinZ[tile] = B / (lo - A);
+						tileMaxZ[tile] = B / (hi - A);
+					}
+				}
+			}
+		};
+		if (pJobs)
+		{
+			pJobs->ParallelFor(size_t(tilesY), 4, reduce);
+		}
+		else
+		{
+			reduce(0, size_t(tilesY));
+		}
+		stats.tilesUsed = size_t(std::count_if(tileMinZ.begin(), tileMinZ.end(),
+			[](float z) { return z != std::numeric_limits<float>::infinity(); }));
+	}
+	// conservative: the screen bounds of the corners of the sphere's view space box
+	TileRect GetTileRect(const PointLight& l) const
+	{
+		const TileRect none = { 0,0,0,0 };
+		if (l.pos.z + l.range <= nearZ || l.pos.z - l.range >= farZ)
+		{
+			return none;
+		}
+		// reaches behind the near plane, can't bound its projection
+		if (l.pos.z - l.range <= nearZ)
+		{
+			return { 0,0,tilesX,tilesY };
+		}
+		const auto& m = proj.elements;
+		float x0 = std::numeric_limits<float>::max();
+		float y0 = std::numeric_limits<float>::max();
+		float x1 = -std::numeric_limits<float>::max();
+		float y1 = -std::numeric_limits<float>::max();
+		for (int c = 0; c < 8; c++)
+		{
+			const Vec3 p = {
+				l.pos.x + (c & 1 ? l.range : -l.range),
+				l.pos.y + (c & 2 ? l.range : -l.range),
+				l.pos.z + (c & 4 ? l.range : -l.range)
+			};
+			const float w = p.x * m[0][3] + p.y * m[1][3] + p.z * m[2][3] + m[3][3];
+			const float x = (p.x * m[0][0] + p.y * m[1][0] + p.z * m[2][0] + m[3][0]) / w;
+			const float y = (p.x * m[0][1] + p.y * m[1][1] + p.z * m[2][1] + m[3][1]) / w;
+			x0 = std::min(x0, x);
+			x1 = std::max(x1, x);
+			y0 = std::min(y0, y);
+			y1 = std::max(y1, y);
+		}
+		// ndc to tiles, y flips
+		const auto toTileX = [this](float x) { return (x + 1.0f) * 0.5f * float(width) / float(TileSize); };
+		const auto toTileY = [this](float y) { return (1.0f - y) * 0.5f * float(height) / float(TileSize); };
+		TileRect r;
+		r.x0 = std::max(int(std::floor(toTileX(x0))), 0);
+		r.x1 = std::min(int(std::floor(toTileX(x1))) + 1, tilesX);
+		r.y0 = std::max(int(std::floor(toTileY(y1))), 0);
+		r.y1 = std::min(int(std::floor(toTileY(y0))) + 1, tilesY);
+		if (r.x0 >= r.x1 || r.y0 >= r.y1)
+		{
+			return none;
+		}
+		return r;
+	}
+private:
+	int width;
+	int height;
+	int tilesX;
+	int tilesY;
+	Mat4 proj = Mat4::Identity();
+	float nearZ = 0.0f;
+	float farZ = 0.0f;
+	std::vector<PointLight> viewLights;
+	std::vector<TileRect> lightRects;
+	std::vector<float> tileMinZ;
+	std::vector<float> tileMaxZ;
+	// tile t's lights are indices[offsets[t], offsets[t + 1])
+	std::vector<size_t> offsets;
+	std::vector<size_t> cursors;
+	std::vector<uint16_t> indices;
+	JobSystem* pJobs = &JobSystem::Get();
+	Stats stats;
+};
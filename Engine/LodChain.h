@@ -0,0 +1,54 @@
+#pragma once
+#include <vector>
+#include "IndexedTriangleList.h"
+#include "MeshSimplifier.h"
+
+// discrete levels of detail for a mesh, level 0 is the full resolution mesh
+// each level stores the accumulated simplification error in model space units
+// so the pipeline can pick the coarsest level whose error stays under a pixel budget
+template<class T>
+class LodChain
+{
+public:
+	LodChain() = default;
+	// every level has about 'reduction' times the triangles of the previous one
+	// stops early when the simplifier stalls or the mesh gets too small
+	static LodChain Build(IndexedTriangleList<T> base, size_t maxLevels = 5, float reduction = 0.5f, size_t minTriangles = 64)
+	{
+		LodChain chain;
+		chain.levels.push_back(std::move(base));
+		chain.errors.push_back(0.0f);
+		while (chain.levels.size() < maxLevels)
+		{
+			const size_t prevTris = chain.levels.back().indices.size() / 3;
+			const size_t target = size_t(float(prevTris) * reduction);
+			if (target < minTriangles)
+			{
+				break;
+			}
+			float error = 0.0f;
+			auto next = MeshSimplifier::Simplify(chain.levels.back(), target, error);
+			// not worth a level if most collapses were rejected
+			if (next.indices.size() / 3 > prevTris * 9 / 10)
+			{
+				break;
+			}
+			chain.errors.push_back(chain.errors.back() + error);
+			chain.levels.push_back(std::move(next));
+		}
+		return chain;
+	}
+	void BuildMeshlets()
+	{
+		for (auto& l : levels)
+		{
+			l.BuildMeshlets();
+		}
+	}
+	size_t GetLevelCount() const
+	{
+		return levels.size();
+	}
+	std::vector<IndexedTriangleList<T>> levels;
+	std::vector<float> errors;
+};
@@ -0,0 +1,220 @@
+#ifdef _WIN32
+#define FULL_WINTARD
+#include "ChiliWin.h"
+#endif
+#include "MappedFile.h"
+#include <stdexcept>
+#include <utility>
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+MappedFile::View::View( View&& donor )
+	:
+	pBase( donor.pBase ),
+	mappedSize( donor.mappedSize ),
+	pData( donor.pData ),
+	size( donor.size )
+{
+	donor.pBase = nullptr;
+	donor.pData = nullptr;
+}
+
+MappedFile::View& MappedFile::View::operator=( View&& donor )
+{
+	if( this != &donor )
+	{
+		Release();
+		pBase = std::exchange( donor.pBase,nullptr );
+		mappedSize = donor.mappedSize;
+		pData = std::exchange( donor.pData,nullptr );
+		size = donor.size;
+	}
+	return *this;
+}
+
+MappedFile::View::~View()
+{
+	Release();
+}
+
+const unsigned char* MappedFile::View::GetData() const
+{
+	return pData;
+}
+
+size_t MappedFile::View::GetSize() const
+{
+	return size;
+}
+
+MappedFile::MappedFile( MappedFile&& donor )
+	:
+	filename( std::move( donor.filename ) ),
+	handle( donor.handle ),
+	size( donor.size ),
+	granularity( donor.granularity )
+{
+	donor.handle = -1;
+}
+
+MappedFile& MappedFile::operator=( MappedFile&& donor )
+{
+	if( this != &donor )
+	{
+		Release();
+		filename = std::move( donor.filename );
+		handle = std::exchange( donor.handle,-1 );
+		size = donor.size;
+		granularity = donor.granularity;
+	}
+	return *this;
+}
+
+MappedFile::~MappedFile()
+{
+	Release();
+}
+
+uint64_t MappedFile::GetSize() const
+{
+	return size;
+}
+
+const std::string& MappedFile::GetFilename() const
+{
+	return filename;
+}
+
+#ifdef _WIN32
+MappedFile::MappedFile( const std::string& filename_in )
+	:
+	filename( filename_in )
+{
+	const HANDLE hFile = CreateFileA( filename.c_str(),GENERIC_READ,FILE_SHARE_READ,nullptr,
+		OPEN_EXISTING,FILE_ATTRIBUTE_NORMAL,nullptr );
+	if( hFile == INVALID_HANDLE_VALUE )
+	{
+		throw std::runtime_error( "MappedFile failed to open file  File:" + filename );
+	}
+	LARGE_INTEGER fileSize;
+	if( !GetFileSizeEx( hFile,&fileSize ) )
+	{
+		CloseHandle( hFile );
+		throw std::runtime_error( "MappedFile failed to get file size  File:" + filename );
+	}
+	size = uint64_t( fileSize.QuadPart );
+	// the mapping object keeps the file open
+	const HANDLE hMap = size > 0u ? CreateFileMappingA( hFile,nullptr,PAGE_READONLY,0u,0u,nullptr ) : nullptr;
+	CloseHandle( hFile );
+	if( hMap == nullptr )
+	{
+		throw std::runtime_error( "MappedFile failed to create file mapping  File:" + filename );
+	}
+	handle = reinterpret_cast<intptr_t>( hMap );
+	SYSTEM_INFO info;
+	GetSystemInfo( &info );
+	granularity = info.dwAllocationGranularity;
+}
+
+MappedFile::View MappedFile::Map( uint64_t offset,size_t size_in ) const
+{
+	if( offset > size || size_in > size - offset )
+	{
+		throw std::runtime_error( "MappedFile view out of range  File:" + filename );
+	}
+	const uint64_t base = offset / granularity * granularity;
+	View view;
+	view.mappedSize = size_t( offset - base ) + size_in;
+	view.pBase = MapViewOfFile( reinterpret_cast<HANDLE>( handle ),FILE_MAP_READ,
+		DWORD( base >> 32u ),DWORD( base & 0xFFFFFFFFu ),view.mappedSize );
+	if( view.pBase == nullptr )
+	{
+		throw std::runtime_error( "MappedFile failed to map view  File:" + filename );
+	}
+	view.pData = static_cast<const unsigned char*>( view.pBase ) + (offset - base);
+	view.size = size_in;
+	return view;
+}
+
+void MappedFile::View::Release()
+{
+	if( pBase != nullptr )
+	{
+		UnmapViewOfFile( pBase );
+		pBase = nullptr;
+		pData = nullptr;
+	}
+}
+
+void MappedFile::Release()
+{
+	if( handle != -1 )
+	{
+		CloseHandle( reinterpret_cast<HANDLE>( handle ) );
+		handle = -1;
+	}
+}
+#else
+MappedFile::MappedFile( const std::string& filename_in )
+	:
+	filename( filename_in )
+{
+	const int fd = open( filename.c_str(),O_RDONLY );
+	if( fd < 0 )
+	{
+		throw std::runtime_error( "MappedFile failed to open file  File:" + filename );
+	}
+	struct stat st;
+	if( fstat( fd,&st ) != 0 )
+	{
+		close( fd );
+		throw std::runtime_error( "MappedFile failed to get file size  File:" + filename );
+	}
+	size = uint64_t( st.st_size );
+	handle = fd;
+	granularity = size_t( sysconf( _SC_PAGESIZE ) );
+}
+
+MappedFile::View MappedFile::Map( uint64_t offset,size_t size_in ) const
+{
+	if( offset > size || size_in > size - offset )
+	{
+		throw std::runtime_error( "MappedFile view out of range  File:" + filename );
+	}
+	const uint64_t base = offset / granularity * granularity;
+	View view;
+	view.mappedSize = size_t( offset - base ) + size_in;
+	void* p = mmap( nullptr,view.mappedSize,PROT_READ,MAP_PRIVATE,int( handle ),off_t( base ) );
+	if( p == MAP_FAILED )
+	{
+		throw std::runtime_error( "MappedFile failed to map view  File:" + filename );
+	}
+	view.pBase = p;
+	view.pData = static_cast<const unsigned char*>( p ) + (offset - base);
+	view.size = size_in;
+	return view;
+}
+
+void MappedFile::View::Release()
+{
+	if( pBase != nullptr )
+	{
+		munmap( pBase,mappedSize );
+		pBase = nullptr;
+		pData = nullptr;
+	}
+}
+
+void MappedFile::Release()
+{
+	if( handle != -1 )
+	{
+		close( int( handle ) );
+		handle = -1;
+	}
+}
+#endif
@@ -0,0 +1,53 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+// read only memory mapping of a file on disk, for assets too large to load into memory
+// any byte range can be mapped as a view and views are unmapped independently, so only
+// the views currently held count against the resident memory of the process
+// posix mmap on linux, a file mapping object on windows
+class MappedFile
+{
+public:
+	class View
+	{
+	public:
+		View() = default;
+		View( View&& donor );
+		View& operator=( View&& donor );
+		View( const View& ) = delete;
+		View& operator=( const View& ) = delete;
+		~View();
+		const unsigned char* GetData() const;
+		size_t GetSize() const;
+	private:
+		friend class MappedFile;
+		void Release();
+	private:
+		// start of the mapping, rounded down to the allocation granularity
+		void* pBase = nullptr;
+		size_t mappedSize = 0u;
+		const unsigned char* pData = nullptr;
+		size_t size = 0u;
+	};
+public:
+	explicit MappedFile( const std::string& filename );
+	MappedFile( MappedFile&& donor );
+	MappedFile& operator=( MappedFile&& donor );
+	MappedFile( const MappedFile& ) = delete;
+	MappedFile& operator=( const MappedFile& ) = delete;
+	~MappedFile();
+	// maps bytes [offset,offset + size), throws std::runtime_error if the range is outside the file
+	View Map( uint64_t offset,size_t size ) const;
+	uint64_t GetSize() const;
+	const std::string& GetFilename() const;
+private:
+	void Release();
+private:
+	std::string filename;
+	// file mapping HANDLE on windows, file descriptor elsewhere
+	intptr_t handle = -1;
+	uint64_t size = 0u;
+	// view offsets have to be multiples of this
+	size_t granularity = 4096u;
+};
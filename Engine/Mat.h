@@ -48,6 +48,51 @@ public:
 		}
 		return result;
 	}
+	// product of two affine matrices (last column 0,0,0,1), the constant column is not multiplied
+	_Mat AffineMultiply(const _Mat& rhs) const
+	{
+		static_assert(S == 4, "affine multiply is for 4x4 matrices");
+		_Mat result;
+		for (size_t j = 0; j < 4; j++)
+		{
+			for (size_t k = 0; k < 3; k++)
+			{
+				result.elements[j][k] = elements[j][0] * rhs.elements[0][k] +
+					elements[j][1] * rhs.elements[1][k] +
+					elements[j][2] * rhs.elements[2][k];
+			}
+			result.elements[j][3] = (T)0.0;
+		}
+		result.elements[3][0] += rhs.elements[3][0];
+		result.elements[3][1] += rhs.elements[3][1];
+		result.elements[3][2] += rhs.elements[3][2];
+		result.elements[3][3] = (T)1.0;
+		return result;
+	}
+	// inverse transpose of the upper 3x3, transforms normals when this matrix transforms points
+	// (stays correct under non-uniform scaling, the length of the result is not normalized)
+	_Mat<T, 3> GetNormalMatrix() const
+	{
+		static_assert(S >= 3, "normal matrix needs a 3x3 block");
+		const _Vec3<T> r0 = { elements[0][0],elements[0][1],elements[0][2] };
+		const _Vec3<T> r1 = { elements[1][0],elements[1][1],elements[1][2] };
+		const _Vec3<T> r2 = { elements[2][0],elements[2][1],elements[2][2] };
+		// rows of the cofactor matrix, which is the inverse transpose times the determinant
+		const auto cross = [](const _Vec3<T>& a, const _Vec3<T>& b) -> _Vec3<T>
+		{
+			return { a.y * b.z - a.z * b.y,a.z * b.x - a.x * b.z,a.x * b.y - a.y * b.x };
+		};
+		const auto c0 = cross(r1, r2);
+		const auto c1 = cross(r2, r0);
+		const auto c2 = cross(r0, r1);
+		const T det = r0 * c0;
+		const T invDet = det != (T)0.0 ? (T)1.0 / det : (T)0.0;
+		return {
+			c0.x * invDet,c0.y * invDet,c0.z * invDet,
+			c1.x * invDet,c1.y * invDet,c1.z * invDet,
+			c2.x * invDet,c2.y * invDet,c2.z * invDet
+		};
+	}
 	static _Mat Identity()
 	{
 		if constexpr (S == 3)
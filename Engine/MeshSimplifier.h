@@ -0,0 +1,292 @@
+#pragma once
+#include <vector>
+#include <queue>
+#include <algorithm>
+#include <utility>
+#include <functional>
+#include <limits>
+#include <cmath>
+#include "Vec3.h"
+#include "IndexedTriangleList.h"
+
+// quadric error metric simplification (Garland & Heckbert)
+// edges are collapsed onto one of their endpoints, so no new vertices are made
+// and any vertex attributes (normals, colors, uvs) carry over unchanged
+class MeshSimplifier
+{
+private:
+	// symmetric 4x4 matrix sum of squared plane distances
+	struct Quadric
+	{
+		Quadric() = default;
+		Quadric(const Vec3& n, float d)
+			:
+			a2(sq(double(n.x))), ab(double(n.x) * n.y), ac(double(n.x) * n.z), ad(double(n.x) * d),
+			b2(sq(double(n.y))), bc(double(n.y) * n.z), bd(double(n.y) * d),
+			c2(sq(double(n.z))), cd(double(n.z) * d),
+			d2(sq(double(d)))
+		{}
+		Quadric& operator+=(const Quadric& rhs)
+		{
+			a2 += rhs.a2; ab += rhs.ab; ac += rhs.ac; ad += rhs.ad;
+			b2 += rhs.b2; bc += rhs.bc; bd += rhs.bd;
+			c2 += rhs.c2; cd += rhs.cd;
+			d2 += rhs.d2;
+			return *this;
+		}
+		Quadric operator+(const Quadric& rhs) const
+		{
+			return Quadric(*this) += rhs;
+		}
+		// squared distance of p to all accumulated planes
+		double Evaluate(const Vec3& p) const
+		{
+			const double x = p.x;
+			const double y = p.y;
+			const double z = p.z;
+			return a2 * x * x + 2.0 * ab * x * y + 2.0 * ac * x * z + 2.0 * ad * x
+				+ b2 * y * y + 2.0 * bc * y * z + 2.0 * bd * y
+				+ c2 * z * z + 2.0 * cd * z
+				+ d2;
+		}
+		double a2 = 0.0, ab = 0.0, ac = 0.0, ad = 0.0;
+		double b2 = 0.0, bc = 0.0, bd = 0.0;
+		double c2 = 0.0, cd = 0.0;
+		double d2 = 0.0;
+	};
+	// candidate collapse of vertex 'from' onto vertex 'to'
+	struct Collapse
+	{
+		double cost;
+		size_t from;
+		size_t to;
+		unsigned int fromVersion;
+		unsigned int toVersion;
+		bool operator>(const Collapse& rhs) const
+		{
+			return cost > rhs.cost;
+		}
+	};
+public:
+	// reduce triangle count to targetTriangles (or as close as collapses allow)
+	// maxError receives the largest collapse error as a distance in model space
+	template<class T>
+	static IndexedTriangleList<T> Simplify(const IndexedTriangleList<T>& src, size_t targetTriangles, float& maxError)
+	{
+		const size_t nVerts = src.vertices.size();
+		const size_t nTris = src.indices.size() / 3;
+		const auto pos = [&src](size_t i) -> const Vec3&
+		{
+			return src.vertices[i].pos;
+		};
+
+		std::vector<size_t> tris = src.indices;
+		std::vector<bool> triRemoved(nTris, false);
+		std::vector<bool> vertRemoved(nVerts, false);
+		std::vector<unsigned int> version(nVerts, 0u);
+		std::vector<Quadric> quadrics(nVerts);
+		std::vector<std::vector<size_t>> vertTris(nVerts);
+
+		// accumulate plane quadrics and vertex -> triangle adjacency
+		for (size_t t = 0; t < nTris; t++)
+		{
+			const auto& p0 = pos(tris[t * 3]);
+			auto n = (pos(tris[t * 3 + 1]) - p0).CrossProd(pos(tris[t * 3 + 2]) - p0);
+			const float len = n.Len();
+			if (len > 0.0f)
+			{
+				n /= len;
+				const Quadric q(n, -(n * p0));
+				for (size_t k = 0; k < 3; k++)
+				{
+					quadrics[tris[t * 3 + k]] += q;
+				}
+			}
+			for (size_t k = 0; k < 3; k++)
+			{
+				vertTris[tris[t * 3 + k]].push_back(t);
+			}
+		}
+
+		// collect undirected edges, edges used by only one triangle are on the boundary
+		// and their vertices are locked so open meshes keep their outline
+		std::vector<std::pair<size_t, size_t>> edges;
+		edges.reserve(nTris * 3);
+		for (size_t t = 0; t < nTris; t++)
+		{
+			for (size_t k = 0; k < 3; k++)
+			{
+				const size_t a = tris[t * 3 + k];
+				const size_t b = tris[t * 3 + (k + 1) % 3];
+				edges.emplace_back(std::min(a, b), std::max(a, b));
+			}
+		}
+		std::sort(edges.begin(), edges.end());
+		std::vector<bool> locked(nVerts, false);
+		{
+			size_t i = 0;
+			while (i < edges.size())
+			{
+				size_t j = i + 1;
+				while (j < edges.size() && edges[j] == edges[i])
+				{
+					j++;
+				}
+				if (j - i == 1)
+				{
+					locked[edges[i].first] = true;
+					locked[edges[i].second] = true;
+				}
+				i = j;
+			}
+		}
+		edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+
+		std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> heap;
+		const auto pushEdge = [&](size_t a, size_t b)
+		{
+			const auto q = quadrics[a] + quadrics[b];
+			if (!locked[a])
+			{
+				heap.push({ std::max(0.0, q.Evaluate(pos(b))),a,b,version[a],version[b] });
+			}
+			if (!locked[b])
+			{
+				heap.push({ std::max(0.0, q.Evaluate(pos(a))),b,a,version[b],version[a] });
+			}
+		};
+		for (const auto& e : edges)
+		{
+			pushEdge(e.first, e.second);
+		}
+		edges.clear();
+		edges.shrink_to_fit();
+
+		double maxCost = 0.0;
+		size_t liveTris = nTris;
+		std::vector<size_t> neighbors;
+		while (liveTris > targetTriangles && !heap.empty())
+		{
+			const auto c = heap.top();
+			heap.pop();
+
+			// stale entry, one of the endpoints changed since it was queued
+			if (vertRemoved[c.from] || vertRemoved[c.to] ||
+				version[c.from] != c.fromVersion || version[c.to] != c.toVersion)
+			{
+				continue;
+			}
+
+			// reject collapses that would flip a surviving triangle
+			bool flips = false;
+			for (const size_t t : vertTris[c.from])
+			{
+				if (triRemoved[t])
+				{
+					continue;
+				}
+				const size_t* tri = &tris[t * 3];
+				if (tri[0] == c.to || tri[1] == c.to || tri[2] == c.to)
+				{
+					continue;
+				}
+				const auto before = (pos(tri[1]) - pos(tri[0])).CrossProd(pos(tri[2]) - pos(tri[0]));
+				const auto moved = [&](size_t k) -> const Vec3&
+				{
+					return tri[k] == c.from ? pos(c.to) : pos(tri[k]);
+				};
+				const auto after = (moved(1) - moved(0)).CrossProd(moved(2) - moved(0));
+				if (before * after <= 0.0f)
+				{
+					flips = true;
+					break;
+				}
+			}
+			if (flips)
+			{
+				continue;
+			}
+
+			// collapse from -> to
+			for (const size_t t : vertTris[c.from])
+			{
+				if (triRemoved[t])
+				{
+					continue;
+				}
+				size_t* tri = &tris[t * 3];
+				for (size_t k = 0; k < 3; k++)
+				{
+					if (tri[k] == c.from)
+					{
+						tri[k] = c.to;
+					}
+				}
+				if (tri[0] == tri[1] || tri[1] == tri[2] || tri[0] == tri[2])
+				{
+					triRemoved[t] = true;
+					liveTris--;
+				}
+				else
+				{
+					vertTris[c.to].push_back(t);
+				}
+			}
+			vertTris[c.from].clear();
+			vertTris[c.from].shrink_to_fit();
+			vertRemoved[c.from] = true;
+			quadrics[c.to] += quadrics[c.from];
+			version[c.to]++;
+			maxCost = std::max(maxCost, c.cost);
+
+			// drop dead triangles from the survivor and requeue its edges with the new quadric
+			auto& vt = vertTris[c.to];
+			vt.erase(std::remove_if(vt.begin(), vt.end(), [&triRemoved](size_t t) { return triRemoved[t]; }), vt.end());
+			std::sort(vt.begin(), vt.end());
+			vt.erase(std::unique(vt.begin(), vt.end()), vt.end());
+			neighbors.clear();
+			for (const size_t t : vt)
+			{
+				for (size_t k = 0; k < 3; k++)
+				{
+					if (tris[t * 3 + k] != c.to)
+					{
+						neighbors.push_back(tris[t * 3 + k]);
+					}
+				}
+			}
+			std::sort(neighbors.begin(), neighbors.end());
+			neighbors.erase(std::unique(neighbors.begin(), neighbors.end()), neighbors.end());
+			for (const size_t n : neighbors)
+			{
+				pushEdge(c.to, n);
+			}
+		}
+
+		maxError = float(std::sqrt(maxCost));
+
+		// compact surviving vertices and triangles
+		constexpr size_t none = std::numeric_limits<size_t>::max();
+		std::vector<size_t> newIndex(nVerts, none);
+		IndexedTriangleList<T> out;
+		out.indices.reserve(liveTris * 3);
+		for (size_t t = 0; t < nTris; t++)
+		{
+			if (triRemoved[t])
+			{
+				continue;
+			}
+			for (size_t k = 0; k < 3; k++)
+			{
+				const size_t v = tris[t * 3 + k];
+				if (newIndex[v] == none)
+				{
+					newIndex[v] = out.vertices.size();
+					out.vertices.push_back(src.vertices[v]);
+				}
+				out.indices.push_back(newIndex[v]);
+			}
+		}
+		return out;
+	}
+};
@@ -0,0 +1,204 @@
+#pragma once
+#include <vector>
+#include <algorithm>
+#include <limits>
+#include <cassert>
+#include "Vec3.h"
+#include "BoundingSphere.h"
+
+// small cluster of triangles that can be culled as a whole before its vertices are shaded
+struct Meshlet
+{
+	// range in Meshlets::vertices (global vertex indices)
+	size_t vertexOffset = 0;
+	size_t vertexCount = 0;
+	// range in Meshlets::indices (local indices, 3 per triangle)
+	size_t indexOffset = 0;
+	size_t triangleCount = 0;
+	// index of the first triangle in the source index list
+	// triangles of a meshlet are contiguous in the source so the geometry shader
+	// still sees the original triangle index
+	size_t firstTriangle = 0;
+	BoundingSphere bounds;
+	// normal cone, the whole cluster is backfacing when
+	// normalize(apex - eye) * axis > cutoff
+	// cutoff of 1 means the cone is too wide to ever cull
+	Vec3 coneApex = { 0.0f,0.0f,0.0f };
+	Vec3 coneAxis = { 0.0f,0.0f,1.0f };
+	float coneCutoff = 1.0f;
+};
+
+// meshlet decomposition of an indexed triangle list
+class Meshlets
+{
+public:
+	static constexpr size_t DefaultMaxVertices = 64;
+	static constexpr size_t DefaultMaxTriangles = 124;
+public:
+	// greedy partition in index order: triangles are appended to the current meshlet
+	// until adding one would exceed the vertex or triangle limit
+	template<class V>
+	static Meshlets Build(const std::vector<V>& verts, const std::vector<size_t>& inds,
+		size_t maxVertices = DefaultMaxVertices, size_t maxTriangles = DefaultMaxTriangles)
+	{
+		// local indices are stored as bytes
+		assert(maxVertices <= 256);
+		assert(inds.size() % 3 == 0);
+
+		Meshlets ml;
+		// maps global vertex index to local index in the meshlet being built
+		constexpr size_t none = std::numeric_limits<size_t>::max();
+		std::vector<size_t> localIndex(verts.size(), none);
+
+		Meshlet cur;
+		const auto flush = [&]()
+		{
+			if (cur.triangleCount == 0)
+			{
+				return;
+			}
+			// reset lookup for the vertices of this meshlet only
+			for (size_t i = 0; i < cur.vertexCount; i++)
+			{
+				localIndex[ml.vertices[cur.vertexOffset + i]] = none;
+			}
+			ComputeBounds(verts, ml, cur);
+			ml.meshlets.push_back(cur);
+
+			Meshlet next;
+			next.vertexOffset = ml.vertices.size();
+			next.indexOffset = ml.indices.size();
+			next.firstTriangle = cur.firstTriangle + cur.triangleCount;
+			cur = next;
+		};
+
+		for (size_t t = 0, end = inds.size() / 3; t < end; t++)
+		{
+			const size_t a = inds[t * 3];
+			const size_t b = inds[t * 3 + 1];
+			const size_t c = inds[t * 3 + 2];
+
+			// count vertices this triangle would add
+			size_t newVerts = 0;
+			newVerts += localIndex[a] == none ? 1 : 0;
+			newVerts += localIndex[b] == none && b != a ? 1 : 0;
+			newVerts += localIndex[c] == none && c != a && c != b ? 1 : 0;
+
+			if (cur.vertexCount + newVerts > maxVertices || cur.triangleCount + 1 > maxTriangles)
+			{
+				flush();
+			}
+
+			for (const size_t v : { a,b,c })
+			{
+				if (localIndex[v] == none)
+				{
+					localIndex[v] = cur.vertexCount++;
+					ml.vertices.push_back(v);
+				}
+				ml.indices.push_back((unsigned char)localIndex[v]);
+			}
+			cur.triangleCount++;
+		}
+		flush();
+
+		return ml;
+	}
+	bool IsEmpty() const
+	{
+		return meshlets.empty();
+	}
+	void Clear()
+	{
+		meshlets.clear();
+		vertices.clear();
+		indices.clear();
+	}
+private:
+	template<class V>
+	static void ComputeBounds(const std::vector<V>& verts, const Meshlets& ml, Meshlet& m)
+	{
+		const auto pos = [&](size_t local) -> const Vec3&
+		{
+			return verts[ml.vertices[m.vertexOffset + local]].pos;
+		};
+
+		// bounding sphere around the aabb center, radius from farthest vertex
+		Vec3 lo = pos(0);
+		Vec3 hi = pos(0);
+		for (size_t i = 1; i < m.vertexCount; i++)
+		{
+			const auto& p = pos(i);
+			lo = { std::min(lo.x,p.x),std::min(lo.y,p.y),std::min(lo.z,p.z) };
+			hi = { std::max(hi.x,p.x),std::max(hi.y,p.y),std::max(hi.z,p.z) };
+		}
+		const Vec3 center = (lo + hi) * 0.5f;
+		float radiusSq = 0.0f;
+		for (size_t i = 0; i < m.vertexCount; i++)
+		{
+			radiusSq = std::max(radiusSq, (pos(i) - center).LenSq());
+		}
+		m.bounds = { center,std::sqrt(radiusSq) };
+
+		// triangle normals, same winding as the pipeline backface test
+		// degenerate triangles get a zero normal and don't constrain the cone
+		std::vector<Vec3> normals(m.triangleCount, Vec3{ 0.0f,0.0f,0.0f });
+		Vec3 axis = { 0.0f,0.0f,0.0f };
+		for (size_t t = 0; t < m.triangleCount; t++)
+		{
+			const auto& p0 = pos(ml.indices[m.indexOffset + t * 3]);
+			const auto& p1 = pos(ml.indices[m.indexOffset + t * 3 + 1]);
+			const auto& p2 = pos(ml.indices[m.indexOffset + t * 3 + 2]);
+			auto n = (p1 - p0).CrossProd(p2 - p0);
+			const float len = n.Len();
+			if (len > 0.0f)
+			{
+				normals[t] = n / len;
+				axis += normals[t];
+			}
+		}
+		const float axisLen = axis.Len();
+		if (axisLen == 0.0f)
+		{
+			return;
+		}
+		axis /= axisLen;
+
+		// smallest cosine between the axis and any triangle normal
+		float minDot = 1.0f;
+		for (const auto& n : normals)
+		{
+			if (n.LenSq() > 0.0f)
+			{
+				minDot = std::min(minDot, n * axis);
+			}
+		}
+		// cone wider than ~84 degrees, not worth testing
+		if (minDot <= 0.1f)
+		{
+			return;
+		}
+
+		// move the apex back along the axis until it is behind every triangle plane
+		float maxT = 0.0f;
+		for (size_t t = 0; t < m.triangleCount; t++)
+		{
+			const auto& n = normals[t];
+			if (n.LenSq() > 0.0f)
+			{
+				const auto& p0 = pos(ml.indices[m.indexOffset + t * 3]);
+				maxT = std::max(maxT, ((center - p0) * n) / (axis * n));
+			}
+		}
+
+		m.coneApex = center - axis * maxT;
+		m.coneAxis = axis;
+		m.coneCutoff = std::sqrt(1.0f - sq(minDot));
+	}
+public:
+	std::vector<Meshlet> meshlets;
+	// global vertex index for each meshlet local vertex
+	std::vector<size_t> vertices;
+	// meshlet local triangle indices
+	std::vector<unsigned char> indices;
+};
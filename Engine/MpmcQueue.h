@@ -0,0 +1,117 @@
+#pragma once
+#include <atomic>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+#include <cassert>
+
+// bounded lock-free multi-producer multi-consumer queue (Vyukov's ring with a sequence number per cell)
+// producers and consumers each claim a slot with one compare-exchange on their position counter, the
+// cell's sequence tells whether it is free to write or ready to read; nothing ever blocks, a full or
+// empty queue makes TryPush / TryPop return false and the caller decides how to wait
+template<typename T>
+class MpmcQueue
+{
+public:
+	// capacity is rounded up to a power of two
+	explicit MpmcQueue(size_t capacity)
+	{
+		size_t size = 2;
+		while (size < capacity)
+		{
+			size *= 2;
+		}
+		mask = size - 1;
+		cells = std::make_unique<Cell[]>(size);
+		for (size_t i = 0; i < size; i++)
+		{
+			cells[i].sequence.store(i, std::memory_order_relaxed);
+		}
+	}
+	MpmcQueue(const MpmcQueue&) = delete;
+	MpmcQueue& operator=(const MpmcQueue&) = delete;
+	bool TryPush(const T& item)
+	{
+		size_t pos = enqueuePos.load(std::memory_order_relaxed);
+		Cell* pCell;
+		while (true)
+		{
+			pCell = &cells[pos & mask];
+			const size_t seq = pCell->sequence.load(std::memory_order_acquire);
+			const intptr_t dif = intptr_t(seq) - intptr_t(pos);
+			if (dif == 0)
+			{
+				if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+				{
+					break;
+				}
+			}
+			else if (dif < 0)
+			{
+				// the cell still holds the item from one lap ago
+				return false;
+			}
+			else
+			{
+				pos = enqueuePos.load(std::memory_order_relaxed);
+			}
+		}
+		pCell->data = item;
+		pCell->sequence.store(pos + 1, std::memory_order_release);
+		return true;
+	}
+	bool TryPop(T& item)
+	{
+		size_t pos = dequeuePos.load(std::memory_order_relaxed);
+		Cell* pCell;
+		while (true)
+		{
+			pCell = &cells[pos & mask];
+			const size_t seq = pCell->sequence.load(std::memory_order_acquire);
+			const intptr_t dif = intptr_t(seq) - intptr_t(pos + 1);
+			if (dif == 0)
+			{
+				if (dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+				{
+					break;
+				}
+			}
+			else if (dif < 0)
+			{
+				// nothing written to the cell yet
+				return false;
+			}
+			else
+			{
+				pos = dequeuePos.load(std::memory_order_relaxed);
+			}
+		}
+		item = std::move(pCell->data);
+		// free for the write one lap ahead
+		pCell->sequence.store(pos + mask + 1, std::memory_order_release);
+		return true;
+	}
+	size_t GetCapacity() const
+	{
+		return mask + 1;
+	}
+	// only a snapshot while other threads push and pop
+	size_t GetSizeApprox() const
+	{
+		const size_t tail = enqueuePos.load(std::memory_order_relaxed);
+		const size_t head = dequeuePos.load(std::memory_order_relaxed);
+		return tail > head ? tail - head : 0;
+	}
+private:
+	struct alignas(64) Cell
+	{
+		std::atomic<size_t> sequence;
+		T data;
+	};
+private:
+	std::unique_ptr<Cell[]> cells;
+	size_t mask;
+	// producers and consumers on separate cache lines
+	alignas(64) std::atomic<size_t> enqueuePos = { 0 };
+	alignas(64) std::atomic<size_t> dequeuePos = { 0 };
+};
@@ -1,14 +1,13 @@
 #pragma once
 #include "Vec3.h"
 #include "Vec4.h"
-#include "Graphics.h"
 
 class NDCScreenTransformer {
 public:
-	NDCScreenTransformer()
+	NDCScreenTransformer(int width, int height)
 		:
-	xFactor (float( Graphics::ScreenWidth / 2 )),
-	yFactor (float( Graphics::ScreenHeight / 2))
+	xFactor (float( width / 2 )),
+	yFactor (float( height / 2))
 	{
 	}
 	template <typename Vertex>
@@ -0,0 +1,635 @@
+#include "ObjParser.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <stdexcept>
+#include "JobSystem.h"
+
+namespace
+{
+	constexpr int32_t Missing = INT32_MIN;
+	// triangles before the first usemtl of a chunk continue the material the previous chunk ended with
+	constexpr uint32_t InheritMaterial = 0xFFFFFFFFu;
+	constexpr uint32_t EndOfChain = 0xFFFFFFFFu;
+	// smallest piece of the file worth a thread of its own
+	constexpr size_t MinChunkSize = 256u * 1024u;
+
+	constexpr uint8_t RelativePosition = 1u;
+	constexpr uint8_t RelativeTexcoord = 2u;
+	constexpr uint8_t RelativeNormal = 4u;
+	// face corner with 0-based indices; negative (relative) obj indices can't be made absolute
+	// before the counts of the earlier chunks are known, so they are stored relative to the
+	// start of the chunk and flagged, the merge adds the chunk's offset
+	struct Corner
+	{
+		int32_t v;
+		int32_t vt;
+		int32_t vn;
+		uint8_t relative;
+	};
+	struct Chunk
+	{
+		// xyz / uv / xyz, texcoords and normals only if requested
+		std::vector<float> positions;
+		std::vector<float> texcoords;
+		std::vector<float> normals;
+		size_t positionCount = 0u;
+		size_t texcoordCount = 0u;
+		size_t normalCount = 0u;
+		// 3 per triangle
+		std::vector<Corner> corners;
+		// index into materialNames per triangle
+		std::vector<uint32_t> triangleMaterials;
+		std::vector<std::string> materialNames;
+		// material active at the end of the chunk
+		uint32_t lastMaterial = InheritMaterial;
+		std::vector<std::string> libraries;
+		std::exception_ptr error;
+	};
+
+	bool IsBlank( char c )
+	{
+		return c == ' ' || c == '\t' || c == '\r';
+	}
+	const char* SkipBlanks( const char* p,const char* pEnd )
+	{
+		while( p < pEnd && IsBlank( *p ) )
+		{
+			p++;
+		}
+		return p;
+	}
+	// p is at a keyword of the given length, true if it is followed by a blank or the line end
+	bool IsKeyword( const char* p,const char* pEnd,const char* keyword,size_t length )
+	{
+		return size_t( pEnd - p ) >= length && std::memcmp( p,keyword,length ) == 0 &&
+			(size_t( pEnd - p ) == length || IsBlank( p[length] ));
+	}
+	// rest of the line without surrounding blanks
+	std::string Trimmed( const char* p,const char* pEnd )
+	{
+		p = SkipBlanks( p,pEnd );
+		while( pEnd > p && IsBlank( pEnd[-1] ) )
+		{
+			pEnd--;
+		}
+		return std::string( p,pEnd );
+	}
+	[[noreturn]] void Fail( const char* what,const char* pLine,const char* pLineEnd )
+	{
+		throw std::runtime_error( std::string( "ObjParser " ) + what + " in line: " +
+			std::string( pLine,std::min( pLineEnd,pLine + 80 ) ) );
+	}
+
+	// reads count floats into out (if given), extra values on the line (w, vertex colors) are ignored
+	void ParseFloats( const char* p,const char* pEnd,const char* pLine,int count,std::vector<float>* pOut )
+	{
+		for( int i = 0; i < count; i++ )
+		{
+			float value;
+			p = ObjParser::ParseFloat( SkipBlanks( p,pEnd ),pEnd,value );
+			if( !p )
+			{
+				// texcoords may leave out v
+				if( count == 2 && i == 1 )
+				{
+					value = 0.0f;
+				}
+				else
+				{
+					Fail( "expected a number",pLine,pEnd );
+				}
+			}
+			if( pOut )
+			{
+				pOut->push_back( value );
+			}
+		}
+	}
+	// one index of a face corner made 0-based, relative ones from the start of the chunk
+	const char* ParseIndex( const char* p,const char* pEnd,size_t count,int32_t& index,bool& relative )
+	{
+		bool negative = false;
+		if( p < pEnd && *p == '-' )
+		{
+			negative = true;
+			p++;
+		}
+		int64_t value = 0;
+		const char* const pDigits = p;
+		while( p < pEnd && unsigned( *p - '0' ) < 10u && value < INT32_MAX )
+		{
+			value = value * 10 + (*p - '0');
+			p++;
+		}
+		if( p == pDigits || value == 0 || value >= INT32_MAX )
+		{
+			return nullptr;
+		}
+		relative = negative;
+		index = int32_t( negative ? int64_t( count ) - value : value - 1 );
+		return p;
+	}
+	void ParseFace( const char* p,const char* pEnd,const char* pLine,Chunk& chunk,uint32_t material )
+	{
+		Corner first = {};
+		Corner previous = {};
+		int n = 0;
+		for( p = SkipBlanks( p,pEnd ); p < pEnd; p = SkipBlanks( p,pEnd ) )
+		{
+			Corner c = { 0,Missing,Missing,0u };
+			bool relative = false;
+			p = ParseIndex( p,pEnd,chunk.positionCount,c.v,relative );
+			if( !p )
+			{
+				Fail( "bad face index",pLine,pEnd );
+			}
+			c.relative |= relative ? RelativePosition : 0u;
+			if( p < pEnd && *p == '/' )
+			{
+				p++;
+				if( p < pEnd && *p != '/' )
+				{
+					p = ParseIndex( p,pEnd,chunk.texcoordCount,c.vt,relative );
+					if( !p )
+					{
+						Fail( "bad texcoord index",pLine,pEnd );
+					}
+					c.relative |= relative ? RelativeTexcoord : 0u;
+				}
+				if( p < pEnd && *p == '/' )
+				{
+					p = ParseIndex( p + 1,pEnd,chunk.normalCount,c.vn,relative );
+					if( !p )
+					{
+						Fail( "bad normal index",pLine,pEnd );
+					}
+					c.relative |= relative ? RelativeNormal : 0u;
+				}
+			}
+			if( p < pEnd && !IsBlank( *p ) )
+			{
+				Fail( "bad face corner",pLine,pEnd );
+			}
+			// fan triangulation, fine for the convex polygons obj exporters write
+			if( n == 0 )
+			{
+				first = c;
+			}
+			else if( n >= 2 )
+			{
+				chunk.corners.push_back( first );
+				chunk.corners.push_back( previous );
+				chunk.corners.push_back( c );
+				chunk.triangleMaterials.push_back( material );
+			}
+			previous = c;
+			n++;
+		}
+		if( n < 3 )
+		{
+			Fail( "face with fewer than 3 vertices",pLine,pEnd );
+		}
+	}
+	void ParseChunk( const char* p,const char* pEnd,const ObjParser::Options& options,Chunk& chunk )
+	{
+		uint32_t material = InheritMaterial;
+		while( p < pEnd )
+		{
+			const char* pLineEnd = static_cast<const char*>( std::memchr( p,'\n',size_t( pEnd - p ) ) );
+			if( !pLineEnd )
+			{
+				pLineEnd = pEnd;
+			}
+			const char* const pLine = p;
+			// a # anywhere starts a comment, only what is in front of it is parsed
+			const char* const pHash = static_cast<const char*>( std::memchr( p,'#',size_t( pLineEnd - p ) ) );
+			const char* const pContentEnd = pHash ? pHash : pLineEnd;
+			p = SkipBlanks( p,pContentEnd );
+			if( p < pContentEnd )
+			{
+				switch( *p )
+				{
+				case 'v':
+					if( IsKeyword( p,pContentEnd,"v",1u ) )
+					{
+						ParseFloats( p + 1,pContentEnd,pLine,3,&chunk.positions );
+						chunk.positionCount++;
+					}
+					else if( IsKeyword( p,pContentEnd,"vt",2u ) )
+					{
+						ParseFloats( p + 2,pContentEnd,pLine,2,options.texcoords ? &chunk.texcoords : nullptr );
+						chunk.texcoordCount++;
+					}
+					else if( IsKeyword( p,pContentEnd,"vn",2u ) )
+					{
+						ParseFloats( p + 2,pContentEnd,pLine,3,options.normals ? &chunk.normals : nullptr );
+						chunk.normalCount++;
+					}
+					break;
+				case 'f':
+					if( IsKeyword( p,pContentEnd,"f",1u ) )
+					{
+						ParseFace( p + 1,pContentEnd,pLine,chunk,material );
+					}
+					break;
+				case 'u':
+					if( options.materials && IsKeyword( p,pContentEnd,"usemtl",6u ) )
+					{
+						const std::string name = Trimmed( p + 6,pContentEnd );
+						const auto it = std::find( chunk.materialNames.begin(),chunk.materialNames.end(),name );
+						material = uint32_t( it - chunk.materialNames.begin() );
+						if( it == chunk.materialNames.end() )
+						{
+							chunk.materialNames.push_back( name );
+						}
+					}
+					break;
+				case 'm':
+					if( options.materials && IsKeyword( p,pContentEnd,"mtllib",6u ) )
+					{
+						chunk.libraries.push_back( Trimmed( p + 6,pContentEnd ) );
+					}
+					break;
+				default:
+					// o, g, s, l, p and everything else are skipped
+					break;
+				}
+			}
+			p = pLineEnd + 1;
+		}
+		chunk.lastMaterial = material;
+	}
+
+	ObjParser::Mesh ParseText( const char* pData,size_t size,const ObjParser::Options& options,
+		std::vector<std::string>* pLibraries )
+	{
+		// split on line boundaries
+		auto& jobs = JobSystem::Get();
+		const unsigned int threads = options.threads ? options.threads : jobs.GetThreadCount();
+		const size_t chunkCount = std::max( std::min( size_t( threads ),size / MinChunkSize ),size_t( 1u ) );
+		std::vector<const char*> bounds( chunkCount + 1u );
+		bounds[0] = pData;
+		bounds[chunkCount] = pData + size;
+		for( size_t i = 1u; i < chunkCount; i++ )
+		{
+			const char* p = std::max( pData + size * i / chunkCount,bounds[i - 1u] );
+			const void* pNewline = std::memchr( p,'\n',size_t( pData + size - p ) );
+			bounds[i] = pNewline ? static_cast<const char*>( pNewline ) + 1 : pData + size;
+		}
+
+		// parse the chunks on the job system
+		std::vector<Chunk> chunks( chunkCount );
+		jobs.ParallelFor( chunkCount,1u,[&]( size_t begin,size_t end )
+		{
+			for( size_t i = begin; i < end; i++ )
+			{
+				try
+				{
+					ParseChunk( bounds[i],bounds[i + 1u],options,chunks[i] );
+				}
+				catch( ... )
+				{
+					chunks[i].error = std::current_exception();
+				}
+			}
+		} );
+		for( const auto& c : chunks )
+		{
+			if( c.error )
+			{
+				std::rethrow_exception( c.error );
+			}
+		}
+
+		// concatenate the attributes
+		std::vector<Vec3> positions;
+		std::vector<Vec3> normals;
+		std::vector<Vec2> texcoords;
+		size_t triangleCount = 0u;
+		size_t texcoordCount = 0u;
+		size_t normalCount = 0u;
+		for( const auto& c : chunks )
+		{
+			texcoordCount += c.texcoordCount;
+			normalCount += c.normalCount;
+			for( size_t i = 0u; i < c.positions.size(); i += 3u )
+			{
+				positions.push_back( { c.positions[i],c.positions[i + 1u],c.positions[i + 2u] } );
+			}
+			for( size_t i = 0u; i < c.normals.size(); i += 3u )
+			{
+				normals.push_back( { c.normals[i],c.normals[i + 1u],c.normals[i + 2u] } );
+			}
+			for( size_t i = 0u; i < c.texcoords.size(); i += 2u )
+			{
+				texcoords.push_back( { c.texcoords[i],c.texcoords[i + 1u] } );
+			}
+			triangleCount += c.triangleMaterials.size();
+			if( pLibraries )
+			{
+				pLibraries->insert( pLibraries->end(),c.libraries.begin(),c.libraries.end() );
+			}
+		}
+		const bool useNormals = !normals.empty();
+		const bool useTexcoords = !texcoords.empty();
+
+		ObjParser::Mesh mesh;
+		mesh.materials.emplace_back();
+		mesh.indices.reserve( triangleCount * 3u );
+		mesh.triangleMaterials.reserve( options.materials ? triangleCount : 0u );
+
+		// vertices sharing a position are chained so a new tuple only has to be compared with those
+		std::vector<uint32_t> chainHeads( (useNormals || useTexcoords) ? positions.size() : 0u,EndOfChain );
+		std::vector<uint32_t> chainNext;
+		std::vector<Corner> vertexKeys;
+
+		size_t positionOffset = 0u;
+		size_t texcoordOffset = 0u;
+		size_t normalOffset = 0u;
+		uint32_t currentMaterial = 0u;
+		for( const auto& c : chunks )
+		{
+			// chunk material names to mesh materials
+			std::vector<uint32_t> materialIds;
+			for( const auto& name : c.materialNames )
+			{
+				const auto it = std::find_if( mesh.materials.begin() + 1,mesh.materials.end(),
+					[&name]( const ObjParser::Material& m ) { return m.name == name; } );
+				materialIds.push_back( uint32_t( it - mesh.materials.begin() ) );
+				if( it == mesh.materials.end() )
+				{
+					mesh.materials.emplace_back();
+					mesh.materials.back().name = name;
+				}
+			}
+			for( size_t t = 0u; t < c.triangleMaterials.size(); t++ )
+			{
+				if( options.materials )
+				{
+					const uint32_t m = c.triangleMaterials[t];
+					mesh.triangleMaterials.push_back( m == InheritMaterial ? currentMaterial : materialIds[m] );
+				}
+				for( size_t k = 0u; k < 3u; k++ )
+				{
+					Corner corner = c.corners[t * 3u + k];
+					const auto resolve = [&corner]( int32_t& index,uint8_t bit,size_t offset,size_t count,const char* what )
+					{
+						if( index == Missing )
+						{
+							return;
+						}
+						const int64_t absolute = (corner.relative & bit) ? int64_t( offset ) + index : index;
+						if( absolute < 0 || absolute >= int64_t( count ) )
+						{
+							throw std::runtime_error( std::string( "ObjParser " ) + what + " index out of range" );
+						}
+						index = int32_t( absolute );
+					};
+					resolve( corner.v,RelativePosition,positionOffset,positions.size(),"position" );
+					resolve( corner.vt,RelativeTexcoord,texcoordOffset,texcoordCount,"texcoord" );
+					resolve( corner.vn,RelativeNormal,normalOffset,normalCount,"normal" );
+					if( !useNormals && !useTexcoords )
+					{
+						mesh.indices.push_back( uint32_t( corner.v ) );
+						continue;
+					}
+					if( !useTexcoords )
+					{
+						corner.vt = Missing;
+					}
+					if( !useNormals )
+					{
+						corner.vn = Missing;
+					}
+					uint32_t i = chainHeads[corner.v];
+					while( i != EndOfChain && (vertexKeys[i].vt != corner.vt || vertexKeys[i].vn != corner.vn) )
+					{
+						i = chainNext[i];
+					}
+					if( i == EndOfChain )
+					{
+						i = uint32_t( vertexKeys.size() );
+						vertexKeys.push_back( corner );
+						chainNext.push_back( chainHeads[corner.v] );
+						chainHeads[corner.v] = i;
+					}
+					mesh.indices.push_back( i );
+				}
+			}
+			if( c.lastMaterial != InheritMaterial )
+			{
+				currentMaterial = materialIds[c.lastMaterial];
+			}
+			positionOffset += c.positionCount;
+			texcoordOffset += c.texcoordCount;
+			normalOffset += c.normalCount;
+		}
+
+		// the vertex stream, or the positions as they are when there is nothing to split them by
+		if( !useNormals && !useTexcoords )
+		{
+			mesh.positions = std::move( positions );
+			return mesh;
+		}
+		mesh.positions.reserve( vertexKeys.size() );
+		for( const auto& key : vertexKeys )
+		{
+			mesh.positions.push_back( positions[key.v] );
+		}
+		if( useNormals )
+		{
+			mesh.normals.reserve( vertexKeys.size() );
+			for( const auto& key : vertexKeys )
+			{
+				mesh.normals.push_back( key.vn == Missing ? Vec3{ 0.0f,0.0f,0.0f } : normals[key.vn] );
+			}
+		}
+		if( useTexcoords )
+		{
+			mesh.texcoords.reserve( vertexKeys.size() );
+			for( const auto& key : vertexKeys )
+			{
+				mesh.texcoords.push_back( key.vt == Missing ? Vec2{ 0.0f,0.0f } : texcoords[key.vt] );
+			}
+		}
+		return mesh;
+	}
+
+	std::vector<char> ReadFile( const std::string& filename )
+	{
+		std::ifstream file( filename,std::ios::binary | std::ios::ate );
+		if( !file )
+		{
+			throw std::runtime_error( "ObjParser failed to open file  File:" + filename );
+		}
+		std::vector<char> data( size_t( file.tellg() ) );
+		file.seekg( 0 );
+		file.read( data.data(),std::streamsize( data.size() ) );
+		if( !file )
+		{
+			throw std::runtime_error( "ObjParser failed to read file  File:" + filename );
+		}
+		return data;
+	}
+	// fills in the diffuse color and texture of the mesh materials defined in the library
+	void LoadMaterialLibrary( const std::string& path,std::vector<ObjParser::Material>& materials )
+	{
+		std::ifstream file( path,std::ios::binary );
+		ObjParser::Material* pCurrent = nullptr;
+		std::string line;
+		while( std::getline( file,line ) )
+		{
+			// same comment rule as the obj itself
+			line.erase( std::min( line.find( '#' ),line.size() ) );
+			const char* p = line.data();
+			const char* const pEnd = line.data() + line.size();
+			p = SkipBlanks( p,pEnd );
+			if( IsKeyword( p,pEnd,"newmtl",6u ) )
+			{
+				const std::string name = Trimmed( p + 6,pEnd );
+				const auto it = std::find_if( materials.begin() + 1,materials.end(),
+					[&name]( const ObjParser::Material& m ) { return m.name == name; } );
+				pCurrent = it == materials.end() ? nullptr : &*it;
+			}
+			else if( pCurrent && IsKeyword( p,pEnd,"Kd",2u ) )
+			{
+				std::vector<float> rgb;
+				ParseFloats( p + 2,pEnd,line.c_str(),3,&rgb );
+				pCurrent->diffuse = { rgb[0],rgb[1],rgb[2] };
+			}
+			else if( pCurrent && IsKeyword( p,pEnd,"map_Kd",6u ) )
+			{
+				// options like -s come first, the file name is the last token
+				const std::string rest = Trimmed( p + 6,pEnd );
+				const size_t lastBlank = rest.find_last_of( " \t" );
+				pCurrent->diffuseMap = lastBlank == std::string::npos ? rest : rest.substr( lastBlank + 1u );
+			}
+		}
+	}
+}
+
+ObjParser::Mesh ObjParser::Load( const std::string& filename,const Options& options )
+{
+	const auto data = ReadFile( filename );
+	std::vector<std::string> libraries;
+	Mesh mesh = ParseText( data.data(),data.size(),options,&libraries );
+
+	const size_t slash = filename.find_last_of( "/\\" );
+	const std::string directory = slash == std::string::npos ? std::string() : filename.substr( 0u,slash + 1u );
+	std::sort( libraries.begin(),libraries.end() );
+	libraries.erase( std::unique( libraries.begin(),libraries.end() ),libraries.end() );
+	for( const auto& library : libraries )
+	{
+		LoadMaterialLibrary( directory + library,mesh.materials );
+	}
+	return mesh;
+}
+
+ObjParser::Mesh ObjParser::Load( const std::string& filename )
+{
+	return Load( filename,Options{} );
+}
+
+ObjParser::Mesh ObjParser::Parse( const char* pData,size_t size,const Options& options )
+{
+	return ParseText( pData,size,options,nullptr );
+}
+
+const char* ObjParser::ParseFloat( const char* p,const char* pEnd,float& value )
+{
+	// powers of ten that are exact in a double
+	static const double powers[] = {
+		1e0,1e1,1e2,1e3,1e4,1e5,1e6,1e7,1e8,1e9,1e10,1e11,
+		1e12,1e13,1e14,1e15,1e16,1e17,1e18,1e19,1e20,1e21,1e22 };
+
+	const char* const pStart = p;
+	bool negative = false;
+	if( p < pEnd && (*p == '-' || *p == '+') )
+	{
+		negative = *p == '-';
+		p++;
+	}
+	// up to 19 significant digits fit the mantissa, the rest only move the exponent
+	uint64_t mantissa = 0u;
+	int significant = 0;
+	int exponent = 0;
+	bool anyDigits = false;
+	for( ; p < pEnd && unsigned( *p - '0' ) < 10u; p++ )
+	{
+		anyDigits = true;
+		if( significant < 19 )
+		{
+			mantissa = mantissa * 10u + unsigned( *p - '0' );
+			significant += mantissa != 0u;
+		}
+		else
+		{
+			exponent++;
+		}
+	}
+	if( p < pEnd && *p == '.' )
+	{
+		for( p++; p < pEnd && unsigned( *p - '0' ) < 10u; p++ )
+		{
+			anyDigits = true;
+			if( significant < 19 )
+			{
+				mantissa = mantissa * 10u + unsigned( *p - '0' );
+				significant += mantissa != 0u;
+				exponent--;
+			}
+		}
+	}
+	if( !anyDigits )
+	{
+		// nan, inf and the like
+		char buffer[32];
+		const size_t length = std::min( size_t( pEnd - pStart ),sizeof( buffer ) - 1u );
+		std::memcpy( buffer,pStart,length );
+		buffer[length] = '\0';
+		char* pParsed = nullptr;
+		value = std::strtof( buffer,&pParsed );
+		return pParsed == buffer ? nullptr : pStart + (pParsed - buffer);
+	}
+	if( p < pEnd && (*p == 'e' || *p == 'E') )
+	{
+		const char* q = p + 1;
+		bool negativeExponent = false;
+		if( q < pEnd && (*q == '-' || *q == '+') )
+		{
+			negativeExponent = *q == '-';
+			q++;
+		}
+		if( q < pEnd && unsigned( *q - '0' ) < 10u )
+		{
+			int e = 0;
+			for( ; q < pEnd && unsigned( *q - '0' ) < 10u; q++ )
+			{
+				e = std::min( e * 10 + (*q - '0'),100000 );
+			}
+			exponent += negativeExponent ? -e : e;
+			p = q;
+		}
+	}
+
+	double result = double( mantissa );
+	if( mantissa == 0u )
+	{
+		result = 0.0;
+	}
+	else if( exponent >= -22 && exponent <= 22 && mantissa < (uint64_t( 1u ) << 53) )
+	{
+		// both operands exact, so the result is correctly rounded
+		result = exponent < 0 ? result / powers[-exponent] : result * powers[exponent];
+	}
+	else
+	{
+		result *= std::pow( 10.0,double( exponent ) );
+	}
+	value = float( negative ? -result : result );
+	return p;
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include "Vec2.h"
+#include "Vec3.h"
+#include <vector>
+#include <string>
+#include <cstdint>
+
+// multithreaded wavefront obj reader
+// the file is split into chunks on line boundaries that are parsed in parallel, then every
+// object / group is merged into one mesh, polygons are fan triangulated and position / texcoord /
+// normal tuples are deduplicated into a single vertex stream
+class ObjParser
+{
+public:
+	struct Material
+	{
+		std::string name;
+		Vec3 diffuse = { 0.8f,0.8f,0.8f };
+		// texture from map_Kd, as written in the mtl file (relative to it)
+		std::string diffuseMap;
+	};
+	struct Mesh
+	{
+		// one entry per unique vertex, normals / texcoords are empty when they were not
+		// requested or the file has none (vertices without one get zeros)
+		std::vector<Vec3> positions;
+		std::vector<Vec3> normals;
+		std::vector<Vec2> texcoords;
+		// 3 per triangle
+		std::vector<uint32_t> indices;
+		// material of each triangle, index into materials; 0 is the default material
+		// used by faces before the first usemtl; empty when materials were not requested
+		std::vector<uint32_t> triangleMaterials;
+		std::vector<Material> materials;
+	};
+	struct Options
+	{
+		bool normals = true;
+		bool texcoords = true;
+		// usemtl and mtllib, without them materials only holds the default material
+		bool materials = true;
+		// pieces the file is split into for parsing on the JobSystem, 0 picks one per job thread
+		unsigned int threads = 0u;
+	};
+public:
+	// reads the file and the mtl libraries it references (missing ones are skipped)
+	// throws std::runtime_error for unreadable files and malformed or out of range faces
+	static Mesh Load( const std::string& filename,const Options& options );
+	static Mesh Load( const std::string& filename );
+	// parses obj text from memory, materials only get their names
+	static Mesh Parse( const char* pData,size_t size,const Options& options );
+	// decimal float like strtof, without locale and without needing a terminated string
+	// returns the end of the number, or nullptr if there is none at p
+	static const char* ParseFloat( const char* p,const char* pEnd,float& value );
+};
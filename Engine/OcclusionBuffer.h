@@ -0,0 +1,188 @@
+#pragma once
+#include <vector>
+#include <limits>
+#include <algorithm>
+#include <cmath>
+#include "Vec3.h"
+#include "Vec4.h"
+#include "Mat.h"
+#include "BoundingSphere.h"
+#include "IndexedTriangleList.h"
+
+// low resolution depth buffer for software occlusion culling
+// designated occluders are rasterized into it first, then the bounding volume of every later
+// draw is tested against it before any vertex shading happens
+// occluders only write texels they cover completely and store their farthest depth over the
+// texel, so the test never rejects something that would have been visible past or through them
+// texels straddling the edges between two triangles stay empty, big triangles occlude the most
+// back faces are culled like the pipeline culls them, so an open mesh seen from behind doesn't occlude
+class OcclusionBuffer
+{
+public:
+	OcclusionBuffer(int width, int height)
+		:
+		width(width),
+		height(height),
+		depths(width * height)
+	{
+		Clear();
+	}
+	void Clear()
+	{
+		std::fill(depths.begin(), depths.end(), std::numeric_limits<float>::infinity());
+	}
+	// positions are transformed with worldViewProj (row vector convention like the effects)
+	template<class V>
+	void RasterizeOccluder(const IndexedTriangleList<V>& triList, const Mat4& worldViewProj)
+	{
+		clipVertices.resize(triList.vertices.size());
+		std::transform(triList.vertices.begin(), triList.vertices.end(), clipVertices.begin(),
+			[&worldViewProj](const V& v) { return Vec4(v.pos) * worldViewProj; });
+
+		for (size_t i = 0, end = triList.indices.size() / 3; i < end; i++)
+		{
+			const auto& c0 = clipVertices[triList.indices[i * 3]];
+			const auto& c1 = clipVertices[triList.indices[i * 3 + 1]];
+			const auto& c2 = clipVertices[triList.indices[i * 3 + 2]];
+			// dropping triangles only makes the occluder smaller, so near plane
+			// crossings are skipped instead of clipped
+			if (c0.z < 0.0f || c1.z < 0.0f || c2.z < 0.0f)
+			{
+				continue;
+			}
+			RasterizeTriangle(ToScreen(c0), ToScreen(c1), ToScreen(c2));
+		}
+	}
+	// sphere in model space, worldView / proj as bound to the vertex shader
+	bool IsVisible(const BoundingSphere& bs, const Mat4& worldView, const Mat4& proj) const
+	{
+		const auto c = Vec4(bs.center) * worldView;
+		const float nearZ = c.z - bs.radius;
+		// sphere reaches behind the near plane, can't bound its projection
+		const auto nearClip = Vec4{ 0.0f,0.0f,nearZ,1.0f } * proj;
+		if (nearZ <= 0.0f || nearClip.z < 0.0f)
+		{
+			return true;
+		}
+		const float nearDepth = nearClip.z / nearClip.w;
+
+		// screen rect from the projected corners of the view space box around the sphere
+		float xMin = std::numeric_limits<float>::infinity();
+		float yMin = std::numeric_limits<float>::infinity();
+		float xMax = -std::numeric_limits<float>::infinity();
+		float yMax = -std::numeric_limits<float>::infinity();
+		for (int i = 0; i < 8; i++)
+		{
+			const Vec4 corner = {
+				c.x + ((i & 1) ? bs.radius : -bs.radius),
+				c.y + ((i & 2) ? bs.radius : -bs.radius),
+				c.z + ((i & 4) ? bs.radius : -bs.radius),
+				1.0f
+			};
+			const auto s = ToScreen(corner * proj);
+			xMin = std::min(xMin, s.x);
+			yMin = std::min(yMin, s.y);
+			xMax = std::max(xMax, s.x);
+			yMax = std::max(yMax, s.y);
+		}
+
+		const int x0 = std::max(int(std::floor(xMin)), 0);
+		const int y0 = std::max(int(std::floor(yMin)), 0);
+		const int x1 = std::min(int(std::ceil(xMax)), width);
+		const int y1 = std::min(int(std::ceil(yMax)), height);
+		// off screen, frustum culling deals with it
+		if (x0 >= x1 || y0 >= y1)
+		{
+			return true;
+		}
+		for (int y = y0; y < y1; y++)
+		{
+			for (int x = x0; x < x1; x++)
+			{
+				if (nearDepth < depths[y * width + x])
+				{
+					return true;
+				}
+			}
+		}
+		return false;
+	}
+	int GetWidth() const
+	{
+		return width;
+	}
+	int GetHeight() const
+	{
+		return height;
+	}
+private:
+	// clip space to buffer texel coordinates, z is depth
+	Vec3 ToScreen(const Vec4& clip) const
+	{
+		const float wInv = 1.0f / clip.w;
+		return {
+			(clip.x * wInv + 1.0f) * 0.5f * float(width),
+			(-clip.y * wInv + 1.0f) * 0.5f * float(height),
+			clip.z * wInv
+		};
+	}
+	// edge function rasterizer (front faces only) writing the texels the triangle covers entirely: the
+	// barycentrics are linear, so all four texel corners are inside when every one of them is at
+	// least half a texel's worth of its gradient from 0 at the center
+	// writes the farthest depth of the triangle plane over the texel footprint
+	void RasterizeTriangle(const Vec3& p0, const Vec3& p1, const Vec3& p2)
+	{
+		// front faces are clockwise on screen with y down, which makes their area positive
+		const float area = (p1.x - p0.x) * (p2.y - p0.y) - (p1.y - p0.y) * (p2.x - p0.x);
+		if (area <= 0.0f)
+		{
+			return;
+		}
+		const float areaInv = 1.0f / area;
+		const float zMax = std::max(p0.z, std::max(p1.z, p2.z));
+
+		// depth plane gradients
+		const float dzdx = ((p1.z - p0.z) * (p2.y - p0.y) - (p2.z - p0.z) * (p1.y - p0.y)) * areaInv;
+		const float dzdy = ((p2.z - p0.z) * (p1.x - p0.x) - (p1.z - p0.z) * (p2.x - p0.x)) * areaInv;
+		const float zSlack = (std::abs(dzdx) + std::abs(dzdy)) * 0.5f;
+		// barycentric gradients, shrinking the edges by half a texel
+		const float db1dx = (p2.y - p0.y) * areaInv;
+		const float db1dy = -(p2.x - p0.x) * areaInv;
+		const float db2dx = -(p1.y - p0.y) * areaInv;
+		const float db2dy = (p1.x - p0.x) * areaInv;
+		const float b0Slack = (std::abs(db1dx + db2dx) + std::abs(db1dy + db2dy)) * 0.5f;
+		const float b1Slack = (std::abs(db1dx) + std::abs(db1dy)) * 0.5f;
+		const float b2Slack = (std::abs(db2dx) + std::abs(db2dy)) * 0.5f;
+
+		const int x0 = std::max(int(std::floor(std::min(p0.x, std::min(p1.x, p2.x)))), 0);
+		const int y0 = std::max(int(std::floor(std::min(p0.y, std::min(p1.y, p2.y)))), 0);
+		const int x1 = std::min(int(std::ceil(std::max(p0.x, std::max(p1.x, p2.x)))), width);
+		const int y1 = std::min(int(std::ceil(std::max(p0.y, std::max(p1.y, p2.y)))), height);
+
+		for (int y = y0; y < y1; y++)
+		{
+			const float py = float(y) + 0.5f;
+			for (int x = x0; x < x1; x++)
+			{
+				const float px = float(x) + 0.5f;
+				// barycentrics
+				const float b1 = ((px - p0.x) * (p2.y - p0.y) - (py - p0.y) * (p2.x - p0.x)) * areaInv;
+				const float b2 = ((p1.x - p0.x) * (py - p0.y) - (p1.y - p0.y) * (px - p0.x)) * areaInv;
+				const float b0 = 1.0f - b1 - b2;
+				if (b0 < b0Slack || b1 < b1Slack || b2 < b2Slack)
+				{
+					continue;
+				}
+				const float z = std::min(p0.z * b0 + p1.z * b1 + p2.z * b2 + zSlack, zMax);
+				float& d = depths[y * width + x];
+				d = std::min(d, z);
+			}
+		}
+	}
+private:
+	int width;
+	int height;
+	std::vector<float> depths;
+	// scratch storage for transformed occluder positions
+	std::vector<Vec4> clipVertices;
+};
@@ -1,6 +1,8 @@
 #pragma once
 #include "Pipeline.h"
 #include "DefaultGeometryShader.h"
+#include "LightGrid.h"
+#include "ShadowCubeMap.h"
 
 
 class PhongPointEffect {
@@ -36,17 +38,17 @@ public:
 		{
 		public:
 			Output() = default;
-			Output(const Vec3& pos)
+			Output(const Vec4& pos)
 				:
 				pos(pos)
 			{}
-			Output(const Vec3& pos, const Output& src)
+			Output(const Vec4& pos, const Output& src)
 				:
 				n(src.n),
 				worldPos(src.worldPos),
 				pos(pos)
 			{}
-			Output(const Vec3& pos, const Vec3& n, const Vec3& worldPos)
+			Output(const Vec4& pos, const Vec3& n, const Vec3& worldPos)
 				:
 				n(n),
 				pos(pos),
@@ -97,28 +99,57 @@ public:
 				return Output(*this) /= rhs;
 			}
 		public:
-			Vec3 pos;
+			Vec4 pos;
 			Vec3 n;
 			Vec3 worldPos;
 		};
 	public:
-		void BindRotation(const Mat3& rotation_in)
+		void BindWorld(const Mat4& transformation_in)
 		{
-			rotation = rotation_in;
+			world = transformation_in;
+			Compose();
 		}
-		void BindTranslation(const Vec3& translation_in)
+		void BindView(const Mat4& transformation_in)
 		{
-			translation = translation_in;
+			view = transformation_in;
+			Compose();
+		}
+		void BindProjection(const Mat4& transformation_in)
+		{
+			proj = transformation_in;
+			worldViewProj = worldView * proj;
+		}
+		const Mat4& GetProj() const
+		{
+			return proj;
+		}
+		const Mat4& GetWorldView() const
+		{
+			return worldView;
+		}
+		const Mat4& GetWorldViewProj() const
+		{
+			return worldViewProj;
 		}
 		Output operator()(const Vertex& v) const
 		{
-			const auto pos = v.pos * rotation + translation;
-			return { pos,v.n * rotation , pos };
+			const auto p4 = Vec4(v.pos);
+			return { p4 * worldViewProj,v.n * normalMatrix,p4 * worldView };
 		}
 	private:
-		Mat3 rotation;
-		Vec3 translation;
-		
+		void Compose()
+		{
+			worldView = world.AffineMultiply(view);
+			normalMatrix = worldView.GetNormalMatrix();
+			worldViewProj = worldView * proj;
+		}
+	private:
+		Mat4 world = Mat4::Identity();
+		Mat4 view = Mat4::Identity();
+		Mat4 proj = Mat4::Identity();
+		Mat4 worldView = Mat4::Identity();
+		Mat4 worldViewProj = Mat4::Identity();
+		Mat3 normalMatrix = Mat3::Identity();
 	};
 
 
@@ -130,15 +161,26 @@ public:
 		template<class Input>
 		Color operator()(const Input& in) const
 		{
-					// light to object vector ***** bad naming****
-	const auto vecL = light_pos - in.worldPos;
-			const auto distance = vecL.Len();
-			const auto dir = vecL / distance;
-			// calculate attentuation
-			const auto attenuation = 1.0f /
-				(constant_attenuation + linear_attenuation * distance + quadradic_attenuation * sq(distance));
-
-			const auto d = light_diffuse * attenuation * std::max(0.0f, (in.n.GetNormalized()  * dir));
+			const auto surfaceNormal = in.n.GetNormalized();
+			Vec3 d = { 0.0f,0.0f,0.0f };
+			if (pLightGrid)
+			{
+				// only the lights reaching this pixel's tile
+				for (const auto i : pLightGrid->GetTileLights(in.worldPos))
+				{
+					AddLight(pLightGrid->GetViewLight(i), in.worldPos, surfaceNormal, d);
+				}
+			}
+			else
+			{
+				// unbounded, so it is never faded, only dimmed where the shadow map has it blocked
+				const float lit = pShadowMap ? pShadowMap->Sample(in.worldPos) : 1.0f;
+				if (lit > 0.0f)
+				{
+					const PointLight light = { light_pos,light_diffuse * lit,std::numeric_limits<float>::infinity() };
+					AddLight(light, in.worldPos, surfaceNormal, d);
+				}
+			}
 
 			const auto c = color.GetHadamard(d + light_ambient).Saturate() * 255.0f;
 
@@ -156,7 +198,36 @@ public:
 		{
 			light_diffuse = d;
 		}
+		// many lights: each pixel is lit by the lights of its tile instead of the single light above
+		void SetLightGrid(std::shared_ptr<const LightGrid> pLightGrid_in)
+		{
+			pLightGrid = std::move(pLightGrid_in);
+		}
+		// shadows of the single light, rendered around the position passed to SetLightPos, nullptr turns them off
+		void SetShadowMap(std::shared_ptr<const ShadowCubeMap> pShadowMap_in)
+		{
+			pShadowMap = std::move(pShadowMap_in);
+		}
+	private:
+		void AddLight(const PointLight& light, const Vec3& worldPos, const Vec3& surfaceNormal, Vec3& d) const
+		{
+			// light to object vector ***** bad naming****
+			const auto vecL = light.pos - worldPos;
+			const auto distance = vecL.Len();
+			if (distance >= light.range)
+			{
+				return;
+			}
+			const auto dir = vecL / distance;
+			// calculate attentuation
+			const auto attenuation = light.GetFalloff(distance) /
+				(constant_attenuation + linear_attenuation * distance + quadradic_attenuation * sq(distance));
+
+			d += light.color * attenuation * std::max(0.0f, (surfaceNormal * dir));
+		}
 	private:
+		std::shared_ptr<const LightGrid> pLightGrid;
+		std::shared_ptr<const ShadowCubeMap> pShadowMap;
 		Vec3 light_pos = { 0.0f,0.0f,0.5f };
 		Vec3 light_diffuse = { 1.0f,1.0f,1.0f };
 		Vec3 light_ambient = { 0.1f,0.1f,0.1f };
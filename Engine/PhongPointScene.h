@@ -7,6 +7,8 @@
 #include "PhongPointEffect.h"
 #include "SolidEffect.h"
 #include "Sphere.h"
+#include "Plane.h"
+#include "ShadowCubeMap.h"
 
 
 class PhongPointScene : public Scene {
@@ -21,11 +23,16 @@ public:
 		:
 		itlist(std::move(tl)),
 		pZb(std::make_shared<ZBuffer>(gfx.ScreenWidth, gfx.ScreenHeight)),
+		pShadowMap(std::make_shared<ShadowCubeMap>(512, 0.05f, 20.0f)),
 		pipeline(gfx, pZb),
 		Lpipeline(gfx, pZb)
 	{
 		itlist.AdjustToTrueCenter();
 		offset_z = itlist.GetRadius() * 1.6f;
+		model_radius = itlist.GetRadius();
+		// wall behind the model to catch its shadow
+		backdrop = Plane::GetNormals<Vertex>(8, model_radius * 8.0f);
+		pipeline.effect.ps.SetShadowMap(pShadowMap);
 		for (auto& v : lightIndicator.vertices)
 		{
 			v.color = Colors::White;
@@ -89,38 +96,66 @@ public:
 		{
 			offset_z -= 2.0f * dt;
 		}
+		// H toggles shadows
+		const bool shadowsDown = kbd.KeyIsPressed('H');
+		if (shadowsDown && !shadowsWasDown)
+		{
+			shadows = !shadows;
+			pipeline.effect.ps.SetShadowMap(shadows ? pShadowMap : nullptr);
+		}
+		shadowsWasDown = shadowsDown;
 	}
 	virtual void Draw() override
 	{
 		pipeline.BeginFrame();
-		// generate rotation matrix 
-		const Mat3 rot =
-			Mat3::RotationX(theta_x) *
-			Mat3::RotationY(theta_y) *
-			Mat3::RotationZ(theta_z);
+		const auto proj = Mat4::ProjectionFOV(hfov, aspect_ratio, 0.5f, 20.0f);
+		// generate world matrix, the camera stays at the origin
+		const Mat4 world =
+			Mat4::RotationX(theta_x) *
+			Mat4::RotationY(theta_y) *
+			Mat4::RotationZ(theta_z) *
+			Mat4::Translation(0.0f, 0.0f, offset_z);
+		const Mat4 backdropWorld = Mat4::Translation(0.0f, 0.0f, offset_z + model_radius * 2.0f);
+		const Vec3 lpos = { lpos_x,lpos_y,lpos_z };
+
+		// depth of the casters around the light first, the pixel shader compares against it
+		// (the backdrop only faces the light, the shadow map keeps back faces)
+		if (shadows)
+		{
+			pShadowMap->Begin(lpos);
+			pShadowMap->Draw(itlist, world);
+			pShadowMap->End();
+		}
 
-		// translation
-		const Vec3 trans = { 0.0f,0.0f,offset_z };
 		// set pipeline transform
-		pipeline.effect.vs.BindRotation(rot);
-		pipeline.effect.vs.BindTranslation(trans);
-		pipeline.effect.ps.SetLightPos({ lpos_x,lpos_y,lpos_z });
+		pipeline.effect.vs.BindView(Mat4::Identity());
+		pipeline.effect.vs.BindProjection(proj);
+		pipeline.effect.ps.SetLightPos(lpos);
 
 		// render triangles
+		pipeline.effect.vs.BindWorld(world);
 		pipeline.Draw(itlist);
+		pipeline.effect.vs.BindWorld(backdropWorld);
+		pipeline.Draw(backdrop);
 
 
-		Lpipeline.effect.vs.BindTranslation({ lpos_x,lpos_y,lpos_z });
-		Lpipeline.effect.vs.BindRotation(Mat3::Identity());
+		Lpipeline.effect.vs.BindWorldView(Mat4::Translation(lpos));
+		Lpipeline.effect.vs.BindProjection(proj);
 		Lpipeline.Draw(lightIndicator);
 	}
 private:
 	IndexedTriangleList<Vertex> itlist;
+	IndexedTriangleList<Vertex> backdrop;
 	IndexedTriangleList<SolidEffect::Vertex> lightIndicator = Sphere::GetPlain<SolidEffect::Vertex>(0.05f);
 	std::shared_ptr<ZBuffer> pZb;
+	std::shared_ptr<ShadowCubeMap> pShadowMap;
 	Pipeline pipeline;
 	LightIndicatorPipeline Lpipeline;
+	// fov
+	static constexpr float aspect_ratio = 1.77777778f;
+	static constexpr float hfov = 95.0f;
 	static constexpr float dTheta = PI;
+	float model_radius = 1.0f;
 	float offset_z = 2.0f;
 	float theta_x = 0.0f;
 	float theta_y = 0.0f;
@@ -128,5 +163,8 @@ private:
 	float lpos_x = 0.0f;
 	float lpos_y = 0.0f;
 	float lpos_z = 0.6f;
+	// shadows
+	bool shadows = true;
+	bool shadowsWasDown = false;
 
 };
\ No newline at end of file
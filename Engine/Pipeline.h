@@ -1,20 +1,50 @@
 #pragma once
-#include "Graphics.h"
 #include "NDCScreenTransformer.h"
 #include "Surface.h"
+#include "RenderTarget.h"
 #include "IndexedTriangleList.h"
+#include "LodChain.h"
+#include "StreamingMesh.h"
+#include "CompactTriangleList.h"
+#include "JobSystem.h"
+#include "MpmcQueue.h"
 #include "Triangle.h"
 #include "ChiliMath.h"
 #include "Mat.h"
 #include <algorithm>
+#include <cmath>
 #include "ZBuffer.h"
 #include "Vec4.h"
+#include "Frustum.h"
+#include "OcclusionBuffer.h"
+#include "PixelSpan.h"
+#include "FragmentBuffer.h"
+#include "SampleBuffer.h"
+#include "ReprojectionCache.h"
+#include "ShadingRateMap.h"
 #include <memory>
+#include <type_traits>
+#include <atomic>
+#include <chrono>
+#include <thread>
 
 
 
 
 
+// vertex shaders that take their transforms as matrices expose them (GetWorldViewProj, GetWorldView,
+// GetProj) for culling and lod selection; draws through the others are never culled and draw lod 0
+template<typename VertexShader, typename = void>
+struct HasViewTransforms : std::false_type
+{
+};
+template<typename VertexShader>
+struct HasViewTransforms<VertexShader, decltype(void(std::declval<const VertexShader&>().GetWorldViewProj()),
+	void(std::declval<const VertexShader&>().GetWorldView()), void(std::declval<const VertexShader&>().GetProj()))>
+	: std::true_type
+{
+};
+
 // triangle drawing pipeline with programable
 // pixel shading stage
 
@@ -25,56 +55,759 @@ public:
 	typedef typename Effect::Vertex Vertex;
 	typedef typename Effect::VertexShader::Output VSOut;
 	typedef typename Effect::GeometryShader::Output GSOut;
+	// work per job when geometry processing is split over the job system
+	static constexpr size_t VertexBatch = 4096;
+	static constexpr size_t TriangleBatch = 2048;
+	// triangles a geometry job sets up before pushing them to the setup queue
+	static constexpr size_t SetupPiece = 64;
+
+	// per-frame draw counters, reset in BeginFrame
+	struct Stats
+	{
+		size_t draws = 0;
+		// triangles of the meshes (or lod levels) that reached the culling stage
+		size_t trianglesSubmitted = 0;
+		// meshes rejected by the bounding sphere test before vertex shading
+		size_t drawsCulled = 0;
+		// meshes fully inside the frustum, drawn without per-triangle clipping
+		size_t drawsAccepted = 0;
+		// meshes hidden behind occluders in the occlusion buffer
+		size_t drawsOccluded = 0;
+		// meshlets that passed the cone, frustum and occlusion tests and were shaded
+		size_t meshletsDrawn = 0;
+		// meshlets rejected before vertex shading
+		size_t meshletsFrustumCulled = 0;
+		size_t meshletsBackfaceCulled = 0;
+		size_t meshletsOccluded = 0;
+		// chunks of streamed meshes, culled ones are never paged in
+		size_t chunksDrawn = 0;
+		size_t chunksCulled = 0;
+		// pixel shader invocations
+		size_t pixelsShaded = 0;
+		// depths written by DepthPass::DepthOnly draws
+		size_t pixelsPrepassed = 0;
+		// pixels that took their color from the reprojection cache instead
+		size_t pixelsReused = 0;
+		// pixels that took the color of a block shaded for an earlier pixel (coarse shading)
+		size_t pixelsBroadcast = 0;
+		// streamed triangle setup (SetSetupQueue): time the rasterizer waited on an empty queue (geometry
+		// is the bottleneck) and the geometry jobs waited on a full one (rasterization is), summed over jobs
+		size_t setupTriangles = 0;
+		float setupRasterWaitMs = 0.0f;
+		float setupGeometryWaitMs = 0.0f;
+		// queued triangles seen by the rasterizer at each pop, divide by setupTriangles for the mean
+		size_t setupQueueFillSum = 0;
+		size_t setupQueuePeak = 0;
+	};
+	// how shaded pixels reach the render target
+	enum class BlendMode
+	{
+		// z tested and written, the pixel shader output replaces the target pixel
+		Opaque,
+		// z tested but not written, the output is blended over the target with its x channel as alpha
+		// translucent meshes go after the opaque ones, sorted back to front
+		Alpha,
+		// z tested but not written, the output goes to the fragment buffer and is blended
+		// by ResolveTransparency after all draws, no sorting needed
+		OrderIndependent
+	};
+	// depth prepass for opaque draws: draw everything once with DepthOnly, which rasterizes positions
+	// only and writes the ZBuffer without shading, then again with Equal, which shades only the pixels
+	// whose depth is the one the prepass left, so every pixel is shaded once however deep the overdraw
+	enum class DepthPass
+	{
+		// one pass, pixels are shaded as they pass TestAndSet
+		Combined,
+		DepthOnly,
+		Equal
+	};
 
 public:
-	Pipeline(Graphics& gfx)
-		: Pipeline(gfx,std::make_shared<ZBuffer>(gfx.ScreenWidth, gfx.ScreenHeight))
+	// draws into the frames of gfx (Graphics), picked up on every draw
+	Pipeline(RenderTargetSource& gfx)
+		: Pipeline(gfx,std::make_shared<ZBuffer>(gfx.GetTargetWidth(), gfx.GetTargetHeight()))
+	{
+	}
+	Pipeline(RenderTargetSource& gfx, std::shared_ptr<ZBuffer> pZb_in)
+		:
+		pGfx(&gfx),
+		pZb(std::move(pZb_in)),
+		cst(int(gfx.GetTargetWidth()), int(gfx.GetTargetHeight()))
 	{
+		assert(pZb->GetHeight() == int(gfx.GetTargetHeight()) && pZb->GetWidth() == int(gfx.GetTargetWidth()));
 	}
-	Pipeline(Graphics& gfx, std::shared_ptr<ZBuffer> pZb_in)
+	// headless pipeline rendering into an externally owned buffer
+	// (shared memory, memory mapped file, Surface::GetRenderTarget)
+	Pipeline(const RenderTarget& target_in, std::shared_ptr<ZBuffer> pZb_in)
 		:
-		gfx(gfx),
-		pZb(std::move(pZb_in))
+		pZb(std::move(pZb_in)),
+		target(target_in),
+		cst(pZb->GetWidth(), pZb->GetHeight())
+	{
+		assert(pZb->GetHeight() == int(target.GetHeight()) && pZb->GetWidth() == int(target.GetWidth()));
+	}
+	// retarget a headless pipeline, e.g. when the external buffer is double buffered
+	void SetRenderTarget(const RenderTarget& target_in)
 	{
-		assert(pZb->GetHeight() == gfx.ScreenHeight && pZb->GetWidth() == gfx.ScreenWidth);
+		assert(pZb->GetHeight() == int(target_in.GetHeight()) && pZb->GetWidth() == int(target_in.GetWidth()));
+		target = target_in;
 	}
 	
 	void Draw(IndexedTriangleList<Vertex>& triList)
 	{
+		Frustum frustum;
+		const auto result = BeginDraw(triList.GetBoundingSphere(), triList.indices.size() / 3, frustum);
+		if (result == Frustum::Result::Outside)
+		{
+			return;
+		}
+
+		if (!triList.meshlets.IsEmpty())
+		{
+			ProcessMeshlets(triList, frustum, result == Frustum::Result::Inside, ViewTransforms());
+			return;
+		}
+
 		ProcessVertices(triList.vertices, triList.indices);
 	}
+	// draws the level of detail picked from the projected size of the bounding sphere
+	void Draw(LodChain<Vertex>& lod)
+	{
+		// the selection needs the size of this frame's target
+		AcquireTarget();
+		Draw(lod.levels[SelectLod(lod, ViewTransforms())]);
+	}
+	// draws a mesh paged in from disk chunk by chunk, chunks are culled by their bounds before
+	// they are mapped and their vertices are shaded straight from the mapping
+	void Draw(StreamingMesh<Vertex>& mesh)
+	{
+		Frustum frustum;
+		const auto result = BeginDraw(mesh.GetBoundingSphere(), mesh.GetTriangleCount(), frustum);
+		if (result == Frustum::Result::Outside)
+		{
+			return;
+		}
+
+		for (size_t i = 0; i < mesh.GetChunkCount(); i++)
+		{
+			if (CullChunk(mesh.GetChunkInfo(i).bounds, frustum, result, ViewTransforms()))
+			{
+				stats.chunksCulled++;
+				continue;
+			}
+			stats.chunksDrawn++;
+
+			const auto chunk = mesh.Acquire(i);
+			ShadeVertices(chunk.vertexCount, [this, &chunk](size_t v) { return effect.vs(chunk.pVertices[v]); });
+			AssembleTriangles(verticesOut.data(), chunk.pIndices, chunk.triangleCount, chunk.firstTriangle);
+		}
+	}
+	// draws a mesh with 16 / 32 bit indices, quantized vertices are decoded on the way into the vertex shader
+	void Draw(CompactTriangleList<Vertex>& mesh)
+	{
+		Frustum frustum;
+		if (BeginDraw(mesh.GetBoundingSphere(), mesh.indices.GetCount() / 3, frustum) == Frustum::Result::Outside)
+		{
+			return;
+		}
+
+		if (mesh.IsQuantized())
+		{
+			ShadeVertices(mesh.quantized.size(), [this, &mesh](size_t i) { return effect.vs(mesh.Decode(mesh.quantized[i])); });
+		}
+		else
+		{
+			ShadeVertices(mesh.vertices.size(), [this, &mesh](size_t i) { return effect.vs(mesh.vertices[i]); });
+		}
+		const size_t triangleCount = mesh.indices.GetCount() / 3;
+		if (mesh.indices.IsWide())
+		{
+			AssembleTriangles(verticesOut.data(), mesh.indices.Data32(), triangleCount, 0);
+		}
+		else
+		{
+			AssembleTriangles(verticesOut.data(), mesh.indices.Data16(), triangleCount, 0);
+		}
+	}
+	// rasterizes the mesh into an occlusion buffer with the currently bound transforms
+	// occluders have to be submitted before the draws they are meant to hide
+	void DrawOccluder(IndexedTriangleList<Vertex>& triList, OcclusionBuffer& ob)
+	{
+		ob.RasterizeOccluder(triList, effect.vs.GetWorldViewProj());
+	}
+	// always the full detail level: a simplified one can bulge out of the surface and hide what is
+	// visible next to it
+	void DrawOccluder(LodChain<Vertex>& lod, OcclusionBuffer& ob)
+	{
+		DrawOccluder(lod.levels.front(), ob);
+	}
+	// draws are tested against this buffer before vertex shading, can be shared between pipelines
+	// nullptr disables occlusion culling
+	void SetOcclusionBuffer(std::shared_ptr<OcclusionBuffer> pOcclusion_in)
+	{
+		pOcclusion = std::move(pOcclusion_in);
+	}
+	void SetBlendMode(BlendMode mode)
+	{
+		assert(mode != BlendMode::OrderIndependent || pFragments);
+		blendMode = mode;
+	}
+	BlendMode GetBlendMode() const
+	{
+		return blendMode;
+	}
+	// single sampled opaque draws only, the prepass needs the same pipeline (effect and ZBuffer) as the
+	// shading pass so both compute bit identical depths
+	void SetDepthPass(DepthPass pass)
+	{
+		depthPass = pass;
+	}
+	DepthPass GetDepthPass() const
+	{
+		return depthPass;
+	}
+	// fragment buffer for BlendMode::OrderIndependent, share it between all pipelines
+	// drawing translucent meshes in a frame and clear it along with the ZBuffer
+	void SetFragmentBuffer(std::shared_ptr<FragmentBuffer> pFragments_in)
+	{
+		pFragments = std::move(pFragments_in);
+	}
+	// blends the collected translucent fragments over the frame, once after all draws
+	void ResolveTransparency()
+	{
+		AcquireTarget();
+		pFragments->Resolve(target, pZb.get());
+	}
+	// 4x msaa: opaque draws rasterize per sample coverage into this buffer and shade once per pixel,
+	// ResolveMultisample writes the result to the render target at the end of the frame
+	// share it between the pipelines of a frame like the ZBuffer, nullptr goes back to single sampling
+	void SetSampleBuffer(std::shared_ptr<SampleBuffer> pSamples_in)
+	{
+		assert(!pSamples_in || (pSamples_in->GetWidth() == pZb->GetWidth() && pSamples_in->GetHeight() == pZb->GetHeight()));
+		pSamples = std::move(pSamples_in);
+	}
+	// averages the samples into the render target after the opaque draws
+	// the nearest sample depth goes to the ZBuffer for translucent draws that follow
+	void ResolveMultisample()
+	{
+		AcquireTarget();
+		pSamples->Resolve(target, pZb.get());
+	}
+	// opaque single sampled draws reuse last frame's shading through this cache where they can
+	// share it between the pipelines of a frame, the caller brackets the draws with its BeginFrame / EndFrame
+	void SetReprojectionCache(std::shared_ptr<ReprojectionCache> pReprojection_in)
+	{
+		pReprojection = std::move(pReprojection_in);
+	}
+	// coarse shading: the pixel shader runs once per rate x rate block of a triangle and the
+	// color goes to every pixel of the block the triangle covers (depth is still per pixel)
+	// 1 (the default), 2 or 4; worth it for effects with low frequency output (flat or gouraud color)
+	void SetShadingRate(int rate)
+	{
+		assert(rate == 1 || rate == 2 || rate == 4);
+		shadingRate = rate;
+	}
+	// per tile rates, e.g. from the luminance of the last frame; a tile can only make the
+	// draw's rate coarser; nullptr uses the draw's rate everywhere
+	void SetShadingRateMap(std::shared_ptr<ShadingRateMap> pRateMap_in)
+	{
+		pRateMap = std::move(pRateMap_in);
+	}
+	// picks the next frame's tile rates from the luminance of the finished frame
+	void UpdateShadingRateMap()
+	{
+		AcquireTarget();
+		pRateMap->Update(target);
+	}
+	// vertex shading, triangle setup and clipping of big draws are split into batches over these threads,
+	// triangles are still rasterized in submission order on the calling thread
+	// defaults to JobSystem::Get(), nullptr keeps everything on the calling thread
+	void SetJobSystem(JobSystem* pJobs_in)
+	{
+		pJobs = pJobs_in;
+	}
+	// opaque draws big enough for parallel setup stream their set up triangles through a lock-free queue
+	// of this many entries: geometry jobs push while the calling thread rasterizes, instead of rasterizing
+	// after all of the setup is done; the draw order within a mesh is lost, so coplanar triangles can
+	// win the depth test differently from frame to frame; needs a job system with workers, 0 turns it off
+	void SetSetupQueue(size_t capacity)
+	{
+		pSetupQueue = capacity > 0 ? std::make_unique<MpmcQueue<Triangle<GSOut>>>(capacity) : nullptr;
+	}
+	// largest simplification error (in pixels) allowed when picking a lod level
+	void SetLodPixelError(float pixels)
+	{
+		lodPixelError = pixels;
+	}
 	
 	// ZBuffer resets after each frame
 	void BeginFrame()
 	{
 		pZb->Clear();
+		if (pSamples)
+		{
+			pSamples->Clear();
+		}
+		ResetStats();
+	}
+	// pipelines sharing a ZBuffer only call BeginFrame on one of them
+	void ResetStats()
+	{
+		stats = {};
+	}
+	const Stats& GetStats() const
+	{
+		return stats;
 	}
 
+private:
+	// interpolant of the depth prepass: the arithmetic the effects' outputs do on pos, on pos only,
+	// so the scanlines step to the same depths as the shading pass
+	struct DepthVertex
+	{
+		Vec4 pos;
+		DepthVertex& operator+=(const DepthVertex& rhs)
+		{
+			pos += rhs.pos;
+			return *this;
+		}
+		DepthVertex operator+(const DepthVertex& rhs) const
+		{
+			return DepthVertex(*this) += rhs;
+		}
+		DepthVertex& operator-=(const DepthVertex& rhs)
+		{
+			pos -= rhs.pos;
+			return *this;
+		}
+		DepthVertex operator-(const DepthVertex& rhs) const
+		{
+			return DepthVertex(*this) -= rhs;
+		}
+		DepthVertex& operator*=(float rhs)
+		{
+			pos *= rhs;
+			return *this;
+		}
+		DepthVertex operator*(float rhs) const
+		{
+			return DepthVertex(*this) *= rhs;
+		}
+		DepthVertex& operator/=(float rhs)
+		{
+			pos /= rhs;
+			return *this;
+		}
+		DepthVertex operator/(float rhs) const
+		{
+			return DepthVertex(*this) /= rhs;
+		}
+	};
 	// vertex processing function
 	// applies rotations, and translations on the vertices and then calls the triangle assembler
 private:
 	void ProcessVertices(std::vector<Vertex>& vertices, const std::vector<size_t>& indices) {
 
+		ShadeVertices(vertices.size(), [this, &vertices](size_t i) { return effect.vs(vertices[i]); });
 
-		std::vector<VSOut> verticesOut(vertices.size());
+		AssembleTriangles(verticesOut, indices);
+	}
+	// fills verticesOut with shade(i) for count vertices, in batches on the job system for big meshes
+	template<typename F>
+	void ShadeVertices(size_t count, F&& shade)
+	{
+		verticesOut.resize(count);
+		if (pJobs && count >= 2 * VertexBatch)
+		{
+			pJobs->ParallelFor(count, VertexBatch, [this, &shade](size_t begin, size_t end)
+				{
+					for (size_t i = begin; i < end; i++)
+					{
+						verticesOut[i] = shade(i);
+					}
+				});
+			return;
+		}
+		for (size_t i = 0; i < count; i++)
+		{
+			verticesOut[i] = shade(i);
+		}
+	}
+	typedef HasViewTransforms<typename Effect::VertexShader> ViewTransforms;
+	// graphics rotates its frame buffers, pick up the current one
+	void AcquireTarget()
+	{
+		if (pGfx)
+		{
+			target = pGfx->GetRenderTarget();
+		}
+	}
+	// prologue shared by the Draw overloads: picks up the frame, counts the draw and culls it whole,
+	// clipTriangles is set for draws that aren't known to be inside the frustum
+	Frustum::Result BeginDraw(const BoundingSphere& bounds, size_t triangleCount, Frustum& frustum)
+	{
+		AcquireTarget();
+		stats.draws++;
+		stats.trianglesSubmitted += triangleCount;
 
-		std::transform(vertices.begin(), vertices.end(),
-			verticesOut.begin(),
-			effect.vs);
+		const auto result = CullDraw(bounds, frustum, ViewTransforms());
+		clipTriangles = result != Frustum::Result::Inside;
+		return result;
+	}
+	// object level frustum and occlusion test with the mesh bounding sphere, done in model space so
+	// nothing has to be transformed; fills frustum for the finer tests, Outside skips the draw
+	Frustum::Result CullDraw(const BoundingSphere& bounds, Frustum& frustum, std::true_type)
+	{
+		frustum = Frustum(effect.vs.GetWorldViewProj());
+		const auto result = frustum.Test(bounds);
+		if (result == Frustum::Result::Outside)
+		{
+			stats.drawsCulled++;
+			return result;
+		}
+		if (pOcclusion && !pOcclusion->IsVisible(bounds, effect.vs.GetWorldView(), effect.vs.GetProj()))
+		{
+			stats.drawsOccluded++;
+			return Frustum::Result::Outside;
+		}
+		if (result == Frustum::Result::Inside)
+		{
+			stats.drawsAccepted++;
+		}
+		return result;
+	}
+	// no matrices to cull with, every triangle goes through the clipper
+	Frustum::Result CullDraw(const BoundingSphere&, Frustum&, std::false_type)
+	{
+		return Frustum::Result::Intersect;
+	}
+	// the same tests for a chunk of a streamed draw, true skips it; sets clipTriangles for the chunk
+	bool CullChunk(const BoundingSphere& bounds, const Frustum& frustum, Frustum::Result drawResult, std::true_type)
+	{
+		clipTriangles = false;
+		if (drawResult != Frustum::Result::Inside)
+		{
+			const auto result = frustum.Test(bounds);
+			if (result == Frustum::Result::Outside)
+			{
+				return true;
+			}
+			clipTriangles = result != Frustum::Result::Inside;
+		}
+		return pOcclusion && !pOcclusion->IsVisible(bounds, effect.vs.GetWorldView(), effect.vs.GetProj());
+	}
+	bool CullChunk(const BoundingSphere&, const Frustum&, Frustum::Result, std::false_type)
+	{
+		clipTriangles = true;
+		return false;
+	}
+	// picks the coarsest level whose model space error projects to under lodPixelError pixels
+	// at the nearest point of the bounding sphere
+	size_t SelectLod(LodChain<Vertex>& lod, std::true_type) const
+	{
+		const auto& worldView = effect.vs.GetWorldView();
+		// model units to view units along the most stretched axis (rows are the transformed axes),
+		// errors and radius are in model units
+		float scaleSq = 0.0f;
+		for (int i = 0; i < 3; i++)
+		{
+			const Vec3 axis = { worldView.elements[i][0],worldView.elements[i][1],worldView.elements[i][2] };
+			scaleSq = std::max(scaleSq, axis.LenSq());
+		}
+		const float scale = std::sqrt(scaleSq);
+		const auto& bs = lod.levels.front().GetBoundingSphere();
+		const auto center = Vec4(bs.center) * worldView;
+		const float nearest = center.z - bs.radius * scale;
+		// camera is inside or right next to the mesh
+		if (nearest <= 0.0f)
+		{
+			return 0;
+		}
+		// model units to pixels at that depth
+		const float pixelsPerUnit = scale * effect.vs.GetProj().elements[1][1] * float(target.GetHeight()) * 0.5f / nearest;
 
-		AssembleTriangles(verticesOut, indices);
+		size_t level = 0;
+		while (level + 1 < lod.GetLevelCount() && lod.errors[level + 1] * pixelsPerUnit <= lodPixelError)
+		{
+			level++;
+		}
+		return level;
+	}
+	size_t SelectLod(LodChain<Vertex>&, std::false_type) const
+	{
+		return 0;
+	}
+	// meshlet processing function
+	// culls clusters against the frustum and their normal cone, then shades
+	// and assembles only the vertices of the surviving clusters
+	void ProcessMeshlets(IndexedTriangleList<Vertex>& triList, const Frustum& frustum, bool meshInside, std::true_type)
+	{
+		const auto& ml = triList.meshlets;
+		const auto& worldView = effect.vs.GetWorldView();
+		// cone axes are normals, they need the inverse transpose under non-uniform scale
+		const auto normalMatrix = worldView.GetNormalMatrix();
+
+		// culling only reads the cluster bounds, it stays on this thread
+		visibleMeshlets.clear();
+		size_t visibleTriangles = 0;
+		for (size_t i = 0; i < ml.meshlets.size(); i++)
+		{
+			const auto& m = ml.meshlets[i];
+			bool clip = false;
+			if (!meshInside)
+			{
+				const auto result = frustum.Test(m.bounds);
+				if (result == Frustum::Result::Outside)
+				{
+					stats.meshletsFrustumCulled++;
+					continue;
+				}
+				clip = result != Frustum::Result::Inside;
+			}
+
+			// cone test in view space where the eye is at the origin
+			if (m.coneCutoff < 1.0f)
+			{
+				const auto apex = Vec4(m.coneApex) * worldView;
+				const auto axis = m.coneAxis * normalMatrix;
+				const float dist = Vec3(apex).Len();
+				if (dist > 0.0f && (Vec3(apex) * axis) / (dist * axis.Len()) > m.coneCutoff)
+				{
+					stats.meshletsBackfaceCulled++;
+					continue;
+				}
+			}
+			// occlusion test last since it walks the covered buffer texels
+			if (pOcclusion && !pOcclusion->IsVisible(m.bounds, worldView, effect.vs.GetProj()))
+			{
+				stats.meshletsOccluded++;
+				continue;
+			}
+			stats.meshletsDrawn++;
+			visibleMeshlets.push_back({ i,clip });
+			visibleTriangles += m.triangleCount;
+		}
+
+		// a meshlet is far below a triangle batch, so consecutive meshlets are grouped into batches
+		// that are shaded and set up together on the job system, then drawn in order
+		if (pJobs && visibleTriangles >= 2 * TriangleBatch)
+		{
+			meshletGroups.clear();
+			clipTriangles = false;
+			size_t groupTriangles = 0;
+			for (size_t i = 0; i < visibleMeshlets.size(); i++)
+			{
+				if (groupTriangles == 0)
+				{
+					meshletGroups.push_back(i);
+				}
+				groupTriangles += ml.meshlets[visibleMeshlets[i].index].triangleCount;
+				if (groupTriangles >= TriangleBatch)
+				{
+					groupTriangles = 0;
+				}
+				// the groups run at the same time, so one flag covers them all; triangles of
+				// meshlets inside the frustum only pay for the plane tests
+				clipTriangles = clipTriangles || visibleMeshlets[i].clip;
+			}
+			const size_t groups = meshletGroups.size();
+			meshletGroups.push_back(visibleMeshlets.size());
+			if (setupBins.size() < groups)
+			{
+				setupBins.resize(groups);
+			}
+			if (meshletVertices.size() < groups)
+			{
+				meshletVertices.resize(groups);
+			}
+			pJobs->ParallelFor(groups, 1, [this, &triList](size_t begin, size_t end)
+				{
+					for (size_t g = begin; g < end; g++)
+					{
+						auto& bin = setupBins[g];
+						bin.clear();
+						for (size_t i = meshletGroups[g]; i < meshletGroups[g + 1]; i++)
+						{
+							ProcessMeshlet(triList, visibleMeshlets[i].index, meshletVertices[g], &bin);
+						}
+					}
+				});
+			for (size_t g = 0; g < groups; g++)
+			{
+				for (const auto& t : setupBins[g])
+				{
+					DrawTriangle(t);
+				}
+			}
+			return;
+		}
+		for (const auto& v : visibleMeshlets)
+		{
+			clipTriangles = v.clip;
+			ProcessMeshlet(triList, v.index, verticesOut, nullptr);
+		}
+	}
+	// vertex shading for one cluster only into vertices, then assembly of its triangles
+	void ProcessMeshlet(const IndexedTriangleList<Vertex>& triList, size_t meshlet, std::vector<VSOut>& vertices,
+		std::vector<Triangle<GSOut>>* pBin)
+	{
+		const auto& ml = triList.meshlets;
+		const auto& m = ml.meshlets[meshlet];
+		vertices.resize(m.vertexCount);
+		const auto first = ml.vertices.begin() + m.vertexOffset;
+		std::transform(first, first + m.vertexCount,
+			vertices.begin(),
+			[this, &triList](size_t i) { return effect.vs(triList.vertices[i]); });
+
+		AssembleTriangles(vertices.data(), ml.indices.data() + m.indexOffset,
+			0, m.triangleCount, m.firstTriangle, pBin);
+	}
+	// the clusters can't be culled without the matrices, the whole mesh is drawn
+	void ProcessMeshlets(IndexedTriangleList<Vertex>& triList, const Frustum&, bool, std::false_type)
+	{
+		ProcessVertices(triList.vertices, triList.indices);
 	}
 	// triangle assembly function
 	// assembles indexed vertex stream into triangles and passes them to thr triangle processing function
 	// does the backface culling
 	void AssembleTriangles(const std::vector<VSOut>& vertices, const std::vector<size_t>& indices) 
+	{
+		AssembleTriangles(vertices.data(), indices.data(), indices.size() / 3, 0);
+	}
+	// triangleOffset is added to the local triangle number to get the index passed to the geometry shader
+	// big lists are culled, clipped and screen transformed in batches on the job system, then drawn in order
+	template<typename Index>
+	void AssembleTriangles(const VSOut* vertices, const Index* indices, size_t triangleCount, size_t triangleOffset)
+	{
+		// a worker drawing can't stream: it would spin on the queue while the jobs feeding it wait for
+		// a worker, with one worker forever
+		if (pJobs && triangleCount >= 2 * TriangleBatch && pSetupQueue && blendMode == BlendMode::Opaque &&
+			pJobs->GetWorkerCount() > 0 && !pJobs->IsWorkerThread())
+		{
+			StreamTriangles(vertices, indices, triangleCount, triangleOffset);
+			return;
+		}
+		if (pJobs && triangleCount >= 2 * TriangleBatch)
+		{
+			const size_t batches = (triangleCount + TriangleBatch - 1) / TriangleBatch;
+			if (setupBins.size() < batches)
+			{
+				setupBins.resize(batches);
+			}
+			pJobs->ParallelFor(triangleCount, TriangleBatch, [=](size_t begin, size_t end)
+				{
+					auto& bin = setupBins[begin / TriangleBatch];
+					bin.clear();
+					AssembleTriangles(vertices, indices, begin, end, triangleOffset, &bin);
+				});
+			for (size_t b = 0; b < batches; b++)
+			{
+				for (const auto& t : setupBins[b])
+				{
+					DrawTriangle(t);
+				}
+			}
+			return;
+		}
+		AssembleTriangles(vertices, indices, 0, triangleCount, triangleOffset, nullptr);
+	}
+	// geometry jobs set up batches of triangles into the setup queue while this thread rasterizes them
+	// this thread never runs a geometry job, it is the only one draining the queue, so it must not
+	// be one of the workers the jobs need
+	template<typename Index>
+	void StreamTriangles(const VSOut* vertices, const Index* indices, size_t triangleCount, size_t triangleOffset)
+	{
+		assert(!pJobs->IsWorkerThread());
+		typedef std::chrono::steady_clock Clock;
+		const size_t batches = (triangleCount + TriangleBatch - 1) / TriangleBatch;
+		if (setupBins.size() < batches)
+		{
+			setupBins.resize(batches);
+		}
+		setupWaits.assign(batches, 0.0f);
+		std::atomic<size_t> done = { 0 };
+
+		JobSystem::Group group;
+		for (size_t b = 0; b < batches; b++)
+		{
+			pJobs->Run(group, [=, &done]()
+				{
+					// counted even if setup throws, so the rasterizer loop ends
+					struct DoneGuard
+					{
+						~DoneGuard()
+						{
+							done.fetch_add(1, std::memory_order_release);
+						}
+						std::atomic<size_t>& done;
+					} guard = { done };
+					auto& bin = setupBins[b];
+					const size_t end = std::min((b + 1) * TriangleBatch, triangleCount);
+					// pushed in small pieces so the rasterizer can start early
+					for (size_t begin = b * TriangleBatch; begin < end; begin += SetupPiece)
+					{
+						bin.clear();
+						AssembleTriangles(vertices, indices, begin, std::min(begin + SetupPiece, end), triangleOffset, &bin);
+						for (const auto& t : bin)
+						{
+							if (!pSetupQueue->TryPush(t))
+							{
+								const auto start = Clock::now();
+								while (!pSetupQueue->TryPush(t))
+								{
+									std::this_thread::yield();
+								}
+								setupWaits[b] += std::chrono::duration<float, std::milli>(Clock::now() - start).count();
+							}
+						}
+					}
+				});
+		}
+
+		Triangle<GSOut> t;
+		while (true)
+		{
+			const size_t fill = pSetupQueue->GetSizeApprox();
+			if (pSetupQueue->TryPop(t))
+			{
+				stats.setupTriangles++;
+				stats.setupQueueFillSum += fill;
+				stats.setupQueuePeak = std::max(stats.setupQueuePeak, fill);
+				DrawTriangle(t);
+				continue;
+			}
+			// every push happened before its batch was counted
+			if (done.load(std::memory_order_acquire) == batches)
+			{
+				if (pSetupQueue->GetSizeApprox() == 0)
+				{
+					break;
+				}
+				continue;
+			}
+			const auto start = Clock::now();
+			while (pSetupQueue->GetSizeApprox() == 0 && done.load(std::memory_order_acquire) < batches)
+			{
+				std::this_thread::yield();
+			}
+			stats.setupRasterWaitMs += std::chrono::duration<float, std::milli>(Clock::now() - start).count();
+		}
+		pJobs->Wait(group);
+		for (const float w : setupWaits)
+		{
+			stats.setupGeometryWaitMs += w;
+		}
+	}
+	// triangles [begin,end), set up triangles go to pBin if there is one, else straight to the rasterizer
+	template<typename Index>
+	void AssembleTriangles(const VSOut* vertices, const Index* indices, size_t begin, size_t end, size_t triangleOffset,
+		std::vector<Triangle<GSOut>>* pBin)
 	{
 
 		const auto eyepos = Vec4{ 0.0f,0.0f,0.0f,1.0f } *effect.vs.GetProj();
 
 		// assemble triangles in the stream and process
-		for (size_t i = 0, end = indices.size() / 3;
-			i < end; i++)
+		for (size_t i = begin; i < end; i++)
 		{
 			// determine triangle vertices via indexing
 			const auto& v0 = vertices[indices[i * 3]];
@@ -84,22 +817,28 @@ private:
 			if ((v1.pos - v0.pos).CrossProd(v2.pos - v0.pos) * Vec3(v0.pos - eyepos) <= 0.0f)
 			{
 				// process 3 vertices into a triangle
-				ProcessTriangle(v0, v1, v2,i);
+				ProcessTriangle(v0, v1, v2, triangleOffset + i, pBin);
 			}
 		}
 	}
 	// triangle processing function
 	// takes 3 vertices to generate triangle and calls the post-processing function
-	void ProcessTriangle(const VSOut& v0, const VSOut& v1, const VSOut& v2, size_t triangle_index)
+	void ProcessTriangle(const VSOut& v0, const VSOut& v1, const VSOut& v2, size_t triangle_index, std::vector<Triangle<GSOut>>* pBin)
 	{
 		// generate triangle from 3 vertices using geometry shader 
 		// call clipper
-		ClipCullTriangle(effect.gs(v0, v1, v2, triangle_index));
+		ClipCullTriangle(effect.gs(v0, v1, v2, triangle_index), pBin);
 
 	}
 
-	void ClipCullTriangle(Triangle<GSOut>& t)
+	void ClipCullTriangle(Triangle<GSOut>& t, std::vector<Triangle<GSOut>>* pBin)
 	{
+		// whole mesh is inside the frustum, no triangle can need culling or clipping
+		if (!clipTriangles)
+		{
+			PostProcessTriangleVertices(t, pBin);
+			return;
+		}
 		// right plane cull test
 		if (t.v0.pos.x > t.v0.pos.w &&
 			t.v1.pos.x > t.v1.pos.w &&
@@ -144,7 +883,7 @@ private:
 		}
 
 		// geometric clipping for triangles with one vertex on the other side of the z near plane
-		const auto Clip1 = [this](GSOut& v0, GSOut& v1, GSOut& v2)
+		const auto Clip1 = [this, pBin](GSOut& v0, GSOut& v1, GSOut& v2)
 		{
 			const auto alpha1 = (-v0.pos.z) / (v1.pos.z - v0.pos.z);
 			const auto alpha2 = (-v0.pos.z) / (v2.pos.z - v0.pos.z);
@@ -152,12 +891,12 @@ private:
 			const auto v0a = interpolate(v0, v1, alpha1);
 			const auto v0b = interpolate(v0, v2, alpha2);
 
-			PostProcessTriangleVertices(Triangle<GSOut>{ v0a, v1, v2 });
-			PostProcessTriangleVertices(Triangle<GSOut>{ v0b, v0a, v2 });
+			PostProcessTriangleVertices(Triangle<GSOut>{ v0a, v1, v2 }, pBin);
+			PostProcessTriangleVertices(Triangle<GSOut>{ v0b, v0a, v2 }, pBin);
 		};
 
 		// geometric clipping for triangles with two vertices on the other side of the z near plane
-		const auto Clip2 = [this](GSOut& v0, GSOut& v1, GSOut& v2)
+		const auto Clip2 = [this, pBin](GSOut& v0, GSOut& v1, GSOut& v2)
 		{
 			
 			const float alpha0 = (-v0.pos.z) / (v2.pos.z - v0.pos.z);
@@ -166,7 +905,7 @@ private:
 			v0 = interpolate(v0, v2, alpha0);
 			v1 = interpolate(v1, v2, alpha1);
 
-			PostProcessTriangleVertices(Triangle<GSOut>{ v0, v1, v2 });
+			PostProcessTriangleVertices(Triangle<GSOut>{ v0, v1, v2 }, pBin);
 		};
 
 
@@ -203,7 +942,7 @@ private:
 		}
 		else // no near clipping
 		{
-			PostProcessTriangleVertices(t);
+			PostProcessTriangleVertices(t, pBin);
 		}
 
 	
@@ -211,7 +950,7 @@ private:
 	}
 	// vertex post-processing function
 	// performs perspective division and screen transformation on the vertices and calls the draw function
-	void PostProcessTriangleVertices(Triangle<GSOut>& triangle)
+	void PostProcessTriangleVertices(Triangle<GSOut>& triangle, std::vector<Triangle<GSOut>>* pBin)
 	{
 
 		cst.Transform(triangle.v0);
@@ -219,14 +958,47 @@ private:
 		cst.Transform(triangle.v2);
 		// perspective division and screen transformation done
 
+		// parallel setup collects the triangles, they are drawn in order afterwards
+		if (pBin)
+		{
+			pBin->push_back(triangle);
+			return;
+		}
 		// draw the triangle
 		DrawTriangle(triangle);
 	}
 	void DrawTriangle(const Triangle<GSOut>& triangle) {
 
-		const GSOut* pv0 = &triangle.v0;
-		const GSOut* pv1 = &triangle.v1;
-		const GSOut* pv2 = &triangle.v2;
+		if (depthPass == DepthPass::DepthOnly)
+		{
+			assert(blendMode == BlendMode::Opaque && !pSamples);
+			RasterizeTriangle(DepthVertex{ triangle.v0.pos }, DepthVertex{ triangle.v1.pos }, DepthVertex{ triangle.v2.pos });
+			return;
+		}
+		// only the single sampled opaque span tests for equal depth, the msaa and blended ones
+		// would quietly fall back to a less test
+		assert(depthPass != DepthPass::Equal || (blendMode == BlendMode::Opaque && !pSamples));
+
+		// coarse blocks are only shared between pixels of the same triangle
+		NextCoarseTriangle();
+
+		// translucent draws stay single sampled, they go over the resolved frame
+		if (pSamples && blendMode == BlendMode::Opaque)
+		{
+			DrawTriangleMultisample(triangle);
+			return;
+		}
+
+		RasterizeTriangle(triangle.v0, triangle.v1, triangle.v2);
+	}
+	// splits the triangle into flat top / flat bottom halves, for the shaded vertices and for the
+	// positions only vertices of the depth prepass alike
+	template<class I>
+	void RasterizeTriangle(const I& v0, const I& v1, const I& v2) {
+
+		const I* pv0 = &v0;
+		const I* pv1 = &v1;
+		const I* pv2 = &v2;
 
 		// Sorting vec2 pointers by y
 		if (pv1->pos.y < pv0->pos.y) std::swap(pv0, pv1);
@@ -264,9 +1036,10 @@ private:
 			}
 		}
 	}
-	void DrawFlatTopTriangle(const GSOut& it0,
-		const GSOut& it1,
-		const GSOut& it2)
+	template<class I>
+	void DrawFlatTopTriangle(const I& it0,
+		const I& it1,
+		const I& it2)
 	{
 		// calculate delta_y 
 		const float delta_y = it2.pos.y - it0.pos.y;
@@ -281,9 +1054,10 @@ private:
 
 		DrawFlatTriangle(it0, it1, it2, dit0, dit1, itEdge1);
 	}
-	void DrawFlatBottomTriangle(const GSOut& it0,
-		const GSOut& it1,
-		const GSOut& it2) {
+	template<class I>
+	void DrawFlatBottomTriangle(const I& it0,
+		const I& it1,
+		const I& it2) {
 		// calculate delta_y 
 		const float delta_y = it2.pos.y - it0.pos.y;
 
@@ -299,19 +1073,20 @@ private:
 
 	}
 
-	void DrawFlatTriangle(const GSOut& it0,
-		const GSOut& it1,
-		const GSOut& it2,
-		const GSOut& dv0,
-		const GSOut& dv1,
-		GSOut itEdge1)
+	template<class I>
+	void DrawFlatTriangle(const I& it0,
+		const I& it1,
+		const I& it2,
+		const I& dv0,
+		const I& dv1,
+		I itEdge1)
 	{
 		// create edge interpolant for left edge (always v0)
 		auto itEdge0 = it0;
 
 		// Calculate first and last scanline
 		const int yStart = std::max((int)ceil(it0.pos.y - 0.5f), 0);
-		const int yEnd = std::min((int)ceil(it2.pos.y - 0.5f), (int)Graphics::ScreenHeight - 1);
+		const int yEnd = std::min((int)ceil(it2.pos.y - 0.5f), (int)target.GetHeight() - 1);
 
 		// interpolants prestep
 		itEdge0 += dv0 * (float(yStart) + 0.5f - it0.pos.y);
@@ -321,7 +1096,7 @@ private:
 
 			// calculate start and end pixels
 			const int xStart = std::max((int)ceil(itEdge0.pos.x - 0.5f), 0);
-			const int xEnd = std::min((int)ceil(itEdge1.pos.x - 0.5f), (int)Graphics::ScreenWidth - 1);
+			const int xEnd = std::min((int)ceil(itEdge1.pos.x - 0.5f), (int)target.GetWidth() - 1);
 
 			// calculate scanline dTexCoord / dx
 			auto iLine = itEdge0;
@@ -330,32 +1105,389 @@ private:
 			// create scanline tex coord interpolant and prestep
 			iLine += diLine * (float(xStart) + 0.5f - itEdge0.pos.x);
 
+			DrawSpan(y, xStart, xEnd, iLine, diLine);
+		}
+	}
+	void DrawSpan(int y, int xStart, int xEnd, GSOut iLine, const GSOut& diLine)
+	{
+		if (blendMode == BlendMode::Alpha)
+		{
+			DrawBlendedSpan(y, xStart, xEnd, iLine, diLine);
+			return;
+		}
+		if (blendMode == BlendMode::OrderIndependent)
+		{
+			DrawFragmentSpan(y, xStart, xEnd, iLine, diLine);
+			return;
+		}
+
+		for (int x = xStart; x < xEnd; x++, iLine += diLine)
+		{
 
-			for (int x = xStart; x < xEnd; x++, iLine += diLine)
+			// depth culling
+			// z rejection / update of z buffer, or only the prepass' depth after a prepass
+			if (depthPass == DepthPass::Equal ? pZb->At(x, y) == iLine.pos.z : pZb->TestAndSet(x, y, iLine.pos.z))
 			{
-
-				// depth culling
-				// z rejection / update of z buffer
-				if (pZb->TestAndSet(x, y, iLine.pos.z))
+				if (pReprojection)
+				{
+					DrawReprojectedPixel(x, y, iLine);
+					continue;
+				}
+				const int rate = pRateMap ? std::max(shadingRate, pRateMap->At(x, y)) : shadingRate;
+				if (rate > 1)
 				{
-					 float w = 1.0f / iLine.pos.w;
+					DrawCoarsePixel(x, y, rate, iLine);
+					continue;
+				}
+				 float w = 1.0f / iLine.pos.w;
+
+				const auto attr = iLine * w;
+
+				target.PutPixel(x, y, effect.ps(attr));
+				stats.pixelsShaded++;
+
+			}
+		}
+	}
+	// depth prepass scanline
+	void DrawSpan(int y, int xStart, int xEnd, DepthVertex iLine, const DepthVertex& diLine)
+	{
+		for (int x = xStart; x < xEnd; x++, iLine += diLine)
+		{
+			if (pZb->TestAndSet(x, y, iLine.pos.z))
+			{
+				stats.pixelsPrepassed++;
+			}
+		}
+	}
+	// shades the pixel only if the reprojection cache has nothing valid for it
+	void DrawReprojectedPixel(int x, int y, const GSOut& iLine)
+	{
+		Color c;
+		if (pReprojection->Fetch(x, y, iLine.pos.z, c))
+		{
+			stats.pixelsReused++;
+		}
+		else
+		{
+			const float w = 1.0f / iLine.pos.w;
+			c = effect.ps(iLine * w);
+			stats.pixelsShaded++;
+		}
+		target.PutPixel(x, y, c);
+		pReprojection->Store(x, y, c);
+	}
+	// the first pixel of a block that passes the depth test is shaded, later ones reuse its color
+	void DrawCoarsePixel(int x, int y, int rate, const GSOut& iLine)
+	{
+		// blocks are kept on a 2x2 grid, a 4x4 block uses the cell of its top left corner
+		const int cellX = (x / rate) * (rate / 2);
+		const int cellY = (y / rate) * (rate / 2);
+		auto& block = coarseBlocks[size_t(cellY) * coarseCellsX + cellX];
+		if (block.triangle != coarseTriangle)
+		{
+			const float w = 1.0f / iLine.pos.w;
+			block.color = effect.ps(iLine * w);
+			block.triangle = coarseTriangle;
+			stats.pixelsShaded++;
+		}
+		else
+		{
+			stats.pixelsBroadcast++;
+		}
+		target.PutPixel(x, y, block.color);
+	}
+	void NextCoarseTriangle()
+	{
+		if (coarseBlocks.empty())
+		{
+			coarseCellsX = (pZb->GetWidth() + 1) / 2;
+			coarseBlocks.resize(size_t(coarseCellsX) * ((pZb->GetHeight() + 1) / 2));
+		}
+		// 0 marks a block nothing was shaded for, restart the numbering when it wraps
+		if (++coarseTriangle == 0u)
+		{
+			std::fill(coarseBlocks.begin(), coarseBlocks.end(), CoarseBlock{});
+			coarseTriangle = 1u;
+		}
+	}
+	// msaa rasterizer: walks the bounding box with edge functions evaluated at each sample position
+	// samples that are covered and pass their own depth test form the pixel's mask, the pixel shader
+	// runs once for a non empty mask and its color goes to the masked samples
+	void DrawTriangleMultisample(const Triangle<GSOut>& triangle)
+	{
+		const GSOut* pv0 = &triangle.v0;
+		const GSOut* pv1 = &triangle.v1;
+		const GSOut* pv2 = &triangle.v2;
+
+		// twice the signed area, orient so the inside of every edge is positive
+		float area = (pv1->pos.x - pv0->pos.x) * (pv2->pos.y - pv0->pos.y) - (pv1->pos.y - pv0->pos.y) * (pv2->pos.x - pv0->pos.x);
+		if (area == 0.0f)
+		{
+			return;
+		}
+		if (area < 0.0f)
+		{
+			std::swap(pv1, pv2);
+			area = -area;
+		}
+		const Vec2 p0 = { pv0->pos.x,pv0->pos.y };
+		const Vec2 p1 = { pv1->pos.x,pv1->pos.y };
+		const Vec2 p2 = { pv2->pos.x,pv2->pos.y };
+
+		const int width = pZb->GetWidth();
+		const int height = pZb->GetHeight();
+		const int xStart = std::max((int)floor(std::min({ p0.x,p1.x,p2.x })), 0);
+		const int xEnd = std::min((int)ceil(std::max({ p0.x,p1.x,p2.x })), width);
+		const int yStart = std::max((int)floor(std::min({ p0.y,p1.y,p2.y })), 0);
+		const int yEnd = std::min((int)ceil(std::max({ p0.y,p1.y,p2.y })), height);
+		if (xStart >= xEnd || yStart >= yEnd)
+		{
+			return;
+		}
 
-					const auto attr = iLine * w;
+		// edge e is opposite to vertex e, its function is that vertex's barycentric weight times area
+		struct Edge
+		{
+			float dx;
+			float dy;
+			float c;
+			// samples exactly on top or left edges belong to this triangle
+			bool inclusive;
+			float At(float x, float y) const
+			{
+				return dx * x + dy * y + c;
+			}
+		};
+		const auto makeEdge = [](const Vec2& a, const Vec2& b)
+		{
+			Edge e;
+			e.dx = a.y - b.y;
+			e.dy = b.x - a.x;
+			e.c = a.x * b.y - a.y * b.x;
+			e.inclusive = (a.y == b.y && b.x > a.x) || b.y < a.y;
+			return e;
+		};
+		const Edge edges[3] = { makeEdge(p1,p2),makeEdge(p2,p0),makeEdge(p0,p1) };
+
+		// attribute and depth gradients from the barycentric weights
+		const auto d1 = *pv1 - *pv0;
+		const auto d2 = *pv2 - *pv0;
+		const auto dAdx = d1 * (edges[1].dx / area) + d2 * (edges[2].dx / area);
+		const auto dAdy = d1 * (edges[1].dy / area) + d2 * (edges[2].dy / area);
+
+		// edge function offsets of the samples from the pixel corner, the largest one per edge
+		// rejects pixels none of whose samples can be inside, the smallest accepts pixels all of them are
+		SampleBuffer::SamplePos samplePos[SampleBuffer::SampleCount];
+		float sampleOffsets[3][SampleBuffer::SampleCount];
+		float minOffsets[3];
+		float maxOffsets[3];
+		for (int e = 0; e < 3; e++)
+		{
+			minOffsets[e] = std::numeric_limits<float>::infinity();
+			maxOffsets[e] = -std::numeric_limits<float>::infinity();
+			for (int s = 0; s < SampleBuffer::SampleCount; s++)
+			{
+				samplePos[s] = SampleBuffer::GetSamplePos(s);
+				sampleOffsets[e][s] = edges[e].dx * samplePos[s].x + edges[e].dy * samplePos[s].y;
+				minOffsets[e] = std::min(minOffsets[e], sampleOffsets[e][s]);
+				maxOffsets[e] = std::max(maxOffsets[e], sampleOffsets[e][s]);
+			}
+		}
+		// depth of the samples relative to the pixel center
+		float depthOffsets[SampleBuffer::SampleCount];
+		for (int s = 0; s < SampleBuffer::SampleCount; s++)
+		{
+			depthOffsets[s] = dAdx.pos.z * (samplePos[s].x - 0.5f) + dAdy.pos.z * (samplePos[s].y - 0.5f);
+		}
+		ZBuffer& depth = pSamples->GetDepth();
 
-					gfx.PutPixel(x, y, effect.ps(attr));
+		// attributes at the center of the first pixel of the first row
+		auto iRow = *pv0 + dAdx * (float(xStart) + 0.5f - p0.x) + dAdy * (float(yStart) + 0.5f - p0.y);
+		for (int y = yStart; y < yEnd; y++, iRow += dAdy)
+		{
+			// narrow the row to the pixels that can have covered samples, one pixel of slack
+			// for rounding, the per pixel test below is exact
+			float rowStart = float(xStart);
+			float rowEnd = float(xEnd);
+			for (int e = 0; e < 3; e++)
+			{
+				const float v = edges[e].At(0.0f, float(y)) + maxOffsets[e];
+				if (edges[e].dx > 0.0f)
+				{
+					rowStart = std::max(rowStart, -v / edges[e].dx - 1.0f);
+				}
+				else if (edges[e].dx < 0.0f)
+				{
+					rowEnd = std::min(rowEnd, -v / edges[e].dx + 2.0f);
+				}
+				else if (v < 0.0f)
+				{
+					rowEnd = rowStart;
+				}
+			}
+			if (rowStart >= rowEnd)
+			{
+				continue;
+			}
+			const int x0 = int(rowStart);
+			const int x1 = int(rowEnd);
+			float eRow[3];
+			for (int e = 0; e < 3; e++)
+			{
+				eRow[e] = edges[e].At(float(x0), float(y));
+			}
+			float* pDepthRow = &depth.At(0, y);
+			float z = iRow.pos.z + dAdx.pos.z * float(x0 - xStart);
+			for (int x = x0; x < x1; x++, z += dAdx.pos.z, eRow[0] += edges[0].dx, eRow[1] += edges[1].dx, eRow[2] += edges[2].dx)
+			{
+				if (eRow[0] + maxOffsets[0] < 0.0f || eRow[1] + maxOffsets[1] < 0.0f || eRow[2] + maxOffsets[2] < 0.0f)
+				{
+					continue;
+				}
 
+				// coverage first, then the depth test of the covered samples
+				unsigned int coverage = SampleBuffer::FullMask;
+				if (eRow[0] + minOffsets[0] <= 0.0f || eRow[1] + minOffsets[1] <= 0.0f || eRow[2] + minOffsets[2] <= 0.0f)
+				{
+					for (int e = 0; e < 3; e++)
+					{
+						for (int s = 0; s < SampleBuffer::SampleCount; s++)
+						{
+							const float v = eRow[e] + sampleOffsets[e][s];
+							if (v < 0.0f || (v == 0.0f && !edges[e].inclusive))
+							{
+								coverage &= ~(1u << s);
+							}
+						}
+					}
+				}
+				unsigned int mask = 0u;
+				float* pDepth = pDepthRow + x * SampleBuffer::SampleCount;
+				for (int s = 0; s < SampleBuffer::SampleCount; s++)
+				{
+					const float sampleDepth = z + depthOffsets[s];
+					if ((coverage & (1u << s)) && sampleDepth < pDepth[s])
+					{
+						pDepth[s] = sampleDepth;
+						mask |= 1u << s;
+					}
+				}
+				if (mask == 0u)
+				{
+					continue;
+				}
+				// attributes at the pixel center, partially covered pixels are shaded at their first covered
+				// sample instead so attributes are never extrapolated past the triangle's edges
+				auto attr = iRow + dAdx * float(x - xStart);
+				if (coverage != SampleBuffer::FullMask)
+				{
+					int first = 0;
+					while (!(coverage & (1u << first)))
+					{
+						first++;
+					}
+					attr += dAdx * (samplePos[first].x - 0.5f) + dAdy * (samplePos[first].y - 0.5f);
 				}
+				const float w = 1.0f / attr.pos.w;
+				pSamples->Write(x, y, mask, effect.ps(attr * w));
+				stats.pixelsShaded++;
 			}
-		
+		}
+	}
+	// order independent scanline: shaded pixels become fragments, nothing is written yet
+	void DrawFragmentSpan(int y, int xStart, int xEnd, GSOut iLine, const GSOut& diLine)
+	{
+		for (int x = xStart; x < xEnd; x++, iLine += diLine)
+		{
+			if (pZb->Test(x, y, iLine.pos.z))
+			{
+				const float w = 1.0f / iLine.pos.w;
+				pFragments->Add(x, y, iLine.pos.z, effect.ps(iLine * w));
+				stats.pixelsShaded++;
+			}
+		}
+	}
+	// translucent scanline: pixels passing the depth test are shaded into spanColors
+	// and every contiguous run is blended onto the target row in one go
+	void DrawBlendedSpan(int y, int xStart, int xEnd, GSOut iLine, const GSOut& diLine)
+	{
+		spanColors.resize(target.GetWidth());
+		Color* pRow = target.GetRow(y);
+		int runStart = xStart;
+		int runLength = 0;
+		for (int x = xStart; x < xEnd; x++, iLine += diLine)
+		{
+			if (pZb->Test(x, y, iLine.pos.z))
+			{
+				if (runLength == 0)
+				{
+					runStart = x;
+				}
+				const float w = 1.0f / iLine.pos.w;
+				spanColors[runLength++] = effect.ps(iLine * w);
+				stats.pixelsShaded++;
+			}
+			else if (runLength > 0)
+			{
+				PixelSpan::Blend(pRow + runStart, spanColors.data(), runLength);
+				runLength = 0;
+			}
+		}
+		if (runLength > 0)
+		{
+			PixelSpan::Blend(pRow + runStart, spanColors.data(), runLength);
 		}
 	}
 public:
 	Effect effect;
 private:
-	Graphics& gfx;
+	// null for headless pipelines
+	RenderTargetSource* pGfx = nullptr;
+	std::shared_ptr<ZBuffer> pZb;
+	RenderTarget target;
 	NDCScreenTransformer cst;
 	Mat3 rotation;
 	Vec3 translation;
-	std::shared_ptr<ZBuffer> pZb;
-	
+	std::shared_ptr<OcclusionBuffer> pOcclusion;
+	bool clipTriangles = true;
+	float lodPixelError = 1.0f;
+	// scratch vertex buffer reused across draws
+	std::vector<VSOut> verticesOut;
+	// set up triangles of each batch of a parallel AssembleTriangles, reused across draws
+	std::vector<std::vector<Triangle<GSOut>>> setupBins;
+	// meshlets that passed culling in the current draw, and whether they need clipping
+	struct VisibleMeshlet
+	{
+		size_t index;
+		bool clip;
+	};
+	std::vector<VisibleMeshlet> visibleMeshlets;
+	// first visible meshlet of each group set up together, with one past the last at the end
+	std::vector<size_t> meshletGroups;
+	// shaded vertices of the meshlet a group is on, one per group since groups run at the same time
+	std::vector<std::vector<VSOut>> meshletVertices;
+	JobSystem* pJobs = &JobSystem::Get();
+	std::unique_ptr<MpmcQueue<Triangle<GSOut>>> pSetupQueue;
+	// time each streaming geometry job waited on a full setup queue
+	std::vector<float> setupWaits;
+	BlendMode blendMode = BlendMode::Opaque;
+	DepthPass depthPass = DepthPass::Combined;
+	// shaded pixels of the current run in blended mode
+	std::vector<Color> spanColors;
+	std::shared_ptr<FragmentBuffer> pFragments;
+	std::shared_ptr<SampleBuffer> pSamples;
+	std::shared_ptr<ReprojectionCache> pReprojection;
+	int shadingRate = 1;
+	std::shared_ptr<ShadingRateMap> pRateMap;
+	// color of the last triangle shaded in each 2x2 cell of the screen
+	struct CoarseBlock
+	{
+		uint32_t triangle = 0u;
+		Color color;
+	};
+	std::vector<CoarseBlock> coarseBlocks;
+	int coarseCellsX = 0;
+	uint32_t coarseTriangle = 0u;
+	Stats stats;
 };
\ No newline at end of file
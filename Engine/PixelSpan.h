@@ -0,0 +1,153 @@
+#pragma once
+#include "Colors.h"
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+
+#if defined( __SSE2__ ) || defined( _M_X64 ) || (defined( _M_IX86_FP ) && _M_IX86_FP >= 2)
+#define PIXELSPAN_SSE2
+#include <emmintrin.h>
+#endif
+
+// bulk operations on runs of pixels in one row, 4 pixels per step with sse2
+// blending uses the x channel as alpha: dst = (src * a + dst * (255 - a)) / 255,
+// and the resulting x channel is src over dst coverage
+class PixelSpan
+{
+public:
+	static void Fill( Color* pDst,Color c,size_t n )
+	{
+		size_t i = 0u;
+#ifdef PIXELSPAN_SSE2
+		const __m128i v = _mm_set1_epi32( int( c.dword ) );
+		for( ; i + 4u <= n; i += 4u )
+		{
+			_mm_storeu_si128( reinterpret_cast<__m128i*>( pDst + i ),v );
+		}
+#endif
+		for( ; i < n; i++ )
+		{
+			pDst[i] = c;
+		}
+	}
+	// per pixel alpha from the x channel of each source pixel
+	static void Blend( Color* pDst,const Color* pSrc,size_t n )
+	{
+		size_t i = 0u;
+#ifdef PIXELSPAN_SSE2
+		for( ; i + 4u <= n; i += 4u )
+		{
+			const __m128i s = _mm_loadu_si128( reinterpret_cast<const __m128i*>( pSrc + i ) );
+			__m128i* pD = reinterpret_cast<__m128i*>( pDst + i );
+			_mm_storeu_si128( pD,Blend4( s,_mm_loadu_si128( pD ) ) );
+		}
+#endif
+		for( ; i < n; i++ )
+		{
+			pDst[i] = Blend1( pSrc[i],pDst[i] );
+		}
+	}
+	// one color (alpha in its x channel) over the whole span
+	static void Blend( Color* pDst,Color c,size_t n )
+	{
+		size_t i = 0u;
+#ifdef PIXELSPAN_SSE2
+		const __m128i s = _mm_set1_epi32( int( c.dword ) );
+		for( ; i + 4u <= n; i += 4u )
+		{
+			__m128i* pD = reinterpret_cast<__m128i*>( pDst + i );
+			_mm_storeu_si128( pD,Blend4( s,_mm_loadu_si128( pD ) ) );
+		}
+#endif
+		for( ; i < n; i++ )
+		{
+			pDst[i] = Blend1( c,pDst[i] );
+		}
+	}
+	// copies every source pixel whose rgb differs from the key's (the x channel is ignored)
+	static void CopyKeyed( Color* pDst,const Color* pSrc,size_t n,Color key )
+	{
+		const uint32_t rgbMask = 0xFFFFFFu;
+		size_t i = 0u;
+#ifdef PIXELSPAN_SSE2
+		const __m128i mask = _mm_set1_epi32( int( rgbMask ) );
+		const __m128i k = _mm_set1_epi32( int( key.dword & rgbMask ) );
+		for( ; i + 4u <= n; i += 4u )
+		{
+			const __m128i s = _mm_loadu_si128( reinterpret_cast<const __m128i*>( pSrc + i ) );
+			__m128i* pD = reinterpret_cast<__m128i*>( pDst + i );
+			const __m128i keyed = _mm_cmpeq_epi32( _mm_and_si128( s,mask ),k );
+			const __m128i d = _mm_loadu_si128( pD );
+			_mm_storeu_si128( pD,_mm_or_si128( _mm_and_si128( keyed,d ),_mm_andnot_si128( keyed,s ) ) );
+		}
+#endif
+		for( ; i < n; i++ )
+		{
+			if( (pSrc[i].dword & rgbMask) != (key.dword & rgbMask) )
+			{
+				pDst[i] = pSrc[i];
+			}
+		}
+	}
+	// nearest neighbour resample: dst[i] = src[(u0 + i * du) >> 16], u in 16.16 fixed point
+	static void CopyScaled( Color* pDst,const Color* pSrc,size_t n,uint32_t u0,uint32_t du )
+	{
+		uint32_t u = u0;
+		size_t i = 0u;
+		// no gather in sse2, unrolling is what helps here
+		for( ; i + 4u <= n; i += 4u )
+		{
+			const Color c0 = pSrc[u >> 16];
+			const Color c1 = pSrc[(u + du) >> 16];
+			const Color c2 = pSrc[(u + du * 2u) >> 16];
+			const Color c3 = pSrc[(u + du * 3u) >> 16];
+			pDst[i] = c0;
+			pDst[i + 1u] = c1;
+			pDst[i + 2u] = c2;
+			pDst[i + 3u] = c3;
+			u += du * 4u;
+		}
+		for( ; i < n; i++,u += du )
+		{
+			pDst[i] = pSrc[u >> 16];
+		}
+	}
+private:
+	// (v + 128) / 255 rounded, exact for v in [0,255*255]
+	static unsigned int Div255( unsigned int v )
+	{
+		v += 128u;
+		return (v + (v >> 8)) >> 8;
+	}
+	static Color Blend1( Color s,Color d )
+	{
+		const unsigned int a = s.GetA();
+		const unsigned int ia = 255u - a;
+		return Color(
+			(unsigned char)Div255( 255u * a + d.GetA() * ia ),
+			(unsigned char)Div255( s.GetR() * a + d.GetR() * ia ),
+			(unsigned char)Div255( s.GetG() * a + d.GetG() * ia ),
+			(unsigned char)Div255( s.GetB() * a + d.GetB() * ia ) );
+	}
+#ifdef PIXELSPAN_SSE2
+	// 2 pixels of 16 bit channels
+	static __m128i Blend2( __m128i s,__m128i d )
+	{
+		// broadcast each pixel's alpha (channel 3) over its 4 channels
+		const __m128i a = _mm_shufflehi_epi16( _mm_shufflelo_epi16( s,_MM_SHUFFLE( 3,3,3,3 ) ),_MM_SHUFFLE( 3,3,3,3 ) );
+		const __m128i ia = _mm_sub_epi16( _mm_set1_epi16( 255 ),a );
+		// alpha channel of the source counts as 255 so x ends up as coverage
+		const __m128i sOpaque = _mm_or_si128( s,_mm_set_epi16( 255,0,0,0,255,0,0,0 ) );
+		__m128i v = _mm_add_epi16( _mm_mullo_epi16( sOpaque,a ),_mm_mullo_epi16( d,ia ) );
+		v = _mm_add_epi16( v,_mm_set1_epi16( 128 ) );
+		return _mm_srli_epi16( _mm_add_epi16( v,_mm_srli_epi16( v,8 ) ),8 );
+	}
+	static __m128i Blend4( __m128i s,__m128i d )
+	{
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i lo = Blend2( _mm_unpacklo_epi8( s,zero ),_mm_unpacklo_epi8( d,zero ) );
+		const __m128i hi = Blend2( _mm_unpackhi_epi8( s,zero ),_mm_unpackhi_epi8( d,zero ) );
+		return _mm_packus_epi16( lo,hi );
+	}
+#endif
+};
@@ -0,0 +1,88 @@
+#pragma once
+#include "Colors.h"
+#include <algorithm>
+#include <assert.h>
+
+// non-owning view of a 32bpp color buffer with an arbitrary row pitch
+// lets the pipeline rasterize straight into memory owned by someone else:
+// shared memory, a memory mapped file or a Surface
+// write-combined memory like a mapped d3d texture only suits opaque drawing, which just writes;
+// blending and the transparency resolve read pixels back and want cached memory
+// (only depends on Colors.h so headless tools can use it without windows headers)
+class RenderTarget
+{
+public:
+	RenderTarget() = default;
+	// pitch is in BYTES (unlike Surface) so d3d row pitches can be used as is
+	RenderTarget( Color* pData,unsigned int width,unsigned int height,unsigned int pitch )
+		:
+		pData( reinterpret_cast<unsigned char*>( pData ) ),
+		width( width ),
+		height( height ),
+		pitch( pitch )
+	{
+		assert( pitch % sizeof( Color ) == 0 );
+		assert( pitch >= width * sizeof( Color ) );
+	}
+	void Clear( Color fillValue )
+	{
+		for( unsigned int y = 0; y < height; y++ )
+		{
+			std::fill_n( GetRow( y ),width,fillValue );
+		}
+	}
+	void PutPixel( unsigned int x,unsigned int y,Color c )
+	{
+		assert( x < width );
+		assert( y < height );
+		GetRow( y )[x] = c;
+	}
+	Color GetPixel( unsigned int x,unsigned int y ) const
+	{
+		assert( x < width );
+		assert( y < height );
+		return GetRow( y )[x];
+	}
+	Color* GetRow( unsigned int y )
+	{
+		return reinterpret_cast<Color*>( pData + size_t( y ) * pitch );
+	}
+	const Color* GetRow( unsigned int y ) const
+	{
+		return reinterpret_cast<const Color*>( pData + size_t( y ) * pitch );
+	}
+	unsigned int GetWidth() const
+	{
+		return width;
+	}
+	unsigned int GetHeight() const
+	{
+		return height;
+	}
+	unsigned int GetPitch() const
+	{
+		return pitch;
+	}
+	bool IsValid() const
+	{
+		return pData != nullptr;
+	}
+private:
+	unsigned char* pData = nullptr;
+	unsigned int width = 0u;
+	unsigned int height = 0u;
+	unsigned int pitch = 0u; // pitch is in BYTES
+};
+
+// hands out the target of the frame being drawn (Graphics rotates its frame buffers, pipelines
+// drawing to the screen fetch it again on every draw)
+class RenderTargetSource
+{
+public:
+	// only valid while a frame is being drawn
+	virtual RenderTarget& GetRenderTarget() = 0;
+	virtual unsigned int GetTargetWidth() const = 0;
+	virtual unsigned int GetTargetHeight() const = 0;
+protected:
+	~RenderTargetSource() = default;
+};
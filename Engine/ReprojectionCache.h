@@ -0,0 +1,175 @@
+#pragma once
+#include <vector>
+#include <utility>
+#include <cassert>
+#include <cmath>
+#include "Colors.h"
+#include "Mat.h"
+#include "Vec4.h"
+#include "ZBuffer.h"
+
+// reverse reprojection cache: keeps the previous frame's colors and depths, and for every pixel that
+// passes the depth test finds where its surface point was last frame; if the depth stored there matches
+// the point was visible and its color is reused instead of running the pixel shader
+// only the camera may move between frames (Invalidate after moving objects or lights), the view has to
+// be a rotation and translation and the projection one from Mat4::Projection / ProjectionFOV
+// shading that depends on the view direction (specular) drifts, so a fixed interleaved 1 / RefreshPeriod
+// of the pixels is reshaded every frame regardless
+class ReprojectionCache
+{
+public:
+	static constexpr int RefreshPeriod = 8;
+	struct Stats
+	{
+		// pixels whose shading was reused
+		size_t reused = 0;
+		// pixels that reprojected outside of the previous frame
+		size_t offscreen = 0;
+		// pixels that were hidden last frame or whose depth changed too much
+		size_t disoccluded = 0;
+		// pixels reshaded by the refresh pattern
+		size_t refreshed = 0;
+	};
+public:
+	ReprojectionCache(int width, int height)
+		:
+		width(width),
+		height(height),
+		xFactor(float(width / 2)),
+		yFactor(float(height / 2)),
+		colors{ std::vector<Color>(size_t(width) * height),std::vector<Color>(size_t(width) * height) },
+		prevDepths(size_t(width) * height, 0.0f)
+	{}
+	// call before the frame's draws with the camera transforms of the frame
+	void BeginFrame(const Mat4& view_in, const Mat4& proj_in)
+	{
+		reprojection = RigidInverse(view_in) * view * proj;
+		view = view_in;
+		proj = proj_in;
+		std::swap(current, previous);
+		frame++;
+		stats = {};
+	}
+	// call after the opaque draws, keeps the frame's depth as linear view depth for the next frame
+	// pixels that were not drawn this frame are invalid next frame
+	void EndFrame(ZBuffer& zb)
+	{
+		assert(zb.GetWidth() == width && zb.GetHeight() == height);
+		for (int y = 0; y < height; y++)
+		{
+			float* pDepths = &prevDepths[size_t(y) * width];
+			for (int x = 0; x < width; x++)
+			{
+				pDepths[x] = LinearDepth(zb.At(x, y));
+			}
+		}
+		valid = true;
+	}
+	// forget the previous frame, e.g. after objects moved or the cache was switched off for a while
+	void Invalidate()
+	{
+		valid = false;
+	}
+	// z is the pixel's depth after the perspective division (what the ZBuffer holds)
+	// returns false when the pixel has to be shaded
+	bool Fetch(int x, int y, float z, Color& c)
+	{
+		if (!valid)
+		{
+			return false;
+		}
+		if (((x & 3) | ((y & 1) << 2)) == int(frame % RefreshPeriod))
+		{
+			stats.refreshed++;
+			return false;
+		}
+		// view space position of the pixel center from the inverse projection
+		const float depth = LinearDepth(z);
+		const float ndcX = (float(x) + 0.5f) / xFactor - 1.0f;
+		const float ndcY = 1.0f - (float(y) + 0.5f) / yFactor;
+		const Vec4 pos = { ndcX * depth / proj.elements[0][0],ndcY * depth / proj.elements[1][1],depth,1.0f };
+
+		// and its position in last frame's clip space
+		const auto prev = pos * reprojection;
+		if (prev.w <= 0.0f)
+		{
+			stats.offscreen++;
+			return false;
+		}
+		const float prevX = (prev.x / prev.w + 1.0f) * xFactor;
+		const float prevY = (1.0f - prev.y / prev.w) * yFactor;
+		if (!(prevX >= 0.0f && prevX < float(width) && prevY >= 0.0f && prevY < float(height)))
+		{
+			stats.offscreen++;
+			return false;
+		}
+		const size_t i = size_t(prevY) * width + size_t(prevX);
+		const float prevDepth = prevDepths[i];
+		if (prevDepth <= 0.0f || std::abs(prevDepth - prev.w) > depthTolerance * prev.w)
+		{
+			stats.disoccluded++;
+			return false;
+		}
+		c = colors[previous][i];
+		stats.reused++;
+		return true;
+	}
+	// the final color of a pixel this frame, shaded or reused
+	void Store(int x, int y, Color c)
+	{
+		colors[current][size_t(y) * width + x] = c;
+	}
+	// largest relative difference between the reprojected and the stored depth of a reused pixel
+	void SetDepthTolerance(float tolerance)
+	{
+		depthTolerance = tolerance;
+	}
+	const Stats& GetStats() const
+	{
+		return stats;
+	}
+private:
+	// view space z from the post division depth, 0 for the cleared ZBuffer
+	float LinearDepth(float z) const
+	{
+		if (z >= 1.0f)
+		{
+			return 0.0f;
+		}
+		return proj.elements[3][2] / (z - proj.elements[2][2]);
+	}
+	static Mat4 RigidInverse(const Mat4& m)
+	{
+		Mat4 inv = Mat4::Identity();
+		for (int j = 0; j < 3; j++)
+		{
+			for (int k = 0; k < 3; k++)
+			{
+				inv.elements[j][k] = m.elements[k][j];
+			}
+		}
+		for (int k = 0; k < 3; k++)
+		{
+			inv.elements[3][k] = -(m.elements[3][0] * inv.elements[0][k] + m.elements[3][1] * inv.elements[1][k] + m.elements[3][2] * inv.elements[2][k]);
+		}
+		return inv;
+	}
+private:
+	int width;
+	int height;
+	float xFactor;
+	float yFactor;
+	// written this frame / read this frame, swapped in BeginFrame
+	std::vector<Color> colors[2];
+	int current = 0;
+	int previous = 1;
+	// linear depth of the previous frame, 0 where nothing was drawn
+	std::vector<float> prevDepths;
+	Mat4 view = Mat4::Identity();
+	Mat4 proj = Mat4::Identity();
+	Mat4 reprojection = Mat4::Identity();
+	float depthTolerance = 0.01f;
+	unsigned int frame = 0u;
+	bool valid = false;
+	Stats stats;
+};
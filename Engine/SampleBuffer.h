@@ -0,0 +1,136 @@
+#pragma once
+#include <vector>
+#include <algorithm>
+#include <cassert>
+#include "Colors.h"
+#include "RenderTarget.h"
+#include "ZBuffer.h"
+#include "PixelSpan.h"
+
+// multisampled color and depth for 4x msaa: every pixel stores SampleCount colors and depths
+// the pipeline shades once per pixel and writes the result to the covered samples,
+// Resolve averages them into a normal render target after the opaque draws
+class SampleBuffer
+{
+public:
+	static constexpr int SampleCount = 4;
+	static constexpr unsigned int FullMask = (1u << SampleCount) - 1u;
+	struct SamplePos
+	{
+		float x;
+		float y;
+	};
+public:
+	SampleBuffer(int width, int height)
+		:
+		width(width),
+		height(height),
+		colors(size_t(width) * height * SampleCount),
+		depth(width, height, SampleCount)
+	{}
+	// sample positions inside the pixel, rotated grid so near horizontal and near vertical
+	// edges both get 4 distinct coverage steps (same layout as the d3d standard 4x pattern)
+	static SamplePos GetSamplePos(int i)
+	{
+		static const SamplePos pattern[SampleCount] = {
+			{ 0.375f,0.125f },
+			{ 0.875f,0.375f },
+			{ 0.125f,0.625f },
+			{ 0.625f,0.875f }
+		};
+		return pattern[i];
+	}
+	void Clear(Color c = Colors::Black)
+	{
+		PixelSpan::Fill(colors.data(), c, colors.size());
+		depth.Clear();
+	}
+	// writes c to the samples whose bit is set in mask
+	void Write(int x, int y, unsigned int mask, Color c)
+	{
+		assert(x >= 0 && x < width && y >= 0 && y < height);
+		Color* pSamples = &colors[(size_t(y) * width + x) * SampleCount];
+		if (mask == FullMask)
+		{
+			std::fill(pSamples, pSamples + SampleCount, c);
+			return;
+		}
+		for (int s = 0; s < SampleCount; s++)
+		{
+			if (mask & (1u << s))
+			{
+				pSamples[s] = c;
+			}
+		}
+	}
+	ZBuffer& GetDepth()
+	{
+		return depth;
+	}
+	// box filter of the samples into the target, and the nearest sample depth into pZbOut
+	// (if given) so single sampled draws after the resolve, like translucent meshes,
+	// are still hidden by the opaque geometry
+	void Resolve(RenderTarget& target, ZBuffer* pZbOut = nullptr)
+	{
+		assert(int(target.GetWidth()) == width && int(target.GetHeight()) == height);
+		for (int y = 0; y < height; y++)
+		{
+			Color* pRow = target.GetRow(y);
+			const Color* pSamples = &colors[size_t(y) * width * SampleCount];
+			for (int x = 0; x < width; x++, pSamples += SampleCount)
+			{
+				pRow[x] = Average(pSamples);
+			}
+			if (pZbOut)
+			{
+				for (int x = 0; x < width; x++)
+				{
+					const float* pDepth = &depth.At(x, y);
+					pZbOut->At(x, y) = *std::min_element(pDepth, pDepth + SampleCount);
+				}
+			}
+		}
+	}
+	int GetWidth() const
+	{
+		return width;
+	}
+	int GetHeight() const
+	{
+		return height;
+	}
+private:
+	// rounded per channel mean of the 4 samples of a pixel
+	static Color Average(const Color* pSamples)
+	{
+#ifdef PIXELSPAN_SSE2
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pSamples));
+		__m128i sum = _mm_add_epi16(_mm_unpacklo_epi8(s, zero), _mm_unpackhi_epi8(s, zero));
+		sum = _mm_add_epi16(sum, _mm_srli_si128(sum, 8));
+		sum = _mm_srli_epi16(_mm_add_epi16(sum, _mm_set1_epi16(2)), 2);
+		Color c;
+		c.dword = (unsigned int)_mm_cvtsi128_si32(_mm_packus_epi16(sum, sum));
+		return c;
+#else
+		unsigned int result = 0u;
+		for (int shift = 0; shift < 32; shift += 8)
+		{
+			unsigned int sum = 2u;
+			for (int s = 0; s < SampleCount; s++)
+			{
+				sum += (pSamples[s].dword >> shift) & 0xFFu;
+			}
+			result |= (sum >> 2) << shift;
+		}
+		Color c;
+		c.dword = result;
+		return c;
+#endif
+	}
+private:
+	int width;
+	int height;
+	std::vector<Color> colors;
+	ZBuffer depth;
+};
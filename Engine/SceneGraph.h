@@ -0,0 +1,233 @@
+#pragma once
+#include <vector>
+#include <deque>
+#include <memory>
+#include <atomic>
+#include <limits>
+#include <cstdint>
+#include <cassert>
+#include "Mat.h"
+#include "Transform.h"
+#include "Pipeline.h"
+#include "JobSystem.h"
+#include "EffectBinding.h"
+
+// hierarchy of transforms with meshes drawn through pipelines attached to its nodes
+// nodes live in flat arrays indexed by id (no per node allocations or child pointers) and are walked
+// level by level, so world matrices of a level are computed in parallel once all parents are done;
+// a world matrix is only rebuilt when its transform or one of its ancestors changed since the last Update
+// draws are grouped per pipeline, which binds the camera once per group instead of once per draw
+class SceneGraph
+{
+public:
+	typedef uint32_t NodeId;
+	static constexpr NodeId NoParent = std::numeric_limits<NodeId>::max();
+	// nodes per job when a level of the hierarchy is updated in parallel
+	static constexpr size_t UpdateBatch = 1024;
+	struct Stats
+	{
+		size_t nodes = 0;
+		// world matrices rebuilt by the last Update
+		size_t worldsUpdated = 0;
+		// by the last Draw
+		size_t draws = 0;
+		// pipelines the draws were grouped into, the camera is bound once per batch
+		size_t batches = 0;
+	};
+public:
+	SceneGraph() = default;
+	SceneGraph(const SceneGraph&) = delete;
+	SceneGraph& operator=(const SceneGraph&) = delete;
+	// parents have to be added before their children
+	NodeId AddNode(NodeId parent = NoParent, const Transform& local = {})
+	{
+		assert(parent == NoParent || parent < parents.size());
+		const NodeId id = NodeId(parents.size());
+		const size_t depth = parent == NoParent ? 0 : depths[parent] + 1;
+		parents.push_back(parent);
+		depths.push_back(uint32_t(depth));
+		transforms.push_back(local);
+		// never seen, the first Update builds the world matrix
+		seenVersions.push_back(local.GetVersion() - 1u);
+		changed.push_back(1u);
+		worlds.push_back(Mat4::Identity());
+		if (levels.size() <= depth)
+		{
+			levels.resize(depth + 1);
+		}
+		levels[depth].push_back(id);
+		return id;
+	}
+	// draws mesh with the node's world matrix through pipeline, which has to outlive the graph
+	// anything Pipeline<Effect>::Draw takes works as mesh (IndexedTriangleList, LodChain, ...)
+	// draws of one pipeline go out together in the order they were attached, pipelines in the order
+	// of their first attach
+	template<class Effect, class Mesh>
+	void Attach(NodeId node, ::Pipeline<Effect>& pipeline, Mesh& mesh)
+	{
+		assert(node < parents.size());
+		PipelineBatch<Effect>* pBatch = nullptr;
+		for (auto& b : batches)
+		{
+			if (b->GetPipeline() == &pipeline)
+			{
+				pBatch = static_cast<PipelineBatch<Effect>*>(b.get());
+				break;
+			}
+		}
+		if (!pBatch)
+		{
+			batches.push_back(std::make_unique<PipelineBatch<Effect>>(pipeline));
+			pBatch = static_cast<PipelineBatch<Effect>*>(batches.back().get());
+		}
+		pBatch->Add(node, mesh);
+	}
+	// the local transform, relative to the parent; editing it marks the node and its subtree for Update
+	// the reference stays valid when more nodes are added
+	Transform& GetTransform(NodeId node)
+	{
+		return transforms[node];
+	}
+	const Transform& GetTransform(NodeId node) const
+	{
+		return transforms[node];
+	}
+	NodeId GetParent(NodeId node) const
+	{
+		return parents[node];
+	}
+	// as of the last Update
+	const Mat4& GetWorld(NodeId node) const
+	{
+		return worlds[node];
+	}
+	size_t GetNodeCount() const
+	{
+		return parents.size();
+	}
+	// world matrices of every node, on the job system for big levels; nullptr keeps it on this thread
+	void SetJobSystem(JobSystem* pJobs_in)
+	{
+		pJobs = pJobs_in;
+	}
+	// rebuilds the world matrices of the nodes that moved, call once per frame before Draw
+	void Update()
+	{
+		std::atomic<size_t> updated = { 0u };
+		for (const auto& level : levels)
+		{
+			const auto update = [this, &level, &updated](size_t begin, size_t end)
+			{
+				size_t count = 0;
+				for (size_t i = begin; i < end; i++)
+				{
+					const NodeId id = level[i];
+					const NodeId parent = parents[id];
+					const auto& t = transforms[id];
+					if (t.GetVersion() == seenVersions[id] && (parent == NoParent || !changed[parent]))
+					{
+						changed[id] = 0u;
+						continue;
+					}
+					worlds[id] = parent == NoParent ? t.GetMatrix() : t.GetMatrix().AffineMultiply(worlds[parent]);
+					seenVersions[id] = t.GetVersion();
+					changed[id] = 1u;
+					count++;
+				}
+				updated += count;
+			};
+			if (pJobs)
+			{
+				pJobs->ParallelFor(level.size(), UpdateBatch, update);
+			}
+			else
+			{
+				update(0, level.size());
+			}
+		}
+		stats.nodes = parents.size();
+		stats.worldsUpdated = updated;
+	}
+	// binds view and projection once per pipeline, then the world matrix of each of its draws
+	// the caller does everything else the effects need (BeginFrame, lights, ...)
+	void Draw(const Mat4& view, const Mat4& proj)
+	{
+		stats.draws = 0;
+		stats.batches = 0;
+		for (auto& b : batches)
+		{
+			stats.draws += b->Draw(*this, view, proj);
+			stats.batches++;
+		}
+	}
+	const Stats& GetStats() const
+	{
+		return stats;
+	}
+private:
+	class Batch
+	{
+	public:
+		virtual ~Batch() = default;
+		virtual const void* GetPipeline() const = 0;
+		// returns the number of draws
+		virtual size_t Draw(const SceneGraph& graph, const Mat4& view, const Mat4& proj) = 0;
+	};
+	template<class Effect>
+	class PipelineBatch : public Batch
+	{
+	public:
+		PipelineBatch(::Pipeline<Effect>& pipeline)
+			:
+			pPipeline(&pipeline)
+		{}
+		template<class Mesh>
+		void Add(NodeId node, Mesh& mesh)
+		{
+			items.push_back({ node,&mesh,[](::Pipeline<Effect>& pipeline, void* pMesh)
+			{
+				pipeline.Draw(*static_cast<Mesh*>(pMesh));
+			} });
+		}
+		const void* GetPipeline() const override
+		{
+			return pPipeline;
+		}
+		size_t Draw(const SceneGraph& graph, const Mat4& view, const Mat4& proj) override
+		{
+			auto& vs = pPipeline->effect.vs;
+			EffectBinding::BindCamera(vs, view, proj);
+			for (const auto& item : items)
+			{
+				EffectBinding::BindObject(vs, graph.worlds[item.node], view);
+				item.draw(*pPipeline, item.pMesh);
+			}
+			return items.size();
+		}
+	private:
+		struct Item
+		{
+			NodeId node;
+			void* pMesh;
+			void (*draw)(::Pipeline<Effect>&, void*);
+		};
+		::Pipeline<Effect>* pPipeline;
+		std::vector<Item> items;
+	};
+private:
+	// per node, indexed by NodeId
+	std::vector<NodeId> parents;
+	std::vector<uint32_t> depths;
+	// a deque so adding nodes doesn't move the transforms GetTransform handed out
+	std::deque<Transform> transforms;
+	// transform version the world matrix was built from
+	std::vector<unsigned int> seenVersions;
+	// world matrix rebuilt by the running Update, read by the children on the next level
+	std::vector<uint8_t> changed;
+	std::vector<Mat4> worlds;
+	// node ids by depth, ascending within a level
+	std::vector<std::vector<NodeId>> levels;
+	std::vector<std::unique_ptr<Batch>> batches;
+	JobSystem* pJobs = &JobSystem::Get();
+	Stats stats;
+};
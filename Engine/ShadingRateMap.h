@@ -0,0 +1,111 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+#include "Colors.h"
+#include "RenderTarget.h"
+
+// per screen tile shading rate (1, 2 or 4 pixels per shaded block side) picked from the luminance
+// gradient of the previous frame: tiles that were smooth get shaded once per 2x2 or 4x4 block,
+// tiles with edges or texture detail stay at full rate
+class ShadingRateMap
+{
+public:
+	static constexpr int TileSize = 16;
+public:
+	ShadingRateMap(int width, int height)
+		:
+		width(width),
+		height(height),
+		tilesX((width + TileSize - 1) / TileSize),
+		tilesY((height + TileSize - 1) / TileSize),
+		rates(size_t(tilesX) * tilesY, 1)
+	{}
+	// mean absolute luminance step between neighbouring pixels (0 - 255 scale) under which
+	// a tile goes to 4x4 and 2x2 shading
+	void SetThresholds(float coarse4x4, float coarse2x2)
+	{
+		assert(coarse4x4 <= coarse2x2);
+		threshold4x4 = coarse4x4;
+		threshold2x2 = coarse2x2;
+	}
+	// rates for the next frame from the finished one
+	void Update(const RenderTarget& frame)
+	{
+		assert(int(frame.GetWidth()) == width && int(frame.GetHeight()) == height);
+		luma.resize(size_t(width) * 2);
+		for (int ty = 0; ty < tilesY; ty++)
+		{
+			const int y0 = ty * TileSize;
+			const int y1 = std::min(y0 + TileSize, height);
+			tileGradients.assign(tilesX, 0u);
+			// luminance of the row above the band, so vertical steps cross tile borders too
+			int* pPrev = luma.data();
+			int* pCur = luma.data() + width;
+			LumaRow(frame, std::max(y0 - 1, 0), pPrev);
+			for (int y = y0; y < y1; y++)
+			{
+				LumaRow(frame, y, pCur);
+				for (int x = 0; x < width; x++)
+				{
+					const int dx = x > 0 ? std::abs(pCur[x] - pCur[x - 1]) : 0;
+					const int dy = std::abs(pCur[x] - pPrev[x]);
+					tileGradients[x / TileSize] += (unsigned int)std::max(dx, dy);
+				}
+				std::swap(pPrev, pCur);
+			}
+			for (int tx = 0; tx < tilesX; tx++)
+			{
+				const int tileWidth = std::min(TileSize, width - tx * TileSize);
+				const float mean = float(tileGradients[tx]) / float(tileWidth * (y1 - y0));
+				rates[size_t(ty) * tilesX + tx] = uint8_t(mean < threshold4x4 ? 4 : mean < threshold2x2 ? 2 : 1);
+			}
+		}
+	}
+	// every tile at the same rate
+	void Fill(int rate)
+	{
+		assert(rate == 1 || rate == 2 || rate == 4);
+		std::fill(rates.begin(), rates.end(), uint8_t(rate));
+	}
+	int At(int x, int y) const
+	{
+		return rates[size_t(y / TileSize) * tilesX + x / TileSize];
+	}
+	// share of the screen per rate, index 0 / 1 / 2 for rates 1 / 2 / 4
+	void GetCoverage(float coverage[3]) const
+	{
+		size_t counts[3] = {};
+		for (const auto r : rates)
+		{
+			counts[r == 1 ? 0 : r == 2 ? 1 : 2]++;
+		}
+		for (int i = 0; i < 3; i++)
+		{
+			coverage[i] = float(counts[i]) / float(rates.size());
+		}
+	}
+private:
+	// rec. 709 luma in 0 - 255
+	static void LumaRow(const RenderTarget& frame, int y, int* pOut)
+	{
+		const Color* pRow = frame.GetRow(y);
+		for (unsigned int x = 0; x < frame.GetWidth(); x++)
+		{
+			pOut[x] = (pRow[x].GetR() * 54 + pRow[x].GetG() * 183 + pRow[x].GetB() * 19) >> 8;
+		}
+	}
+private:
+	int width;
+	int height;
+	int tilesX;
+	int tilesY;
+	std::vector<uint8_t> rates;
+	float threshold4x4 = 0.5f;
+	float threshold2x2 = 2.0f;
+	// scratch
+	std::vector<int> luma;
+	std::vector<unsigned int> tileGradients;
+};
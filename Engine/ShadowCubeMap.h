@@ -0,0 +1,248 @@
+#pragma once
+#include <vector>
+#include <array>
+#include <memory>
+#include <algorithm>
+#include <cmath>
+#include "Vec3.h"
+#include "Vec4.h"
+#include "Mat.h"
+#include "ZBuffer.h"
+#include "BoundingSphere.h"
+#include "DepthPipeline.h"
+#include "LodChain.h"
+#include "JobSystem.h"
+
+// omnidirectional shadow map of a point light: six 90 degree depth faces around the light along
+// +x -x +y -y +z -z, rendered with DepthPipeline
+// a cube rather than a dual paraboloid: the paraboloid warp isn't linear, so triangles rendered into it
+// with straight edges cover the wrong texels unless the casters are finely tessellated
+// Begin, record the casters with Draw, End renders the faces (in parallel), then pixel shaders Sample
+class ShadowCubeMap
+{
+public:
+	struct Stats
+	{
+		// caster draws summed over the faces, culled ones included
+		size_t draws = 0;
+		size_t drawsCulled = 0;
+		size_t trianglesRasterized = 0;
+		size_t pixelsWritten = 0;
+	};
+public:
+	// size is the edge of a face in texels, nearZ / farZ the range around the light that casts shadows
+	ShadowCubeMap(int size, float nearZ, float farZ)
+		:
+		size(size),
+		proj(Mat4::ProjectionFOV(90.0f, 1.0f, nearZ, farZ)),
+		A(proj.elements[2][2]),
+		B(proj.elements[3][2]),
+		nearZ(nearZ),
+		farZ(farZ)
+	{
+		pipelines.reserve(6);
+		for (int i = 0; i < 6; i++)
+		{
+			faces[i] = std::make_shared<ZBuffer>(size, size);
+			pipelines.emplace_back(faces[i]);
+			// depth of the back faces: closed casters can't shadow their own lit side, so the bias only
+			// has to cover the filter and the interpolation
+			pipelines.back().SetCullMode(DepthPipeline::CullMode::Front);
+		}
+	}
+	void SetJobSystem(JobSystem* pJobs_in)
+	{
+		pJobs = pJobs_in;
+	}
+	// light position in the space the casters' matrices transform to, the pixel shader samples in it too
+	void Begin(const Vec3& lightPos_in)
+	{
+		lightPos = lightPos_in;
+		casters.clear();
+		for (int i = 0; i < 6; i++)
+		{
+			const auto& b = GetBasis(i);
+			// columns are the axes, so a point maps to its coordinates along them
+			const Mat4 rot = {
+				b.right.x,b.up.x,b.forward.x,0.0f,
+				b.right.y,b.up.y,b.forward.y,0.0f,
+				b.right.z,b.up.z,b.forward.z,0.0f,
+				0.0f,     0.0f,  0.0f,       1.0f,
+			};
+			faceViewProj[i] = Mat4::Translation(-lightPos) * rot * proj;
+		}
+	}
+	// mesh is anything DepthPipeline::Draw takes and has to stay alive until End
+	// transform takes its vertices to the light's space (world * view in the scenes)
+	template<class Mesh>
+	void Draw(Mesh& mesh, const Mat4& transform)
+	{
+		// bounds are solved lazily, so they are fetched here and not on the face threads
+		casters.push_back({ &mesh,&DrawMesh<Mesh>,GetBounds(mesh),transform });
+	}
+	void End()
+	{
+		const auto render = [this](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; i++)
+			{
+				auto& pipeline = pipelines[i];
+				pipeline.BeginFrame();
+				for (const auto& c : casters)
+				{
+					pipeline.BindWorldViewProj(c.transform * faceViewProj[i]);
+					c.draw(pipeline, c.pMesh, c.bounds);
+				}
+			}
+		};
+		if (pJobs)
+		{
+			pJobs->ParallelFor(6, 1, render);
+		}
+		else
+		{
+			render(0, 6);
+		}
+		stats = {};
+		for (const auto& p : pipelines)
+		{
+			const auto& s = p.GetStats();
+			stats.draws += s.draws;
+			stats.drawsCulled += s.drawsCulled;
+			stats.trianglesRasterized += s.trianglesRasterized;
+			stats.pixelsWritten += s.pixelsWritten;
+		}
+	}
+	// fraction of the light reaching pos, 3x3 percentage closer filtering on the face pos falls in
+	// taps are clamped to that face, so the filter narrows at the cube's edges
+	float Sample(const Vec3& pos) const
+	{
+		const Vec3 v = pos - lightPos;
+		const float ax = std::abs(v.x);
+		const float ay = std::abs(v.y);
+		const float az = std::abs(v.z);
+		int face;
+		if (ax >= ay && ax >= az)
+		{
+			face = v.x > 0.0f ? 0 : 1;
+		}
+		else if (ay >= az)
+		{
+			face = v.y > 0.0f ? 2 : 3;
+		}
+		else
+		{
+			face = v.z > 0.0f ? 4 : 5;
+		}
+		const auto& b = GetBasis(face);
+		const float z = v * b.forward;
+		if (z <= nearZ || z >= farZ)
+		{
+			return 1.0f;
+		}
+		const float zInv = 1.0f / z;
+		const float half = 0.5f * float(size);
+		// texel coordinates, y flips like the rasterizer
+		const float tx = (v * b.right * zInv + 1.0f) * half - 0.5f;
+		const float ty = (1.0f - v * b.up * zInv) * half - 0.5f;
+		// a texel covers about 2z / size at this distance, the bias grows with it
+		const float bias = z * (3.0f / float(size)) + 0.01f;
+		const float reference = A + B / (z - bias);
+
+		const auto& zb = *faces[face];
+		const int x0 = int(std::floor(tx + 0.5f));
+		const int y0 = int(std::floor(ty + 0.5f));
+		int lit = 0;
+		const int xs[3] = { std::max(x0 - 1, 0),std::min(std::max(x0, 0), size - 1),std::min(x0 + 1, size - 1) };
+		for (int dy = -1; dy <= 1; dy++)
+		{
+			const float* pRow = &zb.At(0, std::min(std::max(y0 + dy, 0), size - 1));
+			for (const int x : xs)
+			{
+				// cleared texels are infinity, nothing in between
+				lit += reference <= pRow[x] ? 1 : 0;
+			}
+		}
+		return float(lit) * (1.0f / 9.0f);
+	}
+	const ZBuffer& GetFace(int i) const
+	{
+		return *faces[i];
+	}
+	int GetSize() const
+	{
+		return size;
+	}
+	const Stats& GetStats() const
+	{
+		return stats;
+	}
+private:
+	// right x up = forward for every face, so the face views are rotations and keep the winding
+	struct Basis
+	{
+		Vec3 right;
+		Vec3 up;
+		Vec3 forward;
+	};
+	static const Basis& GetBasis(int face)
+	{
+		static const Basis bases[6] = {
+			{ {  0.0f,0.0f,-1.0f },{ 0.0f,1.0f, 0.0f },{  1.0f, 0.0f, 0.0f } },
+			{ {  0.0f,0.0f, 1.0f },{ 0.0f,1.0f, 0.0f },{ -1.0f, 0.0f, 0.0f } },
+			{ {  1.0f,0.0f, 0.0f },{ 0.0f,0.0f,-1.0f },{  0.0f, 1.0f, 0.0f } },
+			{ {  1.0f,0.0f, 0.0f },{ 0.0f,0.0f, 1.0f },{  0.0f,-1.0f, 0.0f } },
+			{ {  1.0f,0.0f, 0.0f },{ 0.0f,1.0f, 0.0f },{  0.0f, 0.0f, 1.0f } },
+			{ { -1.0f,0.0f, 0.0f },{ 0.0f,1.0f, 0.0f },{  0.0f, 0.0f,-1.0f } },
+		};
+		return bases[face];
+	}
+	struct Caster
+	{
+		const void* pMesh;
+		void (*draw)(DepthPipeline& pipeline, const void* pMesh, const BoundingSphere& bounds);
+		BoundingSphere bounds;
+		Mat4 transform;
+	};
+	template<class Mesh>
+	static void DrawMesh(DepthPipeline& pipeline, const void* pMesh, const BoundingSphere& bounds)
+	{
+		pipeline.Draw(GetLevel(*static_cast<const Mesh*>(pMesh)), bounds);
+	}
+	// full detail of lod chains, like DepthPipeline::Draw( LodChain& )
+	template<class Mesh>
+	static const Mesh& GetLevel(const Mesh& mesh)
+	{
+		return mesh;
+	}
+	template<class T>
+	static const IndexedTriangleList<T>& GetLevel(const LodChain<T>& lod)
+	{
+		return lod.levels.front();
+	}
+	template<class Mesh>
+	static BoundingSphere GetBounds(Mesh& mesh)
+	{
+		return mesh.GetBoundingSphere();
+	}
+	template<class T>
+	static BoundingSphere GetBounds(LodChain<T>& lod)
+	{
+		return lod.levels.front().GetBoundingSphere();
+	}
+private:
+	int size;
+	Mat4 proj;
+	// ndc depth d = A + B / z of the faces
+	float A;
+	float B;
+	float nearZ;
+	float farZ;
+	Vec3 lightPos = { 0.0f,0.0f,0.0f };
+	std::array<Mat4, 6> faceViewProj;
+	std::array<std::shared_ptr<ZBuffer>, 6> faces;
+	std::vector<DepthPipeline> pipelines;
+	std::vector<Caster> casters;
+	JobSystem* pJobs = &JobSystem::Get();
+	Stats stats;
+};
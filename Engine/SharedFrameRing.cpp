@@ -0,0 +1,312 @@
+#ifdef _WIN32
+#define FULL_WINTARD
+#include "ChiliWin.h"
+#endif
+#include "SharedFrameRing.h"
+#include <stdexcept>
+#include <cassert>
+#include <new>
+#include <utility>
+#include <algorithm>
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+	size_t AlignUp( size_t v,size_t a )
+	{
+		return (v + a - 1u) / a * a;
+	}
+}
+
+SharedFrameRing SharedFrameRing::Create( const std::string& name,unsigned int width,unsigned int height,unsigned int slotCount )
+{
+	// need at least one slot for the reader and one for the writer plus slack for lapping
+	if( slotCount < 2u )
+	{
+		throw std::runtime_error( "SharedFrameRing needs at least 2 slots  Name:" + name );
+	}
+	// rows padded to cache lines, slots padded to pages
+	const size_t pitch = AlignUp( width * sizeof( Color ),64u );
+	const size_t slotBytes = AlignUp( pitch * height,4096u );
+	const size_t dataOffset = AlignUp( sizeof( Header ) + sizeof( SlotHeader ) * slotCount,4096u );
+
+	SharedFrameRing ring;
+	ring.name = name;
+	ring.owner = true;
+	ring.Map( dataOffset + slotBytes * slotCount,true,true );
+
+	auto& h = *new( ring.pBase ) Header;
+	h.magic = Magic;
+	h.width = width;
+	h.height = height;
+	h.pitch = uint32_t( pitch );
+	h.slotCount = slotCount;
+	h.slotBytes = slotBytes;
+	h.dataOffset = dataOffset;
+	for( size_t i = 0; i < slotCount; i++ )
+	{
+		new( &ring.GetSlot( i ) ) SlotHeader;
+		ring.GetSlot( i ).sequence.store( 0u,std::memory_order_relaxed );
+	}
+	h.latestFrame.store( 0u,std::memory_order_release );
+	return ring;
+}
+
+SharedFrameRing SharedFrameRing::Open( const std::string& name )
+{
+	SharedFrameRing ring;
+	ring.name = name;
+	ring.Map( 0u,false,false );
+	if( ring.size < sizeof( Header ) || ring.GetHeader().magic != Magic )
+	{
+		throw std::runtime_error( "SharedFrameRing is not a frame ring  Name:" + name );
+	}
+	// the layout comes from another process, check it fits the mapping before using any pointers
+	const auto& h = ring.GetHeader();
+	const uint64_t rowBytes = uint64_t( h.width ) * sizeof( Color );
+	const bool valid = h.slotCount >= 2u &&
+		h.pitch >= rowBytes && h.pitch % sizeof( Color ) == 0u &&
+		h.slotBytes >= uint64_t( h.pitch ) * h.height &&
+		h.dataOffset >= sizeof( Header ) + sizeof( SlotHeader ) * uint64_t( h.slotCount ) &&
+		h.dataOffset <= ring.size &&
+		h.slotBytes <= (ring.size - h.dataOffset) / h.slotCount;
+	if( !valid )
+	{
+		throw std::runtime_error( "SharedFrameRing has a corrupt header  Name:" + name );
+	}
+	return ring;
+}
+
+SharedFrameRing::SharedFrameRing( SharedFrameRing&& donor )
+{
+	*this = std::move( donor );
+}
+
+SharedFrameRing& SharedFrameRing::operator=( SharedFrameRing&& donor )
+{
+	Release();
+	name = std::move( donor.name );
+	owner = donor.owner;
+	pBase = donor.pBase;
+	size = donor.size;
+	handle = donor.handle;
+	writeFrame = donor.writeFrame;
+	donor.owner = false;
+	donor.pBase = nullptr;
+	donor.size = 0u;
+	donor.handle = -1;
+	return *this;
+}
+
+SharedFrameRing::~SharedFrameRing()
+{
+	Release();
+}
+
+RenderTarget SharedFrameRing::BeginWrite()
+{
+	assert( owner );
+	const auto& h = GetHeader();
+	const uint64_t frame = ++writeFrame;
+	const size_t slot = size_t( (frame - 1u) % h.slotCount );
+	// odd sequence tells readers the slot is being overwritten
+	GetSlot( slot ).sequence.store( frame * 2u + 1u,std::memory_order_relaxed );
+	std::atomic_thread_fence( std::memory_order_release );
+	return RenderTarget( GetSlotData( slot ),h.width,h.height,h.pitch );
+}
+
+void SharedFrameRing::EndWrite()
+{
+	assert( owner );
+	auto& h = GetHeader();
+	const uint64_t frame = writeFrame;
+	const size_t slot = size_t( (frame - 1u) % h.slotCount );
+	GetSlot( slot ).sequence.store( frame * 2u + 2u,std::memory_order_release );
+	h.latestFrame.store( frame,std::memory_order_release );
+}
+
+void SharedFrameRing::Consume( const RenderTarget& frame )
+{
+	if( frame.GetWidth() != GetWidth() || frame.GetHeight() != GetHeight() )
+	{
+		throw std::runtime_error( "SharedFrameRing got a frame of the wrong size  Name:" + name );
+	}
+	auto target = BeginWrite();
+	for( unsigned int y = 0u; y < target.GetHeight(); y++ )
+	{
+		std::copy_n( frame.GetRow( y ),target.GetWidth(),target.GetRow( y ) );
+	}
+	EndWrite();
+}
+
+uint64_t SharedFrameRing::ReadLatest( uint64_t lastFrame,const std::function<void( const RenderTarget& )>& reader ) const
+{
+	const auto& h = GetHeader();
+	while( true )
+	{
+		const uint64_t frame = h.latestFrame.load( std::memory_order_acquire );
+		if( frame <= lastFrame )
+		{
+			return lastFrame;
+		}
+		const size_t slot = size_t( (frame - 1u) % h.slotCount );
+		const auto& seq = GetSlot( slot ).sequence;
+		const uint64_t before = seq.load( std::memory_order_acquire );
+		// writer already lapped us onto this slot, go again with the newer frame
+		if( before != frame * 2u + 2u )
+		{
+			continue;
+		}
+		reader( RenderTarget( GetSlotData( slot ),h.width,h.height,h.pitch ) );
+		std::atomic_thread_fence( std::memory_order_acquire );
+		if( seq.load( std::memory_order_relaxed ) == before )
+		{
+			return frame;
+		}
+	}
+}
+
+uint64_t SharedFrameRing::GetLatestFrame() const
+{
+	return GetHeader().latestFrame.load( std::memory_order_acquire );
+}
+
+unsigned int SharedFrameRing::GetWidth() const
+{
+	return GetHeader().width;
+}
+
+unsigned int SharedFrameRing::GetHeight() const
+{
+	return GetHeader().height;
+}
+
+unsigned int SharedFrameRing::GetSlotCount() const
+{
+	return GetHeader().slotCount;
+}
+
+SharedFrameRing::Header& SharedFrameRing::GetHeader() const
+{
+	return *reinterpret_cast<Header*>( pBase );
+}
+
+SharedFrameRing::SlotHeader& SharedFrameRing::GetSlot( size_t i ) const
+{
+	return reinterpret_cast<SlotHeader*>( pBase + sizeof( Header ) )[i];
+}
+
+Color* SharedFrameRing::GetSlotData( size_t i ) const
+{
+	const auto& h = GetHeader();
+	return reinterpret_cast<Color*>( pBase + h.dataOffset + h.slotBytes * i );
+}
+
+#ifdef _WIN32
+void SharedFrameRing::Map( size_t size_in,bool create,bool writable )
+{
+	HANDLE hMap;
+	if( create )
+	{
+		const auto size64 = uint64_t( size_in );
+		hMap = CreateFileMappingA( INVALID_HANDLE_VALUE,nullptr,PAGE_READWRITE,
+			DWORD( size64 >> 32u ),DWORD( size64 & 0xFFFFFFFFu ),name.c_str() );
+	}
+	else
+	{
+		hMap = OpenFileMappingA( FILE_MAP_READ,FALSE,name.c_str() );
+	}
+	if( hMap == nullptr )
+	{
+		throw std::runtime_error( "SharedFrameRing failed to create/open file mapping  Name:" + name );
+	}
+	void* p = MapViewOfFile( hMap,writable ? FILE_MAP_ALL_ACCESS : FILE_MAP_READ,0u,0u,size_in );
+	if( p == nullptr )
+	{
+		CloseHandle( hMap );
+		throw std::runtime_error( "SharedFrameRing failed to map view  Name:" + name );
+	}
+	if( !create )
+	{
+		MEMORY_BASIC_INFORMATION info;
+		VirtualQuery( p,&info,sizeof( info ) );
+		size_in = info.RegionSize;
+	}
+	handle = reinterpret_cast<intptr_t>( hMap );
+	pBase = static_cast<unsigned char*>( p );
+	size = size_in;
+}
+
+void SharedFrameRing::Release()
+{
+	if( pBase != nullptr )
+	{
+		UnmapViewOfFile( pBase );
+		pBase = nullptr;
+	}
+	// pagefile backed mapping goes away with its last handle
+	if( handle != -1 )
+	{
+		CloseHandle( reinterpret_cast<HANDLE>( handle ) );
+		handle = -1;
+	}
+	owner = false;
+}
+#else
+void SharedFrameRing::Map( size_t size_in,bool create,bool writable )
+{
+	const std::string shmName = "/" + name;
+	const int fd = create ?
+		shm_open( shmName.c_str(),O_CREAT | O_RDWR,0600 ) :
+		shm_open( shmName.c_str(),writable ? O_RDWR : O_RDONLY,0 );
+	if( fd < 0 )
+	{
+		throw std::runtime_error( "SharedFrameRing failed to open shm  Name:" + name );
+	}
+	if( create && ftruncate( fd,off_t( size_in ) ) != 0 )
+	{
+		close( fd );
+		throw std::runtime_error( "SharedFrameRing failed to size shm  Name:" + name );
+	}
+	if( !create )
+	{
+		struct stat st;
+		fstat( fd,&st );
+		size_in = size_t( st.st_size );
+	}
+	void* p = mmap( nullptr,size_in,PROT_READ | (writable ? PROT_WRITE : 0),MAP_SHARED,fd,0 );
+	if( p == MAP_FAILED )
+	{
+		close( fd );
+		throw std::runtime_error( "SharedFrameRing failed to map shm  Name:" + name );
+	}
+	handle = fd;
+	pBase = static_cast<unsigned char*>( p );
+	size = size_in;
+}
+
+void SharedFrameRing::Release()
+{
+	if( pBase != nullptr )
+	{
+		munmap( pBase,size );
+		pBase = nullptr;
+	}
+	if( handle != -1 )
+	{
+		close( int( handle ) );
+		handle = -1;
+	}
+	// the producer owns the name
+	if( owner )
+	{
+		shm_unlink( ("/" + name).c_str() );
+		owner = false;
+	}
+}
+#endif
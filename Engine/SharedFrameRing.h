@@ -0,0 +1,89 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <functional>
+#include "RenderTarget.h"
+#include "FrameSink.h"
+
+// ring of frame slots in named shared memory for handing rendered frames to
+// another process (e.g. a video encoder) on the same machine
+// the producer renders straight into a slot through a RenderTarget, so publishing
+// costs no copy. every slot is guarded by a sequence counter (odd while being
+// written) and the header holds the number of the latest completed frame, so
+// neither side ever takes a lock
+// as a FrameSink it publishes copies of frames drawn elsewhere (Graphics::SetFrameSink)
+// posix shm on linux, a pagefile backed file mapping on windows
+class SharedFrameRing : public FrameSink
+{
+public:
+	static constexpr unsigned int DefaultSlotCount = 3u;
+public:
+	// producer side, creates the shared memory object or takes over an existing one of that name,
+	// which is overwritten in place under any producer and readers still using it, so a name
+	// must only be used by one producer at a time
+	static SharedFrameRing Create( const std::string& name,unsigned int width,unsigned int height,
+		unsigned int slotCount = DefaultSlotCount );
+	// consumer side, opens an existing ring read only
+	static SharedFrameRing Open( const std::string& name );
+	SharedFrameRing( SharedFrameRing&& donor );
+	SharedFrameRing& operator=( SharedFrameRing&& donor );
+	SharedFrameRing( const SharedFrameRing& ) = delete;
+	SharedFrameRing& operator=( const SharedFrameRing& ) = delete;
+	~SharedFrameRing() override;
+
+	// producer: slot for the next frame, stays valid until EndWrite
+	RenderTarget BeginWrite();
+	// producer: marks the slot complete and makes it the latest frame
+	void EndWrite();
+	// producer: publishes a copy of a frame of the ring's size drawn somewhere else
+	void Consume( const RenderTarget& frame ) override;
+
+	// consumer: calls reader with the latest completed frame if it is newer than lastFrame
+	// the frame is read in place; if the producer lapped the reader meanwhile the read is
+	// retried, so reader must not keep pointers into the frame
+	// returns the frame number read, or lastFrame if there was nothing new
+	uint64_t ReadLatest( uint64_t lastFrame,const std::function<void( const RenderTarget& )>& reader ) const;
+	// number of the latest completed frame (frames are numbered from 1)
+	uint64_t GetLatestFrame() const;
+
+	unsigned int GetWidth() const;
+	unsigned int GetHeight() const;
+	unsigned int GetSlotCount() const;
+private:
+	// padded to a cache line, so the slot headers after it start on one
+	struct alignas( 64 ) Header
+	{
+		uint32_t magic;
+		uint32_t width;
+		uint32_t height;
+		uint32_t pitch;		// bytes
+		uint32_t slotCount;
+		uint64_t slotBytes;
+		uint64_t dataOffset;
+		std::atomic<uint64_t> latestFrame;
+	};
+	struct alignas( 64 ) SlotHeader
+	{
+		// 2 * frame + 1 while frame is being written, 2 * frame + 2 once complete
+		std::atomic<uint64_t> sequence;
+	};
+	static_assert( sizeof( std::atomic<uint64_t> ) == sizeof( uint64_t ),"shared atomics must be plain words" );
+	static_assert( sizeof( Header ) % alignof( SlotHeader ) == 0,"slot headers must stay cache line aligned" );
+	static constexpr uint32_t Magic = 0x53465231u; // 'SFR1'
+private:
+	SharedFrameRing() = default;
+	void Map( size_t size,bool create,bool writable );
+	void Release();
+	Header& GetHeader() const;
+	SlotHeader& GetSlot( size_t i ) const;
+	Color* GetSlotData( size_t i ) const;
+private:
+	std::string name;
+	bool owner = false;
+	unsigned char* pBase = nullptr;
+	size_t size = 0u;
+	// HANDLE on windows, file descriptor elsewhere
+	intptr_t handle = -1;
+	uint64_t writeFrame = 0u;
+};
@@ -143,6 +143,14 @@ public:
 		{
 			return proj;
 		}
+		const Mat4& GetWorldView() const
+		{
+			return worldView;
+		}
+		const Mat4& GetWorldViewProj() const
+		{
+			return worldViewProj;
+		}
 		Output operator()(const Vertex& v) const
 		{
 			return{ Vec4(v.pos) * worldViewProj,v.color };
@@ -1,6 +1,10 @@
 #pragma once
 #include "Pipeline.h"
 #include "DefaultGeometryShader.h"
+#include "Transform.h"
+#include "LightGrid.h"
+#include "ShadowCubeMap.h"
+#include <cstring>
 
 
 class SpecularPhongPointEffect {
@@ -105,14 +109,22 @@ public:
 		void BindWorld(const Mat4& transformation_in)
 		{
 			world = transformation_in;
-			worldView = world * view;
-			worldViewProj = worldView * proj;
+			Compose();
+		}
+		// skips the compose when the transform's matrix is the one already bound (objects that didn't move
+		// and consecutive draws of the same object)
+		void BindWorld(const Transform& transform)
+		{
+			const auto& m = transform.GetMatrix();
+			if (std::memcmp(&m, &world, sizeof(Mat4)) != 0)
+			{
+				BindWorld(m);
+			}
 		}
 		void BindView(const Mat4& transformation_in)
 		{
 			view = transformation_in;
-			worldView = world * view;
-			worldViewProj = worldView * proj;
+			Compose();
 		}
 		void BindProjection(const Mat4& transformation_in)
 		{
@@ -123,10 +135,26 @@ public:
 		{
 			return proj;
 		}
+		const Mat4& GetWorldView() const
+		{
+			return worldView;
+		}
+		const Mat4& GetWorldViewProj() const
+		{
+			return worldViewProj;
+		}
 		Output operator()(const Vertex& v) const
 		{
 			const auto p4 = Vec4(v.pos);
-			return { p4 * worldViewProj,Vec4{ v.n,0.0f } *worldView,p4 * worldView };
+			return { p4 * worldViewProj,v.n * normalMatrix,p4 * worldView };
+		}
+	private:
+		// world and view are rigid or scaled, never projective, so their product is affine
+		void Compose()
+		{
+			worldView = world.AffineMultiply(view);
+			normalMatrix = worldView.GetNormalMatrix();
+			worldViewProj = worldView * proj;
 		}
 	private:
 		Mat4 world = Mat4::Identity();
@@ -134,6 +162,7 @@ public:
 		Mat4 proj = Mat4::Identity();
 		Mat4 worldView = Mat4::Identity();
 		Mat4 worldViewProj = Mat4::Identity();
+		Mat3 normalMatrix = Mat3::Identity();
 	};
 
 
@@ -148,21 +177,31 @@ public:
 			// normalizing the interpolated surface normal
 			const auto surfaceNormal = in.n.GetNormalized();
 			//in.n.Normalize();
-			// light to object vector ***** bad naming****
-			const auto vecL = light_pos - in.worldPos;
-			const auto distance = vecL.Len();
-			const auto dir = vecL / distance;
-			// calculate attentuation
-			const auto attenuation = 1.0f /
-				(constant_attenuation + linear_attenuation * distance + quadradic_attenuation * sq(distance));
-			// diffuse
-			const auto d = light_diffuse * attenuation * std::max(0.0f, (surfaceNormal * dir));
-			// reflection vector
-			const auto r = (surfaceNormal * (surfaceNormal * vecL)) * 2.0f  - vecL;
-			// specular
-			const auto s = light_diffuse * specular_intensity * std::pow(std::max(0.0f, -r.GetNormalized() * in.worldPos.GetNormalized()), specular_power);
+			const auto viewDir = in.worldPos.GetNormalized();
+			Vec3 d = { 0.0f,0.0f,0.0f };
+			Vec3 s = { 0.0f,0.0f,0.0f };
+			if (pLightGrid)
+			{
+				// only the lights reaching this pixel's tile
+				for (const auto i : pLightGrid->GetTileLights(in.worldPos))
+				{
+					AddLight(pLightGrid->GetViewLight(i), in.worldPos, surfaceNormal, viewDir, d, s);
+				}
+			}
+			else
+			{
+				// unbounded, so it is never faded, only dimmed where the shadow map has it blocked
+				const float lit = pShadowMap ? pShadowMap->Sample(in.worldPos) : 1.0f;
+				if (lit > 0.0f)
+				{
+					const PointLight light = { light_pos,light_diffuse * lit,std::numeric_limits<float>::infinity() };
+					AddLight(light, in.worldPos, surfaceNormal, viewDir, d, s);
+				}
+			}
 
-			return Color(color.GetHadamard(d + light_ambient + s).Saturate() * 255.0f);
+			Color c(color.GetHadamard(d + light_ambient + s).Saturate() * 255.0f);
+			c.SetA(alpha);
+			return c;
 
 		}
 		void SetLightPos(const Vec3& p)
@@ -177,7 +216,49 @@ public:
 		{
 			light_diffuse = d;
 		}
+		// written to the x channel, only used by pipelines with a blended output mode
+		void SetOpacity(float opacity)
+		{
+			alpha = (unsigned char)(std::min(std::max(opacity, 0.0f), 1.0f) * 255.0f);
+		}
+		// many lights: each pixel is lit by the lights of its tile instead of the single light above
+		// build the grid with the view and projection bound to the vertex shader, nullptr goes back
+		void SetLightGrid(std::shared_ptr<const LightGrid> pLightGrid_in)
+		{
+			pLightGrid = std::move(pLightGrid_in);
+		}
+		// shadows of the single light, rendered around the position passed to SetLightPos, nullptr turns them off
+		void SetShadowMap(std::shared_ptr<const ShadowCubeMap> pShadowMap_in)
+		{
+			pShadowMap = std::move(pShadowMap_in);
+		}
+	private:
+		// accumulates the diffuse and specular light of one light
+		void AddLight(const PointLight& light, const Vec3& worldPos, const Vec3& surfaceNormal, const Vec3& viewDir,
+			Vec3& d, Vec3& s) const
+		{
+			// light to object vector ***** bad naming****
+			const auto vecL = light.pos - worldPos;
+			const auto distance = vecL.Len();
+			if (distance >= light.range)
+			{
+				return;
+			}
+			const auto dir = vecL / distance;
+			const auto falloff = light.GetFalloff(distance);
+			// calculate attentuation
+			const auto attenuation = falloff /
+				(constant_attenuation + linear_attenuation * distance + quadradic_attenuation * sq(distance));
+			// diffuse
+			d += light.color * attenuation * std::max(0.0f, (surfaceNormal * dir));
+			// reflection vector
+			const auto r = (surfaceNormal * (surfaceNormal * vecL)) * 2.0f - vecL;
+			// specular
+			s += light.color * specular_intensity * falloff * std::pow(std::max(0.0f, -r.GetNormalized() * viewDir), specular_power);
+		}
 	private:
+		std::shared_ptr<const LightGrid> pLightGrid;
+		std::shared_ptr<const ShadowCubeMap> pShadowMap;
 		Vec3 light_pos = { 0.0f,0.0f,0.5f };
 		Vec3 light_diffuse = { 1.0f,1.0f,1.0f };
 		Vec3 light_ambient = { 0.1f,0.1f,0.1f };
@@ -188,6 +269,7 @@ public:
 
 		float specular_power = 60.0f;
 		float specular_intensity = 0.7f;
+		unsigned char alpha = 255u;
 	};
 public:
 	PixelShader ps;
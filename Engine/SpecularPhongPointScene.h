@@ -3,10 +3,12 @@
 #include "Cube.h"
 #include "Mat.h"
 #include "Pipeline.h"
+#include "CommandBuffer.h"
 #include "SpecularPhongPointEffect.h"
 #include "SolidEffect.h"
 #include "Sphere.h"
 #include "MouseTracker.h"
+#include "ShadowCubeMap.h"
 
 
 class SpecularPhongPointScene : public Scene {
@@ -19,13 +21,33 @@ public:
 
 	SpecularPhongPointScene(Graphics& gfx, IndexedTriangleList<Vertex> tl)
 		:
-		itlist(std::move(tl)),
+		gfx(gfx),
 		pZb(std::make_shared<ZBuffer>(gfx.ScreenWidth, gfx.ScreenHeight)),
+		pOcclusion(std::make_shared<OcclusionBuffer>(gfx.ScreenWidth / 4, gfx.ScreenHeight / 4)),
+		pFragments(std::make_shared<FragmentBuffer>(gfx.ScreenWidth, gfx.ScreenHeight, size_t(gfx.ScreenWidth) * gfx.ScreenHeight * 2)),
+		pSamples(std::make_shared<SampleBuffer>(gfx.ScreenWidth, gfx.ScreenHeight)),
+		pReprojection(std::make_shared<ReprojectionCache>(gfx.ScreenWidth, gfx.ScreenHeight)),
+		pRateMap(std::make_shared<ShadingRateMap>(gfx.ScreenWidth, gfx.ScreenHeight)),
+		pLightGrid(std::make_shared<LightGrid>(gfx.ScreenWidth, gfx.ScreenHeight)),
+		pShadowMap(std::make_shared<ShadowCubeMap>(512, 0.05f, 7.0f)),
 		pipeline(gfx, pZb),
-		Lpipeline(gfx, pZb)
+		Lpipeline(gfx, pZb),
+		modelMaterial(commands.AddMaterial(pipeline)),
+		lightIndicatorMaterial(commands.AddMaterial(Lpipeline))
 	{
-		itlist.AdjustToTrueCenter();
-		mod_pos.z= itlist.GetRadius() * 1.6f;
+		// the model occludes the light indicator and its own far side meshlets, in the prepass
+		// and the shading pass alike
+		Lpipeline.SetOcclusionBuffer(pOcclusion);
+		pipeline.SetOcclusionBuffer(pOcclusion);
+		// constant color, one shade per 4x4 block loses nothing
+		Lpipeline.SetShadingRate(4);
+		pipeline.SetFragmentBuffer(pFragments);
+		pipeline.effect.ps.SetOpacity(0.5f);
+		tl.AdjustToTrueCenter();
+		model_transform.SetPosition({ 0.0f,0.0f,tl.GetRadius() * 1.6f });
+		model_radius = tl.GetRadius();
+		model = LodChain<Vertex>::Build(std::move(tl));
+		model.BuildMeshlets();
 		for (auto& v : lightIndicator.vertices)
 		{
 			v.color = Colors::White;
@@ -65,6 +87,68 @@ public:
 		{
 			cam_rot_inv = cam_rot_inv * Mat4::RotationZ(-cam_roll_speed * dt);
 		}
+		// T toggles a translucent model drawn with order independent transparency
+		const bool toggleDown = kbd.KeyIsPressed('T');
+		if (toggleDown && !toggleWasDown)
+		{
+			translucent = !translucent;
+			pipeline.SetBlendMode(translucent ? Pipeline::BlendMode::OrderIndependent : Pipeline::BlendMode::Opaque);
+		}
+		toggleWasDown = toggleDown;
+		// M toggles 4x msaa
+		const bool msaaDown = kbd.KeyIsPressed('M');
+		if (msaaDown && !msaaWasDown)
+		{
+			msaa = !msaa;
+			pipeline.SetSampleBuffer(msaa ? pSamples : nullptr);
+			Lpipeline.SetSampleBuffer(msaa ? pSamples : nullptr);
+		}
+		msaaWasDown = msaaDown;
+		// R toggles reuse of last frame's shading
+		const bool reprojectionDown = kbd.KeyIsPressed('R');
+		if (reprojectionDown && !reprojectionWasDown)
+		{
+			reprojection = !reprojection;
+		}
+		reprojectionWasDown = reprojectionDown;
+		// V cycles the model's shading rate: full, 2x2, picked per tile from the last frame
+		const bool rateDown = kbd.KeyIsPressed('V');
+		if (rateDown && !rateWasDown)
+		{
+			rateMode = (rateMode + 1) % 3;
+			pipeline.SetShadingRate(rateMode == 1 ? 2 : 1);
+			pipeline.SetShadingRateMap(rateMode == 2 ? pRateMap : nullptr);
+			// no history yet, start at full rate
+			pRateMap->Fill(1);
+		}
+		rateWasDown = rateDown;
+		// L toggles a swarm of small lights circling the model instead of the single light
+		const bool lightsDown = kbd.KeyIsPressed('L');
+		if (lightsDown && !lightsWasDown)
+		{
+			manyLights = !manyLights;
+			pipeline.effect.ps.SetLightGrid(manyLights ? pLightGrid : nullptr);
+		}
+		lightsWasDown = lightsDown;
+		// H toggles the single light's shadows (the model shadowing itself)
+		const bool shadowsDown = kbd.KeyIsPressed('H');
+		if (shadowsDown && !shadowsWasDown)
+		{
+			shadows = !shadows;
+			pipeline.effect.ps.SetShadowMap(shadows ? pShadowMap : nullptr);
+		}
+		shadowsWasDown = shadowsDown;
+		// P toggles a depth prepass, the model is then shaded once per pixel
+		const bool prepassDown = kbd.KeyIsPressed('P');
+		if (prepassDown && !prepassWasDown)
+		{
+			depthPrepass = !depthPrepass;
+		}
+		prepassWasDown = prepassDown;
+		if (manyLights)
+		{
+			swarm_time += dt;
+		}
 		while (!mouse.IsEmpty())
 		{
 			const auto e = mouse.Read();
@@ -90,37 +174,129 @@ public:
 	}
 	virtual void Draw() override
 	{
+		// the transparency resolve and the rate map read the frame back, the msaa resolve only writes it
+		gfx.SetTargetReadback(translucent || rateMode == 2);
 		pipeline.BeginFrame();
 		
 		const auto proj = Mat4::ProjectionFOV(hfov, aspect_ratio, 0.5f, 7.0f);
 		const auto view = Mat4::Translation(-cam_pos) * cam_rot_inv;
 
-		// set pipeline transform
-		pipeline.effect.vs.BindWorld(
-			Mat4::RotationX(theta_x) *
-			Mat4::RotationY(theta_y) *
-			Mat4::RotationZ(theta_z) *
-			Mat4::Translation(mod_pos)
-		);
+		// set pipeline transform, the model matrix is only rebuilt when the transform changes
+		pipeline.effect.vs.BindWorld(model_transform);
 
 		pipeline.effect.vs.BindView(view);
 		pipeline.effect.vs.BindProjection(proj);
 		pipeline.effect.ps.SetLightPos(l_pos * view );
 
-		// render triangles
-		pipeline.Draw(itlist);
+		// model is the only occluder (unless you can see through it), drawn before the
+		// prepass so both passes cull against the same buffer
+		pOcclusion->Clear();
+		pFragments->Clear();
+		if (!translucent)
+		{
+			pipeline.DrawOccluder(model, *pOcclusion);
+		}
+
+		// depth of the opaque model first, the shading pass only shades the pixels it left
+		const bool prepass = depthPrepass && !translucent && !msaa;
+		if (prepass)
+		{
+			pipeline.SetDepthPass(Pipeline::DepthPass::DepthOnly);
+			pipeline.Draw(model);
+		}
+		pipeline.SetDepthPass(prepass ? Pipeline::DepthPass::Equal : Pipeline::DepthPass::Combined);
+
+		if (manyLights)
+		{
+			UpdateSwarm();
+			// with a prepass the tiles get this frame's depth ranges
+			pLightGrid->Build(swarm, view, proj, prepass ? pZb.get() : nullptr);
+		}
+		// the swarm replaces the single light, so its shadows aren't needed then
+		else if (shadows)
+		{
+			pShadowMap->Begin(Vec3(l_pos * view));
+			pShadowMap->Draw(model, model_transform.GetMatrix() * view);
+			pShadowMap->End();
+		}
 
+		// only the camera moves in this scene (unless the light swarm is on), so every opaque single
+		// sampled frame can reuse the last one
+		const bool reproject = reprojection && !translucent && !msaa && !manyLights;
+		pipeline.SetReprojectionCache(reproject ? pReprojection : nullptr);
+		Lpipeline.SetReprojectionCache(reproject ? pReprojection : nullptr);
+		if (reproject)
+		{
+			pReprojection->BeginFrame(view, proj);
+		}
+		else
+		{
+			pReprojection->Invalidate();
+		}
+
+		// render triangles, the buffer puts the model after the light indicator when it is translucent
+		drawList.Draw(modelMaterial, model, model_transform.GetMatrix());
+		drawList.Draw(lightIndicatorMaterial, lightIndicator, Mat4::Translation(l_pos));
+		commands.Submit(drawList);
+		commands.Execute(view, proj);
 
-		Lpipeline.effect.vs.BindWorldView(Mat4::Translation(l_pos) * view);
-		Lpipeline.effect.vs.BindProjection(proj);
-		Lpipeline.Draw(lightIndicator);
+		if (reproject)
+		{
+			pReprojection->EndFrame(*pZb);
+		}
+		// opaque draws are done, the translucent fragments go over the resolved frame
+		if (msaa)
+		{
+			pipeline.ResolveMultisample();
+		}
+		// translucent fragments are blended once everything else is in the ZBuffer
+		if (translucent)
+		{
+			pipeline.ResolveTransparency();
+		}
+		// the finished frame picks the coarse tiles of the next one
+		if (rateMode == 2)
+		{
+			pipeline.UpdateShadingRateMap();
+		}
+	}
+private:
+	// lights on rings around the model, each ring turning at its own speed
+	void UpdateSwarm()
+	{
+		swarm.resize(swarm_size);
+		const auto& center = model_transform.GetPosition();
+		for (size_t i = 0; i < swarm_size; i++)
+		{
+			const float ring = float(i % 8);
+			const float angle = float(i / 8) * (2.0f * PI / float(swarm_size / 8)) + swarm_time * (0.3f + ring * 0.1f);
+			const float tilt = (ring - 3.5f) * 0.2f;
+			const float radius = model_radius * (1.1f + 0.05f * ring);
+			auto& l = swarm[i];
+			l.pos = center + Vec3{ std::cos(angle) * radius,tilt * radius,std::sin(angle) * radius };
+			l.color = { 0.5f + 0.5f * std::cos(ring),0.5f + 0.5f * std::cos(ring + 2.1f),0.5f + 0.5f * std::cos(ring + 4.2f) };
+			l.range = model_radius * 0.6f;
+		}
 	}
 private:
-	IndexedTriangleList<Vertex> itlist;
+	Graphics& gfx;
+	LodChain<Vertex> model;
 	IndexedTriangleList<SolidEffect::Vertex> lightIndicator = Sphere::GetPlain<SolidEffect::Vertex>(0.05f);
 	std::shared_ptr<ZBuffer> pZb;
+	std::shared_ptr<OcclusionBuffer> pOcclusion;
+	std::shared_ptr<FragmentBuffer> pFragments;
+	std::shared_ptr<SampleBuffer> pSamples;
+	std::shared_ptr<ReprojectionCache> pReprojection;
+	std::shared_ptr<ShadingRateMap> pRateMap;
+	std::shared_ptr<LightGrid> pLightGrid;
+	std::shared_ptr<ShadowCubeMap> pShadowMap;
 	Pipeline pipeline;
 	LightIndicatorPipeline Lpipeline;
+	// the shading pass, the occluder, prepass and shadow draws stay immediate
+	CommandBuffer commands;
+	CommandBuffer::CommandList drawList;
+	CommandBuffer::Material<SpecularPhongPointEffect> modelMaterial;
+	CommandBuffer::Material<SolidEffect> lightIndicatorMaterial;
 	MouseTracker mt;
 	// fov
 	static constexpr float aspect_ratio = 1.77777778f;
@@ -135,11 +311,33 @@ private:
 	Mat4 cam_rot = Mat4::Identity();
 	Mat4 cam_rot_inv = Mat4::Identity();
 	// model 
-	Vec3 mod_pos = { 0.0f,0.0f,2.0f };
-	float theta_x = 0.0f;
-	float theta_y = 0.0f;
-	float theta_z = 0.0f;
+	Transform model_transform = { { 0.0f,0.0f,2.0f } };
+	float model_radius = 1.0f;
 	// light 
 	Vec4 l_pos = { 0.0f,0.0f,0.6f,1.0f };
+	// transparency
+	bool translucent = false;
+	bool toggleWasDown = false;
+	// anti-aliasing
+	bool msaa = false;
+	bool msaaWasDown = false;
+	// shading reuse
+	bool reprojection = false;
+	bool reprojectionWasDown = false;
+	// coarse shading
+	int rateMode = 0;
+	bool rateWasDown = false;
+	// many lights
+	static constexpr size_t swarm_size = 256;
+	std::vector<PointLight> swarm;
+	float swarm_time = 0.0f;
+	bool manyLights = false;
+	bool lightsWasDown = false;
+	// shadows
+	bool shadows = false;
+	bool shadowsWasDown = false;
+	// depth prepass
+	bool depthPrepass = false;
+	bool prepassWasDown = false;
 
 };
\ No newline at end of file
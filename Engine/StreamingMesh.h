@@ -0,0 +1,359 @@
+#pragma once
+#include <vector>
+#include <list>
+#include <string>
+#include <fstream>
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
+#include <cstdint>
+#include <cmath>
+#include <cassert>
+#include "Vec3.h"
+#include "BoundingSphere.h"
+#include "MappedFile.h"
+
+// mesh in a chunked file that is paged in while it is drawn, for models that don't fit in memory
+// every chunk holds up to 64k raw vertices of T and 16 bit chunk local indices, and has its own
+// bounding sphere so the pipeline can cull it before touching its data; chunks are memory mapped
+// when drawn and the least recently drawn ones are unmapped once the mapped bytes go over the budget
+template<class T>
+class StreamingMesh
+{
+	// vertices are stored and read back as raw bytes, so T has to be plain data without pointers
+	// (Vec3 has a user copy constructor, so trivially copyable can't be asked for)
+	static_assert(!std::is_polymorphic<T>::value, "streamed vertices are stored as raw bytes");
+public:
+	static constexpr size_t MaxChunkVertices = 65536;
+	static constexpr size_t DefaultChunkTriangles = 65536;
+	static constexpr size_t DefaultResidentBytes = size_t(256) << 20;
+	// chunk data as laid out in the file
+	struct ChunkInfo
+	{
+		uint64_t offset = 0;
+		uint32_t vertexCount = 0;
+		uint32_t triangleCount = 0;
+		// index of the first triangle in the source index list, for the geometry shader
+		uint64_t firstTriangle = 0;
+		BoundingSphere bounds;
+	};
+	// a mapped chunk, valid until later Acquires push it out of the resident set
+	struct Chunk
+	{
+		const T* pVertices = nullptr;
+		const uint16_t* pIndices = nullptr;
+		size_t vertexCount = 0;
+		size_t triangleCount = 0;
+		size_t firstTriangle = 0;
+	};
+	struct Stats
+	{
+		// chunks mapped because they were not resident
+		size_t chunksMapped = 0;
+		// chunks unmapped to stay within the budget
+		size_t chunksEvicted = 0;
+		size_t residentBytes = 0;
+		size_t peakResidentBytes = 0;
+	};
+public:
+	// converts an indexed triangle list to the chunked format, greedily in index order: triangles go
+	// into the current chunk until it would exceed 64k vertices or maxTriangles
+	// the source has to be in memory, so convert on a machine that can hold it
+	template<class Index>
+	static void Write(const std::string& filename, const std::vector<T>& vertices, const std::vector<Index>& indices,
+		size_t maxTriangles = DefaultChunkTriangles)
+	{
+		assert(indices.size() % 3 == 0);
+		std::ofstream file(filename, std::ios::binary);
+		if (!file)
+		{
+			throw std::runtime_error(("StreamingMesh failed to create file  File:" + filename).c_str());
+		}
+		FileHeader header;
+		header.vertexSize = uint32_t(sizeof(T));
+		header.triangleCount = indices.size() / 3;
+		header.bounds = ComputeBounds([&](size_t i) -> const Vec3& { return vertices[i].pos; }, vertices.size());
+		// placeholder, rewritten once the chunk table is known
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+		std::vector<ChunkInfo> table;
+		// maps global vertex index to local index in the chunk being built
+		constexpr uint32_t none = std::numeric_limits<uint32_t>::max();
+		std::vector<uint32_t> localIndex(vertices.size(), none);
+		std::vector<T> chunkVertices;
+		std::vector<uint16_t> chunkIndices;
+		// global index of each chunk vertex
+		std::vector<size_t> chunkSources;
+		uint64_t offset = sizeof(header);
+		size_t firstTriangle = 0;
+		const auto flush = [&]()
+		{
+			if (chunkIndices.empty())
+			{
+				return;
+			}
+			ChunkInfo info;
+			info.vertexCount = uint32_t(chunkVertices.size());
+			info.triangleCount = uint32_t(chunkIndices.size() / 3);
+			info.firstTriangle = firstTriangle;
+			info.bounds = ComputeBounds([&](size_t i) -> const Vec3& { return chunkVertices[i].pos; }, chunkVertices.size());
+			// chunks start on cache lines
+			const uint64_t padding = (ChunkAlignment - offset % ChunkAlignment) % ChunkAlignment;
+			static const char zeros[ChunkAlignment] = {};
+			file.write(zeros, std::streamsize(padding));
+			info.offset = offset + padding;
+			file.write(reinterpret_cast<const char*>(chunkVertices.data()), std::streamsize(chunkVertices.size() * sizeof(T)));
+			file.write(reinterpret_cast<const char*>(chunkIndices.data()), std::streamsize(chunkIndices.size() * sizeof(uint16_t)));
+			offset = info.offset + GetChunkBytes(info);
+			table.push_back(info);
+
+			// reset lookup for the vertices of this chunk only
+			for (const size_t v : chunkSources)
+			{
+				localIndex[v] = none;
+			}
+			firstTriangle += info.triangleCount;
+			chunkVertices.clear();
+			chunkIndices.clear();
+			chunkSources.clear();
+		};
+
+		for (size_t t = 0, end = indices.size() / 3; t < end; t++)
+		{
+			const size_t a = size_t(indices[t * 3]);
+			const size_t b = size_t(indices[t * 3 + 1]);
+			const size_t c = size_t(indices[t * 3 + 2]);
+
+			size_t newVerts = 0;
+			newVerts += localIndex[a] == none ? 1 : 0;
+			newVerts += localIndex[b] == none && b != a ? 1 : 0;
+			newVerts += localIndex[c] == none && c != a && c != b ? 1 : 0;
+			if (chunkVertices.size() + newVerts > MaxChunkVertices || chunkIndices.size() / 3 + 1 > maxTriangles)
+			{
+				flush();
+			}
+			for (const size_t v : { a,b,c })
+			{
+				if (localIndex[v] == none)
+				{
+					localIndex[v] = uint32_t(chunkVertices.size());
+					chunkVertices.push_back(vertices[v]);
+					chunkSources.push_back(v);
+				}
+				chunkIndices.push_back(uint16_t(localIndex[v]));
+			}
+		}
+		flush();
+
+		header.vertexCount = vertices.size();
+		header.chunkCount = uint32_t(table.size());
+		header.chunkTableOffset = offset;
+		file.write(reinterpret_cast<const char*>(table.data()), std::streamsize(table.size() * sizeof(ChunkInfo)));
+		file.seekp(0);
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		if (!file)
+		{
+			throw std::runtime_error(("StreamingMesh failed to write file  File:" + filename).c_str());
+		}
+	}
+	// opens a file written by Write for the same vertex type and checks it, throwing on a bad file
+	// chunks are mapped one by one to check their indices but none stay resident
+	StreamingMesh(const std::string& filename, size_t residentBytes = DefaultResidentBytes)
+		:
+		file(filename),
+		residentBudget(residentBytes)
+	{
+		if (file.GetSize() < sizeof(FileHeader))
+		{
+			throw std::runtime_error(("StreamingMesh file too small  File:" + filename).c_str());
+		}
+		{
+			// byte copies, the header and table hold Vec3s so they can't be memcpy'd into
+			const auto view = file.Map(0, sizeof(FileHeader));
+			std::copy_n(view.GetData(), sizeof(FileHeader), reinterpret_cast<unsigned char*>(&header));
+		}
+		if (header.magic != Magic || header.version != Version)
+		{
+			throw std::runtime_error(("StreamingMesh bad file header  File:" + filename).c_str());
+		}
+		if (header.vertexSize != sizeof(T))
+		{
+			throw std::runtime_error(("StreamingMesh vertex size mismatch  File:" + filename).c_str());
+		}
+		if (header.chunkTableOffset > file.GetSize() ||
+			uint64_t(header.chunkCount) * sizeof(ChunkInfo) > file.GetSize() - header.chunkTableOffset)
+		{
+			throw std::runtime_error(("StreamingMesh chunk table out of range  File:" + filename).c_str());
+		}
+		table.resize(header.chunkCount);
+		if (!table.empty())
+		{
+			const auto view = file.Map(header.chunkTableOffset, table.size() * sizeof(ChunkInfo));
+			std::copy_n(view.GetData(), view.GetSize(), reinterpret_cast<unsigned char*>(table.data()));
+		}
+		for (const auto& info : table)
+		{
+			// offsets are aligned by Write, Acquire relies on that to read vertices in place
+			if (info.offset % ChunkAlignment != 0 || info.offset > file.GetSize() ||
+				GetChunkBytes(info) > file.GetSize() - info.offset)
+			{
+				throw std::runtime_error(("StreamingMesh chunk out of range  File:" + filename).c_str());
+			}
+			if (info.vertexCount > MaxChunkVertices || info.firstTriangle > header.triangleCount ||
+				info.triangleCount > header.triangleCount - info.firstTriangle)
+			{
+				throw std::runtime_error(("StreamingMesh bad chunk info  File:" + filename).c_str());
+			}
+			// Draw trusts the indices, so every chunk is paged through once here; one at a time,
+			// the open never holds more than a chunk mapped
+			const auto view = file.Map(info.offset, GetChunkBytes(info));
+			const uint16_t* const pIndices = reinterpret_cast<const uint16_t*>(view.GetData() + info.vertexCount * sizeof(T));
+			const uint16_t* const pEnd = pIndices + size_t(info.triangleCount) * 3;
+			if (std::any_of(pIndices, pEnd, [&info](uint16_t i) { return i >= info.vertexCount; }))
+			{
+				throw std::runtime_error(("StreamingMesh chunk index out of range  File:" + filename).c_str());
+			}
+		}
+		resident.resize(table.size());
+	}
+	// maps the chunk if it is not resident and marks it most recently used
+	// chunks that were acquired before may be unmapped by this call
+	Chunk Acquire(size_t i)
+	{
+		auto& r = resident[i];
+		if (r.view.GetData() == nullptr)
+		{
+			r.view = file.Map(table[i].offset, GetChunkBytes(table[i]));
+			lru.push_front(i);
+			r.lruPos = lru.begin();
+			stats.chunksMapped++;
+			stats.residentBytes += r.view.GetSize();
+			// always keep the chunk just mapped, even if it alone is over the budget
+			while (stats.residentBytes > residentBudget && lru.back() != i)
+			{
+				Evict(lru.back());
+			}
+			stats.peakResidentBytes = std::max(stats.peakResidentBytes, stats.residentBytes);
+		}
+		else
+		{
+			lru.splice(lru.begin(), lru, r.lruPos);
+		}
+		const auto& info = table[i];
+		Chunk c;
+		c.pVertices = reinterpret_cast<const T*>(r.view.GetData());
+		c.pIndices = reinterpret_cast<const uint16_t*>(r.view.GetData() + info.vertexCount * sizeof(T));
+		c.vertexCount = info.vertexCount;
+		c.triangleCount = info.triangleCount;
+		c.firstTriangle = size_t(info.firstTriangle);
+		return c;
+	}
+	// unmaps every chunk
+	void Release()
+	{
+		while (!lru.empty())
+		{
+			Evict(lru.back());
+		}
+	}
+	void SetResidentBudget(size_t bytes)
+	{
+		residentBudget = bytes;
+		while (stats.residentBytes > residentBudget && !lru.empty())
+		{
+			Evict(lru.back());
+		}
+	}
+	size_t GetChunkCount() const
+	{
+		return table.size();
+	}
+	const ChunkInfo& GetChunkInfo(size_t i) const
+	{
+		return table[i];
+	}
+	size_t GetVertexCount() const
+	{
+		return size_t(header.vertexCount);
+	}
+	size_t GetTriangleCount() const
+	{
+		return size_t(header.triangleCount);
+	}
+	// model space bounds of the whole mesh
+	const BoundingSphere& GetBoundingSphere() const
+	{
+		return header.bounds;
+	}
+	const Stats& GetStats() const
+	{
+		return stats;
+	}
+private:
+	struct FileHeader
+	{
+		uint32_t magic = Magic;
+		uint32_t version = Version;
+		uint32_t vertexSize = 0;
+		uint32_t chunkCount = 0;
+		uint64_t vertexCount = 0;
+		uint64_t triangleCount = 0;
+		uint64_t chunkTableOffset = 0;
+		BoundingSphere bounds;
+	};
+	struct Resident
+	{
+		MappedFile::View view;
+		typename std::list<size_t>::iterator lruPos;
+	};
+	static constexpr uint32_t Magic = 0x31534D53u; // 'SMS1'
+	static constexpr uint32_t Version = 1u;
+	static constexpr size_t ChunkAlignment = 64;
+private:
+	static size_t GetChunkBytes(const ChunkInfo& info)
+	{
+		return size_t(info.vertexCount) * sizeof(T) + size_t(info.triangleCount) * 3 * sizeof(uint16_t);
+	}
+	// sphere around the aabb center, radius from the farthest vertex
+	template<typename F>
+	static BoundingSphere ComputeBounds(F&& pos, size_t count)
+	{
+		if (count == 0)
+		{
+			return {};
+		}
+		Vec3 lo = pos(0);
+		Vec3 hi = pos(0);
+		for (size_t i = 1; i < count; i++)
+		{
+			const auto& p = pos(i);
+			lo = { std::min(lo.x,p.x),std::min(lo.y,p.y),std::min(lo.z,p.z) };
+			hi = { std::max(hi.x,p.x),std::max(hi.y,p.y),std::max(hi.z,p.z) };
+		}
+		const Vec3 center = (lo + hi) * 0.5f;
+		float radiusSq = 0.0f;
+		for (size_t i = 0; i < count; i++)
+		{
+			radiusSq = std::max(radiusSq, (pos(i) - center).LenSq());
+		}
+		return { center,std::sqrt(radiusSq) };
+	}
+	void Evict(size_t i)
+	{
+		auto& r = resident[i];
+		stats.residentBytes -= r.view.GetSize();
+		stats.chunksEvicted++;
+		r.view = MappedFile::View();
+		lru.erase(r.lruPos);
+	}
+private:
+	MappedFile file;
+	FileHeader header;
+	std::vector<ChunkInfo> table;
+	std::vector<Resident> resident;
+	// most recently used first
+	std::list<size_t> lru;
+	size_t residentBudget;
+	Stats stats;
+};
@@ -18,19 +18,48 @@
 *	You should have received a copy of the GNU General Public License					  *
 *	along with The Chili DirectX Framework.  If not, see <http://www.gnu.org/licenses/>.  *
 ******************************************************************************************/
-#define FULL_WINTARD
-#include "ChiliWin.h"
 #include "Surface.h"
-#include "ChiliException.h"
-namespace Gdiplus
-{
-	using std::min;
-	using std::max;
-}
-#include <gdiplus.h>
+#include "ImageCodec.h"
+#include <fstream>
 #include <sstream>
+#include <vector>
+#include <cstdint>
+
+#ifndef _CRT_WIDE
+#define _CRT_WIDE_( s ) L ## s
+#define _CRT_WIDE( s ) _CRT_WIDE_( s )
+#endif
 
-#pragma comment( lib,"gdiplus.lib" )
+namespace
+{
+	// msvc streams take wide paths, elsewhere the path is assumed to be plain ascii
+	std::string NarrowPath( const std::wstring& name )
+	{
+		return std::string( name.begin(),name.end() );
+	}
+
+	template<typename Stream>
+	void OpenFile( Stream& file,const std::wstring& name,std::ios::openmode mode )
+	{
+#ifdef _WIN32
+		file.open( name,mode );
+#else
+		file.open( NarrowPath( name ),mode );
+#endif
+	}
+
+	void PutU16LE( std::vector<unsigned char>& out,uint16_t v )
+	{
+		out.push_back( (unsigned char)v );
+		out.push_back( (unsigned char)(v >> 8) );
+	}
+
+	void PutU32LE( std::vector<unsigned char>& out,uint32_t v )
+	{
+		PutU16LE( out,uint16_t( v ) );
+		PutU16LE( out,uint16_t( v >> 16 ) );
+	}
+}
 
 void Surface::PutPixelAlpha( unsigned int x,unsigned int y,Color c )
 {
@@ -38,100 +67,125 @@ void Surface::PutPixelAlpha( unsigned int x,unsigned int y,Color c )
 	assert( y >= 0 );
 	assert( x < width );
 	assert( y < height );
-	// load source pixel
-	const Color d = GetPixel( x,y );
-
-	// blend channels
-	const unsigned char rsltRed = (c.GetR() * c.GetA() + d.GetR() * (255u - c.GetA())) / 256u;
-	const unsigned char rsltGreen = (c.GetG() * c.GetA() + d.GetG() * (255u - c.GetA())) / 256u;
-	const unsigned char rsltBlue = (c.GetB() * c.GetA() + d.GetB() * (255u - c.GetA())) / 256u;
-
-	// pack channels back into pixel and fire pixel onto surface
-	PutPixel( x,y,{ rsltRed,rsltGreen,rsltBlue } );
+	PixelSpan::Blend( &pBuffer[y * pitch + x],c,1u );
 }
 
-Surface Surface::FromFile( const std::wstring & name )
+void Surface::BlendSpan( unsigned int x,unsigned int y,const Color* pSrc,unsigned int n )
 {
-	unsigned int width = 0;
-	unsigned int height = 0;
-	unsigned int pitch = 0;
-	std::unique_ptr<Color[]> pBuffer = nullptr;
+	assert( y < height );
+	assert( x + n <= width );
+	PixelSpan::Blend( &pBuffer[y * pitch + x],pSrc,n );
+}
 
+void Surface::FillRect( RectI rect,Color c )
+{
+	rect.ClipTo( { 0,int( height ),0,int( width ) } );
+	for( int y = rect.top; y < rect.bottom; y++ )
 	{
-		Gdiplus::Bitmap bitmap( name.c_str() );
-		if( bitmap.GetLastStatus() != Gdiplus::Status::Ok )
-		{
-			std::wstringstream ss;
-			ss << L"Loading image [" << name << L"]: failed to load.";
-			throw Exception( _CRT_WIDE( __FILE__ ),__LINE__,ss.str() );
-		}
-
-		pitch = width = bitmap.GetWidth();
-		height = bitmap.GetHeight();
-		pBuffer = std::make_unique<Color[]>( width * height );
-
-		for( unsigned int y = 0; y < height; y++ )
-		{
-			for( unsigned int x = 0; x < width; x++ )
-			{
-				Gdiplus::Color c;
-				bitmap.GetPixel( x,y,&c );
-				pBuffer[y * pitch + x] = c.GetValue();
-			}
-		}
+		PixelSpan::Fill( &pBuffer[y * pitch + rect.left],c,std::max( rect.GetWidth(),0 ) );
 	}
-
-	return Surface( width,height,pitch,std::move( pBuffer ) );
 }
 
-void Surface::Save( const std::wstring & filename ) const
+void Surface::BlendRect( RectI rect,Color c )
 {
-	auto GetEncoderClsid = [&filename]( const WCHAR* format,CLSID* pClsid ) -> void
+	rect.ClipTo( { 0,int( height ),0,int( width ) } );
+	for( int y = rect.top; y < rect.bottom; y++ )
 	{
-		UINT  num = 0;          // number of image encoders
-		UINT  size = 0;         // size of the image encoder array in bytes
-
-		Gdiplus::ImageCodecInfo* pImageCodecInfo = nullptr;
-
-		Gdiplus::GetImageEncodersSize( &num,&size );
-		if( size == 0 )
-		{
-			std::wstringstream ss;
-			ss << L"Saving surface to [" << filename << L"]: failed to get encoder; size == 0.";
-			throw Exception( _CRT_WIDE( __FILE__ ),__LINE__,ss.str() );
-		}
+		PixelSpan::Blend( &pBuffer[y * pitch + rect.left],c,std::max( rect.GetWidth(),0 ) );
+	}
+}
 
-		pImageCodecInfo = (Gdiplus::ImageCodecInfo*)(malloc( size ));
-		if( pImageCodecInfo == nullptr )
-		{
-			std::wstringstream ss;
-			ss << L"Saving surface to [" << filename << L"]: failed to get encoder; failed to allocate memory.";
-			throw Exception( _CRT_WIDE( __FILE__ ),__LINE__,ss.str() );
-		}
+void Surface::BlitKeyed( int x,int y,const Surface& src,Color key )
+{
+	RectI rect = { y,y + int( src.height ),x,x + int( src.width ) };
+	rect.ClipTo( { 0,int( height ),0,int( width ) } );
+	for( int dy = rect.top; dy < rect.bottom; dy++ )
+	{
+		PixelSpan::CopyKeyed( &pBuffer[dy * pitch + rect.left],
+			&src.pBuffer[(dy - y) * src.pitch + (rect.left - x)],
+			std::max( rect.GetWidth(),0 ),key );
+	}
+}
 
-		GetImageEncoders( num,size,pImageCodecInfo );
+void Surface::BlitScaled( const RectI& dstRect,const Surface& src )
+{
+	if( dstRect.GetWidth() <= 0 || dstRect.GetHeight() <= 0 )
+	{
+		return;
+	}
+	RectI rect = dstRect;
+	rect.ClipTo( { 0,int( height ),0,int( width ) } );
+	// 16.16 source steps, sampling at destination pixel centers
+	const uint32_t du = uint32_t( (uint64_t( src.width ) << 16) / dstRect.GetWidth() );
+	const uint32_t dv = uint32_t( (uint64_t( src.height ) << 16) / dstRect.GetHeight() );
+	const uint32_t u0 = du / 2u + du * uint32_t( rect.left - dstRect.left );
+	for( int y = rect.top; y < rect.bottom; y++ )
+	{
+		const uint32_t v = dv / 2u + dv * uint32_t( y - dstRect.top );
+		PixelSpan::CopyScaled( &pBuffer[y * pitch + rect.left],&src.pBuffer[(v >> 16) * src.pitch],
+			std::max( rect.GetWidth(),0 ),u0,du );
+	}
+}
 
-		for( UINT j = 0; j < num; ++j )
-		{
-			if( wcscmp( pImageCodecInfo[j].MimeType,format ) == 0 )
-			{
-				*pClsid = pImageCodecInfo[j].Clsid;
-				free( pImageCodecInfo );
-				return;
-			}
-		}
+Surface Surface::FromFile( const std::wstring & name )
+{
+	std::ifstream file;
+	OpenFile( file,name,std::ios::binary | std::ios::ate );
+	if( !file )
+	{
+		std::wstringstream ss;
+		ss << L"Loading image [" << name << L"]: failed to open.";
+		throw Exception( _CRT_WIDE( __FILE__ ),__LINE__,ss.str() );
+	}
+	std::vector<unsigned char> data( size_t( file.tellg() ) );
+	file.seekg( 0 );
+	file.read( reinterpret_cast<char*>( data.data() ),data.size() );
 
-		free( pImageCodecInfo );
+	try
+	{
+		return ImageCodec::Decode( data.data(),data.size() );
+	}
+	catch( const std::exception& e )
+	{
+		const std::string what = e.what();
 		std::wstringstream ss;
-		ss << L"Saving surface to [" << filename << 
-			L"]: failed to get encoder; failed to find matching encoder.";
+		ss << L"Loading image [" << name << L"]: " << std::wstring( what.begin(),what.end() ) << L".";
 		throw Exception( _CRT_WIDE( __FILE__ ),__LINE__,ss.str() );
-	};
+	}
+}
 
-	CLSID bmpID;
-	GetEncoderClsid( L"image/bmp",&bmpID );
-	Gdiplus::Bitmap bitmap( width,height,pitch * sizeof( Color ),PixelFormat32bppARGB,(BYTE*)pBuffer.get() );
-	if( bitmap.Save( filename.c_str(),&bmpID,nullptr ) != Gdiplus::Status::Ok )
+void Surface::Save( const std::wstring & filename ) const
+{
+	// 32 bit bottom-up bmp, rows are written straight from the buffer (Color is bgrx in memory)
+	const uint32_t rowBytes = width * sizeof( Color );
+	const uint32_t dataOffset = 14u + 40u;
+	std::vector<unsigned char> header;
+	header.push_back( 'B' );
+	header.push_back( 'M' );
+	PutU32LE( header,dataOffset + rowBytes * height );
+	PutU32LE( header,0u );
+	PutU32LE( header,dataOffset );
+	PutU32LE( header,40u );
+	PutU32LE( header,width );
+	PutU32LE( header,height );
+	PutU16LE( header,1u );
+	PutU16LE( header,32u );
+	// BI_RGB, image size, 72 dpi, no palette
+	PutU32LE( header,0u );
+	PutU32LE( header,rowBytes * height );
+	PutU32LE( header,2835u );
+	PutU32LE( header,2835u );
+	PutU32LE( header,0u );
+	PutU32LE( header,0u );
+
+	std::ofstream file;
+	OpenFile( file,filename,std::ios::binary | std::ios::trunc );
+	file.write( reinterpret_cast<const char*>( header.data() ),header.size() );
+	for( unsigned int y = height; y-- > 0u; )
+	{
+		file.write( reinterpret_cast<const char*>( &pBuffer[pitch * y] ),rowBytes );
+	}
+	if( !file )
 	{
 		std::wstringstream ss;
 		ss << L"Saving surface to [" << filename << L"]: failed to save.";
@@ -145,13 +199,13 @@ void Surface::Copy( const Surface & src )
 	assert( height == src.height );
 	if( pitch == src.pitch )
 	{
-		memcpy( pBuffer.get(),src.pBuffer.get(),pitch * height * sizeof( Color ) );
+		std::copy_n( src.pBuffer.get(),size_t( pitch ) * height,pBuffer.get() );
 	}
 	else
 	{
 		for( unsigned int y = 0; y < height; y++ )
 		{
-			memcpy( &pBuffer[pitch * y],&src.pBuffer[pitch * y],sizeof( Color )* width );
+			std::copy_n( &src.pBuffer[size_t( src.pitch ) * y],width,&pBuffer[size_t( pitch ) * y] );
 		}
 	}
 }
@@ -19,17 +19,22 @@
 *	along with The Chili DirectX Framework.  If not, see <http://www.gnu.org/licenses/>.  *
 ******************************************************************************************/
 #pragma once
-#include "ChiliWin.h"
 #include "Colors.h"
+#include "RenderTarget.h"
+#include "PixelSpan.h"
 #include "Rect.h"
 #include "ChiliException.h"
 #include <string>
 #include <assert.h>
 #include <memory>
+#include <cstring>
 
 
 class Surface
 {
+public:
+	// row alignment in bytes of loaded images, so rows can be processed 4 pixels at a time
+	static constexpr unsigned int RowAlignment = 16u;
 public:
 	class Exception : public ChiliException
 	{
@@ -72,9 +77,19 @@ public:
 	{}
 	void Clear( Color fillValue  )
 	{
-		memset( pBuffer.get(),fillValue.dword,pitch * height * sizeof( Color ) );
+		if( pitch == width )
+		{
+			PixelSpan::Fill( pBuffer.get(),fillValue,size_t( pitch ) * height );
+		}
+		else
+		{
+			for( unsigned int y = 0; y < height; y++ )
+			{
+				PixelSpan::Fill( &pBuffer[pitch * y],fillValue,width );
+			}
+		}
 	}
-	void Present( unsigned int dstPitch,BYTE* const pDst ) const
+	void Present( unsigned int dstPitch,unsigned char* const pDst ) const
 	{
 		for( unsigned int y = 0; y < height; y++ )
 		{
@@ -90,6 +105,15 @@ public:
 		pBuffer[y * pitch + x] = c;
 	}
 	void PutPixelAlpha( unsigned int x,unsigned int y,Color c );
+	// blends n pixels (alpha in their x channel) onto row y starting at x, must fit in the row
+	void BlendSpan( unsigned int x,unsigned int y,const Color* pSrc,unsigned int n );
+	// the rect parts outside the surface are clipped away (right and bottom are exclusive)
+	void FillRect( RectI rect,Color c );
+	void BlendRect( RectI rect,Color c );
+	// copies src with its top left at x,y, leaving pixels that match key's rgb untouched
+	void BlitKeyed( int x,int y,const Surface& src,Color key );
+	// stretches all of src over dstRect, nearest neighbour
+	void BlitScaled( const RectI& dstRect,const Surface& src );
 	Color GetPixel( unsigned int x,unsigned int y ) const
 	{
 		assert( x >= 0 );
@@ -118,10 +142,14 @@ public:
 	{
 		return pBuffer.get();
 	}
+	// view for rendering into this surface with a pipeline
+	RenderTarget GetRenderTarget()
+	{
+		return RenderTarget( pBuffer.get(),width,height,pitch * (unsigned int)sizeof( Color ) );
+	}
 	static Surface FromFile( const std::wstring& name );
 	void Save( const std::wstring& filename ) const;
 	void Copy( const Surface& src );
-private:
 	// calculate pixel pitch required for given byte aligment (must be multiple of 4 bytes)
 	static unsigned int GetPitch( unsigned int width,unsigned int byteAlignment )
 	{
@@ -129,6 +157,7 @@ private:
 		const unsigned int pixelAlignment = byteAlignment / sizeof( Color );
 		return width + ( pixelAlignment - width % pixelAlignment ) % pixelAlignment;
 	}
+private:
 	Surface( unsigned int width,unsigned int height,unsigned int pitch,std::unique_ptr<Color[]> pBufferParam )
 		:
 		width( width ),
@@ -0,0 +1,114 @@
+#pragma once
+#include "Mat.h"
+#include "Vec3.h"
+
+// position, rotation and scale of an object with the composed world matrix cached
+// setters only mark the matrix dirty, it is rebuilt on the next GetMatrix, so objects that
+// didn't move cost nothing per frame; GetVersion changes with every edit so users holding
+// something derived from the matrix can tell when to refresh it
+class Transform
+{
+public:
+	Transform() = default;
+	Transform(const Vec3& position, const Vec3& rotation = { 0.0f,0.0f,0.0f })
+		:
+		position(position),
+		rotation(rotation)
+	{}
+	void SetPosition(const Vec3& position_in)
+	{
+		position = position_in;
+		Touch();
+	}
+	// euler angles in radians, applied about x, then y, then z (Mat4::RotationX * RotationY * RotationZ)
+	void SetRotation(const Vec3& rotation_in)
+	{
+		rotation = rotation_in;
+		Touch();
+	}
+	void SetScale(const Vec3& scale_in)
+	{
+		scale = scale_in;
+		Touch();
+	}
+	void SetScale(float scale_in)
+	{
+		SetScale({ scale_in,scale_in,scale_in });
+	}
+	void Translate(const Vec3& delta)
+	{
+		SetPosition(position + delta);
+	}
+	void Rotate(const Vec3& delta)
+	{
+		SetRotation(rotation + delta);
+	}
+	const Vec3& GetPosition() const
+	{
+		return position;
+	}
+	const Vec3& GetRotation() const
+	{
+		return rotation;
+	}
+	const Vec3& GetScale() const
+	{
+		return scale;
+	}
+	// scale, then rotation, then translation
+	const Mat4& GetMatrix() const
+	{
+		if (dirty)
+		{
+			Compose();
+		}
+		return matrix;
+	}
+	// transforms model space normals to world space, see Mat4::GetNormalMatrix
+	const Mat3& GetNormalMatrix() const
+	{
+		if (dirty)
+		{
+			Compose();
+		}
+		return normalMatrix;
+	}
+	unsigned int GetVersion() const
+	{
+		return version;
+	}
+private:
+	void Touch()
+	{
+		dirty = true;
+		version++;
+	}
+	void Compose() const
+	{
+		// rotation in 3x3, scale folded into its rows, translation written in place: no 4x4 products
+		const auto rot = Mat3::RotationX(rotation.x) * Mat3::RotationY(rotation.y) * Mat3::RotationZ(rotation.z);
+		const float s[3] = { scale.x,scale.y,scale.z };
+		for (size_t j = 0; j < 3; j++)
+		{
+			for (size_t k = 0; k < 3; k++)
+			{
+				matrix.elements[j][k] = rot.elements[j][k] * s[j];
+			}
+			matrix.elements[j][3] = 0.0f;
+		}
+		matrix.elements[3][0] = position.x;
+		matrix.elements[3][1] = position.y;
+		matrix.elements[3][2] = position.z;
+		matrix.elements[3][3] = 1.0f;
+		normalMatrix = matrix.GetNormalMatrix();
+		dirty = false;
+	}
+private:
+	Vec3 position = { 0.0f,0.0f,0.0f };
+	Vec3 rotation = { 0.0f,0.0f,0.0f };
+	Vec3 scale = { 1.0f,1.0f,1.0f };
+	unsigned int version = 0u;
+	mutable bool dirty = true;
+	mutable Mat4 matrix = Mat4::Identity();
+	mutable Mat3 normalMatrix = Mat3::Identity();
+};
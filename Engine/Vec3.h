@@ -1,15 +1,19 @@
 #pragma once
 #include "ChiliMath.h"
 #include "Vec2.h"
+#include <algorithm>
 
 template <typename T>
 class _Vec3 : public _Vec2<T>
 {
+public:
+	using _Vec2<T>::x;
+	using _Vec2<T>::y;
 public:
 	_Vec3() {}
 	_Vec3(T x, T y,T z)
 		:
-		_Vec2(x,y),
+		_Vec2<T>(x,y),
 		z(z)
 	{}
 	_Vec3(const _Vec3& vect)
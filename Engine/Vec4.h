@@ -5,20 +5,25 @@
 template <typename T>
 class _Vec4 : public _Vec3<T>
 {
+public:
+	using _Vec2<T>::x;
+	using _Vec2<T>::y;
+	using _Vec3<T>::z;
+	using _Vec3<T>::LenSq;
 public:
 	_Vec4() {}
 	_Vec4(T x, T y, T z,T w)
 		:
-		_Vec3(x, y,z),
+		_Vec3<T>(x, y,z),
 		w(w)
 	{}
 	_Vec4(const _Vec4& vect)
 		:
 		_Vec4(vect.x, vect.y, vect.z, vect.w)
 	{}
-	_Vec4( const _Vec3& v3,float w = 1.0f  )
+	_Vec4( const _Vec3<T>& v3,float w = 1.0f  )
 		:
-		_Vec3( v3 ),
+		_Vec3<T>( v3 ),
 		w( w )
 	{}
 	template <typename T2>
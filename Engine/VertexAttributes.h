@@ -0,0 +1,101 @@
+#pragma once
+#include "Vec2.h"
+#include "Vec3.h"
+#include <utility>
+
+// access to the optional attributes of effect vertex types, which differ in what they carry
+// vertices without a normal (n) or texcoord (t) member ignore writes and read back zeros
+namespace VertexAttributes
+{
+	namespace detail
+	{
+		template<typename V>
+		auto SetNormal(V& v, const Vec3& n, int) -> decltype(void(v.n = n))
+		{
+			v.n = n;
+		}
+		template<typename V>
+		void SetNormal(V&, const Vec3&, long)
+		{
+		}
+		template<typename V>
+		auto SetTexcoord(V& v, const Vec2& t, int) -> decltype(void(v.t = t))
+		{
+			v.t = t;
+		}
+		template<typename V>
+		void SetTexcoord(V&, const Vec2&, long)
+		{
+		}
+		template<typename V>
+		auto GetNormal(const V& v, int) -> decltype(Vec3(v.n))
+		{
+			return v.n;
+		}
+		template<typename V>
+		Vec3 GetNormal(const V&, long)
+		{
+			return { 0.0f,0.0f,0.0f };
+		}
+		template<typename V>
+		auto GetTexcoord(const V& v, int) -> decltype(Vec2(v.t))
+		{
+			return v.t;
+		}
+		template<typename V>
+		Vec2 GetTexcoord(const V&, long)
+		{
+			return { 0.0f,0.0f };
+		}
+		template<typename V>
+		constexpr auto HasNormal(int) -> decltype(void(std::declval<V&>().n), true)
+		{
+			return true;
+		}
+		template<typename V>
+		constexpr bool HasNormal(long)
+		{
+			return false;
+		}
+		template<typename V>
+		constexpr auto HasTexcoord(int) -> decltype(void(std::declval<V&>().t), true)
+		{
+			return true;
+		}
+		template<typename V>
+		constexpr bool HasTexcoord(long)
+		{
+			return false;
+		}
+	}
+	template<typename V>
+	void SetNormal(V& v, const Vec3& n)
+	{
+		detail::SetNormal(v, n, 0);
+	}
+	template<typename V>
+	void SetTexcoord(V& v, const Vec2& t)
+	{
+		detail::SetTexcoord(v, t, 0);
+	}
+	template<typename V>
+	Vec3 GetNormal(const V& v)
+	{
+		return detail::GetNormal(v, 0);
+	}
+	template<typename V>
+	Vec2 GetTexcoord(const V& v)
+	{
+		return detail::GetTexcoord(v, 0);
+	}
+	template<typename V>
+	constexpr bool HasNormal()
+	{
+		return detail::HasNormal<V>(0);
+	}
+	template<typename V>
+	constexpr bool HasTexcoord()
+	{
+		return detail::HasTexcoord<V>(0);
+	}
+}
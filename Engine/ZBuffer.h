@@ -8,10 +8,11 @@
 class ZBuffer
 {
 public:
-	ZBuffer(int width, int height)
-		: width(width),height(height)
+	// samples > 1 keeps that many depths per pixel for multisampling
+	ZBuffer(int width, int height, int samples = 1)
+		: width(width),height(height),samples(samples)
 	{
-		pBuffer = std::make_unique<std::vector<float>>( width * height );
+		pBuffer = std::make_unique<std::vector<float>>( width * height * samples );
 	}
 	~ZBuffer()
 	{
@@ -22,11 +23,7 @@ public:
 
 	void Clear()
 	{
-		const int nDepths = width * height;
-		for (int i = 0; i < nDepths; i++)
-		{
-			(*pBuffer).at(i) = std::numeric_limits<float>::infinity();
-		}
+		std::fill(pBuffer->begin(), pBuffer->end(), std::numeric_limits<float>::infinity());
 	}
 	float& At(int x, int y)
 	{
@@ -34,12 +31,18 @@ public:
 		assert(x < width);
 		assert(y >= 0);
 		assert(y < height);
-		return (*pBuffer).at(y * width + x);
+		return (*pBuffer).at((y * width + x) * samples);
 	}
 	const float& At(int x, int y) const
 	{
 		return const_cast<ZBuffer*>(this)->At(x, y);
 	}
+	float& At(int x, int y, int sample)
+	{
+		assert(sample >= 0);
+		assert(sample < samples);
+		return (&At(x, y))[sample];
+	}
 	bool TestAndSet(int x, int y, float depth)
 	{
 		float& depthInBuffer = At(x, y);
@@ -50,14 +53,33 @@ public:
 		}
 		return false;
 	}
-	int GetWidth()
+	bool TestAndSet(int x, int y, int sample, float depth)
+	{
+		float& depthInBuffer = At(x, y, sample);
+		if (depth < depthInBuffer)
+		{
+			depthInBuffer = depth;
+			return true;
+		}
+		return false;
+	}
+	// depth test without updating the buffer (translucent surfaces)
+	bool Test(int x, int y, float depth) const
+	{
+		return depth < At(x, y);
+	}
+	int GetWidth() const
 	{
 		return width;
 	}
-	int GetHeight()
+	int GetHeight() const
 	{
 		return height;
 	}
+	int GetSampleCount() const
+	{
+		return samples;
+	}
 	/*auto GetMinMax() const
 	{
 		return std::minmax_element(pBuffer, pBuffer + width * height);
@@ -65,5 +87,6 @@ public:
 private:
 	int width;
 	int height;
+	int samples;
 	std::unique_ptr < std::vector<float>> pBuffer ;
 };
\ No newline at end of file
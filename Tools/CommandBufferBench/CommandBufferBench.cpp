@@ -0,0 +1,188 @@
+// command buffer benchmark
+// a few thousand overlapping spheres (SpecularPhongPointEffect, 4 materials) and cubes (SolidEffect) at
+// random depths, drawn immediately in submission order with every bind per draw, against recorded into
+// a CommandBuffer (from one thread and from every job thread) and executed sorted by pipeline, material
+// and front to back depth; prints frame time, recording time, pixel shader invocations and state changes
+//
+//   CommandBufferBench [objects] [threads] [frames]
+//
+// build (windows): cl /std:c++17 /O2 /EHsc /I..\..\Engine CommandBufferBench.cpp ..\..\Engine\ObjParser.cpp ..\..\Engine\JobSystem.cpp ..\..\Engine\MappedFile.cpp
+#include "CommandBuffer.h"
+#include "SolidEffect.h"
+#include "SpecularPhongPointEffect.h"
+#include "Cube.h"
+#include "Sphere.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <thread>
+#include <vector>
+
+namespace
+{
+	using Clock = std::chrono::steady_clock;
+
+	constexpr int Width = 1280;
+	constexpr int Height = 720;
+	constexpr size_t RecordBatch = 256;
+
+	struct Object
+	{
+		Mat4 world;
+		// 0-3 sphere materials, 4 cube
+		int material;
+	};
+	const Vec3 diffuse[4] = {
+		{ 1.0f,0.3f,0.3f },{ 0.3f,1.0f,0.3f },{ 0.3f,0.3f,1.0f },{ 1.0f,1.0f,0.3f }
+	};
+	double Ms(Clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	}
+}
+
+int main(int argc, char** argv)
+{
+	const size_t count = argc > 1 ? size_t(std::max(std::atoi(argv[1]), 1)) : 3000;
+	const unsigned int threads = argc > 2 ? (unsigned int)std::max(std::atoi(argv[2]), 1) : std::max(std::thread::hardware_concurrency(), 1u);
+	const int frames = argc > 3 ? std::max(std::atoi(argv[3]), 1) : 10;
+	JobSystem jobs(threads - 1);
+
+	std::vector<Color> mem(size_t(Width) * Height);
+	RenderTarget target(mem.data(), Width, Height, Width * sizeof(Color));
+	auto pZb = std::make_shared<ZBuffer>(Width, Height);
+	Pipeline<SpecularPhongPointEffect> phong(target, pZb);
+	Pipeline<SolidEffect> solid(target, pZb);
+	phong.SetJobSystem(&jobs);
+	solid.SetJobSystem(&jobs);
+	auto sphere = Sphere::GetPlainNormals<SpecularPhongPointEffect::Vertex>(0.5f);
+	auto cube = Cube::GetPlain<SolidEffect::Vertex>(0.8f);
+	for (auto& v : cube.vertices)
+	{
+		v.color = Colors::Gray;
+	}
+
+	std::mt19937 rng(7);
+	std::uniform_real_distribution<float> xy(-3.0f, 3.0f);
+	std::uniform_real_distribution<float> depth(2.0f, 12.0f);
+	std::uniform_real_distribution<float> angle(0.0f, 2.0f * PI);
+	std::vector<Object> objects(count);
+	for (auto& o : objects)
+	{
+		const float z = depth(rng);
+		o.world = Mat4::RotationY(angle(rng)) * Mat4::Translation(xy(rng) * z * 0.3f, xy(rng) * z * 0.17f, z);
+		o.material = int(rng() % 5);
+	}
+	const auto view = Mat4::Identity();
+	const auto proj = Mat4::ProjectionFOV(90.0f, 1.77777778f, 0.5f, 20.0f);
+	const Vec3 lightPos = { 0.0f,2.0f,1.0f };
+
+	CommandBuffer buffer;
+	std::vector<CommandBuffer::Material<SpecularPhongPointEffect>> materials;
+	for (const auto& d : diffuse)
+	{
+		materials.push_back(buffer.AddMaterial(phong, [d, lightPos](SpecularPhongPointEffect& e)
+		{
+			e.ps.SetDiffuseLight(d);
+			e.ps.SetLightPos(lightPos);
+		}));
+	}
+	const auto cubeMaterial = buffer.AddMaterial(solid);
+	const auto record = [&](CommandBuffer::CommandList& list, size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			const auto& o = objects[i];
+			if (o.material < 4)
+			{
+				list.Draw(materials[o.material], sphere, o.world);
+			}
+			else
+			{
+				list.Draw(cubeMaterial, cube, o.world);
+			}
+		}
+	};
+	const auto shaded = [&]()
+	{
+		return phong.GetStats().pixelsShaded + solid.GetStats().pixelsShaded;
+	};
+	std::printf("%zu objects at %dx%d, %u threads\n", count, Width, Height, jobs.GetThreadCount());
+
+	// immediate, in submission order
+	double immediateMs = 0.0;
+	size_t immediateShaded = 0;
+	for (int f = 0; f < frames; f++)
+	{
+		const auto start = Clock::now();
+		target.Clear(Colors::Black);
+		phong.BeginFrame();
+		solid.ResetStats();
+		for (const auto& o : objects)
+		{
+			if (o.material < 4)
+			{
+				EffectBinding::BindCamera(phong.effect.vs, view, proj);
+				phong.effect.ps.SetDiffuseLight(diffuse[o.material]);
+				phong.effect.ps.SetLightPos(lightPos);
+				EffectBinding::BindObject(phong.effect.vs, o.world, view);
+				phong.Draw(sphere);
+			}
+			else
+			{
+				EffectBinding::BindCamera(solid.effect.vs, view, proj);
+				EffectBinding::BindObject(solid.effect.vs, o.world, view);
+				solid.Draw(cube);
+			}
+		}
+		immediateMs += Ms(start);
+		immediateShaded = shaded();
+	}
+	const std::vector<Color> reference = mem;
+	std::printf("  immediate             %8.2f ms/frame, %9zu pixels shaded, %zu binds\n",
+		immediateMs / frames, immediateShaded, count);
+
+	for (const bool parallel : { false,true })
+	{
+		double recordMs = 0.0;
+		double totalMs = 0.0;
+		size_t sortedShaded = 0;
+		for (int f = 0; f < frames; f++)
+		{
+			const auto start = Clock::now();
+			target.Clear(Colors::Black);
+			phong.BeginFrame();
+			solid.ResetStats();
+			if (parallel)
+			{
+				jobs.ParallelFor(count, RecordBatch, [&](size_t begin, size_t end)
+				{
+					CommandBuffer::CommandList list;
+					record(list, begin, end);
+					buffer.Submit(list);
+				});
+			}
+			else
+			{
+				CommandBuffer::CommandList list;
+				record(list, 0, count);
+				buffer.Submit(list);
+			}
+			recordMs += Ms(start);
+			buffer.Execute(view, proj);
+			totalMs += Ms(start);
+			sortedShaded = shaded();
+		}
+		size_t differing = 0;
+		for (size_t i = 0; i < mem.size(); i++)
+		{
+			differing += mem[i].dword != reference[i].dword ? 1 : 0;
+		}
+		const auto& s = buffer.GetStats();
+		std::printf("  sorted, %s %8.2f ms/frame (recording %.2f ms), %9zu pixels shaded, %zu pipeline / %zu material changes, %zu pixels differ\n",
+			parallel ? "parallel record" : "serial record  ", totalMs / frames, recordMs / frames, sortedShaded,
+			s.pipelineChanges, s.materialChanges, differing);
+	}
+	return 0;
+}
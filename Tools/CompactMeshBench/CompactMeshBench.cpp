@@ -0,0 +1,94 @@
+// compact mesh benchmark
+// draws a model as an IndexedTriangleList (float vertices, size_t indices) and as CompactTriangleLists
+// with 16 / 32 bit indices, with and without quantized vertices, at 1280x720; prints the mesh memory,
+// frame times and the largest position and normal error of the quantized vertices
+//
+//   CompactMeshBench [model.obj] [frames]
+//
+// build (windows): cl /std:c++17 /O2 /EHsc /I..\..\Engine CompactMeshBench.cpp ..\..\Engine\ObjParser.cpp ..\..\Engine\JobSystem.cpp ..\..\Engine\MappedFile.cpp
+#include "Pipeline.h"
+#include "SpecularPhongPointEffect.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <string>
+#include <vector>
+
+namespace
+{
+	typedef Pipeline<SpecularPhongPointEffect> PhongPipeline;
+	typedef PhongPipeline::Vertex Vertex;
+	using Clock = std::chrono::steady_clock;
+
+	constexpr int Width = 1280;
+	constexpr int Height = 720;
+
+	template<typename Mesh>
+	double Time(PhongPipeline& pipeline, RenderTarget& target, Mesh& mesh, const Mat4& world, int frames)
+	{
+		const auto proj = Mat4::ProjectionFOV(95.0f, 1.77777778f, 0.5f, 7.0f);
+		const auto start = Clock::now();
+		for (int i = 0; i < frames; i++)
+		{
+			target.Clear(Colors::Black);
+			pipeline.BeginFrame();
+			pipeline.effect.vs.BindWorld(Mat4::RotationY(float(i) * 0.05f) * world);
+			pipeline.effect.vs.BindView(Mat4::Identity());
+			pipeline.effect.vs.BindProjection(proj);
+			pipeline.effect.ps.SetLightPos({ 0.0f,0.0f,0.6f });
+			pipeline.Draw(mesh);
+		}
+		return std::chrono::duration<double, std::milli>(Clock::now() - start).count() / frames;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	const std::string path = argc > 1 ? argv[1] : "../../Engine/Models/suzanne.obj";
+	const int frames = argc > 2 ? std::max(std::atoi(argv[2]), 1) : 60;
+
+	auto model = IndexedTriangleList<Vertex>::LoadNormals(path);
+	model.AdjustToTrueCenter();
+	const Mat4 world = Mat4::Translation(0.0f, 0.0f, model.GetRadius() * 1.6f);
+
+	std::vector<Color> mem(size_t(Width) * Height);
+	RenderTarget target(mem.data(), Width, Height, Width * sizeof(Color));
+	PhongPipeline pipeline(target, std::make_shared<ZBuffer>(Width, Height));
+
+	const size_t vertexBytes = model.vertices.size() * sizeof(Vertex);
+	std::printf("%zu vertices, %zu triangles\n", model.vertices.size(), model.indices.size() / 3);
+	std::printf("%-26s %8.1f KB %8.2f ms\n", "float, size_t indices",
+		(vertexBytes + model.indices.size() * sizeof(size_t)) / 1024.0, Time(pipeline, target, model, world, frames));
+	const struct
+	{
+		const char* name;
+		bool quantize;
+		IndexBuffer::Width width;
+	} variants[] = {
+		{ "float, 32 bit indices",false,IndexBuffer::Width::Bits32 },
+		{ "float, auto indices",false,IndexBuffer::Width::Auto },
+		{ "quantized, auto indices",true,IndexBuffer::Width::Auto },
+	};
+	for (const auto& variant : variants)
+	{
+		CompactTriangleList<Vertex> compact(model, variant.quantize, variant.width);
+		std::printf("%-26s %8.1f KB %8.2f ms  (%s indices)\n", variant.name,
+			(compact.GetVertexBytes() + compact.indices.GetBytes()) / 1024.0, Time(pipeline, target, compact, world, frames),
+			compact.indices.IsWide() ? "32 bit" : "16 bit");
+		if (variant.quantize)
+		{
+			float posError = 0.0f;
+			float normalDot = 1.0f;
+			for (size_t i = 0; i < model.vertices.size(); i++)
+			{
+				const auto v = compact.Decode(compact.quantized[i]);
+				posError = std::max(posError, (v.pos - model.vertices[i].pos).Len());
+				normalDot = std::min(normalDot, v.n * model.vertices[i].n.GetNormalized());
+			}
+			std::printf("max position error %.2e (radius %.3f), max normal error %.4f degrees\n",
+				posError, model.GetRadius(), std::acos(std::min(normalDot, 1.0f)) * 180.0f / PI);
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,205 @@
+// depth prepass benchmark
+// renders three scenes headless at 1280x720 with SpecularPhongPointEffect, drawn back to front so every
+// covered pixel is shaded once per layer in a single pass: three layers of a grid of models, a wall
+// with spheres in front of it, and the same with 256 tiled point lights (whose tile depth ranges come
+// from the prepass depth); prints the best single pass frame time against the best prepass frame split
+// into its depth only and shading passes, the pixel shader invocations of both and how many pixels
+// differ between their images
+//
+//   DepthPrepassBench [model.obj] [repeats]
+//
+// build (windows): cl /std:c++17 /O2 /EHsc /I..\..\Engine DepthPrepassBench.cpp ..\..\Engine\ObjParser.cpp ..\..\Engine\JobSystem.cpp ..\..\Engine\MappedFile.cpp
+#include "Pipeline.h"
+#include "SpecularPhongPointEffect.h"
+#include "LightGrid.h"
+#include "Plane.h"
+#include "Sphere.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace
+{
+	typedef Pipeline<SpecularPhongPointEffect> PhongPipeline;
+	typedef PhongPipeline::Vertex Vertex;
+	using Clock = std::chrono::steady_clock;
+
+	constexpr int Width = 1280;
+	constexpr int Height = 720;
+
+	struct Scene
+	{
+		const char* name;
+		// binds the camera and issues the draws
+		std::function<void(PhongPipeline&)> draw;
+		// runs after the prepass (with its depth) or before the single pass (without depth)
+		std::function<void(const ZBuffer*)> prepare;
+	};
+	struct Result
+	{
+		double ms = 1e30;
+		double prepassMs = 0.0;
+		double shadeMs = 0.0;
+		size_t pixelsShaded = 0;
+		std::vector<Color> image;
+	};
+
+	double Since(Clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	}
+	Result Render(const Scene& scene, bool prepass, int repeats)
+	{
+		std::vector<Color> mem(size_t(Width) * Height);
+		RenderTarget target(mem.data(), Width, Height, Width * sizeof(Color));
+		auto pZb = std::make_shared<ZBuffer>(Width, Height);
+		PhongPipeline pipeline(target, pZb);
+		Result result;
+		for (int i = 0; i < repeats; i++)
+		{
+			const auto start = Clock::now();
+			target.Clear(Colors::Black);
+			pipeline.BeginFrame();
+			double prepassMs = 0.0;
+			if (prepass)
+			{
+				pipeline.SetDepthPass(PhongPipeline::DepthPass::DepthOnly);
+				scene.draw(pipeline);
+				pipeline.SetDepthPass(PhongPipeline::DepthPass::Equal);
+				prepassMs = Since(start);
+			}
+			scene.prepare(prepass ? pZb.get() : nullptr);
+			scene.draw(pipeline);
+			const double ms = Since(start);
+			if (ms < result.ms)
+			{
+				result.ms = ms;
+				result.prepassMs = prepassMs;
+				result.shadeMs = ms - prepassMs;
+			}
+		}
+		result.pixelsShaded = pipeline.GetStats().pixelsShaded;
+		result.image = mem;
+		return result;
+	}
+	void Compare(const Scene& scene, int repeats)
+	{
+		const auto single = Render(scene, false, repeats);
+		const auto prepass = Render(scene, true, repeats);
+		size_t differing = 0;
+		for (size_t i = 0; i < single.image.size(); i++)
+		{
+			differing += single.image[i].dword != prepass.image[i].dword ? 1 : 0;
+		}
+		std::printf("%s\n", scene.name);
+		std::printf("  single pass %8.2f ms                             %9zu shaded\n", single.ms, single.pixelsShaded);
+		std::printf("  prepass     %8.2f ms (depth %7.2f, shading %7.2f) %9zu shaded, net %+.1f%%, %zu pixels differ\n",
+			prepass.ms, prepass.prepassMs, prepass.shadeMs, prepass.pixelsShaded,
+			100.0 * (single.ms - prepass.ms) / single.ms, differing);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	const std::string path = argc > 1 ? argv[1] : "../../Engine/Models/suzanne.obj";
+	const int repeats = argc > 2 ? std::max(std::atoi(argv[2]), 1) : 5;
+
+	auto model = IndexedTriangleList<Vertex>::LoadNormals(path);
+	model.AdjustToTrueCenter();
+	const float radius = model.GetRadius();
+	auto wall = Plane::GetNormals<Vertex>(40, 12.0f);
+	auto sphere = Sphere::GetPlainNormals<Vertex>(0.5f);
+	const auto proj = Mat4::ProjectionFOV(90.0f, float(Width) / float(Height), 0.5f, 20.0f);
+	const auto bindCamera = [&proj](PhongPipeline& pipeline)
+	{
+		pipeline.effect.vs.BindView(Mat4::Identity());
+		pipeline.effect.vs.BindProjection(proj);
+		pipeline.effect.ps.SetLightPos({ 0.0f,0.0f,0.6f });
+	};
+
+	// three layers of 3x2 models, the far one first
+	const Scene models = {
+		"models, 3 layers",
+		[&](PhongPipeline& pipeline)
+		{
+			bindCamera(pipeline);
+			pipeline.effect.ps.SetLightGrid(nullptr);
+			for (int layer = 2; layer >= 0; layer--)
+			{
+				const float z = radius * (2.0f + float(layer) * 1.2f);
+				for (int i = 0; i < 6; i++)
+				{
+					pipeline.effect.vs.BindWorld(Mat4::RotationY(0.3f * float(i % 3) - 0.3f) *
+						Mat4::Translation((float(i % 3) - 1.0f) * z * 0.7f, (float(i / 3) - 0.5f) * z * 0.6f, z));
+					pipeline.Draw(model);
+				}
+			}
+		},
+		[](const ZBuffer*) {}
+	};
+
+	// wall, then the spheres from the far row to the near one
+	std::vector<Mat4> spheres;
+	for (int i = 11; i >= 0; i--)
+	{
+		spheres.push_back(Mat4::Translation(float(i % 4) * 1.6f - 2.4f, float(i / 4) * 1.4f - 1.4f, 1.5f + float(i % 3)));
+	}
+	const auto drawSpheres = [&](PhongPipeline& pipeline)
+	{
+		bindCamera(pipeline);
+		pipeline.effect.vs.BindWorld(Mat4::Translation(0.0f, 0.0f, 5.0f));
+		pipeline.Draw(wall);
+		for (const auto& w : spheres)
+		{
+			pipeline.effect.vs.BindWorld(w);
+			pipeline.Draw(sphere);
+		}
+	};
+	const Scene spheresScene = {
+		"wall and spheres",
+		[&](PhongPipeline& pipeline)
+		{
+			pipeline.effect.ps.SetLightGrid(nullptr);
+			drawSpheres(pipeline);
+		},
+		[](const ZBuffer*) {}
+	};
+
+	// the same lit by 256 small lights through a light grid
+	std::vector<PointLight> lights(256);
+	std::mt19937 rng(3);
+	std::uniform_real_distribution<float> xy(-5.0f, 5.0f);
+	std::uniform_real_distribution<float> z(1.0f, 5.0f);
+	std::uniform_real_distribution<float> hue(0.2f, 1.0f);
+	for (auto& l : lights)
+	{
+		const float lz = z(rng);
+		l.pos = { xy(rng) * lz * 0.3f,xy(rng) * lz * 0.17f,lz };
+		l.color = { hue(rng),hue(rng),hue(rng) };
+		l.range = 0.8f;
+	}
+	auto pGrid = std::make_shared<LightGrid>(Width, Height);
+	const Scene lightsScene = {
+		"wall and spheres, 256 lights",
+		[&](PhongPipeline& pipeline)
+		{
+			pipeline.effect.ps.SetLightGrid(pGrid);
+			drawSpheres(pipeline);
+		},
+		[&](const ZBuffer* pDepth)
+		{
+			// the prepass gives the tiles this frame's depth ranges, the single pass has none yet
+			pGrid->Build(lights, Mat4::Identity(), proj, pDepth);
+		}
+	};
+
+	std::printf("%dx%d, best of %d frames\n", Width, Height, repeats);
+	Compare(models, repeats);
+	Compare(spheresScene, repeats);
+	Compare(lightsScene, repeats);
+	return 0;
+}
@@ -0,0 +1,125 @@
+// round trip check for FrameWriter
+// feeds a few frames of a test pattern through FrameWriter::Consume (the way Graphics hands frames
+// to its sink), then reads the png and qoi sequences back through ImageCodec and compares the
+// pixels, and checks the size of the y4m stream; exits with 1 on any mismatch
+//
+//   FrameCaptureCheck [output prefix] [frames]
+//
+// build (linux):   g++ -std=c++17 -O2 -I../../Engine FrameCaptureCheck.cpp ../../Engine/FrameWriter.cpp ../../Engine/ImageCodec.cpp ../../Engine/Surface.cpp ../../Engine/FrameTimer.cpp -o FrameCaptureCheck -pthread
+// build (windows): cl /std:c++17 /O2 /EHsc /I..\..\Engine FrameCaptureCheck.cpp ..\..\Engine\FrameWriter.cpp ..\..\Engine\ImageCodec.cpp ..\..\Engine\Surface.cpp ..\..\Engine\FrameTimer.cpp
+#include "FrameWriter.h"
+#include "ImageCodec.h"
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+#include <exception>
+
+namespace
+{
+	// odd size and a padded pitch, so row handling is exercised too
+	constexpr unsigned int Width = 173u;
+	constexpr unsigned int Height = 61u;
+	constexpr unsigned int Pitch = (Width + 3u) * sizeof( Color );
+
+	Color Pattern( unsigned int x,unsigned int y,unsigned int frame )
+	{
+		return Color( (unsigned char)(x * 3u + frame * 17u),(unsigned char)(y * 5u + frame),(unsigned char)((x ^ y) + frame * 29u) );
+	}
+
+	std::vector<unsigned char> ReadFile( const std::string& path )
+	{
+		std::ifstream file( path,std::ios::binary );
+		return std::vector<unsigned char>( std::istreambuf_iterator<char>( file ),std::istreambuf_iterator<char>() );
+	}
+
+	std::string FramePath( const std::string& path,unsigned int frame,const char* extension )
+	{
+		char suffix[32];
+		std::snprintf( suffix,sizeof( suffix ),"_%06u.%s",frame,extension );
+		return path + suffix;
+	}
+
+	void Write( const std::string& path,FrameWriter::Format format,unsigned int frames )
+	{
+		std::vector<Color> mem( size_t( Pitch / sizeof( Color ) ) * Height );
+		RenderTarget target( mem.data(),Width,Height,Pitch );
+		FrameWriter writer( path,format,Width,Height );
+		for( unsigned int f = 0u; f < frames; f++ )
+		{
+			for( unsigned int y = 0u; y < Height; y++ )
+			{
+				for( unsigned int x = 0u; x < Width; x++ )
+				{
+					target.PutPixel( x,y,Pattern( x,y,f ) );
+				}
+			}
+			writer.Consume( target );
+		}
+		writer.Finish();
+	}
+
+	// returns the number of frames that didn't come back as written
+	unsigned int CheckSequence( const std::string& path,FrameWriter::Format format,const char* extension,unsigned int frames )
+	{
+		Write( path,format,frames );
+		unsigned int bad = 0u;
+		for( unsigned int f = 0u; f < frames; f++ )
+		{
+			const auto file = ReadFile( FramePath( path,f,extension ) );
+			try
+			{
+				const Surface s = ImageCodec::Decode( file.data(),file.size() );
+				bool same = s.GetWidth() == Width && s.GetHeight() == Height;
+				for( unsigned int y = 0u; same && y < Height; y++ )
+				{
+					for( unsigned int x = 0u; same && x < Width; x++ )
+					{
+						const Color a = s.GetPixel( x,y );
+						const Color b = Pattern( x,y,f );
+						same = a.GetR() == b.GetR() && a.GetG() == b.GetG() && a.GetB() == b.GetB();
+					}
+				}
+				bad += same ? 0u : 1u;
+			}
+			catch( const std::exception& e )
+			{
+				std::printf( "  frame %u: %s\n",f,e.what() );
+				bad++;
+			}
+		}
+		std::printf( "%s: %u of %u frames read back wrong\n",extension,bad,frames );
+		return bad;
+	}
+}
+
+int main( int argc,char** argv )
+{
+	const std::string path = argc > 1 ? argv[1] : "capturecheck";
+	const unsigned int frames = argc > 2 ? (unsigned int)std::max( std::atoi( argv[2] ),1 ) : 4u;
+	try
+	{
+		unsigned int bad = CheckSequence( path,FrameWriter::Format::Png,"png",frames );
+		bad += CheckSequence( path,FrameWriter::Format::Qoi,"qoi",frames );
+
+		// y4m is lossy (4:2:0), only its layout is checked: header plus FRAME marker and planes per frame
+		const std::string y4mPath = path + ".y4m";
+		Write( y4mPath,FrameWriter::Format::Y4m,frames );
+		const size_t planes = size_t( Width ) * Height + 2u * (size_t( (Width + 1u) / 2u ) * ((Height + 1u) / 2u));
+		const size_t expected = ImageCodec::GetY4mHeader( Width,Height,60u ).size() + frames * (6u + planes);
+		const size_t actual = ReadFile( y4mPath ).size();
+		std::printf( "y4m: %zu bytes, expected %zu\n",actual,expected );
+		bad += actual == expected ? 0u : 1u;
+
+		std::printf( bad == 0u ? "ok\n" : "FAILED\n" );
+		return bad == 0u ? 0 : 1;
+	}
+	catch( const std::exception& e )
+	{
+		std::printf( "error: %s\n",e.what() );
+		return 1;
+	}
+}
@@ -0,0 +1,127 @@
+// small console tool for checking SharedFrameRing throughput
+// reads the latest frame as fast as it can, checksums it in place and prints
+// frames/s, MB/s and how many frames it missed once per second
+//
+//   FrameConsumer <name> [seconds]               consume frames published by the engine
+//                                                (F9 in the engine publishes to "ChiliFrames")
+//   FrameConsumer --produce <name> [seconds]     publish a test pattern instead (for testing without the engine)
+//
+// build (linux):   g++ -std=c++14 -O2 -I../../Engine FrameConsumer.cpp ../../Engine/SharedFrameRing.cpp -o FrameConsumer -lrt
+// build (windows): cl /std:c++14 /O2 /EHsc /I..\..\Engine FrameConsumer.cpp ..\..\Engine\SharedFrameRing.cpp
+#include "SharedFrameRing.h"
+#include <chrono>
+#include <thread>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <string>
+#include <exception>
+
+namespace
+{
+	using Clock = std::chrono::steady_clock;
+
+	double Seconds( Clock::time_point a,Clock::time_point b )
+	{
+		return std::chrono::duration<double>( b - a ).count();
+	}
+
+	int Produce( const std::string& name,double duration )
+	{
+		auto ring = SharedFrameRing::Create( name,1300u,731u );
+		std::printf( "producing %ux%u into '%s' (%u slots)\n",
+			ring.GetWidth(),ring.GetHeight(),name.c_str(),ring.GetSlotCount() );
+		const auto start = Clock::now();
+		unsigned int frames = 0u;
+		while( Seconds( start,Clock::now() ) < duration )
+		{
+			auto target = ring.BeginWrite();
+			target.Clear( Color( (unsigned char)frames,(unsigned char)(frames >> 8),128u ) );
+			ring.EndWrite();
+			frames++;
+		}
+		std::printf( "produced %u frames (%.1f fps)\n",frames,frames / duration );
+		return 0;
+	}
+
+	int Consume( const std::string& name,double duration )
+	{
+		const auto ring = SharedFrameRing::Open( name );
+		const double frameMB = double( ring.GetWidth() ) * ring.GetHeight() * sizeof( Color ) / (1024.0 * 1024.0);
+		std::printf( "consuming %ux%u from '%s' (%u slots)\n",
+			ring.GetWidth(),ring.GetHeight(),name.c_str(),ring.GetSlotCount() );
+
+		uint64_t lastFrame = ring.GetLatestFrame();
+		uint64_t checksum = 0u;
+		unsigned int read = 0u;
+		uint64_t missed = 0u;
+		unsigned int totalRead = 0u;
+		const auto start = Clock::now();
+		auto reportStart = start;
+		while( Seconds( start,Clock::now() ) < duration )
+		{
+			const uint64_t frame = ring.ReadLatest( lastFrame,[&checksum]( const RenderTarget& target )
+			{
+				for( unsigned int y = 0u; y < target.GetHeight(); y++ )
+				{
+					const Color* pRow = target.GetRow( y );
+					for( unsigned int x = 0u; x < target.GetWidth(); x++ )
+					{
+						checksum += pRow[x].dword;
+					}
+				}
+			} );
+			if( frame == lastFrame )
+			{
+				std::this_thread::yield();
+			}
+			else
+			{
+				if( lastFrame != 0u )
+				{
+					missed += frame - lastFrame - 1u;
+				}
+				lastFrame = frame;
+				read++;
+			}
+
+			const auto now = Clock::now();
+			const double elapsed = Seconds( reportStart,now );
+			if( elapsed >= 1.0 )
+			{
+				std::printf( "%8.1f fps  %8.1f MB/s  missed %llu  frame %llu\n",
+					read / elapsed,read * frameMB / elapsed,
+					(unsigned long long)missed,(unsigned long long)lastFrame );
+				totalRead += read;
+				read = 0u;
+				missed = 0u;
+				reportStart = now;
+			}
+		}
+		totalRead += read;
+		std::printf( "read %u frames, checksum %llx\n",totalRead,(unsigned long long)checksum );
+		return 0;
+	}
+}
+
+int main( int argc,char** argv )
+{
+	try
+	{
+		if( argc >= 3 && std::strcmp( argv[1],"--produce" ) == 0 )
+		{
+			return Produce( argv[2],argc >= 4 ? std::atof( argv[3] ) : 10.0 );
+		}
+		if( argc >= 2 && argv[1][0] != '-' )
+		{
+			return Consume( argv[1],argc >= 3 ? std::atof( argv[2] ) : 10.0 );
+		}
+		std::printf( "usage: FrameConsumer <name> [seconds]\n       FrameConsumer --produce <name> [seconds]\n" );
+		return 1;
+	}
+	catch( const std::exception& e )
+	{
+		std::printf( "error: %s\n",e.what() );
+		return 1;
+	}
+}
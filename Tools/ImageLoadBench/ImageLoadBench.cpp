@@ -0,0 +1,125 @@
+// load time benchmark for Surface::FromFile
+// loads every image in a directory (Engine/Images by default) a number of times and
+// prints the best time and throughput per image; on windows it also times the old
+// gdi+ Bitmap::GetPixel loop for comparison
+//
+//   ImageLoadBench [directory] [repeats]
+//
+// build (linux):   g++ -std=c++17 -O2 -I../../Engine ImageLoadBench.cpp ../../Engine/Surface.cpp ../../Engine/ImageCodec.cpp -o ImageLoadBench
+// build (windows): cl /std:c++17 /O2 /EHsc /I..\..\Engine ImageLoadBench.cpp ..\..\Engine\Surface.cpp ..\..\Engine\ImageCodec.cpp
+#ifdef _WIN32
+#define FULL_WINTARD
+#include "ChiliWin.h"
+#include <algorithm>
+namespace Gdiplus
+{
+	using std::min;
+	using std::max;
+}
+#include <gdiplus.h>
+#pragma comment( lib,"gdiplus.lib" )
+#endif
+#include "Surface.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <filesystem>
+
+namespace
+{
+	using Clock = std::chrono::steady_clock;
+
+	template<typename F>
+	double BestMs( int repeats,F&& f )
+	{
+		double best = 1e30;
+		for( int i = 0; i < repeats; i++ )
+		{
+			const auto start = Clock::now();
+			f();
+			best = std::min( best,std::chrono::duration<double,std::milli>( Clock::now() - start ).count() );
+		}
+		return best;
+	}
+
+#ifdef _WIN32
+	// the loader Surface::FromFile used to have
+	void LoadGdiPlus( const std::wstring& name )
+	{
+		Gdiplus::Bitmap bitmap( name.c_str() );
+		const unsigned int width = bitmap.GetWidth();
+		const unsigned int height = bitmap.GetHeight();
+		Surface s( width,height );
+		for( unsigned int y = 0; y < height; y++ )
+		{
+			for( unsigned int x = 0; x < width; x++ )
+			{
+				Gdiplus::Color c;
+				bitmap.GetPixel( x,y,&c );
+				s.PutPixel( x,y,c.GetValue() );
+			}
+		}
+	}
+#endif
+}
+
+int main( int argc,char** argv )
+{
+	namespace fs = std::filesystem;
+	const fs::path dir = argc >= 2 ? argv[1] : "../../Engine/Images";
+	const int repeats = argc >= 3 ? std::max( std::atoi( argv[2] ),1 ) : 10;
+
+#ifdef _WIN32
+	Gdiplus::GdiplusStartupInput input;
+	ULONG_PTR token;
+	Gdiplus::GdiplusStartup( &token,&input,nullptr );
+#endif
+
+	std::vector<fs::path> files;
+	for( const auto& entry : fs::directory_iterator( dir ) )
+	{
+		if( entry.is_regular_file() )
+		{
+			files.push_back( entry.path() );
+		}
+	}
+	std::sort( files.begin(),files.end() );
+
+	double total = 0.0;
+	for( const auto& file : files )
+	{
+		const std::wstring name = file.wstring();
+		try
+		{
+			unsigned int width = 0u;
+			unsigned int height = 0u;
+			const double ms = BestMs( repeats,[&]()
+			{
+				const Surface s = Surface::FromFile( name );
+				width = s.GetWidth();
+				height = s.GetHeight();
+			} );
+			total += ms;
+			std::printf( "%-28s %5ux%-5u %8.2f ms %8.1f MP/s",file.filename().string().c_str(),
+				width,height,ms,width * height / (ms * 1000.0) );
+#ifdef _WIN32
+			const double gdiMs = BestMs( std::min( repeats,3 ),[&]() { LoadGdiPlus( name ); } );
+			std::printf( "   gdi+ %8.2f ms (%.1fx)",gdiMs,gdiMs / ms );
+#endif
+			std::printf( "\n" );
+		}
+		catch( const Surface::Exception& e )
+		{
+			std::printf( "%-28s failed: %ls\n",file.filename().string().c_str(),e.GetNote().c_str() );
+		}
+	}
+	std::printf( "total %.2f ms (best of %d per image)\n",total,repeats );
+
+#ifdef _WIN32
+	Gdiplus::GdiplusShutdown( token );
+#endif
+	return 0;
+}
@@ -0,0 +1,100 @@
+// job system scaling benchmark
+// draws bunny.obj and a highly tessellated Sphere::GetPlain with SolidEffect at 1280x720 through
+// job systems of 1 to every hardware thread, so vertex shading, triangle setup and clipping are split
+// over more and more threads while rasterization stays on the calling thread; prints frame times,
+// speedup and stolen jobs, and checks every frame against the single threaded one
+//
+//   JobScalingBench [bunny.obj] [frames]
+//
+// build (windows): cl /std:c++17 /O2 /EHsc /I..\..\Engine JobScalingBench.cpp ..\..\Engine\ObjParser.cpp ..\..\Engine\JobSystem.cpp ..\..\Engine\MappedFile.cpp
+#include "Pipeline.h"
+#include "SolidEffect.h"
+#include "Sphere.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+	typedef Pipeline<SolidEffect> SolidPipeline;
+	typedef SolidPipeline::Vertex Vertex;
+	using Clock = std::chrono::steady_clock;
+
+	constexpr int Width = 1280;
+	constexpr int Height = 720;
+
+	void Bench(const char* name, IndexedTriangleList<Vertex>& model, int frames)
+	{
+		model.AdjustToTrueCenter();
+		const float radius = model.GetRadius();
+		for (size_t i = 0; i < model.vertices.size(); i++)
+		{
+			model.vertices[i].color = Color((unsigned char)(64 + i % 192), (unsigned char)(64 + i / 7 % 192), 200u);
+		}
+		std::vector<Color> mem(size_t(Width) * Height);
+		std::vector<Color> reference;
+		RenderTarget target(mem.data(), Width, Height, Width * sizeof(Color));
+		SolidPipeline pipeline(target, std::make_shared<ZBuffer>(Width, Height));
+		const auto proj = Mat4::ProjectionFOV(70.0f, 1.77777778f, 0.1f, 10.0f);
+
+		std::printf("%s: %zu vertices, %zu triangles\n", name, model.vertices.size(), model.indices.size() / 3);
+		const unsigned int hardwareThreads = std::max(std::thread::hardware_concurrency(), 1u);
+		double baseMs = 0.0;
+		for (unsigned int threads = 1; ; threads = std::min(threads * 2, hardwareThreads))
+		{
+			JobSystem jobs(threads - 1);
+			pipeline.SetJobSystem(&jobs);
+			bool same = true;
+			double ms = 0.0;
+			for (int i = 0; i < frames; i++)
+			{
+				const auto start = Clock::now();
+				target.Clear(Colors::Black);
+				pipeline.BeginFrame();
+				// the camera dips into the mesh every few frames so the near plane clips it
+				const float z = radius * (1.2f + 0.6f * std::cos(float(i) * 0.4f));
+				pipeline.effect.vs.BindWorldView(Mat4::RotationY(float(i) * 0.05f) * Mat4::Translation(0.0f, 0.0f, z));
+				pipeline.effect.vs.BindProjection(proj);
+				pipeline.Draw(model);
+				ms += std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+				if (threads == 1)
+				{
+					reference.insert(reference.end(), mem.begin(), mem.end());
+				}
+				else
+				{
+					same = same && std::memcmp(mem.data(), reference.data() + mem.size() * i, mem.size() * sizeof(Color)) == 0;
+				}
+			}
+			ms /= frames;
+			if (threads == 1)
+			{
+				baseMs = ms;
+			}
+			const auto stats = jobs.GetStats();
+			std::printf("  %2u thread%s %8.2f ms/frame  %.2fx  %llu jobs, %llu stolen%s\n",
+				threads, threads == 1 ? " " : "s", ms, baseMs / ms,
+				(unsigned long long)stats.jobsRun, (unsigned long long)stats.jobsStolen, same ? "" : "  IMAGE MISMATCH");
+			if (threads == hardwareThreads)
+			{
+				break;
+			}
+		}
+	}
+}
+
+int main(int argc, char** argv)
+{
+	const std::string path = argc > 1 ? argv[1] : "../../Engine/Models/bunny.obj";
+	const int frames = argc > 2 ? std::max(std::atoi(argv[2]), 1) : 30;
+
+	auto bunny = IndexedTriangleList<Vertex>::Load(path);
+	Bench("bunny", bunny, frames);
+	auto sphere = Sphere::GetPlain<Vertex>(1.0f, 1000, 2000);
+	Bench("sphere 1000x2000", sphere, frames);
+	return 0;
+}
@@ -0,0 +1,155 @@
+// anti-aliasing benchmark for the pipeline
+// renders a grid of models headless at 1280x720 without anti-aliasing, with 4x msaa and with
+// 2x2 supersampling (2560x1440 downsampled), and prints the best frame time, pixel shader
+// invocations and the mean error against a 4x4 supersampled reference
+//
+//   MsaaBench [model.obj] [repeats]
+//
+// build (windows): cl /std:c++17 /O2 /EHsc /I..\..\Engine MsaaBench.cpp ..\..\Engine\ObjParser.cpp ..\..\Engine\JobSystem.cpp ..\..\Engine\MappedFile.cpp
+#include "Pipeline.h"
+#include "SpecularPhongPointEffect.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <string>
+#include <vector>
+
+namespace
+{
+	typedef Pipeline<SpecularPhongPointEffect> PhongPipeline;
+	typedef PhongPipeline::Vertex Vertex;
+	using Clock = std::chrono::steady_clock;
+
+	constexpr int Width = 1280;
+	constexpr int Height = 720;
+
+	struct Result
+	{
+		double ms = 1e30;
+		size_t pixelsShaded = 0;
+		std::vector<Color> image;
+	};
+
+	void DrawModels(PhongPipeline& pipeline, IndexedTriangleList<Vertex>& model, float distance)
+	{
+		const auto proj = Mat4::ProjectionFOV(95.0f, float(Width) / float(Height), 0.5f, 20.0f);
+		pipeline.effect.vs.BindView(Mat4::Identity());
+		pipeline.effect.vs.BindProjection(proj);
+		pipeline.effect.ps.SetLightPos(Vec4{ 0.0f,0.0f,0.6f,1.0f });
+		for (int row = 0; row < 2; row++)
+		{
+			for (int col = 0; col < 3; col++)
+			{
+				const float x = (float(col) - 1.0f) * distance * 0.9f;
+				const float y = (0.5f - float(row)) * distance * 0.8f;
+				pipeline.effect.vs.BindWorld(
+					Mat4::RotationY(0.4f * float(col) - 0.4f) *
+					Mat4::RotationX(0.3f * float(row) - 0.15f) *
+					Mat4::Translation(x, y, distance * 1.6f));
+				pipeline.Draw(model);
+			}
+		}
+	}
+	// box filter of factor x factor blocks
+	std::vector<Color> Downsample(const std::vector<Color>& src, int factor)
+	{
+		const int srcWidth = Width * factor;
+		std::vector<Color> dst(size_t(Width) * Height);
+		for (int y = 0; y < Height; y++)
+		{
+			for (int x = 0; x < Width; x++)
+			{
+				unsigned int r = 0u, g = 0u, b = 0u;
+				for (int sy = 0; sy < factor; sy++)
+				{
+					const Color* pSrc = &src[size_t(y * factor + sy) * srcWidth + x * factor];
+					for (int sx = 0; sx < factor; sx++)
+					{
+						r += pSrc[sx].GetR();
+						g += pSrc[sx].GetG();
+						b += pSrc[sx].GetB();
+					}
+				}
+				const unsigned int n = (unsigned int)(factor * factor);
+				dst[size_t(y) * Width + x] = Color((unsigned char)((r + n / 2u) / n),
+					(unsigned char)((g + n / 2u) / n), (unsigned char)((b + n / 2u) / n));
+			}
+		}
+		return dst;
+	}
+	// supersampled by factor in both directions, factor 1 is the plain pipeline
+	Result RenderSupersampled(IndexedTriangleList<Vertex>& model, float distance, int factor, int repeats)
+	{
+		const int w = Width * factor;
+		const int h = Height * factor;
+		std::vector<Color> mem(size_t(w) * h);
+		RenderTarget target(mem.data(), (unsigned int)w, (unsigned int)h, (unsigned int)(w * sizeof(Color)));
+		PhongPipeline pipeline(target, std::make_shared<ZBuffer>(w, h));
+		Result result;
+		for (int i = 0; i < repeats; i++)
+		{
+			const auto start = Clock::now();
+			target.Clear(Colors::Black);
+			pipeline.BeginFrame();
+			DrawModels(pipeline, model, distance);
+			result.image = factor == 1 ? mem : Downsample(mem, factor);
+			result.ms = std::min(result.ms, std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+		}
+		result.pixelsShaded = pipeline.GetStats().pixelsShaded;
+		return result;
+	}
+	Result RenderMultisampled(IndexedTriangleList<Vertex>& model, float distance, int repeats)
+	{
+		std::vector<Color> mem(size_t(Width) * Height);
+		RenderTarget target(mem.data(), Width, Height, Width * sizeof(Color));
+		PhongPipeline pipeline(target, std::make_shared<ZBuffer>(Width, Height));
+		pipeline.SetSampleBuffer(std::make_shared<SampleBuffer>(Width, Height));
+		Result result;
+		for (int i = 0; i < repeats; i++)
+		{
+			const auto start = Clock::now();
+			pipeline.BeginFrame();
+			DrawModels(pipeline, model, distance);
+			pipeline.ResolveMultisample();
+			result.image = mem;
+			result.ms = std::min(result.ms, std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+		}
+		result.pixelsShaded = pipeline.GetStats().pixelsShaded;
+		return result;
+	}
+	// mean absolute channel difference and the share of pixels off by more than 8 levels
+	void PrintError(const char* name, const Result& r, const Result& reference)
+	{
+		double sum = 0.0;
+		size_t bad = 0;
+		for (size_t i = 0; i < r.image.size(); i++)
+		{
+			const Color a = r.image[i];
+			const Color b = reference.image[i];
+			const int d[3] = { std::abs(int(a.GetR()) - int(b.GetR())),
+				std::abs(int(a.GetG()) - int(b.GetG())),
+				std::abs(int(a.GetB()) - int(b.GetB())) };
+			sum += d[0] + d[1] + d[2];
+			bad += std::max({ d[0],d[1],d[2] }) > 8;
+		}
+		std::printf("%-10s %8.2f ms %10zu shaded  error %.3f  pixels off %5.2f%%\n", name, r.ms, r.pixelsShaded,
+			sum / (3.0 * r.image.size()), 100.0 * double(bad) / double(r.image.size()));
+	}
+}
+
+int main(int argc, char** argv)
+{
+	const std::string path = argc > 1 ? argv[1] : "../../Engine/Models/suzanne.obj";
+	const int repeats = argc > 2 ? std::max(std::atoi(argv[2]), 1) : 10;
+
+	auto model = IndexedTriangleList<Vertex>::LoadNormals(path);
+	model.AdjustToTrueCenter();
+	const float distance = model.GetRadius();
+
+	const auto reference = RenderSupersampled(model, distance, 4, 1);
+	PrintError("none", RenderSupersampled(model, distance, 1, repeats), reference);
+	PrintError("msaa 4x", RenderMultisampled(model, distance, repeats), reference);
+	PrintError("ssaa 2x2", RenderSupersampled(model, distance, 2, repeats), reference);
+	return 0;
+}
@@ -0,0 +1,119 @@
+// obj loading benchmark
+// times tiny_obj_loader (what IndexedTriangleList used before ObjParser) against ObjParser with 1 thread
+// and with every job system thread on the given file, or on a generated uv sphere with positions, texcoords
+// and normals written as quads when no file is given, and checks that both produce the same triangles
+//
+//   ObjLoadBench [model.obj] [runs]
+//
+// build (windows): cl /std:c++17 /O2 /EHsc /I..\..\Engine ObjLoadBench.cpp ..\..\Engine\ObjParser.cpp ..\..\Engine\JobSystem.cpp ..\..\Engine\tiny_obj_loader.cpp
+#include "ObjParser.h"
+#include "tiny_obj_loader.h"
+#include "JobSystem.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace
+{
+	using Clock = std::chrono::steady_clock;
+
+	// rings * segments quads, 2 triangles each
+	void WriteSphere(const std::string& path, int rings, int segments)
+	{
+		std::ofstream file(path, std::ios::binary);
+		if (!file)
+		{
+			throw std::runtime_error("cannot write " + path);
+		}
+		std::vector<char> line(128);
+		for (int r = 0; r <= rings; r++)
+		{
+			const float theta = 3.14159265f * float(r) / float(rings);
+			for (int s = 0; s <= segments; s++)
+			{
+				const float phi = 6.28318531f * float(s) / float(segments);
+				const float x = std::sin(theta) * std::cos(phi);
+				const float y = std::cos(theta);
+				const float z = std::sin(theta) * std::sin(phi);
+				file.write(line.data(), std::snprintf(line.data(), line.size(), "v %.6f %.6f %.6f\n", x, y, z));
+				file.write(line.data(), std::snprintf(line.data(), line.size(), "vt %.6f %.6f\n", float(s) / segments, float(r) / rings));
+				file.write(line.data(), std::snprintf(line.data(), line.size(), "vn %.6f %.6f %.6f\n", x, y, z));
+			}
+		}
+		for (int r = 0; r < rings; r++)
+		{
+			for (int s = 0; s < segments; s++)
+			{
+				const int a = r * (segments + 1) + s + 1;
+				const int b = a + segments + 1;
+				file.write(line.data(), std::snprintf(line.data(), line.size(), "f %d/%d/%d %d/%d/%d %d/%d/%d %d/%d/%d\n",
+					a, a, a, b, b, b, b + 1, b + 1, b + 1, a + 1, a + 1, a + 1));
+			}
+		}
+	}
+	template<typename F>
+	double BestOf(int runs, F&& f)
+	{
+		double best = 1e30;
+		for (int i = 0; i < runs; i++)
+		{
+			const auto start = Clock::now();
+			f();
+			best = std::min(best, std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+		}
+		return best;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	std::string path = argc > 1 ? argv[1] : "";
+	const int runs = argc > 2 ? std::max(std::atoi(argv[2]), 1) : 3;
+	if (path.empty())
+	{
+		// 2000 x 1000 quads, 4M triangles
+		path = "sphere.obj";
+		WriteSphere(path, 1000, 2000);
+	}
+
+	size_t tinyTriangles = 0;
+	const double tinyMs = BestOf(runs, [&] {
+		tinyobj::attrib_t attrib;
+		std::vector<tinyobj::shape_t> shapes;
+		std::string err;
+		if (!tinyobj::LoadObj(&attrib, &shapes, nullptr, &err, path.c_str()))
+		{
+			throw std::runtime_error("LoadObj failed: " + err);
+		}
+		tinyTriangles = 0;
+		for (const auto& shape : shapes)
+		{
+			tinyTriangles += shape.mesh.indices.size() / 3;
+		}
+	});
+	std::printf("tiny_obj_loader     %9.1f ms  %zu triangles\n", tinyMs, tinyTriangles);
+
+	const unsigned int hardwareThreads = JobSystem::Get().GetThreadCount();
+	for (unsigned int threads = 1; ; threads = std::min(threads * 2, hardwareThreads))
+	{
+		ObjParser::Options options;
+		options.threads = threads;
+		ObjParser::Mesh mesh;
+		const double ms = BestOf(runs, [&] { mesh = ObjParser::Load(path, options); });
+		const size_t triangles = mesh.indices.size() / 3;
+		std::printf("ObjParser %2u thread%s %9.1f ms  %zu triangles, %zu vertices  (%.1fx)%s\n",
+			threads, threads == 1 ? " " : "s", ms, triangles, mesh.positions.size(), tinyMs / ms,
+			triangles == tinyTriangles ? "" : "  TRIANGLE COUNT MISMATCH");
+		if (threads == hardwareThreads)
+		{
+			break;
+		}
+	}
+	return 0;
+}
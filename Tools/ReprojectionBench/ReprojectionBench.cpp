@@ -0,0 +1,123 @@
+// reprojection cache benchmark
+// flies the camera of SpecularPhongPointScene along a short path at 1280x720 and renders every frame
+// twice, fully shaded and through the reprojection cache, then prints the share of reused pixels,
+// frame times and the error of the cached frames against the full ones
+//
+//   ReprojectionBench [model.obj] [frames]
+//
+// build (windows): cl /std:c++17 /O2 /EHsc /I..\..\Engine ReprojectionBench.cpp ..\..\Engine\ObjParser.cpp ..\..\Engine\JobSystem.cpp ..\..\Engine\MappedFile.cpp
+#include "Pipeline.h"
+#include "SpecularPhongPointEffect.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <string>
+#include <vector>
+
+namespace
+{
+	typedef Pipeline<SpecularPhongPointEffect> PhongPipeline;
+	typedef PhongPipeline::Vertex Vertex;
+	using Clock = std::chrono::steady_clock;
+
+	constexpr int Width = 1280;
+	constexpr int Height = 720;
+
+	struct Frame
+	{
+		Frame(std::shared_ptr<ZBuffer> pZb)
+			:
+			mem(size_t(Width) * Height),
+			target(mem.data(), Width, Height, Width * sizeof(Color)),
+			pipeline(target, std::move(pZb))
+		{}
+		std::vector<Color> mem;
+		RenderTarget target;
+		PhongPipeline pipeline;
+		double ms = 0.0;
+	};
+
+	// camera at t seconds: strafing, dollying and turning slowly like a user with the keyboard and mouse
+	Mat4 CameraView(float t)
+	{
+		const Vec3 camPos = { 0.3f * std::sin(t * 0.7f),0.1f * std::sin(t * 0.5f),0.4f * std::sin(t * 0.3f) };
+		const Mat4 camRotInv = Mat4::RotationY(0.15f * std::sin(t * 0.6f)) * Mat4::RotationX(0.05f * std::sin(t * 0.4f));
+		return Mat4::Translation(-camPos) * camRotInv;
+	}
+	template<typename F>
+	void Render(Frame& f, IndexedTriangleList<Vertex>& model, const Mat4& world, const Mat4& view, const Mat4& proj, F&& afterDraw)
+	{
+		const auto start = Clock::now();
+		f.target.Clear(Colors::Black);
+		f.pipeline.BeginFrame();
+		f.pipeline.effect.vs.BindWorld(world);
+		f.pipeline.effect.vs.BindView(view);
+		f.pipeline.effect.vs.BindProjection(proj);
+		f.pipeline.effect.ps.SetLightPos(Vec4{ 0.0f,0.0f,0.6f,1.0f } * view);
+		f.pipeline.Draw(model);
+		afterDraw();
+		f.ms += std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	}
+}
+
+int main(int argc, char** argv)
+{
+	const std::string path = argc > 1 ? argv[1] : "../../Engine/Models/suzanne.obj";
+	const int frames = argc > 2 ? std::max(std::atoi(argv[2]), 2) : 120;
+
+	auto model = IndexedTriangleList<Vertex>::LoadNormals(path);
+	model.AdjustToTrueCenter();
+	const Mat4 world = Mat4::Translation(0.0f, 0.0f, model.GetRadius() * 1.6f);
+	const auto proj = Mat4::ProjectionFOV(95.0f, 1.77777778f, 0.5f, 7.0f);
+
+	const auto pZb = std::make_shared<ZBuffer>(Width, Height);
+	const auto pCache = std::make_shared<ReprojectionCache>(Width, Height);
+	Frame full(std::make_shared<ZBuffer>(Width, Height));
+	Frame cached(pZb);
+	cached.pipeline.SetReprojectionCache(pCache);
+
+	size_t reused = 0, shaded = 0, offscreen = 0, disoccluded = 0, refreshed = 0;
+	double errorSum = 0.0;
+	int maxError = 0;
+	size_t pixelsOff = 0, covered = 0;
+	for (int i = 0; i < frames; i++)
+	{
+		// 60 fps
+		const auto view = CameraView(float(i) / 60.0f);
+		Render(full, model, world, view, proj, [] {});
+		pCache->BeginFrame(view, proj);
+		Render(cached, model, world, view, proj, [&] { pCache->EndFrame(*pZb); });
+
+		const auto& stats = cached.pipeline.GetStats();
+		const auto& cacheStats = pCache->GetStats();
+		reused += stats.pixelsReused;
+		shaded += stats.pixelsShaded;
+		offscreen += cacheStats.offscreen;
+		disoccluded += cacheStats.disoccluded;
+		refreshed += cacheStats.refreshed;
+		for (size_t p = 0; p < full.mem.size(); p++)
+		{
+			const Color a = full.mem[p];
+			const Color b = cached.mem[p];
+			if (a.dword == 0u && b.dword == 0u)
+			{
+				continue;
+			}
+			covered++;
+			const int d = std::max({ std::abs(int(a.GetR()) - int(b.GetR())),
+				std::abs(int(a.GetG()) - int(b.GetG())),
+				std::abs(int(a.GetB()) - int(b.GetB())) });
+			errorSum += d;
+			maxError = std::max(maxError, d);
+			pixelsOff += d > 8;
+		}
+	}
+	const double total = double(reused + shaded);
+	std::printf("%d frames, full %.2f ms/frame, cached %.2f ms/frame\n", frames, full.ms / frames, cached.ms / frames);
+	std::printf("reused %.1f%%  (shaded: refresh %.1f%%, offscreen %.1f%%, disoccluded %.1f%%)\n",
+		100.0 * reused / total, 100.0 * refreshed / total, 100.0 * offscreen / total, 100.0 * disoccluded / total);
+	std::printf("error over covered pixels: mean %.3f, max %d, off by more than 8: %.2f%%\n",
+		errorSum / double(covered), maxError, 100.0 * double(pixelsOff) / double(covered));
+	return 0;
+}
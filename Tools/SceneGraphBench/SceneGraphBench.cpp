@@ -0,0 +1,220 @@
+// scene graph benchmark
+// 10k nodes (100 roots with 9 children of 10 children each), the nodes alternate between a cube drawn
+// with SolidEffect and a sphere drawn with SpecularPhongPointEffect
+// world matrix update: a tree of heap allocated nodes walked recursively with full 4x4 products (how
+// a scene would hand roll it) against SceneGraph::Update with everything, 10% of the leaves and
+// nothing moving; drawing: node order with the camera bound per draw against SceneGraph::Draw, which
+// groups the draws per pipeline
+//
+//   SceneGraphBench [threads] [frames]
+//
+// build (windows): cl /std:c++17 /O2 /EHsc /I..\..\Engine SceneGraphBench.cpp ..\..\Engine\ObjParser.cpp ..\..\Engine\JobSystem.cpp ..\..\Engine\MappedFile.cpp
+#include "SceneGraph.h"
+#include "SolidEffect.h"
+#include "SpecularPhongPointEffect.h"
+#include "Cube.h"
+#include "Sphere.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace
+{
+	using Clock = std::chrono::steady_clock;
+
+	constexpr int Width = 640;
+	constexpr int Height = 360;
+	constexpr size_t Roots = 100;
+	constexpr size_t Children = 9;
+	constexpr size_t GrandChildren = 10;
+
+	struct TreeNode
+	{
+		Transform local;
+		Mat4 world;
+		std::vector<std::unique_ptr<TreeNode>> children;
+	};
+	void UpdateTree(TreeNode& node, const Mat4& parentWorld)
+	{
+		node.world = node.local.GetMatrix() * parentWorld;
+		for (auto& c : node.children)
+		{
+			UpdateTree(*c, node.world);
+		}
+	}
+	template<typename F>
+	double TimeMs(int frames, F&& f)
+	{
+		const auto start = Clock::now();
+		for (int i = 0; i < frames; i++)
+		{
+			f(i);
+		}
+		return std::chrono::duration<double, std::milli>(Clock::now() - start).count() / frames;
+	}
+	Transform Placement(size_t i, float spread)
+	{
+		return Transform({ float(int(i % 10) - 5) * spread,float(int(i / 10 % 10) - 5) * spread,0.0f },
+			{ 0.0f,float(i) * 0.3f,0.0f });
+	}
+}
+
+int main(int argc, char** argv)
+{
+	const unsigned int threads = argc > 1 ? (unsigned int)std::max(std::atoi(argv[1]), 1) : std::max(std::thread::hardware_concurrency(), 1u);
+	const int frames = argc > 2 ? std::max(std::atoi(argv[2]), 1) : 50;
+	JobSystem jobs(threads - 1);
+
+	SceneGraph graph;
+	graph.SetJobSystem(&jobs);
+	std::vector<std::unique_ptr<TreeNode>> tree;
+	std::vector<SceneGraph::NodeId> leaves;
+	std::vector<TreeNode*> treeLeaves;
+	std::vector<SceneGraph::NodeId> roots;
+	for (size_t r = 0; r < Roots; r++)
+	{
+		Transform t = Placement(r, 3.0f);
+		t.Translate({ 0.0f,0.0f,40.0f });
+		const auto root = graph.AddNode(SceneGraph::NoParent, t);
+		roots.push_back(root);
+		tree.push_back(std::make_unique<TreeNode>());
+		tree.back()->local = t;
+		for (size_t c = 0; c < Children; c++)
+		{
+			const auto child = graph.AddNode(root, Placement(c, 0.8f));
+			tree.back()->children.push_back(std::make_unique<TreeNode>());
+			auto& treeChild = *tree.back()->children.back();
+			treeChild.local = Placement(c, 0.8f);
+			for (size_t g = 0; g < GrandChildren; g++)
+			{
+				Transform leaf = Placement(g, 0.1f);
+				leaf.SetScale(0.04f);
+				leaves.push_back(graph.AddNode(child, leaf));
+				treeChild.children.push_back(std::make_unique<TreeNode>());
+				treeChild.children.back()->local = leaf;
+				treeLeaves.push_back(treeChild.children.back().get());
+			}
+		}
+	}
+	const size_t nodes = graph.GetNodeCount();
+	std::printf("%zu nodes, %zu levels deep, %u threads\n", nodes, size_t(3), jobs.GetThreadCount());
+
+	// world matrices
+	const double treeMs = TimeMs(frames, [&](int f)
+	{
+		for (auto& r : tree)
+		{
+			r->local.Rotate({ 0.0f,0.01f,0.0f });
+			UpdateTree(*r, Mat4::Identity());
+		}
+	});
+	const double allMs = TimeMs(frames, [&](int f)
+	{
+		for (const auto r : roots)
+		{
+			graph.GetTransform(r).Rotate({ 0.0f,0.01f,0.0f });
+		}
+		graph.Update();
+	});
+	const size_t allUpdated = graph.GetStats().worldsUpdated;
+	const double someMs = TimeMs(frames, [&](int f)
+	{
+		for (size_t i = size_t(f) % 10; i < leaves.size(); i += 10)
+		{
+			graph.GetTransform(leaves[i]).Rotate({ 0.0f,0.01f,0.0f });
+		}
+		graph.Update();
+	});
+	const size_t someUpdated = graph.GetStats().worldsUpdated;
+	const double staticMs = TimeMs(frames, [&](int) { graph.Update(); });
+	std::printf("update: pointer tree %.3f ms, graph all moving %.3f ms (%zu worlds), 10%% of leaves %.3f ms (%zu), still %.3f ms (%zu)\n",
+		treeMs, allMs, allUpdated, someMs, someUpdated, staticMs, graph.GetStats().worldsUpdated);
+
+	// both hold the same matrices after the same edits
+	for (size_t i = 0; i < leaves.size(); i++)
+	{
+		treeLeaves[i]->local = graph.GetTransform(leaves[i]);
+	}
+	for (size_t r = 0; r < Roots; r++)
+	{
+		tree[r]->local = graph.GetTransform(roots[r]);
+		UpdateTree(*tree[r], Mat4::Identity());
+	}
+	float maxDiff = 0.0f;
+	for (size_t i = 0; i < leaves.size(); i++)
+	{
+		for (int j = 0; j < 4; j++)
+		{
+			for (int k = 0; k < 4; k++)
+			{
+				maxDiff = std::max(maxDiff, std::abs(graph.GetWorld(leaves[i]).elements[j][k] - treeLeaves[i]->world.elements[j][k]));
+			}
+		}
+	}
+	std::printf("max world matrix difference %.2e\n", maxDiff);
+
+	// drawing
+	std::vector<Color> mem(size_t(Width) * Height);
+	RenderTarget target(mem.data(), Width, Height, Width * sizeof(Color));
+	auto pZb = std::make_shared<ZBuffer>(Width, Height);
+	Pipeline<SolidEffect> solid(target, pZb);
+	Pipeline<SpecularPhongPointEffect> phong(target, pZb);
+	solid.SetJobSystem(&jobs);
+	phong.SetJobSystem(&jobs);
+	auto cube = Cube::GetPlain<SolidEffect::Vertex>();
+	for (auto& v : cube.vertices)
+	{
+		v.color = Colors::White;
+	}
+	auto sphere = Sphere::GetPlainNormals<SpecularPhongPointEffect::Vertex>(0.6f, 6, 12);
+	for (size_t i = 0; i < nodes; i++)
+	{
+		if (i % 2 == 0)
+		{
+			graph.Attach(SceneGraph::NodeId(i), solid, cube);
+		}
+		else
+		{
+			graph.Attach(SceneGraph::NodeId(i), phong, sphere);
+		}
+	}
+	const auto view = Mat4::Translation(0.0f, 0.0f, -10.0f);
+	const auto proj = Mat4::ProjectionFOV(70.0f, 1.77777778f, 0.5f, 100.0f);
+	phong.effect.ps.SetLightPos(Vec4{ 0.0f,5.0f,20.0f,1.0f } * view);
+	graph.Update();
+
+	const double interleavedMs = TimeMs(frames, [&](int)
+	{
+		target.Clear(Colors::Black);
+		solid.BeginFrame();
+		for (size_t i = 0; i < nodes; i++)
+		{
+			const auto& world = graph.GetWorld(SceneGraph::NodeId(i));
+			if (i % 2 == 0)
+			{
+				solid.effect.vs.BindWorldView(world * view);
+				solid.effect.vs.BindProjection(proj);
+				solid.Draw(cube);
+			}
+			else
+			{
+				phong.effect.vs.BindWorld(world);
+				phong.effect.vs.BindView(view);
+				phong.effect.vs.BindProjection(proj);
+				phong.Draw(sphere);
+			}
+		}
+	});
+	const double groupedMs = TimeMs(frames, [&](int)
+	{
+		target.Clear(Colors::Black);
+		solid.BeginFrame();
+		graph.Draw(view, proj);
+	});
+	std::printf("draw: node order %.2f ms, grouped %.2f ms (%zu draws in %zu batches)\n",
+		interleavedMs, groupedMs, graph.GetStats().draws, graph.GetStats().batches);
+	return 0;
+}
@@ -0,0 +1,102 @@
+// setup queue benchmark
+// draws a highly tessellated Sphere::GetPlain with SolidEffect and SpecularPhongPointEffect at 1280x720,
+// with triangle setup batched and rasterized afterwards and streamed through setup queues of several
+// sizes; prints frame times, how long the rasterizer and the geometry jobs waited on each other, and
+// the queue fill, which tells which stage is the bottleneck
+//
+//   SetupQueueBench [threads] [frames]
+//
+// build (windows): cl /std:c++17 /O2 /EHsc /I..\..\Engine SetupQueueBench.cpp ..\..\Engine\ObjParser.cpp ..\..\Engine\JobSystem.cpp ..\..\Engine\MappedFile.cpp
+#include "Pipeline.h"
+#include "SolidEffect.h"
+#include "SpecularPhongPointEffect.h"
+#include "Sphere.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+	using Clock = std::chrono::steady_clock;
+
+	constexpr int Width = 1280;
+	constexpr int Height = 720;
+
+	template<typename Effect>
+	void Bind(Pipeline<Effect>& pipeline, const Mat4& worldView, const Mat4& proj);
+	template<>
+	void Bind(Pipeline<SolidEffect>& pipeline, const Mat4& worldView, const Mat4& proj)
+	{
+		pipeline.effect.vs.BindWorldView(worldView);
+		pipeline.effect.vs.BindProjection(proj);
+	}
+	template<>
+	void Bind(Pipeline<SpecularPhongPointEffect>& pipeline, const Mat4& worldView, const Mat4& proj)
+	{
+		pipeline.effect.vs.BindWorld(worldView);
+		pipeline.effect.vs.BindView(Mat4::Identity());
+		pipeline.effect.vs.BindProjection(proj);
+		pipeline.effect.ps.SetLightPos({ 0.0f,0.0f,0.5f });
+	}
+
+	template<typename Effect>
+	void Bench(const char* name, IndexedTriangleList<typename Effect::Vertex> model, JobSystem& jobs, int frames)
+	{
+		std::vector<Color> mem(size_t(Width) * Height);
+		RenderTarget target(mem.data(), Width, Height, Width * sizeof(Color));
+		Pipeline<Effect> pipeline(target, std::make_shared<ZBuffer>(Width, Height));
+		pipeline.SetJobSystem(&jobs);
+		const auto proj = Mat4::ProjectionFOV(70.0f, 1.77777778f, 0.1f, 10.0f);
+
+		std::printf("%s, %zu triangles, %u threads\n", name, model.indices.size() / 3, jobs.GetThreadCount());
+		for (const size_t capacity : { size_t(0),size_t(256),size_t(4096),size_t(65536) })
+		{
+			pipeline.SetSetupQueue(capacity);
+			double ms = 0.0;
+			float rasterWait = 0.0f, geometryWait = 0.0f;
+			size_t triangles = 0, fillSum = 0, peak = 0;
+			for (int i = 0; i < frames; i++)
+			{
+				const auto start = Clock::now();
+				target.Clear(Colors::Black);
+				pipeline.BeginFrame();
+				Bind(pipeline, Mat4::RotationY(float(i) * 0.05f) * Mat4::Translation(0.0f, 0.0f, 1.6f), proj);
+				pipeline.Draw(model);
+				ms += std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+				const auto& s = pipeline.GetStats();
+				rasterWait += s.setupRasterWaitMs;
+				geometryWait += s.setupGeometryWaitMs;
+				triangles += s.setupTriangles;
+				fillSum += s.setupQueueFillSum;
+				peak = std::max(peak, s.setupQueuePeak);
+			}
+			if (capacity == 0)
+			{
+				std::printf("  batched       %8.2f ms/frame\n", ms / frames);
+				continue;
+			}
+			std::printf("  queue %6zu  %8.2f ms/frame  raster waited %6.2f ms, geometry waited %6.2f ms, fill mean %.0f peak %zu\n",
+				capacity, ms / frames, rasterWait / frames, geometryWait / frames,
+				triangles ? double(fillSum) / double(triangles) : 0.0, peak);
+		}
+	}
+}
+
+int main(int argc, char** argv)
+{
+	const unsigned int threads = argc > 1 ? (unsigned int)std::max(std::atoi(argv[1]), 2) : std::max(std::thread::hardware_concurrency(), 2u);
+	const int frames = argc > 2 ? std::max(std::atoi(argv[2]), 1) : 20;
+	JobSystem jobs(threads - 1);
+
+	auto solid = Sphere::GetPlain<SolidEffect::Vertex>(1.0f, 700, 1400);
+	for (size_t i = 0; i < solid.vertices.size(); i++)
+	{
+		solid.vertices[i].color = Color((unsigned char)(i * 37 % 256), (unsigned char)(i * 91 % 256), 200u);
+	}
+	Bench<SolidEffect>("solid sphere", std::move(solid), jobs, frames);
+	Bench<SpecularPhongPointEffect>("phong sphere", Sphere::GetPlainNormals<SpecularPhongPointEffect::Vertex>(1.0f, 700, 1400), jobs, frames);
+	return 0;
+}
@@ -0,0 +1,212 @@
+// point light shadow benchmark
+// a wall with spheres in front of it and a point light between them and the camera; renders the
+// light's six 512x512 cube faces with the full Pipeline<SolidEffect> (vertex shading, attribute
+// interpolation, a pixel shader and color writes nobody reads) and with DepthPipeline, compares the
+// depths they write, then times the 1280x720 SpecularPhongPointEffect frame without shadows and
+// with the cube map and 3x3 PCF
+//
+//   ShadowBench [threads] [frames]
+//
+// build (windows): cl /std:c++17 /O2 /EHsc /I..\..\Engine ShadowBench.cpp ..\..\Engine\ObjParser.cpp ..\..\Engine\JobSystem.cpp ..\..\Engine\MappedFile.cpp
+#include "Pipeline.h"
+#include "SolidEffect.h"
+#include "SpecularPhongPointEffect.h"
+#include "DepthPipeline.h"
+#include "ShadowCubeMap.h"
+#include "Plane.h"
+#include "Sphere.h"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+#include <thread>
+#include <vector>
+
+namespace
+{
+	using Clock = std::chrono::steady_clock;
+
+	constexpr int Width = 1280;
+	constexpr int Height = 720;
+	constexpr int FaceSize = 512;
+
+	template<typename F>
+	double Time(int frames, F&& f)
+	{
+		const auto start = Clock::now();
+		for (int i = 0; i < frames; i++)
+		{
+			f();
+		}
+		return std::chrono::duration<double, std::milli>(Clock::now() - start).count() / frames;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	const unsigned int threads = argc > 1 ? (unsigned int)std::max(std::atoi(argv[1]), 1) : std::max(std::thread::hardware_concurrency(), 1u);
+	const int frames = argc > 2 ? std::max(std::atoi(argv[2]), 1) : 5;
+	JobSystem jobs(threads - 1);
+
+	std::vector<Mat4> spheres;
+	for (int i = 0; i < 12; i++)
+	{
+		spheres.push_back(Mat4::Translation(float(i % 4) * 1.6f - 2.4f, float(i / 4) * 1.4f - 1.4f, 2.5f + float(i % 3) * 0.5f));
+	}
+	const auto wallWorld = Mat4::Translation(0.0f, 0.0f, 5.0f);
+	const Vec3 lightPos = { 0.3f,0.2f,1.0f };
+
+	// six 90 degree faces looking down the axes from the light
+	const auto faceProj = Mat4::ProjectionFOV(90.0f, 1.0f, 0.05f, 20.0f);
+	const Mat4 faceRotations[6] = {
+		Mat4::RotationY(-PI / 2.0f),Mat4::RotationY(PI / 2.0f),
+		Mat4::RotationX(PI / 2.0f),Mat4::RotationX(-PI / 2.0f),
+		Mat4::Identity(),Mat4::RotationY(PI),
+	};
+	auto solidWall = Plane::GetPlain<SolidEffect::Vertex>(40, 12.0f);
+	auto solidSphere = Sphere::GetPlain<SolidEffect::Vertex>(0.5f);
+
+	std::printf("%u threads, %dx%d faces\n", jobs.GetThreadCount(), FaceSize, FaceSize);
+
+	// full pipeline, one face after the other with the pipeline's own threading
+	std::vector<Color> faceMem(size_t(FaceSize) * FaceSize);
+	RenderTarget faceTarget(faceMem.data(), FaceSize, FaceSize, FaceSize * sizeof(Color));
+	std::vector<std::shared_ptr<ZBuffer>> fullFaces;
+	std::vector<std::shared_ptr<ZBuffer>> depthFaces;
+	for (int i = 0; i < 6; i++)
+	{
+		fullFaces.push_back(std::make_shared<ZBuffer>(FaceSize, FaceSize));
+		depthFaces.push_back(std::make_shared<ZBuffer>(FaceSize, FaceSize));
+	}
+	std::vector<Pipeline<SolidEffect>> solids;
+	for (int i = 0; i < 6; i++)
+	{
+		solids.emplace_back(faceTarget, fullFaces[i]);
+		solids.back().SetJobSystem(&jobs);
+	}
+	const double fullMs = Time(frames, [&]()
+	{
+		for (int i = 0; i < 6; i++)
+		{
+			const auto faceView = Mat4::Translation(-lightPos) * faceRotations[i];
+			auto& solid = solids[i];
+			solid.BeginFrame();
+			solid.effect.vs.BindProjection(faceProj);
+			solid.effect.vs.BindWorldView(wallWorld * faceView);
+			solid.Draw(solidWall);
+			for (const auto& w : spheres)
+			{
+				solid.effect.vs.BindWorldView(w * faceView);
+				solid.Draw(solidSphere);
+			}
+		}
+	});
+	// depth only, same faces and culling so the results compare, the faces render in parallel
+	std::vector<DepthPipeline> depths;
+	for (int i = 0; i < 6; i++)
+	{
+		depths.emplace_back(depthFaces[i]);
+	}
+	const double depthMs = Time(frames, [&]()
+	{
+		jobs.ParallelFor(6, 1, [&](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; i++)
+			{
+				const auto faceViewProj = Mat4::Translation(-lightPos) * faceRotations[i] * faceProj;
+				auto& d = depths[i];
+				d.BeginFrame();
+				d.BindWorldViewProj(wallWorld * faceViewProj);
+				d.Draw(solidWall);
+				for (const auto& w : spheres)
+				{
+					d.BindWorldViewProj(w * faceViewProj);
+					d.Draw(solidSphere);
+				}
+			}
+		});
+	});
+	size_t coverageDiffers = 0;
+	float maxDepthDiff = 0.0f;
+	// Pipeline leaves the last row and column of its target unwritten, they aren't compared
+	for (int i = 0; i < 6; i++)
+	{
+		for (int y = 0; y < FaceSize - 1; y++)
+		{
+			for (int x = 0; x < FaceSize - 1; x++)
+			{
+				const float a = fullFaces[i]->At(x, y);
+				const float b = depthFaces[i]->At(x, y);
+				const bool aEmpty = a == std::numeric_limits<float>::infinity();
+				const bool bEmpty = b == std::numeric_limits<float>::infinity();
+				if (aEmpty != bEmpty)
+				{
+					coverageDiffers++;
+				}
+				else if (!aEmpty)
+				{
+					maxDepthDiff = std::max(maxDepthDiff, std::abs(a - b));
+				}
+			}
+		}
+	}
+	std::printf("  six faces, Pipeline<SolidEffect> %8.2f ms\n", fullMs);
+	std::printf("  six faces, DepthPipeline         %8.2f ms, %zu texels covered differently, max depth difference %g\n",
+		depthMs, coverageDiffers, maxDepthDiff);
+
+	// the shaded frame with and without shadows
+	std::vector<Color> mem(size_t(Width) * Height);
+	RenderTarget target(mem.data(), Width, Height, Width * sizeof(Color));
+	auto pZb = std::make_shared<ZBuffer>(Width, Height);
+	Pipeline<SpecularPhongPointEffect> pipeline(target, pZb);
+	pipeline.SetJobSystem(&jobs);
+	pipeline.effect.ps.SetLightPos(lightPos);
+	auto wall = Plane::GetNormals<SpecularPhongPointEffect::Vertex>(40, 12.0f);
+	auto sphere = Sphere::GetPlainNormals<SpecularPhongPointEffect::Vertex>(0.5f);
+	auto pShadowMap = std::make_shared<ShadowCubeMap>(FaceSize, 0.05f, 20.0f);
+	pShadowMap->SetJobSystem(&jobs);
+	const auto proj = Mat4::ProjectionFOV(90.0f, 1.77777778f, 0.5f, 10.0f);
+	const auto render = [&]()
+	{
+		target.Clear(Colors::Black);
+		pipeline.BeginFrame();
+		pipeline.effect.vs.BindView(Mat4::Identity());
+		pipeline.effect.vs.BindProjection(proj);
+		pipeline.effect.vs.BindWorld(wallWorld);
+		pipeline.Draw(wall);
+		for (const auto& w : spheres)
+		{
+			pipeline.effect.vs.BindWorld(w);
+			pipeline.Draw(sphere);
+		}
+	};
+	const auto renderShadowMap = [&]()
+	{
+		pShadowMap->Begin(lightPos);
+		pShadowMap->Draw(wall, wallWorld);
+		for (const auto& w : spheres)
+		{
+			pShadowMap->Draw(sphere, w);
+		}
+		pShadowMap->End();
+	};
+
+	pipeline.effect.ps.SetShadowMap(nullptr);
+	const double plainMs = Time(frames, render);
+	const auto unshadowed = mem;
+	pipeline.effect.ps.SetShadowMap(pShadowMap);
+	const double mapMs = Time(frames, renderShadowMap);
+	const double shadedMs = Time(frames, render);
+	size_t darker = 0;
+	for (size_t i = 0; i < mem.size(); i++)
+	{
+		darker += mem[i].dword != unshadowed[i].dword ? 1 : 0;
+	}
+	const auto& s = pShadowMap->GetStats();
+	std::printf("  %dx%d frame, no shadows        %8.2f ms\n", Width, Height, plainMs);
+	std::printf("  %dx%d frame, shadow map        %8.2f ms (%zu of %zu face draws culled, %zu triangles)\n",
+		Width, Height, mapMs, s.drawsCulled, s.draws, s.trianglesRasterized);
+	std::printf("  %dx%d frame, PCF shading       %8.2f ms, %zu pixels in shadow or penumbra\n", Width, Height, shadedMs, darker);
+	return 0;
+}
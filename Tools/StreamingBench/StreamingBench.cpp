@@ -0,0 +1,132 @@
+// streaming mesh benchmark
+// converts a mesh to the chunked StreamingMesh format (a generated 8M triangle sphere unless a model
+// is given), then flies the camera close over its surface at 1280x720 and draws it both from memory
+// and streamed from the file with a small resident budget; prints frame times, chunk culling and
+// paging counts, and the resident bytes of both
+//
+//   StreamingBench [model.obj] [budget MB] [frames]
+//
+// build (windows): cl /std:c++17 /O2 /EHsc /I..\..\Engine StreamingBench.cpp ..\..\Engine\ObjParser.cpp ..\..\Engine\JobSystem.cpp ..\..\Engine\MappedFile.cpp
+#include "Pipeline.h"
+#include "SpecularPhongPointEffect.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <string>
+#include <vector>
+
+namespace
+{
+	typedef Pipeline<SpecularPhongPointEffect> PhongPipeline;
+	typedef PhongPipeline::Vertex Vertex;
+	using Clock = std::chrono::steady_clock;
+
+	constexpr int Width = 1280;
+	constexpr int Height = 720;
+
+	// unit uv sphere, rings * segments * 2 triangles, rows of triangles in index order
+	IndexedTriangleList<Vertex> MakeSphere(int rings, int segments)
+	{
+		std::vector<Vertex> vertices;
+		vertices.reserve(size_t(rings + 1) * (segments + 1));
+		for (int r = 0; r <= rings; r++)
+		{
+			const float theta = PI * float(r) / float(rings);
+			for (int s = 0; s <= segments; s++)
+			{
+				const float phi = 2.0f * PI * float(s) / float(segments);
+				const Vec3 p = { std::sin(theta) * std::cos(phi),std::cos(theta),std::sin(theta) * std::sin(phi) };
+				vertices.emplace_back(p, p);
+			}
+		}
+		std::vector<size_t> indices;
+		indices.reserve(size_t(rings) * segments * 6);
+		for (int r = 0; r < rings; r++)
+		{
+			for (int s = 0; s < segments; s++)
+			{
+				const size_t a = size_t(r) * (segments + 1) + s;
+				const size_t b = a + segments + 1;
+				indices.insert(indices.end(), { a,a + 1,b,a + 1,b + 1,b });
+			}
+		}
+		return { std::move(vertices),std::move(indices) };
+	}
+	// camera skimming along the surface at radius 1.3, looking at it
+	Mat4 CameraView(float t)
+	{
+		return Mat4::RotationY(t * 0.8f) * Mat4::RotationX(0.3f * std::sin(t * 0.5f)) * Mat4::Translation(0.0f, 0.0f, 1.3f);
+	}
+	template<typename Mesh>
+	double Render(PhongPipeline& pipeline, RenderTarget& target, Mesh& mesh, const Mat4& view, const Mat4& proj)
+	{
+		const auto start = Clock::now();
+		target.Clear(Colors::Black);
+		pipeline.BeginFrame();
+		pipeline.effect.vs.BindWorld(Mat4::Identity());
+		pipeline.effect.vs.BindView(view);
+		pipeline.effect.vs.BindProjection(proj);
+		pipeline.effect.ps.SetLightPos(Vec4{ 0.0f,0.0f,0.0f,1.0f } * view);
+		pipeline.Draw(mesh);
+		return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	}
+}
+
+int main(int argc, char** argv)
+{
+	const std::string path = argc > 1 ? argv[1] : "";
+	const size_t budget = size_t(argc > 2 ? std::max(std::atoi(argv[2]), 1) : 32) << 20;
+	const int frames = argc > 3 ? std::max(std::atoi(argv[3]), 1) : 60;
+	const std::string chunkPath = "streaming.sms";
+
+	auto model = path.empty() ? MakeSphere(2000, 2000) : IndexedTriangleList<Vertex>::LoadNormals(path);
+	if (!path.empty())
+	{
+		model.AdjustToTrueCenter();
+		const float scale = 1.0f / model.GetRadius();
+		for (auto& v : model.vertices)
+		{
+			v.pos *= scale;
+		}
+		model.InvalidateBounds();
+	}
+	const size_t memoryBytes = model.vertices.size() * sizeof(Vertex) + model.indices.size() * sizeof(size_t);
+
+	auto start = Clock::now();
+	StreamingMesh<Vertex>::Write(chunkPath, model.vertices, model.indices);
+	const double writeMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+	std::vector<Color> mem(size_t(Width) * Height);
+	RenderTarget target(mem.data(), Width, Height, Width * sizeof(Color));
+	PhongPipeline pipeline(target, std::make_shared<ZBuffer>(Width, Height));
+	const auto proj = Mat4::ProjectionFOV(70.0f, 1.77777778f, 0.05f, 4.0f);
+
+	double memoryMs = 0.0;
+	for (int i = 0; i < frames; i++)
+	{
+		memoryMs += Render(pipeline, target, model, CameraView(float(i) / 30.0f), proj);
+	}
+	const size_t triangles = model.indices.size() / 3;
+	model = {};
+
+	StreamingMesh<Vertex> streamed(chunkPath, budget);
+	double streamedMs = 0.0;
+	size_t chunksDrawn = 0, chunksCulled = 0;
+	for (int i = 0; i < frames; i++)
+	{
+		streamedMs += Render(pipeline, target, streamed, CameraView(float(i) / 30.0f), proj);
+		chunksDrawn += pipeline.GetStats().chunksDrawn;
+		chunksCulled += pipeline.GetStats().chunksCulled;
+	}
+	const auto& s = streamed.GetStats();
+	std::printf("%zu triangles, %zu chunks, written in %.0f ms\n", triangles, streamed.GetChunkCount(), writeMs);
+	std::printf("in memory  %7.2f ms/frame, %6.1f MB resident (vertices + size_t indices)\n",
+		memoryMs / frames, memoryBytes / 1048576.0);
+	std::printf("streamed   %7.2f ms/frame, %6.1f MB peak resident of %.1f MB budget\n",
+		streamedMs / frames, s.peakResidentBytes / 1048576.0, budget / 1048576.0);
+	std::printf("per frame: %.1f chunks drawn, %.1f culled, %.1f mapped, %.1f evicted\n",
+		double(chunksDrawn) / frames, double(chunksCulled) / frames, double(s.chunksMapped) / frames, double(s.chunksEvicted) / frames);
+	std::remove(chunkPath.c_str());
+	return 0;
+}
@@ -0,0 +1,149 @@
+// transform setup benchmark
+// per draw setup cost of a scene with many objects: every object builds its world matrix from a rotation
+// chain and binds world, view and projection like the scenes did before Transform (eight 4x4 products per
+// draw), against cached Transforms bound to the vertex shader (which skips the compose when the matrix is
+// the one already bound), with all objects still and with 10% of them moving every frame; also checks that both give the same matrices and normals
+//
+//   TransformBench [objects] [frames]
+//
+// build (windows): cl /std:c++17 /O2 /EHsc /I..\..\Engine TransformBench.cpp ..\..\Engine\ObjParser.cpp ..\..\Engine\JobSystem.cpp ..\..\Engine\MappedFile.cpp
+#include "Pipeline.h"
+#include "SpecularPhongPointEffect.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <vector>
+
+namespace
+{
+	typedef SpecularPhongPointEffect::VertexShader VertexShader;
+	using Clock = std::chrono::steady_clock;
+
+	// what the vertex shader binds did before caching: compose on every bind
+	struct EagerBinds
+	{
+		void BindWorld(const Mat4& m)
+		{
+			world = m;
+			worldView = world * view;
+			worldViewProj = worldView * proj;
+		}
+		void BindView(const Mat4& m)
+		{
+			view = m;
+			worldView = world * view;
+			worldViewProj = worldView * proj;
+		}
+		void BindProjection(const Mat4& m)
+		{
+			proj = m;
+			worldViewProj = worldView * proj;
+		}
+		Mat4 world = Mat4::Identity();
+		Mat4 view = Mat4::Identity();
+		Mat4 proj = Mat4::Identity();
+		Mat4 worldView = Mat4::Identity();
+		Mat4 worldViewProj = Mat4::Identity();
+	};
+	struct Object
+	{
+		Vec3 pos;
+		Vec3 rot;
+		Transform transform;
+	};
+	float sink = 0.0f;
+}
+
+int main(int argc, char** argv)
+{
+	const size_t count = argc > 1 ? size_t(std::max(std::atoi(argv[1]), 1)) : 10000;
+	const int frames = argc > 2 ? std::max(std::atoi(argv[2]), 1) : 200;
+
+	std::vector<Object> objects(count);
+	for (size_t i = 0; i < count; i++)
+	{
+		auto& o = objects[i];
+		o.pos = { float(i % 100) - 50.0f,float(i / 100 % 100) - 50.0f,float(i / 10000) + 5.0f };
+		o.rot = { float(i) * 0.1f,float(i) * 0.2f,float(i) * 0.3f };
+		o.transform.SetPosition(o.pos);
+		o.transform.SetRotation(o.rot);
+	}
+	const auto view = Mat4::Translation(0.0f, 0.0f, 3.0f) * Mat4::RotationY(0.3f);
+	const auto proj = Mat4::ProjectionFOV(70.0f, 1.77777778f, 0.5f, 100.0f);
+
+	for (const float moving : { 0.0f,0.1f })
+	{
+		const size_t stride = moving > 0.0f ? size_t(1.0f / moving) : count + 1;
+		EagerBinds eager;
+		auto start = Clock::now();
+		for (int f = 0; f < frames; f++)
+		{
+			for (size_t i = 0; i < count; i++)
+			{
+				auto& o = objects[i];
+				if (i % stride == 0)
+				{
+					o.rot.y += 0.01f;
+				}
+				eager.BindWorld(Mat4::RotationX(o.rot.x) * Mat4::RotationY(o.rot.y) * Mat4::RotationZ(o.rot.z) * Mat4::Translation(o.pos));
+				eager.BindView(view);
+				eager.BindProjection(proj);
+				sink += eager.worldViewProj.elements[3][2];
+			}
+		}
+		const double eagerNs = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / (double(frames) * count);
+
+		VertexShader vs;
+		start = Clock::now();
+		for (int f = 0; f < frames; f++)
+		{
+			vs.BindView(view);
+			vs.BindProjection(proj);
+			for (size_t i = 0; i < count; i++)
+			{
+				auto& o = objects[i];
+				if (i % stride == 0)
+				{
+					o.transform.Rotate({ 0.0f,0.01f,0.0f });
+				}
+				vs.BindWorld(o.transform);
+				sink += vs.GetWorldViewProj().elements[3][2];
+			}
+		}
+		const double cachedNs = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / (double(frames) * count);
+		std::printf("%zu objects, %2.0f%% moving: eager %6.1f ns/draw, cached %6.1f ns/draw (%.1fx)\n",
+			count, moving * 100.0f, eagerNs, cachedNs, eagerNs / cachedNs);
+	}
+
+	// same matrices both ways, normals through the normal matrix agree with the old worldView transform
+	float maxDiff = 0.0f;
+	float minDot = 1.0f;
+	VertexShader vs;
+	vs.BindView(view);
+	vs.BindProjection(proj);
+	EagerBinds eager;
+	for (size_t i = 0; i < count; i += 97)
+	{
+		const auto& o = objects[i];
+		eager.BindView(view);
+		eager.BindProjection(proj);
+		eager.BindWorld(Mat4::RotationX(o.rot.x) * Mat4::RotationY(o.rot.y) * Mat4::RotationZ(o.rot.z) * Mat4::Translation(o.pos));
+		vs.BindWorld(o.transform);
+		const auto& m = vs.GetWorldViewProj();
+		for (int j = 0; j < 4; j++)
+		{
+			for (int k = 0; k < 4; k++)
+			{
+				maxDiff = std::max(maxDiff, std::abs(m.elements[j][k] - eager.worldViewProj.elements[j][k]));
+			}
+		}
+		const Vec3 n = Vec3{ 0.3f,-0.5f,0.81f }.GetNormalized();
+		const auto out = vs(SpecularPhongPointEffect::Vertex({ 0.0f,0.0f,0.0f }, n));
+		const Vec3 reference = Vec3(Vec4(n, 0.0f) * eager.worldView).GetNormalized();
+		minDot = std::min(minDot, out.n.GetNormalized() * reference);
+	}
+	std::printf("max matrix difference %.2e, max normal angle %.4f degrees (sink %g)\n",
+		maxDiff, std::acos(std::min(minDot, 1.0f)) * 180.0f / PI, sink);
+	return 0;
+}